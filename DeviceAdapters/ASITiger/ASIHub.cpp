@@ -37,6 +37,9 @@
 
 using namespace std;
 
+// how long to query the axes one by one after a batched reply couldn't be matched to them
+const long g_PollingRetryMs = 1000;
+
 ///////////////////////////////////////////////////////////////////////////////
 // ASIHub implementation
 // this implements serial communication, and could be used as parent class
@@ -51,7 +54,12 @@ ASIHub::ASIHub() :
       serialRepeatDuration_(0),
       serialRepeatPeriod_(500),
       serialOnlySendChanged_(true),
-      updatingSharedProperties_(false)
+      updatingSharedProperties_(false),
+      axisStatusCacheMs_(10),
+      sendingPollCommand_(false),
+      pollingFailed_(false),
+      polledPositionsValid_(false),
+      polledBusyValid_(false)
 {
    CPropertyAction* pAct = new CPropertyAction(this, &ASIHub::OnPort);
    CreateProperty(MM::g_Keyword_Port, "Undefined", MM::String, false, pAct, true);
@@ -88,6 +96,11 @@ ASIHub::ASIHub() :
    AddAllowedValue(g_SerialTerminatorPropertyName, g_SerialTerminator_2);
    AddAllowedValue(g_SerialTerminatorPropertyName, g_SerialTerminator_3);
    AddAllowedValue(g_SerialTerminatorPropertyName, g_SerialTerminator_4);
+
+   // how long the reply to a batched position or status query of all axes is reused; 0 disables
+   pAct = new CPropertyAction (this, &ASIHub::OnAxisStatusCacheTime);
+   CreateProperty(g_AxisStatusCacheTimePropertyName, "10", MM::Integer, false, pAct);
+   SetPropertyLimits(g_AxisStatusCacheTimePropertyName, 0, 1000);
 }
 
 int ASIHub::ClearComPort(void)
@@ -100,6 +113,8 @@ int ASIHub::ClearComPort(void)
    */
 int ASIHub::QueryCommandUnterminatedResponse(const char *command, const long timeoutMs, unsigned long reply_length)
 {
+   MMThreadGuard g(threadLock_);
+   InvalidatePolledStatus();
    RETURN_ON_MM_ERROR ( ClearComPort() );
    RETURN_ON_MM_ERROR ( SendSerialCommand(port_.c_str(), command, "\r") );
    serialCommand_ = command;
@@ -127,6 +142,8 @@ int ASIHub::QueryCommandUnterminatedResponse(const char *command, const long tim
 // Note that the property SerialResponse property will only show the first 1023 characters of the controller's reply.
 int ASIHub::QueryCommandLongReply(const char *command, const char *replyTerminator)
 {
+   MMThreadGuard g(threadLock_);
+   InvalidatePolledStatus();
    RETURN_ON_MM_ERROR ( ClearComPort() );
    RETURN_ON_MM_ERROR ( SendSerialCommand(port_.c_str(), command, "\r") );
    serialCommand_ = command;
@@ -150,6 +167,8 @@ int ASIHub::QueryCommandLongReply(const char *command, const char *replyTerminat
 int ASIHub::QueryCommand(const char *command, const char *replyTerminator, const long delayMs)
 {
    MMThreadGuard g(threadLock_);
+   if (!sendingPollCommand_)  // any command may have changed position or status
+      InvalidatePolledStatus();
    RETURN_ON_MM_ERROR ( ClearComPort() );
    RETURN_ON_MM_ERROR ( SendSerialCommand(port_.c_str(), command, "\r") );
    serialCommand_ = command;
@@ -171,6 +190,124 @@ int ASIHub::QueryCommandVerify(const char *command, const char *expectedReplyPre
    return DEVICE_OK;
 }
 
+vector<string> ASIHub::GetPolledAxesInOrder() const
+{
+   // multi-axis replies come back in the controller's axis order, so ask in that order
+   string letters;
+   for (map<string, string>::const_iterator it = polledAxes_.begin(); it != polledAxes_.end(); ++it)
+      letters += it->second;
+   vector<string> axes;
+   for (vector<char>::const_iterator it = axisLetterOrder_.begin(); it != axisLetterOrder_.end(); ++it)
+   {
+      if (letters.find(*it) != string::npos)
+         axes.push_back(string(1, *it));
+   }
+   return axes;
+}
+
+int ASIHub::RefreshPolledStatus(bool busy)
+// caller holds threadLock_
+{
+   vector<string> axes = GetPolledAxesInOrder();
+   if (axes.empty())
+      return ERR_UNRECOGNIZED_ANSWER;
+   ostringstream command; command.str("");
+   command << (busy ? "RS" : "W");
+   for (vector<string>::const_iterator it = axes.begin(); it != axes.end(); ++it)
+      command << " " << *it << (busy ? "?" : "");
+
+   sendingPollCommand_ = true;
+   int ret = QueryCommandVerify(command.str(), ":A");
+   sendingPollCommand_ = false;
+   RETURN_ON_MM_ERROR ( ret );
+
+   // reply is e.g. ":A 1234.5 -20.0 0.0" for W and ":A NBN" (or with spaces) for RS
+   string reply = serialAnswer_.substr(2);
+   if (busy)
+   {
+      string states;
+      for (string::const_iterator it = reply.begin(); it != reply.end(); ++it)
+      {
+         if (*it == 'B' || *it == 'N')
+            states += *it;
+         else if (*it != ' ')
+            break;
+      }
+      if (states.length() != axes.size())
+      {
+         pollingFailed_ = true;
+         pollingFailedTime_ = GetCurrentMMTime();
+         return ERR_UNRECOGNIZED_ANSWER;
+      }
+      for (unsigned int i=0; i<axes.size(); ++i)
+         polledBusy_[axes[i]] = (states[i] == 'B');
+      polledBusyTime_ = GetCurrentMMTime();
+      polledBusyValid_ = true;
+   }
+   else
+   {
+      vector<string> values;
+      CDeviceUtils::Tokenize(reply, values, " ");
+      if (values.size() != axes.size())
+      {
+         pollingFailed_ = true;
+         pollingFailedTime_ = GetCurrentMMTime();
+         return ERR_UNRECOGNIZED_ANSWER;
+      }
+      for (unsigned int i=0; i<axes.size(); ++i)
+         polledPositions_[axes[i]] = atof(values[i].c_str());
+      polledPositionsTime_ = GetCurrentMMTime();
+      polledPositionsValid_ = true;
+   }
+   pollingFailed_ = false;
+   return DEVICE_OK;
+}
+
+bool ASIHub::PollingEnabled()
+// caller holds threadLock_
+{
+   if (axisStatusCacheMs_ <= 0)
+      return false;
+   return !pollingFailed_ ||
+         (GetCurrentMMTime() - pollingFailedTime_).getMsec() >= g_PollingRetryMs;
+}
+
+int ASIHub::GetPolledPosition(const string &axisLetter, double &pos)
+{
+   MMThreadGuard g(threadLock_);
+   if (!PollingEnabled())
+      return DEVICE_NOT_SUPPORTED;
+   if (!polledPositionsValid_ ||
+         (GetCurrentMMTime() - polledPositionsTime_).getMsec() >= axisStatusCacheMs_ ||
+         polledPositions_.find(axisLetter) == polledPositions_.end())
+   {
+      RETURN_ON_MM_ERROR ( RefreshPolledStatus(false) );
+   }
+   map<string, double>::const_iterator it = polledPositions_.find(axisLetter);
+   if (it == polledPositions_.end())
+      return DEVICE_NOT_SUPPORTED;
+   pos = it->second;
+   return DEVICE_OK;
+}
+
+int ASIHub::GetPolledBusy(const string &axisLetter, bool &busy)
+{
+   MMThreadGuard g(threadLock_);
+   if (!PollingEnabled())
+      return DEVICE_NOT_SUPPORTED;
+   if (!polledBusyValid_ ||
+         (GetCurrentMMTime() - polledBusyTime_).getMsec() >= axisStatusCacheMs_ ||
+         polledBusy_.find(axisLetter) == polledBusy_.end())
+   {
+      RETURN_ON_MM_ERROR ( RefreshPolledStatus(true) );
+   }
+   map<string, bool>::const_iterator it = polledBusy_.find(axisLetter);
+   if (it == polledBusy_.end())
+      return DEVICE_NOT_SUPPORTED;
+   busy = it->second;
+   return DEVICE_OK;
+}
+
 int ASIHub::ParseErrorReply() const
 {
    if (serialAnswer_.length() > 3 && serialAnswer_.substr(0, 2).compare(":N") == 0)
@@ -667,6 +804,24 @@ int ASIHub::OnSerialCommandOnlySendChanged(MM::PropertyBase* pProp, MM::ActionTy
    return DEVICE_OK;
 }
 
+int ASIHub::OnAxisStatusCacheTime(MM::PropertyBase* pProp, MM::ActionType eAct)
+{
+   if (eAct == MM::BeforeGet)
+   {
+      pProp->Set(axisStatusCacheMs_);
+   }
+   else if (eAct == MM::AfterSet) {
+      MMThreadGuard g(threadLock_);
+      long tmp = 0;
+      pProp->Get(tmp);
+      if (tmp < 0) tmp = 0;
+      axisStatusCacheMs_ = tmp;
+      InvalidatePolledStatus();
+      pollingFailed_ = false;
+   }
+   return DEVICE_OK;
+}
+
 string ASIHub::EscapeControlCharacters(const string v)
 // based on similar function in FreeSerialPort.cpp
 {
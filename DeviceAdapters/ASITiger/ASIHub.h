@@ -29,7 +29,9 @@
 #include "MMDevice.h"
 #include "DeviceBase.h"
 #include "DeviceThreads.h"
+#include <map>
 #include <string>
+#include <vector>
 
 using namespace std;
 
@@ -132,8 +134,25 @@ public:
 
    void UnRegisterPeripheral(const string deviceLabel) {
       deviceMap_.erase(deviceLabel);  // remove device from lookup table
+      polledAxes_.erase(deviceLabel);
    }
 
+   // batched axis status: the axes of all registered peripherals are queried together
+   //   with one multi-axis "W" (position) or "RS" (busy) command, and the replies are used
+   //   for every axis until they are older than AxisStatusCacheTime(ms) or any other
+   //   command is sent to the controller
+   void SetAxisLetterOrder(const vector<char> &axisLetters) { axisLetterOrder_ = axisLetters; }
+   void RegisterPolledAxes(const string deviceLabel, const string axisLetters) {
+      polledAxes_[deviceLabel] = axisLetters;
+      InvalidatePolledStatus();
+      pollingFailed_ = false;
+   }
+   // both return an error if the axis isn't registered or the batched query failed,
+   //   in which case the caller should query the axis by itself; after a reply that
+   //   can't be matched to the axes, batching is retried once g_PollingRetryMs has passed
+   int GetPolledPosition(const string &axisLetter, double &pos);  // in controller units like reply to W
+   int GetPolledBusy(const string &axisLetter, bool &busy);
+
    bool UpdatingSharedProperties() { return updatingSharedProperties_; }
 
    int UpdateSharedProperties(string addressChar, string propName, string value);
@@ -146,6 +165,7 @@ public:
    int OnSerialCommandRepeatDuration(MM::PropertyBase* pProp, MM::ActionType eAct);
    int OnSerialCommandRepeatPeriod  (MM::PropertyBase* pProp, MM::ActionType eAct);
    int OnSerialCommandOnlySendChanged(MM::PropertyBase* pProp, MM::ActionType eAct);
+   int OnAxisStatusCacheTime        (MM::PropertyBase* pProp, MM::ActionType eAct);
 
 protected:
    string port_;         // port to use for communication
@@ -156,6 +176,10 @@ private:
 	static string UnescapeControlCharacters(const string v0 );
 	static vector<char> ConvertStringVector2CharVector(const vector<string> v);
 	static vector<int> ConvertStringVector2IntVector(const vector<string> v);
+   void InvalidatePolledStatus() { polledPositionsValid_ = false; polledBusyValid_ = false; }
+   vector<string> GetPolledAxesInOrder() const;
+   int RefreshPolledStatus(bool busy);
+   bool PollingEnabled();
 
    string serialAnswer_;      // the last answer received from any communication with the controller
    string manualSerialAnswer_; // last answer received when the SerialCommand property was used
@@ -169,6 +193,20 @@ private:
    map<string, string> deviceMap_;  // to implement properties shared between devices
         // key is the device name, value is the Tiger address (normally a single character, see note about addressChar_ in ASIPeripheralBase)
 
+   // batched axis status
+   map<string, string> polledAxes_;   // key is the device name, value is its axis letters
+   vector<char> axisLetterOrder_;     // axis letters in the order the controller lists them (BU X)
+   long axisStatusCacheMs_;           // how long a batched reply is used, 0 disables batching
+   bool sendingPollCommand_;          // true while the batched query itself is being sent
+   bool pollingFailed_;               // set if a batched reply couldn't be matched to the axes
+   MM::MMTime pollingFailedTime_;     // when it was set
+   bool polledPositionsValid_;
+   bool polledBusyValid_;
+   MM::MMTime polledPositionsTime_;
+   MM::MMTime polledBusyTime_;
+   map<string, double> polledPositions_;
+   map<string, bool> polledBusy_;
+
 };
 
 
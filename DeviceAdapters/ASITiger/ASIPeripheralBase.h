@@ -135,6 +135,17 @@ public:
       return DEVICE_OK;
    }
 
+   // include this peripheral's axes in the hub's batched position and status queries
+   // the multi-axis "RS <axis>?" form needs firmware 2.7, otherwise the axes keep being queried separately
+   void RegisterPolledAxes(const string axisLetters)
+   {
+      if (!this->FirmwareVersionAtLeast(2.7))
+         return;
+      char deviceLabel[MM::MaxStrLength];
+      this->GetLabel(deviceLabel);
+      hub_->RegisterPolledAxes(deviceLabel, axisLetters);
+   }
+
 protected:
    ASIHub *hub_;           // pointer to hub object used for serial communication
    string addressString_;  // address within hub, in hex format, should be two characters (e.g. '31')
@@ -230,6 +230,8 @@ int CPiezo::Initialize()
    AddAllowedValue(g_AxisPolarity, g_FocusPolarityMicroManagerDefault);
 
 
+   RegisterPolledAxes(axisLetter_);
+
    // end now if we are pre-2.8 firmware
    if (!FirmwareVersionAtLeast(2.8))
    {
@@ -429,10 +431,13 @@ int CPiezo::Initialize()
 
 int CPiezo::GetPositionUm(double& pos)
 {
-   ostringstream command; command.str("");
-   command << "W " << axisLetter_;
-   RETURN_ON_MM_ERROR ( hub_->QueryCommandVerify(command.str(),":A") );
-   RETURN_ON_MM_ERROR ( hub_->ParseAnswerAfterPosition2(pos) );
+   if (hub_->GetPolledPosition(axisLetter_, pos) != DEVICE_OK)
+   {
+      ostringstream command; command.str("");
+      command << "W " << axisLetter_;
+      RETURN_ON_MM_ERROR ( hub_->QueryCommandVerify(command.str(),":A") );
+      RETURN_ON_MM_ERROR ( hub_->ParseAnswerAfterPosition2(pos) );
+   }
    pos = pos/unitMult_;
    return DEVICE_OK;
 }
@@ -446,11 +451,14 @@ int CPiezo::SetPositionUm(double pos)
 
 int CPiezo::GetPositionSteps(long& steps)
 {
-   ostringstream command; command.str("");
-   command << "W " << axisLetter_;
-   RETURN_ON_MM_ERROR ( hub_->QueryCommandVerify(command.str(),":A") );
    double tmp;
-   RETURN_ON_MM_ERROR ( hub_->ParseAnswerAfterPosition2(tmp) );
+   if (hub_->GetPolledPosition(axisLetter_, tmp) != DEVICE_OK)
+   {
+      ostringstream command; command.str("");
+      command << "W " << axisLetter_;
+      RETURN_ON_MM_ERROR ( hub_->QueryCommandVerify(command.str(),":A") );
+      RETURN_ON_MM_ERROR ( hub_->ParseAnswerAfterPosition2(tmp) );
+   }
    steps = (long)(tmp/unitMult_/stepSizeUm_);
    return DEVICE_OK;
 }
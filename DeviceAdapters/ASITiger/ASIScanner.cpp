@@ -643,6 +643,8 @@ int CScanner::Initialize()
    SetPropertyLimits(g_VectorYPropertyName, -10 , 10);//hardcoded as -+10mm/sec , can he higher 
    UpdateProperty(g_VectorYPropertyName);
 
+   RegisterPolledAxes(axisLetterX_ + axisLetterY_);
+
    initialized_ = true;
    return DEVICE_OK;
 }
@@ -697,15 +699,21 @@ int CScanner::SetPosition(double x, double y)
 int CScanner::GetPosition(double& x, double& y)
 {
 //   // read from card instead of using cached values directly, could be slight mismatch
-   // TODO implement as single serial command for speed (know that X axis always before Y on card)
+   // both axes normally come from the hub's batched query of all axes
    ostringstream command; command.str("");
-   command << "W " << axisLetterX_;
-   RETURN_ON_MM_ERROR ( hub_->QueryCommandVerify(command.str(),":A") );
-   RETURN_ON_MM_ERROR ( hub_->ParseAnswerAfterPosition2(x) );
+   if (hub_->GetPolledPosition(axisLetterX_, x) != DEVICE_OK)
+   {
+      command << "W " << axisLetterX_;
+      RETURN_ON_MM_ERROR ( hub_->QueryCommandVerify(command.str(),":A") );
+      RETURN_ON_MM_ERROR ( hub_->ParseAnswerAfterPosition2(x) );
+   }
    x = x/unitMultX_;
-   command.str(""); command << "W " << axisLetterY_;
-   RETURN_ON_MM_ERROR ( hub_->QueryCommandVerify(command.str(),":A") );
-   RETURN_ON_MM_ERROR ( hub_->ParseAnswerAfterPosition2(y) );
+   if (hub_->GetPolledPosition(axisLetterY_, y) != DEVICE_OK)
+   {
+      command.str(""); command << "W " << axisLetterY_;
+      RETURN_ON_MM_ERROR ( hub_->QueryCommandVerify(command.str(),":A") );
+      RETURN_ON_MM_ERROR ( hub_->ParseAnswerAfterPosition2(y) );
+   }
    y = y/unitMultY_;
    return DEVICE_OK;
 }
@@ -181,6 +181,7 @@ const char* const g_SerialCommandOnlySendChangedPropertyName = "OnlySendSerialCo
 const char* const g_SerialCommandRepeatDurationPropertyName = "SerialCommandRepeatDuration(s)";
 const char* const g_SerialCommandRepeatPeriodPropertyName = "SerialCommandRepeatPeriod(ms)";
 const char* const g_SerialComPortPropertyName = "SerialComPort";
+const char* const g_AxisStatusCacheTimePropertyName = "AxisStatusCacheTime(ms)";
 
 // motorized stage property names (XY and Z)
 const char* const g_StepSizeXPropertyName = "StepSizeX(um)";
@@ -93,6 +93,7 @@ int CTigerCommHub::Initialize()
    // get build info for axis letters
    build_info_type build;
    RETURN_ON_MM_ERROR ( GetBuildInfo("", build) );
+   SetAxisLetterOrder(build.vAxesLetter);
    command.str("");
    for (unsigned int i=0; i<build.numAxes; ++i)
    {
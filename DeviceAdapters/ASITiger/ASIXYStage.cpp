@@ -466,6 +466,8 @@ int CXYStage::Initialize()
    SetPropertyLimits(g_VectorYPropertyName, maxSpeedY*-1 , maxSpeedY);
    UpdateProperty(g_VectorYPropertyName);
 
+   RegisterPolledAxes(axisLetterX_ + axisLetterY_);
+
    initialized_ = true;
    return DEVICE_OK;
 }
@@ -496,15 +498,21 @@ int CXYStage::getMinMaxSpeed(string axisLetter, double& minSpeed, double& maxSpe
 int CXYStage::GetPositionSteps(long& x, long& y)
 {
    ostringstream command; command.str("");
-   command << "W " << axisLetterX_;
-   RETURN_ON_MM_ERROR ( hub_->QueryCommandVerify(command.str(),":A") );
    double tmp;
-   RETURN_ON_MM_ERROR ( hub_->ParseAnswerAfterPosition2(tmp) );
+   if (hub_->GetPolledPosition(axisLetterX_, tmp) != DEVICE_OK)
+   {
+      command << "W " << axisLetterX_;
+      RETURN_ON_MM_ERROR ( hub_->QueryCommandVerify(command.str(),":A") );
+      RETURN_ON_MM_ERROR ( hub_->ParseAnswerAfterPosition2(tmp) );
+   }
    x = (long)(tmp/unitMultX_/stepSizeXUm_);
-   command.str("");
-   command << "W " << axisLetterY_;
-   RETURN_ON_MM_ERROR ( hub_->QueryCommandVerify(command.str(),":A") );
-   RETURN_ON_MM_ERROR ( hub_->ParseAnswerAfterPosition2(tmp) );
+   if (hub_->GetPolledPosition(axisLetterY_, tmp) != DEVICE_OK)
+   {
+      command.str("");
+      command << "W " << axisLetterY_;
+      RETURN_ON_MM_ERROR ( hub_->QueryCommandVerify(command.str(),":A") );
+      RETURN_ON_MM_ERROR ( hub_->ParseAnswerAfterPosition2(tmp) );
+   }
    y = (long)(tmp/unitMultY_/stepSizeYUm_);
    return DEVICE_OK;
 }
@@ -601,6 +609,10 @@ bool CXYStage::Busy()
    ostringstream command; command.str("");
    if (FirmwareVersionAtLeast(2.7)) // can use more accurate RS <axis>?
    {
+      bool busyX, busyY;
+      if (hub_->GetPolledBusy(axisLetterX_, busyX) == DEVICE_OK &&
+            hub_->GetPolledBusy(axisLetterY_, busyY) == DEVICE_OK)
+         return busyX || busyY;
       command << "RS " << axisLetterX_ << "?";
       if (hub_->QueryCommandVerify(command.str(),":A") != DEVICE_OK)  // say we aren't busy if we can't communicate
          return false;
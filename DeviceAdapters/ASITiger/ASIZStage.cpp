@@ -405,16 +405,21 @@ int CZStage::Initialize()
    SetPropertyLimits(g_VectorPropertyName, maxSpeed*-1, maxSpeed);
    UpdateProperty(g_VectorPropertyName);
 
+   RegisterPolledAxes(axisLetter_);
+
    initialized_ = true;
    return DEVICE_OK;
 }
 
 int CZStage::GetPositionUm(double& pos)
 {
-   ostringstream command; command.str("");
-   command << "W " << axisLetter_;
-   RETURN_ON_MM_ERROR ( hub_->QueryCommandVerify(command.str(),":A") );
-   RETURN_ON_MM_ERROR ( hub_->ParseAnswerAfterPosition2(pos) );
+   if (hub_->GetPolledPosition(axisLetter_, pos) != DEVICE_OK)
+   {
+      ostringstream command; command.str("");
+      command << "W " << axisLetter_;
+      RETURN_ON_MM_ERROR ( hub_->QueryCommandVerify(command.str(),":A") );
+      RETURN_ON_MM_ERROR ( hub_->ParseAnswerAfterPosition2(pos) );
+   }
    pos = pos/unitMult_;
    return DEVICE_OK;
 }
@@ -428,11 +433,14 @@ int CZStage::SetPositionUm(double pos)
 
 int CZStage::GetPositionSteps(long& steps)
 {
-   ostringstream command; command.str("");
-   command << "W " << axisLetter_;
-   RETURN_ON_MM_ERROR ( hub_->QueryCommandVerify(command.str(),":A") );
    double tmp;
-   RETURN_ON_MM_ERROR ( hub_->ParseAnswerAfterPosition2(tmp) );
+   if (hub_->GetPolledPosition(axisLetter_, tmp) != DEVICE_OK)
+   {
+      ostringstream command; command.str("");
+      command << "W " << axisLetter_;
+      RETURN_ON_MM_ERROR ( hub_->QueryCommandVerify(command.str(),":A") );
+      RETURN_ON_MM_ERROR ( hub_->ParseAnswerAfterPosition2(tmp) );
+   }
    steps = (long)(tmp/unitMult_/stepSizeUm_);
    return DEVICE_OK;
 }
@@ -496,6 +504,9 @@ bool CZStage::Busy()
    }
    if (FirmwareVersionAtLeast(2.7)) // can use more accurate RS <axis>?
    {
+      bool busy;
+      if (hub_->GetPolledBusy(axisLetter_, busy) == DEVICE_OK)
+         return busy;
       command << "RS " << axisLetter_ << "?";
       if (hub_->QueryCommandVerify(command.str(),":A") != DEVICE_OK)  // say we aren't busy if we can't communicate
          return false;
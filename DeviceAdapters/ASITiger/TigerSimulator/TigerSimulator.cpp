@@ -0,0 +1,435 @@
+///////////////////////////////////////////////////////////////////////////////
+// FILE:          TigerSimulator.cpp
+// PROJECT:       Micro-Manager
+// SUBSYSTEM:     DeviceAdapters
+//-----------------------------------------------------------------------------
+// DESCRIPTION:   Simulated ASI Tiger controller on a pseudo-terminal, for testing
+//                the ASITiger adapter without hardware (POSIX only)
+//
+//                Usage: tigersim [-v] [-g count] [axes:type:card ...]
+//                  e.g. tigersim XY:x:1 Z:z:2 P:p:3
+//
+//                Prints the name of the pseudo-terminal to use as the serial port
+//                (set up a SerialManager port with that name).  Answers the commands
+//                needed to detect and initialize the hub, XY stages, Z stages and
+//                piezos; moves take time so that busy status can be observed.
+//                Unknown queries "CMD X?" are answered ":A X=<last value set>".
+//                On exit (Ctrl-C) prints how many times each command was received,
+//                and SIGUSR1 resets the counts;
+//                -v also prints every command and reply; -g drops the last value
+//                from the replies to the first count multi-axis W queries, to test
+//                the adapter's handling of replies it can't match to the axes.
+//
+// LICENSE:       This file is distributed under the BSD license.
+//
+//                This file is distributed in the hope that it will be useful,
+//                but WITHOUT ANY WARRANTY; without even the implied warranty
+//                of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+//
+//                IN NO EVENT SHALL THE COPYRIGHT OWNER OR
+//                CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+//                INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES.
+//
+
+#include <fcntl.h>
+#include <poll.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/time.h>
+#include <termios.h>
+#include <unistd.h>
+
+#include <cmath>
+#include <map>
+#include <sstream>
+#include <string>
+#include <vector>
+
+using namespace std;
+
+namespace {
+
+const double g_SpeedUnitsPerMs = 5.0;    // move speed, in controller units (0.1 um) per ms
+const double g_SettleMs = 20.0;          // added to every move
+
+volatile sig_atomic_t g_Quit = 0;
+volatile sig_atomic_t g_ResetCounts = 0;
+
+void OnSignal(int) { g_Quit = 1; }
+void OnResetSignal(int) { g_ResetCounts = 1; }
+
+double NowMs()
+{
+   struct timeval tv;
+   gettimeofday(&tv, 0);
+   return tv.tv_sec * 1000.0 + tv.tv_usec / 1000.0;
+}
+
+struct Axis
+{
+   char letter;
+   char type;
+   char card;
+   double start;
+   double target;
+   double moveStartMs;
+   double moveEndMs;
+
+   double Position(double now) const
+   {
+      if (now >= moveEndMs || moveEndMs <= moveStartMs)
+         return target;
+      double fraction = (now - moveStartMs) / (moveEndMs - moveStartMs);
+      if (fraction > 1.0)
+         fraction = 1.0;
+      return start + (target - start) * fraction;
+   }
+
+   bool Busy(double now) const { return now < moveEndMs; }
+
+   void MoveTo(double position, double now)
+   {
+      start = Position(now);
+      target = position;
+      moveStartMs = now;
+      moveEndMs = now + fabs(target - start) / g_SpeedUnitsPerMs + g_SettleMs;
+   }
+
+   void Halt(double now)
+   {
+      start = target = Position(now);
+      moveEndMs = now;
+   }
+};
+
+class Tiger
+{
+public:
+   Tiger(const vector<Axis>& axes, int garbleCount) :
+      axes_(axes), garbleCount_(garbleCount) {}
+
+   string Reply(const string& line)
+   {
+      const double now = NowMs();
+
+      // optional card address: digit or extended ASCII before the command
+      size_t pos = 0;
+      char card = 0;
+      if (pos < line.size() && (isdigit((unsigned char)line[pos]) || (unsigned char)line[pos] >= 0x81))
+         card = line[pos++];
+      while (pos < line.size() && line[pos] == ' ')
+         ++pos;
+
+      vector<string> tokens;
+      istringstream is(line.substr(pos));
+      string token;
+      while (is >> token)
+         tokens.push_back(token);
+      if (tokens.empty())
+         return ":A";
+      string command = tokens[0];
+      for (size_t i = 0; i < command.size(); ++i)
+         command[i] = (char)toupper((unsigned char)command[i]);
+      vector<string> args(tokens.begin() + 1, tokens.end());
+      ++commandCounts_[command];
+
+      if (command == "V" || command == "VERSION")
+         return ":A v3.30";
+      if (command == "CD")
+         return "Jan 01 2020:00:00:00";
+      if (command == "BU" || command == "BUILD")
+      {
+         if (!args.empty() && (args[0] == "X" || args[0] == "x"))
+            return BuildReply();
+         return (card == 0 || card == '0') ? "TIGER_COMM" : "STD_XYZ";
+      }
+      if (command == "W" || command == "WHERE")
+      {
+         ostringstream os;
+         os << ":A";
+         for (size_t i = 0; i < args.size(); ++i)
+         {
+            Axis* axis = Find(args[i]);
+            if (!axis)
+               return ":N-1";
+            if (args.size() > 1 && i + 1 == args.size() && garbleCount_ > 0)
+            {
+               --garbleCount_;
+               break;
+            }
+            os << " " << Format(axis->Position(now));
+         }
+         return os.str();
+      }
+      if (command == "RS" || command == "RDSTAT")
+      {
+         ostringstream os;
+         os << ":A ";
+         for (size_t i = 0; i < args.size(); ++i)
+         {
+            Axis* axis = Find(args[i]);
+            if (!axis)
+               return ":N-1";
+            if (args[i].find('?') != string::npos)
+               os << (axis->Busy(now) ? 'B' : 'N');
+            else
+               os << (axis->Busy(now) ? "11" : "10");  // status byte, LSB is busy
+         }
+         return os.str();
+      }
+      if (command == "/" || command == "STATUS")
+      {
+         for (size_t i = 0; i < axes_.size(); ++i)
+            if (axes_[i].Busy(now))
+               return "B";
+         return "N";
+      }
+      if (command == "M" || command == "MOVE" || command == "R" || command == "MOVREL")
+      {
+         bool relative = (command[0] == 'R');
+         for (size_t i = 0; i < args.size(); ++i)
+         {
+            Axis* axis = Find(args[i]);
+            if (!axis)
+               return ":N-1";
+            size_t eq = args[i].find('=');
+            double value = (eq == string::npos) ? 0.0 : atof(args[i].substr(eq + 1).c_str());
+            axis->MoveTo(relative ? axis->Position(now) + value : value, now);
+         }
+         return ":A";
+      }
+      if (command == "H" || command == "HERE")
+      {
+         for (size_t i = 0; i < args.size(); ++i)
+         {
+            Axis* axis = Find(args[i]);
+            if (!axis)
+               return ":N-1";
+            size_t eq = args[i].find('=');
+            axis->start = axis->target = (eq == string::npos) ? 0.0 : atof(args[i].substr(eq + 1).c_str());
+            axis->moveEndMs = now;
+         }
+         return ":A";
+      }
+      if (command == "\\" || command == "HALT")
+      {
+         for (size_t i = 0; i < axes_.size(); ++i)
+            axes_[i].Halt(now);
+         return ":A";
+      }
+
+      // anything else: remember settings, answer queries with what was set
+      ostringstream os;
+      os << ":A";
+      for (size_t i = 0; i < args.size(); ++i)
+      {
+         const string& arg = args[i];
+         size_t q = arg.find('?');
+         size_t eq = arg.find('=');
+         if (q != string::npos)
+         {
+            string name = arg.substr(0, q);
+            os << " " << name << "=" << Setting(card, command, name);
+         }
+         else if (eq != string::npos)
+         {
+            settings_[Key(card, command, arg.substr(0, eq))] = arg.substr(eq + 1);
+         }
+      }
+      return os.str();
+   }
+
+   void ResetCounts() { commandCounts_.clear(); }
+
+   void PrintCounts() const
+   {
+      unsigned long total = 0;
+      for (map<string, unsigned long>::const_iterator it = commandCounts_.begin();
+            it != commandCounts_.end(); ++it)
+      {
+         fprintf(stderr, "%-8s %lu\n", it->first.c_str(), it->second);
+         total += it->second;
+      }
+      fprintf(stderr, "%-8s %lu\n", "total", total);
+   }
+
+private:
+   Axis* Find(const string& arg)
+   {
+      if (arg.empty())
+         return 0;
+      char letter = (char)toupper((unsigned char)arg[0]);
+      for (size_t i = 0; i < axes_.size(); ++i)
+         if (axes_[i].letter == letter)
+            return &axes_[i];
+      return 0;
+   }
+
+   static string Format(double value)
+   {
+      char buf[64];
+      snprintf(buf, sizeof(buf), "%.1f", value);
+      return buf;
+   }
+
+   static string Key(char card, const string& command, const string& name)
+   {
+      return string(1, card) + command + " " + name;
+   }
+
+   string Setting(char card, const string& command, const string& name) const
+   {
+      map<string, string>::const_iterator it = settings_.find(Key(card, command, name));
+      if (it != settings_.end())
+         return it->second;
+      if (command == "UM" || command == "UNITS")
+         return "10000";
+      if (command == "S" || command == "SPEED")
+         return "1.0";
+      return "0";
+   }
+
+   string BuildReply() const
+   {
+      ostringstream letters, types, addrs, hex, props;
+      for (size_t i = 0; i < axes_.size(); ++i)
+      {
+         letters << " " << axes_[i].letter;
+         types << " " << axes_[i].type;
+         addrs << " " << axes_[i].card;
+         hex << " " << hex_digits((unsigned char)axes_[i].card);
+         props << " 0";
+      }
+      return "TIGER_COMM\rMotor Axes:" + letters.str() + "\rAxis Types:" + types.str() +
+         "\rAxis Addr:" + addrs.str() + "\rHex Addr:" + hex.str() +
+         "\rAxis Props:" + props.str();
+   }
+
+   static string hex_digits(unsigned char c)
+   {
+      char buf[3];
+      snprintf(buf, sizeof(buf), "%02X", c);
+      return buf;
+   }
+
+   vector<Axis> axes_;
+   int garbleCount_;
+   map<string, string> settings_;
+   map<string, unsigned long> commandCounts_;
+};
+
+bool ParseAxes(const char* spec, vector<Axis>& axes)
+{
+   // <letters>:<type>:<card>, e.g. XY:x:1
+   string s(spec);
+   size_t c1 = s.find(':');
+   size_t c2 = s.find(':', c1 + 1);
+   if (c1 == string::npos || c2 == string::npos || c2 != c1 + 2 || c2 + 2 != s.size())
+      return false;
+   for (size_t i = 0; i < c1; ++i)
+   {
+      Axis axis;
+      axis.letter = (char)toupper((unsigned char)s[i]);
+      axis.type = s[c1 + 1];
+      axis.card = s[c2 + 1];
+      axis.start = axis.target = 0.0;
+      axis.moveStartMs = axis.moveEndMs = 0.0;
+      axes.push_back(axis);
+   }
+   return true;
+}
+
+} // anonymous namespace
+
+
+int main(int argc, char* argv[])
+{
+   bool verbose = false;
+   int garbleCount = 0;
+   vector<Axis> axes;
+   for (int i = 1; i < argc; ++i)
+   {
+      if (strcmp(argv[i], "-v") == 0)
+         verbose = true;
+      else if (strcmp(argv[i], "-g") == 0 && i + 1 < argc)
+         garbleCount = atoi(argv[++i]);
+      else if (!ParseAxes(argv[i], axes))
+      {
+         fprintf(stderr, "Usage: tigersim [-v] [-g count] [axes:type:card ...]  e.g. XY:x:1 Z:z:2 P:p:3\n");
+         return 2;
+      }
+   }
+   if (axes.empty())
+   {
+      ParseAxes("XY:x:1", axes);
+      ParseAxes("Z:z:2", axes);
+      ParseAxes("P:p:3", axes);
+   }
+
+   int master = posix_openpt(O_RDWR | O_NOCTTY);
+   if (master < 0 || grantpt(master) != 0 || unlockpt(master) != 0)
+   {
+      perror("posix_openpt");
+      return 1;
+   }
+   // raw mode on the slave side so that the adapter sees exactly what we write
+   int slave = open(ptsname(master), O_RDWR | O_NOCTTY);
+   if (slave >= 0)
+   {
+      struct termios tio;
+      tcgetattr(slave, &tio);
+      cfmakeraw(&tio);
+      tcsetattr(slave, TCSANOW, &tio);
+   }
+   printf("%s\n", ptsname(master));
+   fflush(stdout);
+
+   signal(SIGINT, OnSignal);
+   signal(SIGTERM, OnSignal);
+   signal(SIGUSR1, OnResetSignal);
+
+   Tiger tiger(axes, garbleCount);
+   string line;
+   while (!g_Quit)
+   {
+      if (g_ResetCounts)
+      {
+         tiger.ResetCounts();
+         g_ResetCounts = 0;
+      }
+      struct pollfd pfd;
+      pfd.fd = master;
+      pfd.events = POLLIN;
+      pfd.revents = 0;
+      if (poll(&pfd, 1, 200) <= 0)
+         continue;
+      char buf[256];
+      ssize_t n = read(master, buf, sizeof(buf));
+      if (n <= 0)
+         continue;
+      for (ssize_t i = 0; i < n; ++i)
+      {
+         if (buf[i] == '\n')
+            continue;
+         if (buf[i] != '\r')
+         {
+            line += buf[i];
+            continue;
+         }
+         string reply = tiger.Reply(line) + "\r\n";
+         if (verbose)
+            fprintf(stderr, "> %s\n< %s", line.c_str(), reply.c_str());
+         if (write(master, reply.data(), reply.size()) < 0)
+            perror("write");
+         line.clear();
+      }
+   }
+
+   tiger.PrintCounts();
+   if (slave >= 0)
+      close(slave);
+   close(master);
+   return 0;
+}
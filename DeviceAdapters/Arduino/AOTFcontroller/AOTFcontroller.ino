@@ -69,6 +69,13 @@
  *   the pattern generation.
  *   Controller will retun 12.
  * 
+ * Set all digital patterns for triggered mode at once: 13np...c
+ *   Where n is the number of patterns (up to 12), followed by the n patterns and
+ *   a checksum c, the sum of n and the patterns modulo 256.  Replaces commands
+ *   5 and 6 with a single round trip.  Patterns are only stored when the checksum
+ *   matches.
+ *   Controller will return 13n, or 13 followed by 255 if the frame was rejected
+ * 
  * Start blanking Mode: 20
  *   In blanking mode, zeroes will be written on the output pins when the trigger pin
  *   is low, when the trigger pin is high, the pattern set with command #1 will be 
@@ -104,7 +111,7 @@
  *   Get Number of digital patterns
  */
  
-   unsigned int version_ = 2;
+   unsigned int version_ = 3;
    
    // pin on which to receive the trigger (2 and 3 can be used with interrupts, although this code does not use interrupts)
    int inPin_ = 2;
@@ -303,6 +310,33 @@
          }
          break;
 
+       // Sets all digital patterns and their number in one frame
+       case 13:
+         {
+           byte reply = 255;
+           if (waitForSerial(timeOut_)) {
+             int pL = Serial.read();
+             if ( (pL >= 0) && (pL <= SEQUENCELENGTH) ) {
+               byte patterns[SEQUENCELENGTH];
+               byte sum = pL;
+               int i = 0;
+               for (; i < pL && waitForSerial(timeOut_); i++) {
+                 patterns[i] = Serial.read();
+                 sum += patterns[i];
+               }
+               if (i == pL && waitForSerial(timeOut_) && Serial.read() == sum) {
+                 for (i = 0; i < pL; i++)
+                   triggerPattern_[i] = patterns[i] & B00111111;
+                 patternLength_ = pL;
+                 reply = pL;
+               }
+             }
+           }
+           Serial.write( byte(13));
+           Serial.write( reply);
+         }
+         break;
+
        // Blanks output based on TTL input
        case 20:
          blanking_ = true;
@@ -33,7 +33,9 @@ const char* g_DeviceNameArduinoInput = "Arduino-Input";
 
 // Global info about the state of the Arduino.  This should be folded into a class
 const int g_Min_MMVersion = 1;
-const int g_Max_MMVersion = 2;
+const int g_Max_MMVersion = 3;
+// First firmware version that loads all trigger patterns with one command
+const int g_Min_MMVersionBulkSequence = 3;
 const char* g_versionProp = "Version";
 const char* g_normalLogicString = "Normal";
 const char* g_invertedLogicString = "Inverted";
@@ -183,6 +185,29 @@ int CArduinoHub::GetControllerVersion(int& version)
 
 }
 
+// Reads a binary answer of exactly len bytes.  Expects caller to guard the port
+int CArduinoHub::ReadAnswerH(unsigned char* answer, unsigned long len, long timeoutMs)
+{
+   MM::MMTime startTime = GetCurrentMMTime();
+   unsigned long bytesRead = 0;
+   while (bytesRead < len)
+   {
+      unsigned long br = 0;
+      int ret = ReadFromComPortH(answer + bytesRead, (unsigned) (len - bytesRead), br);
+      if (ret != DEVICE_OK)
+         return ret;
+      bytesRead += br;
+      if (bytesRead < len && br == 0)
+      {
+         if ((GetCurrentMMTime() - startTime).getMsec() >= timeoutMs)
+            return ERR_COMMUNICATION;
+         // Do not spin while the Arduino is answering
+         CDeviceUtils::SleepMs(1);
+      }
+   }
+   return DEVICE_OK;
+}
+
 bool CArduinoHub::SupportsDeviceDetection(void)
 {
    return true;
@@ -561,38 +586,63 @@ int CArduinoSwitch::LoadSequence(unsigned size, unsigned char* seq)
    if (!hub || !hub->IsPortAvailable())
       return ERR_NO_PORT_SET;
 
+   MMThreadGuard myLock(hub->GetLock());
+
    hub->PurgeComPortH();
 
+   std::vector<unsigned char> patterns(size);
    for (unsigned i=0; i < size; i++)
    {
-      unsigned char value = seq[i];
-
-      value = 63 & value;
+      unsigned char value = 63 & seq[i];
       if (hub->IsLogicInverted())
          value = ~value;
+      patterns[i] = value;
+   }
 
+   if (hub->GetFirmwareVersion() >= g_Min_MMVersionBulkSequence)
+   {
+      // Whole table in one frame: 13, count, patterns, checksum (sum of
+      // count and patterns modulo 256).  Answer is 13, count (255 if the
+      // frame was rejected)
+      std::vector<unsigned char> command;
+      command.push_back(13);
+      command.push_back((unsigned char) size);
+      command.insert(command.end(), patterns.begin(), patterns.end());
+      unsigned char checksum = 0;
+      for (size_t i = 1; i < command.size(); i++)
+         checksum = (unsigned char) (checksum + command[i]);
+      command.push_back(checksum);
+
+      int ret = hub->WriteToComPortH(&command[0], (unsigned) command.size());
+      if (ret != DEVICE_OK)
+         return ret;
+
+      unsigned char answer[2];
+      ret = hub->ReadAnswerH(answer, 2);
+      if (ret != DEVICE_OK)
+         return ret;
+      if (answer[0] != 13 || answer[1] != size)
+         return ERR_COMMUNICATION;
+
+      return DEVICE_OK;
+   }
+
+   for (unsigned i=0; i < size; i++)
+   {
       unsigned char command[3];
       command[0] = 5;
       command[1] = (unsigned char) i;
-      command[2] = value;
+      command[2] = patterns[i];
       int ret = hub->WriteToComPortH((const unsigned char*) command, 3);
       if (ret != DEVICE_OK)
          return ret;
 
-
-      MM::MMTime startTime = GetCurrentMMTime();
-      unsigned long bytesRead = 0;
       unsigned char answer[3];
-      while ((bytesRead < 3) && ( (GetCurrentMMTime() - startTime).getMsec() < 250)) {
-         unsigned long br;
-         ret = hub->ReadFromComPortH(answer + bytesRead, 3, br);
+      ret = hub->ReadAnswerH(answer, 3);
       if (ret != DEVICE_OK)
          return ret;
-      bytesRead += br;
-      }
       if (answer[0] != 5)
          return ERR_COMMUNICATION;
-
    }
 
    unsigned char command[2];
@@ -602,16 +652,10 @@ int CArduinoSwitch::LoadSequence(unsigned size, unsigned char* seq)
    if (ret != DEVICE_OK)
       return ret;
 
-   MM::MMTime startTime = GetCurrentMMTime();
-   unsigned long bytesRead = 0;
    unsigned char answer[2];
-   while ((bytesRead < 2) && ( (GetCurrentMMTime() - startTime).getMsec() < 250)) {
-      unsigned long br;
-      ret = hub->ReadFromComPortH(answer + bytesRead, 2, br);
-      if (ret != DEVICE_OK)
-         return ret;
-      bytesRead += br;
-   }
+   ret = hub->ReadAnswerH(answer, 2);
+   if (ret != DEVICE_OK)
+      return ret;
    if (answer[0] != 6)
       return ERR_COMMUNICATION;
 
@@ -662,10 +706,9 @@ int CArduinoSwitch::OnState(MM::PropertyBase* pProp, MM::ActionType eAct)
          seq[i] = (unsigned char) val;
       }                                                                      
       int ret = LoadSequence((unsigned) sequence.size(), seq);
+      delete[] seq;                                                          
       if (ret != DEVICE_OK)                                                  
          return ret;                                                         
-                                                                             
-      delete[] seq;                                                          
    }                                                                         
    else if (eAct == MM::StartSequence)
    { 
@@ -678,16 +721,10 @@ int CArduinoSwitch::OnState(MM::PropertyBase* pProp, MM::ActionType eAct)
       if (ret != DEVICE_OK)
          return ret;
 
-      MM::MMTime startTime = GetCurrentMMTime();
-      unsigned long bytesRead = 0;
       unsigned char answer[1];
-      while ((bytesRead < 1) && ( (GetCurrentMMTime() - startTime).getMsec() < 250)) {
-         unsigned long br;
-         ret = hub->ReadFromComPortH(answer + bytesRead, 1, br);
-         if (ret != DEVICE_OK)
-            return ret;
-         bytesRead += br;
-      }
+      ret = hub->ReadAnswerH(answer, 1);
+      if (ret != DEVICE_OK)
+         return ret;
       if (answer[0] != 8)
          return ERR_COMMUNICATION;
    }
@@ -701,16 +738,10 @@ int CArduinoSwitch::OnState(MM::PropertyBase* pProp, MM::ActionType eAct)
       if (ret != DEVICE_OK)
          return ret;
 
-      MM::MMTime startTime = GetCurrentMMTime();
-      unsigned long bytesRead = 0;
       unsigned char answer[2];
-      while ((bytesRead < 2) && ( (GetCurrentMMTime() - startTime).getMsec() < 250)) {
-         unsigned long br;
-         ret = hub->ReadFromComPortH(answer + bytesRead, 2, br);
-         if (ret != DEVICE_OK)
-            return ret;
-         bytesRead += br;
-      }
+      ret = hub->ReadAnswerH(answer, 2);
+      if (ret != DEVICE_OK)
+         return ret;
       if (answer[0] != 9)
          return ERR_COMMUNICATION;
 
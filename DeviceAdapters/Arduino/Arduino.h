@@ -68,6 +68,8 @@ public:
    {
       return ReadFromComPort(port_.c_str(), answer, maxLen, bytesRead);
    }
+   int ReadAnswerH(unsigned char* answer, unsigned long len, long timeoutMs = 250);
+   int GetFirmwareVersion() {return version_;}
    static MMThreadLock& GetLock() {return lock_;}
    void SetShutterState(unsigned state) {shutterState_ = state;}
    void SetSwitchState(unsigned state) {switchState_ = state;}
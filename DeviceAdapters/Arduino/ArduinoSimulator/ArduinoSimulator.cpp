@@ -0,0 +1,368 @@
+///////////////////////////////////////////////////////////////////////////////
+// FILE:          ArduinoSimulator.cpp
+// PROJECT:       Micro-Manager
+// SUBSYSTEM:     DeviceAdapters
+//-----------------------------------------------------------------------------
+// DESCRIPTION:   Simulated Arduino (AOTFcontroller firmware) on a pseudo-terminal,
+//                for testing the Arduino adapter without hardware (POSIX only)
+//
+//                Usage: arduinosim [-v] [-2] [-r <n>]
+//
+//                Prints the name of the pseudo-terminal to use as the serial port
+//                (set up a SerialManager port with that name).  Answers the binary
+//                commands of the firmware; digital and analogue outputs are
+//                remembered, analogue inputs read as 0.  -2 reports firmware
+//                version 2, which lacks the bulk pattern upload (command 13), so
+//                that the per-pattern fallback of the adapter can be exercised.
+//                -r rejects the first n bulk uploads as if their checksum did
+//                not match.  On exit (Ctrl-C) prints how many times each
+//                command was received, and the trigger patterns; -v also
+//                prints every command and reply.
+//
+// LICENSE:       This file is distributed under the "Lesser GPL" (LGPL) license.
+//                License text is included with the source distribution.
+//
+//                This file is distributed in the hope that it will be useful,
+//                but WITHOUT ANY WARRANTY; without even the implied warranty
+//                of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+//
+//                IN NO EVENT SHALL THE COPYRIGHT OWNER OR
+//                CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+//                INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES.
+
+#include <fcntl.h>
+#include <poll.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <termios.h>
+#include <unistd.h>
+
+#include <map>
+#include <string>
+#include <vector>
+
+using namespace std;
+
+namespace {
+
+const int g_SequenceLength = 12;
+
+volatile sig_atomic_t g_Quit = 0;
+
+void OnSignal(int) { g_Quit = 1; }
+
+class Arduino
+{
+public:
+   Arduino(int version, int rejectedUploads) :
+      version_(version),
+      rejectedUploads_(rejectedUploads),
+      pattern_(0),
+      patternLength_(0),
+      repeatPattern_(0),
+      skipTriggers_(0),
+      blanking_(false),
+      triggerMode_(false)
+   {
+      memset(triggerPattern_, 0, sizeof(triggerPattern_));
+      memset(triggerDelay_, 0, sizeof(triggerDelay_));
+   }
+
+   // Handles the first complete command in input.  Returns the number of
+   // bytes consumed, or 0 if the command is not complete yet.
+   size_t Process(const vector<unsigned char>& input, vector<unsigned char>& reply)
+   {
+      if (input.empty())
+         return 0;
+      const unsigned char command = input[0];
+      size_t length = 1 + ArgumentCount(input);
+      if (input.size() < length)
+         return 0;
+      const unsigned char* arg = &input[1];
+      ++commandCounts_[command];
+
+      switch (command)
+      {
+         case 1:
+            pattern_ = arg[0] & 0x3f;
+            reply.push_back(1);
+            break;
+         case 2:
+            reply.push_back(2);
+            reply.push_back(pattern_);
+            break;
+         case 3:
+            reply.push_back(3);
+            reply.push_back(arg[0]);
+            reply.push_back(arg[1] & 0x0f);
+            reply.push_back(arg[2]);
+            break;
+         case 5:
+            if (arg[0] < g_SequenceLength)
+            {
+               triggerPattern_[arg[0]] = arg[1] & 0x3f;
+               reply.push_back(5);
+               reply.push_back(arg[0]);
+               reply.push_back(triggerPattern_[arg[0]]);
+            }
+            else
+            {
+               reply.push_back('n');
+               reply.push_back(':');
+            }
+            break;
+         case 6:
+            if (arg[0] <= g_SequenceLength)
+            {
+               patternLength_ = arg[0];
+               reply.push_back(6);
+               reply.push_back(arg[0]);
+            }
+            break;
+         case 7:
+            skipTriggers_ = arg[0];
+            reply.push_back(7);
+            reply.push_back(arg[0]);
+            break;
+         case 8:
+            if (patternLength_ > 0)
+            {
+               triggerMode_ = true;
+               reply.push_back(8);
+            }
+            break;
+         case 9:
+            triggerMode_ = false;
+            reply.push_back(9);
+            reply.push_back(0); // no triggers on a pseudo-terminal
+            break;
+         case 10:
+            if (arg[0] < g_SequenceLength)
+            {
+               triggerDelay_[arg[0]] = (arg[1] << 8) | arg[2];
+               reply.push_back(10);
+               reply.push_back(arg[0]);
+            }
+            break;
+         case 11:
+            repeatPattern_ = arg[0];
+            reply.push_back(11);
+            reply.push_back(arg[0]);
+            break;
+         case 12:
+            if (patternLength_ > 0)
+               reply.push_back(12);
+            break;
+         case 13:
+         {
+            // Frame: 13, n, n patterns, checksum of n and the patterns
+            const unsigned char n = arg[0];
+            unsigned char sum = n;
+            for (unsigned char i = 0; i < n; ++i)
+               sum = (unsigned char) (sum + arg[1 + i]);
+            reply.push_back(13);
+            bool reject = rejectedUploads_ > 0;
+            if (reject)
+               --rejectedUploads_;
+            if (!reject && n <= g_SequenceLength && sum == arg[1 + n])
+            {
+               for (unsigned char i = 0; i < n; ++i)
+                  triggerPattern_[i] = arg[1 + i] & 0x3f;
+               patternLength_ = n;
+               reply.push_back(n);
+            }
+            else
+               reply.push_back(255);
+            break;
+         }
+         case 20:
+            blanking_ = true;
+            reply.push_back(20);
+            break;
+         case 21:
+            blanking_ = false;
+            reply.push_back(21);
+            break;
+         case 22:
+            reply.push_back(22);
+            break;
+         case 30:
+            Append(reply, "MM-Ard\r\n");
+            break;
+         case 31:
+         {
+            char version[16];
+            snprintf(version, sizeof(version), "%d\r\n", version_);
+            Append(reply, version);
+            break;
+         }
+         case 40:
+            reply.push_back(40);
+            reply.push_back(0x3f); // pull-ups: all inputs high
+            break;
+         case 41:
+            if (arg[0] <= 5)
+            {
+               reply.push_back(41);
+               reply.push_back(arg[0]);
+               reply.push_back(0);
+               reply.push_back(0);
+            }
+            break;
+         case 42:
+            reply.push_back(42);
+            reply.push_back(arg[0]);
+            reply.push_back(arg[1] <= 1 ? arg[1] : 0);
+            break;
+         default:
+            // The firmware silently ignores unknown bytes
+            break;
+      }
+      return length;
+   }
+
+   void PrintCounts() const
+   {
+      fprintf(stderr, "Command counts:\n");
+      for (map<int, long>::const_iterator it = commandCounts_.begin();
+            it != commandCounts_.end(); ++it)
+         fprintf(stderr, "  %3d: %ld\n", it->first, it->second);
+      fprintf(stderr, "Trigger patterns (%d):", patternLength_);
+      for (int i = 0; i < patternLength_; ++i)
+         fprintf(stderr, " %d", triggerPattern_[i]);
+      fprintf(stderr, "\n");
+   }
+
+private:
+   // Bytes following the command byte (as far as known from the input)
+   size_t ArgumentCount(const vector<unsigned char>& input) const
+   {
+      switch (input[0])
+      {
+         case 1: case 6: case 7: case 11: case 22: case 41:
+            return 1;
+         case 5: case 42:
+            return 2;
+         case 3: case 10:
+            return 3;
+         case 13:
+            if (version_ < 3)
+               return 0;
+            // count, patterns, checksum
+            return input.size() < 2 ? 1 : 2 + input[1];
+         default:
+            return 0;
+      }
+   }
+
+   static void Append(vector<unsigned char>& reply, const char* text)
+   {
+      reply.insert(reply.end(), text, text + strlen(text));
+   }
+
+   const int version_;
+   int rejectedUploads_;
+   unsigned char pattern_;
+   unsigned char triggerPattern_[g_SequenceLength];
+   unsigned int triggerDelay_[g_SequenceLength];
+   int patternLength_;
+   unsigned char repeatPattern_;
+   unsigned char skipTriggers_;
+   bool blanking_;
+   bool triggerMode_;
+   map<int, long> commandCounts_;
+};
+
+void PrintBytes(const char* prefix, const unsigned char* bytes, size_t count)
+{
+   fprintf(stderr, "%s", prefix);
+   for (size_t i = 0; i < count; ++i)
+      fprintf(stderr, " %d", bytes[i]);
+   fprintf(stderr, "\n");
+}
+
+} // namespace
+
+int main(int argc, char* argv[])
+{
+   bool verbose = false;
+   int version = 3;
+   int rejectedUploads = 0;
+   for (int i = 1; i < argc; ++i)
+   {
+      if (strcmp(argv[i], "-v") == 0)
+         verbose = true;
+      else if (strcmp(argv[i], "-2") == 0)
+         version = 2;
+      else if (strcmp(argv[i], "-r") == 0 && i + 1 < argc)
+         rejectedUploads = atoi(argv[++i]);
+      else
+      {
+         fprintf(stderr, "Usage: arduinosim [-v] [-2] [-r <n>]\n");
+         return 2;
+      }
+   }
+
+   int master = posix_openpt(O_RDWR | O_NOCTTY);
+   if (master < 0 || grantpt(master) != 0 || unlockpt(master) != 0)
+   {
+      perror("posix_openpt");
+      return 1;
+   }
+   // raw mode on the slave side so that the adapter sees exactly what we write
+   int slave = open(ptsname(master), O_RDWR | O_NOCTTY);
+   if (slave >= 0)
+   {
+      struct termios tio;
+      tcgetattr(slave, &tio);
+      cfmakeraw(&tio);
+      tcsetattr(slave, TCSANOW, &tio);
+   }
+   printf("%s\n", ptsname(master));
+   fflush(stdout);
+
+   signal(SIGINT, OnSignal);
+   signal(SIGTERM, OnSignal);
+
+   Arduino arduino(version, rejectedUploads);
+   vector<unsigned char> input;
+   while (!g_Quit)
+   {
+      struct pollfd pfd;
+      pfd.fd = master;
+      pfd.events = POLLIN;
+      pfd.revents = 0;
+      if (poll(&pfd, 1, 200) <= 0)
+         continue;
+      unsigned char buf[256];
+      ssize_t n = read(master, buf, sizeof(buf));
+      if (n <= 0)
+         continue;
+      input.insert(input.end(), buf, buf + n);
+
+      for (;;)
+      {
+         vector<unsigned char> reply;
+         size_t consumed = arduino.Process(input, reply);
+         if (consumed == 0)
+            break;
+         if (verbose)
+         {
+            PrintBytes(">", &input[0], consumed);
+            if (!reply.empty())
+               PrintBytes("<", &reply[0], reply.size());
+         }
+         input.erase(input.begin(), input.begin() + consumed);
+         if (!reply.empty() && write(master, &reply[0], reply.size()) < 0)
+            perror("write");
+      }
+   }
+
+   arduino.PrintCounts();
+   if (slave >= 0)
+      close(slave);
+   close(master);
+   return 0;
+}
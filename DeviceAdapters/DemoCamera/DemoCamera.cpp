@@ -52,6 +52,7 @@ const char* g_ShutterDeviceName = "DShutter";
 const char* g_DADeviceName = "D-DA";
 const char* g_DA2DeviceName = "D-DA2";
 const char* g_GalvoDeviceName = "DGalvo";
+const char* g_SLMDeviceName = "DSLM";
 const char* g_MagnifierDeviceName = "DOptovar";
 const char* g_HubDeviceName = "DHub";
 
@@ -88,11 +89,15 @@ MODULE_API void InitializeModuleData()
    RegisterDevice(g_DA2DeviceName, MM::SignalIODevice, "Demo DA-2");
    RegisterDevice(g_MagnifierDeviceName, MM::MagnifierDevice, "Demo Optovar");
    RegisterDevice(g_GalvoDeviceName, MM::GalvoDevice, "Demo Galvo");
+   RegisterDevice(g_SLMDeviceName, MM::SLMDevice, "Demo SLM");
    RegisterDevice("TransposeProcessor", MM::ImageProcessorDevice, "TransposeProcessor");
    RegisterDevice("ImageFlipX", MM::ImageProcessorDevice, "ImageFlipX");
    RegisterDevice("ImageFlipY", MM::ImageProcessorDevice, "ImageFlipY");
    RegisterDevice("MedianFilter", MM::ImageProcessorDevice, "MedianFilter");
    RegisterDevice(g_HubDeviceName, MM::HubDevice, "DHub");
+
+   // Devices share state only with their own DHub
+   SetModuleConcurrency(MM::ConcurrencyPerHub);
 }
 
 MODULE_API MM::Device* CreateDevice(const char* deviceName)
@@ -166,6 +171,11 @@ MODULE_API MM::Device* CreateDevice(const char* deviceName)
       // create Galvo 
       return new DemoGalvo();
    }
+   else if (strcmp(deviceName, g_SLMDeviceName) == 0)
+   {
+      // create SLM
+      return new DemoSLM();
+   }
 
    else if(strcmp(deviceName, "TransposeProcessor") == 0)
    {
@@ -3252,10 +3262,21 @@ CDemoStage::CDemoStage() :
    initialized_(false),
    lowerLimit_(-300.0),
    upperLimit_(300.0),
-   sequenceable_(false)
+   sequenceable_(false),
+   moveTimeMs_(0.0),
+   moveStartTime_(0.0),
+   sequenceMaxLength_(2000),
+   sequenceStepIntervalMs_(1.0),
+   simulateSequenceError_(false),
+   sequenceRunning_(false),
+   lastStepUs_(0),
+   positionsExecuted_(0),
+   freeSpaceQueries_(0),
+   runningAppends_(0)
 {
    InitializeDefaultErrorMessages();
    SetErrorText(ERR_UNKNOWN_POSITION, "Position out of range");
+   SetErrorText(ERR_SIMULATED_SEQUENCE, "Simulated sequence error");
 
    // parent ID display
    CreateHubIDProperty();
@@ -3306,6 +3327,13 @@ int CDemoStage::Initialize()
    if (ret != DEVICE_OK)
       return ret;
 
+   // Simulated travel time of each move
+   pAct = new CPropertyAction (this, &CDemoStage::OnMoveTime);
+   ret = CreateFloatProperty("MoveTimeMs", moveTimeMs_, false, pAct);
+   if (ret != DEVICE_OK)
+      return ret;
+   SetPropertyLimits("MoveTimeMs", 0.0, 10000.0);
+
    // Sequenceability
    // --------
    pAct = new CPropertyAction (this, &CDemoStage::OnSequence);
@@ -3315,6 +3343,34 @@ int CDemoStage::Initialize()
    if (ret != DEVICE_OK)
       return ret;
 
+   // Simulated sequence memory, which can be refilled while running
+   pAct = new CPropertyAction (this, &CDemoStage::OnSequenceMaxLength);
+   ret = CreateIntegerProperty("SequenceMaxLength", sequenceMaxLength_, false, pAct);
+   if (ret != DEVICE_OK)
+      return ret;
+   SetPropertyLimits("SequenceMaxLength", 1, 100000);
+
+   pAct = new CPropertyAction (this, &CDemoStage::OnSequenceStepInterval);
+   ret = CreateFloatProperty("SequenceStepIntervalMs", sequenceStepIntervalMs_, false, pAct);
+   if (ret != DEVICE_OK)
+      return ret;
+   SetPropertyLimits("SequenceStepIntervalMs", 0.001, 1000.0);
+
+   pAct = new CPropertyAction (this, &CDemoStage::OnSimulateSequenceError);
+   ret = CreateStringProperty("SimulateSequenceError", "No", false, pAct);
+   AddAllowedValue("SimulateSequenceError", "No");
+   AddAllowedValue("SimulateSequenceError", "Yes");
+   if (ret != DEVICE_OK)
+      return ret;
+
+   // Counts since the sequence was last started
+   pAct = new CPropertyAction (this, &CDemoStage::OnSequenceStatistics);
+   CreateIntegerProperty("SequencePositionsExecuted", 0, true, pAct);
+   pAct = new CPropertyAction (this, &CDemoStage::OnSequenceStatistics);
+   CreateIntegerProperty("SequenceRunningAppends", 0, true, pAct);
+   pAct = new CPropertyAction (this, &CDemoStage::OnSequenceStatistics);
+   CreateIntegerProperty("SequenceFreeSpaceQueries", 0, true, pAct);
+
    ret = UpdateStatus();
    if (ret != DEVICE_OK)
       return ret;
@@ -3340,10 +3396,19 @@ int CDemoStage::SetPositionUm(double pos)
       return ERR_UNKNOWN_POSITION;
    }
    pos_um_ = pos; 
+   moveStartTime_ = GetCurrentMMTime();
    SetIntensityFactor(pos);
    return OnStagePositionChanged(pos_um_);
 }
 
+bool CDemoStage::Busy()
+{
+   if (busy_)
+      return true;
+   return moveTimeMs_ > 0.0 &&
+      (GetCurrentMMTime() - moveStartTime_).getMsec() < moveTimeMs_;
+}
+
 // Have "focus" (i.e. max intensity) at Z=0, getting gradually dimmer as we
 // get further away, without ever actually hitting 0.
 // We cap the intensity factor to between .1 and 1.
@@ -3365,7 +3430,7 @@ int CDemoStage::GetStageSequenceMaxLength(long& nrEvents) const
       return DEVICE_UNSUPPORTED_COMMAND;
    }
 
-   nrEvents = 2000;
+   nrEvents = sequenceMaxLength_;
    return DEVICE_OK;
 }
 
@@ -3375,6 +3440,11 @@ int CDemoStage::StartStageSequence()
       return DEVICE_UNSUPPORTED_COMMAND;
    }
 
+   sequenceRunning_ = true;
+   lastStepUs_ = CDeviceUtils::GetMonotonicTimeUs();
+   positionsExecuted_ = 0;
+   freeSpaceQueries_ = 0;
+   runningAppends_ = 0;
    return DEVICE_OK;
 }
 
@@ -3384,6 +3454,8 @@ int CDemoStage::StopStageSequence()
       return DEVICE_UNSUPPORTED_COMMAND;
    }
 
+   AdvanceSequence();
+   sequenceRunning_ = false;
    return DEVICE_OK;
 }
 
@@ -3393,18 +3465,69 @@ int CDemoStage::ClearStageSequence()
       return DEVICE_UNSUPPORTED_COMMAND;
    }
 
+   sequence_.clear();
+   return DEVICE_OK;
+}
+
+int CDemoStage::AddToStageSequence(double position)
+{
+   return AddArrayToStageSequence(&position, 1);
+}
+
+int CDemoStage::AddArrayToStageSequence(const double* positions, long count)
+{
+   if (!sequenceable_) {
+      return DEVICE_UNSUPPORTED_COMMAND;
+   }
+
+   if (sequenceRunning_)
+   {
+      if (simulateSequenceError_)
+         return ERR_SIMULATED_SEQUENCE;
+      AdvanceSequence();
+      ++runningAppends_;
+   }
+   if ((long) sequence_.size() + count > sequenceMaxLength_)
+      return DEVICE_SEQUENCE_TOO_LARGE;
+   sequence_.insert(sequence_.end(), positions, positions + count);
    return DEVICE_OK;
 }
 
-int CDemoStage::AddToStageSequence(double /* position */)
+int CDemoStage::GetStageSequenceFreeSpace(long& nrEvents) const
 {
    if (!sequenceable_) {
       return DEVICE_UNSUPPORTED_COMMAND;
    }
 
+   if (sequenceRunning_)
+   {
+      ++freeSpaceQueries_;
+      AdvanceSequence();
+   }
+   nrEvents = sequenceMaxLength_ - (long) sequence_.size();
    return DEVICE_OK;
 }
 
+void CDemoStage::AdvanceSequence() const
+{
+   if (!sequenceRunning_)
+      return;
+
+   const long long now = CDeviceUtils::GetMonotonicTimeUs();
+   const long long intervalUs =
+      std::max(1LL, (long long) (sequenceStepIntervalMs_ * 1000.0));
+   while (!sequence_.empty() && now - lastStepUs_ >= intervalUs)
+   {
+      pos_um_ = sequence_.front();
+      sequence_.pop_front();
+      ++positionsExecuted_;
+      lastStepUs_ += intervalUs;
+   }
+   // Triggers arriving while the memory is empty are missed
+   if (sequence_.empty())
+      lastStepUs_ = now;
+}
+
 int CDemoStage::SendStageSequence()
 {
    if (!sequenceable_) {
@@ -3437,12 +3560,89 @@ int CDemoStage::OnPosition(MM::PropertyBase* pProp, MM::ActionType eAct)
          return ERR_UNKNOWN_POSITION;
       }
       pos_um_ = pos;
+      moveStartTime_ = GetCurrentMMTime();
       SetIntensityFactor(pos);
    }
 
    return DEVICE_OK;
 }
 
+int CDemoStage::OnMoveTime(MM::PropertyBase* pProp, MM::ActionType eAct)
+{
+   if (eAct == MM::BeforeGet)
+   {
+      pProp->Set(moveTimeMs_);
+   }
+   else if (eAct == MM::AfterSet)
+   {
+      pProp->Get(moveTimeMs_);
+   }
+   return DEVICE_OK;
+}
+
+int CDemoStage::OnSequenceMaxLength(MM::PropertyBase* pProp, MM::ActionType eAct)
+{
+   if (eAct == MM::BeforeGet)
+   {
+      pProp->Set(sequenceMaxLength_);
+   }
+   else if (eAct == MM::AfterSet)
+   {
+      if (sequenceRunning_)
+      {
+         pProp->Set(sequenceMaxLength_); // revert
+         return ERR_IN_SEQUENCE;
+      }
+      pProp->Get(sequenceMaxLength_);
+   }
+   return DEVICE_OK;
+}
+
+int CDemoStage::OnSequenceStepInterval(MM::PropertyBase* pProp, MM::ActionType eAct)
+{
+   if (eAct == MM::BeforeGet)
+   {
+      pProp->Set(sequenceStepIntervalMs_);
+   }
+   else if (eAct == MM::AfterSet)
+   {
+      AdvanceSequence();
+      pProp->Get(sequenceStepIntervalMs_);
+   }
+   return DEVICE_OK;
+}
+
+int CDemoStage::OnSimulateSequenceError(MM::PropertyBase* pProp, MM::ActionType eAct)
+{
+   if (eAct == MM::BeforeGet)
+   {
+      pProp->Set(simulateSequenceError_ ? "Yes" : "No");
+   }
+   else if (eAct == MM::AfterSet)
+   {
+      std::string answer;
+      pProp->Get(answer);
+      simulateSequenceError_ = (answer == "Yes");
+   }
+   return DEVICE_OK;
+}
+
+int CDemoStage::OnSequenceStatistics(MM::PropertyBase* pProp, MM::ActionType eAct)
+{
+   if (eAct == MM::BeforeGet)
+   {
+      AdvanceSequence();
+      const std::string name = pProp->GetName();
+      if (name == "SequencePositionsExecuted")
+         pProp->Set(positionsExecuted_);
+      else if (name == "SequenceRunningAppends")
+         pProp->Set(runningAppends_);
+      else
+         pProp->Set(freeSpaceQueries_);
+   }
+   return DEVICE_OK;
+}
+
 int CDemoStage::OnSequence(MM::PropertyBase* pProp, MM::ActionType eAct)
 {
    if (eAct == MM::BeforeGet)
@@ -4101,7 +4301,8 @@ DemoGalvo::DemoGalvo() :
    offsetX_(20),
    vMaxX_(10.0),
    offsetY_(15),
-   vMaxY_(10.0)
+   vMaxY_(10.0),
+   patternUploads_(0)
 {
    // handwritten 5x5 gaussian kernel, no longer used
    /*
@@ -4174,6 +4375,19 @@ int DemoGalvo::Initialize()
          deviceIterator++;
       }
    }
+
+   // Number of patterns received with LoadPolygonPattern()
+   CPropertyAction* pAct = new CPropertyAction(this, &DemoGalvo::OnPatternUploads);
+   int ret = CreateIntegerProperty("PatternUploads", 0, true, pAct);
+   if (DEVICE_OK != ret)
+      return ret;
+   return DEVICE_OK;
+}
+
+int DemoGalvo::OnPatternUploads(MM::PropertyBase* pProp, MM::ActionType eAct)
+{
+   if (eAct == MM::BeforeGet)
+      pProp->Set(patternUploads_);
    return DEVICE_OK;
 }
 
@@ -4246,6 +4460,46 @@ int DemoGalvo::SetPolygonRepetitions(int /* repetitions */)
    return DEVICE_OK;
 }
 
+/**
+ * Keeps the pattern so that it can be selected again without transferring
+ * the vertices. Dwell times and repetitions have no visible effect in the
+ * simulation and are ignored.
+ */
+int DemoGalvo::LoadPolygonPattern(const char* patternKey, const double* xs,
+      const double* ys, const long* vertexCounts,
+      const double* /* dwellTimes_us */, const long* /* repetitions */,
+      long polygonCount)
+{
+   // A real device would be limited by its memory
+   const size_t maxPatterns = 16;
+   if (patterns_.size() >= maxPatterns)
+      patterns_.clear();
+
+   std::map<int, std::vector<PointD> >& pattern = patterns_[patternKey];
+   pattern.clear();
+   long vertex = 0;
+   for (long i = 0; i < polygonCount; ++i)
+   {
+      std::vector<PointD>& polygon = pattern[(int) i];
+      polygon.reserve(vertexCounts[i]);
+      for (long j = 0; j < vertexCounts[i]; ++j, ++vertex)
+         polygon.push_back(PointD(xs[vertex], ys[vertex]));
+   }
+   vertices_ = pattern;
+   ++patternUploads_;
+   return DEVICE_OK;
+}
+
+int DemoGalvo::SelectPolygonPattern(const char* patternKey, bool& found)
+{
+   std::map<std::string, std::map<int, std::vector<PointD> > >::iterator it =
+      patterns_.find(patternKey);
+   found = (it != patterns_.end());
+   if (found)
+      vertices_ = it->second;
+   return DEVICE_OK;
+}
+
 int DemoGalvo::RunPolygons()
 {
    /*
@@ -4552,6 +4806,284 @@ bool DemoGalvo::PointInTriangle(Point p, Point p0, Point p1, Point p2)
     return s > 0 && t > 0 && (s + t) < A;
 }
 
+///////////////////////////////////////////////////////////
+// DemoSLM
+//
+// Patterns are staged in a back buffer and shown by swapping it with the
+// front buffer, so staging the next pattern never disturbs the displayed
+// one. The counters tell how many pixel transfers and displays took place.
+
+DemoSLM::DemoSLM() :
+   initialized_(false),
+   width_(64),
+   height_(48),
+   exposureMs_(0.0),
+   displayDelayMs_(0.0),
+   patternMemory_(16),
+   staged_(false),
+   imageTransfers_(0),
+   patternTransfers_(0),
+   displays_(0)
+{
+   CreateHubIDProperty();
+}
+
+DemoSLM::~DemoSLM()
+{
+   Shutdown();
+}
+
+void DemoSLM::GetName(char* pName) const
+{
+   CDeviceUtils::CopyLimitedString(pName, g_SLMDeviceName);
+}
+
+int DemoSLM::Initialize()
+{
+   DemoHub* pHub = static_cast<DemoHub*>(GetParentHub());
+   if (pHub)
+   {
+      char hubLabel[MM::MaxStrLength];
+      pHub->GetLabel(hubLabel);
+      SetParentID(hubLabel); // for backward comp.
+   }
+   else
+      LogMessage(NoHubError);
+
+   if (initialized_)
+      return DEVICE_OK;
+
+   int ret = CreateStringProperty(MM::g_Keyword_Name, g_SLMDeviceName, true);
+   if (DEVICE_OK != ret)
+      return ret;
+   ret = CreateStringProperty(MM::g_Keyword_Description, "Demo SLM", true);
+   if (DEVICE_OK != ret)
+      return ret;
+
+   // Number of patterns the device can store; 0 simulates an SLM without
+   // pattern memory
+   CPropertyAction* pAct = new CPropertyAction(this, &DemoSLM::OnPatternMemory);
+   ret = CreateIntegerProperty("PatternMemory", patternMemory_, false, pAct);
+   if (DEVICE_OK != ret)
+      return ret;
+   SetPropertyLimits("PatternMemory", 0, 1024);
+
+   // Time taken by each display
+   pAct = new CPropertyAction(this, &DemoSLM::OnDisplayDelayMs);
+   ret = CreateFloatProperty("DisplayDelayMs", displayDelayMs_, false, pAct);
+   if (DEVICE_OK != ret)
+      return ret;
+   SetPropertyLimits("DisplayDelayMs", 0.0, 10000.0);
+
+   pAct = new CPropertyAction(this, &DemoSLM::OnImageTransfers);
+   ret = CreateIntegerProperty("ImageTransfers", 0, true, pAct);
+   if (DEVICE_OK != ret)
+      return ret;
+   pAct = new CPropertyAction(this, &DemoSLM::OnPatternTransfers);
+   ret = CreateIntegerProperty("PatternTransfers", 0, true, pAct);
+   if (DEVICE_OK != ret)
+      return ret;
+   pAct = new CPropertyAction(this, &DemoSLM::OnDisplays);
+   ret = CreateIntegerProperty("Displays", 0, true, pAct);
+   if (DEVICE_OK != ret)
+      return ret;
+   // Sum of the displayed pixel values
+   pAct = new CPropertyAction(this, &DemoSLM::OnDisplayedChecksum);
+   ret = CreateIntegerProperty("DisplayedChecksum", 0, true, pAct);
+   if (DEVICE_OK != ret)
+      return ret;
+
+   frontBuffer_.assign(width_ * height_, 0);
+   backBuffer_.assign(width_ * height_, 0);
+
+   initialized_ = true;
+   return DEVICE_OK;
+}
+
+int DemoSLM::SetImage(unsigned char* pixels)
+{
+   backBuffer_.assign(pixels, pixels + width_ * height_);
+   staged_ = true;
+   ++imageTransfers_;
+   return DEVICE_OK;
+}
+
+int DemoSLM::SetImage(unsigned int* /* pixels */)
+{
+   return DEVICE_UNSUPPORTED_COMMAND;
+}
+
+int DemoSLM::DisplayImage()
+{
+   if (!staged_)
+      backBuffer_ = frontBuffer_;
+   return ShowBackBuffer();
+}
+
+int DemoSLM::SetPixelsTo(unsigned char intensity)
+{
+   std::fill(backBuffer_.begin(), backBuffer_.end(), intensity);
+   return ShowBackBuffer();
+}
+
+int DemoSLM::SetPixelsTo(unsigned char red, unsigned char green, unsigned char blue)
+{
+   return SetPixelsTo((unsigned char) ((red + green + blue) / 3));
+}
+
+int DemoSLM::SetExposure(double interval_ms)
+{
+   exposureMs_ = interval_ms;
+   return DEVICE_OK;
+}
+
+double DemoSLM::GetExposure()
+{
+   return exposureMs_;
+}
+
+int DemoSLM::IsSLMSequenceable(bool& isSequenceable) const
+{
+   isSequenceable = true;
+   return DEVICE_OK;
+}
+
+int DemoSLM::GetSLMSequenceMaxLength(long& nrEvents) const
+{
+   nrEvents = 1024;
+   return DEVICE_OK;
+}
+
+int DemoSLM::StartSLMSequence()
+{
+   return DEVICE_OK;
+}
+
+int DemoSLM::StopSLMSequence()
+{
+   return DEVICE_OK;
+}
+
+int DemoSLM::ClearSLMSequence()
+{
+   sequence_.clear();
+   return DEVICE_OK;
+}
+
+int DemoSLM::AddToSLMSequence(const unsigned char* const pixels)
+{
+   sequence_.push_back(std::vector<unsigned char>(pixels, pixels + width_ * height_));
+   ++imageTransfers_;
+   return DEVICE_OK;
+}
+
+int DemoSLM::SendSLMSequence()
+{
+   return DEVICE_OK;
+}
+
+int DemoSLM::GetSLMPatternBankCapacity(long& capacity) const
+{
+   if (patternMemory_ == 0)
+      return DEVICE_UNSUPPORTED_COMMAND;
+   capacity = patternMemory_;
+   return DEVICE_OK;
+}
+
+int DemoSLM::SetSLMPattern(long index, const unsigned char* pixels)
+{
+   if (index < 0 || index >= patternMemory_)
+      return DEVICE_INVALID_INPUT_PARAM;
+   if ((long) patterns_.size() <= index)
+      patterns_.resize(index + 1);
+   patterns_[index].assign(pixels, pixels + width_ * height_);
+   ++patternTransfers_;
+   return DEVICE_OK;
+}
+
+int DemoSLM::DisplaySLMPattern(long index)
+{
+   if (index < 0 || index >= (long) patterns_.size() || patterns_[index].empty())
+      return DEVICE_INVALID_INPUT_PARAM;
+   // Copied within the device, not transferred
+   backBuffer_ = patterns_[index];
+   return ShowBackBuffer();
+}
+
+int DemoSLM::AddSLMPatternToSequence(long index)
+{
+   if (index < 0 || index >= (long) patterns_.size() || patterns_[index].empty())
+      return DEVICE_INVALID_INPUT_PARAM;
+   sequence_.push_back(patterns_[index]);
+   return DEVICE_OK;
+}
+
+int DemoSLM::ShowBackBuffer()
+{
+   if (displayDelayMs_ > 0.0)
+      CDeviceUtils::SleepMs((long) (displayDelayMs_ + 0.5));
+   frontBuffer_.swap(backBuffer_);
+   staged_ = false;
+   ++displays_;
+   return DEVICE_OK;
+}
+
+int DemoSLM::OnPatternMemory(MM::PropertyBase* pProp, MM::ActionType eAct)
+{
+   if (eAct == MM::BeforeGet)
+   {
+      pProp->Set(patternMemory_);
+   }
+   else if (eAct == MM::AfterSet)
+   {
+      pProp->Get(patternMemory_);
+      patterns_.clear();
+   }
+   return DEVICE_OK;
+}
+
+int DemoSLM::OnDisplayDelayMs(MM::PropertyBase* pProp, MM::ActionType eAct)
+{
+   if (eAct == MM::BeforeGet)
+      pProp->Set(displayDelayMs_);
+   else if (eAct == MM::AfterSet)
+      pProp->Get(displayDelayMs_);
+   return DEVICE_OK;
+}
+
+int DemoSLM::OnImageTransfers(MM::PropertyBase* pProp, MM::ActionType eAct)
+{
+   if (eAct == MM::BeforeGet)
+      pProp->Set(imageTransfers_);
+   return DEVICE_OK;
+}
+
+int DemoSLM::OnPatternTransfers(MM::PropertyBase* pProp, MM::ActionType eAct)
+{
+   if (eAct == MM::BeforeGet)
+      pProp->Set(patternTransfers_);
+   return DEVICE_OK;
+}
+
+int DemoSLM::OnDisplays(MM::PropertyBase* pProp, MM::ActionType eAct)
+{
+   if (eAct == MM::BeforeGet)
+      pProp->Set(displays_);
+   return DEVICE_OK;
+}
+
+int DemoSLM::OnDisplayedChecksum(MM::PropertyBase* pProp, MM::ActionType eAct)
+{
+   if (eAct == MM::BeforeGet)
+   {
+      long sum = 0;
+      for (size_t i = 0; i < frontBuffer_.size(); ++i)
+         sum += frontBuffer_[i];
+      pProp->Set(sum);
+   }
+   return DEVICE_OK;
+}
+
 ////////// BEGINNING OF POORLY ORGANIZED CODE //////////////
 //////////  CLEANUP NEEDED ////////////////////////////
 
@@ -35,6 +35,8 @@
 #include "DeviceThreads.h"
 #include <string>
 #include <map>
+#include <deque>
+#include <vector>
 #include <algorithm>
 #include <stdint.h>
 
@@ -47,6 +49,7 @@
 #define ERR_SEQUENCE_INACTIVE    105
 #define ERR_STAGE_MOVING         106
 #define HUB_NOT_AVAILABLE        107
+#define ERR_SIMULATED_SEQUENCE   108
 
 const char* NoHubError = "Parent Hub not defined.";
 
@@ -450,7 +453,7 @@ public:
    CDemoStage();
    ~CDemoStage();
 
-   bool Busy() {return busy_;}
+   bool Busy();
    void GetName(char* pszName) const;
 
    int Initialize();
@@ -463,6 +466,7 @@ public:
    int SetPositionSteps(long steps) 
    {
       pos_um_ = steps * stepSize_um_; 
+      moveStartTime_ = GetCurrentMMTime();
       return  OnStagePositionChanged(pos_um_);
    }
    int GetPositionSteps(long& steps)
@@ -484,7 +488,12 @@ public:
    // action interface
    // ----------------
    int OnPosition(MM::PropertyBase* pProp, MM::ActionType eAct);
+   int OnMoveTime(MM::PropertyBase* pProp, MM::ActionType eAct);
    int OnSequence(MM::PropertyBase* pProp, MM::ActionType eAct);
+   int OnSequenceMaxLength(MM::PropertyBase* pProp, MM::ActionType eAct);
+   int OnSequenceStepInterval(MM::PropertyBase* pProp, MM::ActionType eAct);
+   int OnSimulateSequenceError(MM::PropertyBase* pProp, MM::ActionType eAct);
+   int OnSequenceStatistics(MM::PropertyBase* pProp, MM::ActionType eAct);
 
    // Sequence functions
    int IsStageSequenceable(bool& isSequenceable) const;
@@ -492,18 +501,41 @@ public:
    int StartStageSequence();
    int StopStageSequence();
    int ClearStageSequence();
-   int AddToStageSequence(double /* position */);
+   int AddToStageSequence(double position);
    int SendStageSequence();
+   int AddArrayToStageSequence(const double* positions, long count);
+   int GetStageSequenceFreeSpace(long& nrEvents) const;
 
 private:
    void SetIntensityFactor(double pos);
+   // Moves through the positions that the (simulated) triggers received
+   // since the last call have consumed
+   void AdvanceSequence() const;
+
    double stepSize_um_;
-   double pos_um_;
+   mutable double pos_um_;
    bool busy_;
    bool initialized_;
    double lowerLimit_;
    double upperLimit_;
    bool sequenceable_;
+
+   // The stage reports busy for moveTimeMs_ after each move
+   double moveTimeMs_;
+   MM::MMTime moveStartTime_;
+
+   // Simulated sequence memory: one position is consumed every
+   // sequenceStepIntervalMs_ while the sequence runs, and positions can be
+   // appended as room is freed
+   long sequenceMaxLength_;
+   double sequenceStepIntervalMs_;
+   bool simulateSequenceError_;
+   bool sequenceRunning_;
+   mutable std::deque<double> sequence_;
+   mutable long long lastStepUs_;
+   mutable long positionsExecuted_;
+   mutable long freeSpaceQueries_;
+   long runningAppends_;
 };
 
 //////////////////////////////////////////////////////////////////////////////
@@ -1142,10 +1174,17 @@ public:
    int RunSequence();
    int StopSequence();
    int GetChannel(char* channelName);                         
+   int LoadPolygonPattern(const char* patternKey, const double* xs,
+         const double* ys, const long* vertexCounts,
+         const double* dwellTimes_us, const long* repetitions,
+         long polygonCount);
+   int SelectPolygonPattern(const char* patternKey, bool& found);
 
    double GetXRange();                         
    double GetYRange(); 
 
+   int OnPatternUploads(MM::PropertyBase* pProp, MM::ActionType eAct);
+
    int ChangePixels(ImgBuffer& img);
    static bool PointInTriangle(Point p, Point p0, Point p1, Point p2);
 
@@ -1160,6 +1199,9 @@ private:
    bool InBoundingBox(std::vector<Point> boundingBox, Point testPoint);
 
    std::map<int, std::vector<PointD> > vertices_;
+   // Patterns loaded with LoadPolygonPattern(), by key
+   std::map<std::string, std::map<int, std::vector<PointD> > > patterns_;
+   long patternUploads_;
    MM::MMTime pfExpirationTime_;
    bool initialized_;
    bool busy_;
@@ -1176,6 +1218,75 @@ private:
    double vMaxY_;
 };
 
+//////////////////////////////////////////////////////////////////////////////
+// DemoSLM class
+// Simulation of an SLM with pattern memory and double-buffered display
+//////////////////////////////////////////////////////////////////////////////
+class DemoSLM : public CSLMBase<DemoSLM>
+{
+public:
+   DemoSLM();
+   ~DemoSLM();
+
+   // MMDevice API
+   bool Busy() {return false;}
+   void GetName(char* pszName) const;
+
+   int Initialize();
+   int Shutdown() {initialized_ = false; return DEVICE_OK;}
+
+   // SLM API
+   int SetImage(unsigned char* pixels);
+   int SetImage(unsigned int* pixels);
+   int DisplayImage();
+   int SetPixelsTo(unsigned char intensity);
+   int SetPixelsTo(unsigned char red, unsigned char green, unsigned char blue);
+   int SetExposure(double interval_ms);
+   double GetExposure();
+   unsigned GetWidth() {return width_;}
+   unsigned GetHeight() {return height_;}
+   unsigned GetNumberOfComponents() {return 1;}
+   unsigned GetBytesPerPixel() {return 1;}
+   int IsSLMSequenceable(bool& isSequenceable) const;
+   int GetSLMSequenceMaxLength(long& nrEvents) const;
+   int StartSLMSequence();
+   int StopSLMSequence();
+   int ClearSLMSequence();
+   int AddToSLMSequence(const unsigned char* const pixels);
+   int SendSLMSequence();
+   int GetSLMPatternBankCapacity(long& capacity) const;
+   int SetSLMPattern(long index, const unsigned char* pixels);
+   int DisplaySLMPattern(long index);
+   int AddSLMPatternToSequence(long index);
+
+   // action interface
+   int OnPatternMemory(MM::PropertyBase* pProp, MM::ActionType eAct);
+   int OnDisplayDelayMs(MM::PropertyBase* pProp, MM::ActionType eAct);
+   int OnImageTransfers(MM::PropertyBase* pProp, MM::ActionType eAct);
+   int OnPatternTransfers(MM::PropertyBase* pProp, MM::ActionType eAct);
+   int OnDisplays(MM::PropertyBase* pProp, MM::ActionType eAct);
+   int OnDisplayedChecksum(MM::PropertyBase* pProp, MM::ActionType eAct);
+
+private:
+   int ShowBackBuffer();
+
+   bool initialized_;
+   unsigned width_;
+   unsigned height_;
+   double exposureMs_;
+   double displayDelayMs_;
+   long patternMemory_; // Number of patterns stored; 0 for none
+   // The displayed frame, and the one being staged for the next display
+   std::vector<unsigned char> frontBuffer_;
+   std::vector<unsigned char> backBuffer_;
+   bool staged_;
+   std::vector< std::vector<unsigned char> > patterns_;
+   std::vector< std::vector<unsigned char> > sequence_;
+   long imageTransfers_;
+   long patternTransfers_;
+   long displays_;
+};
+
 
 
 #endif //_DEMOCAMERA_H_
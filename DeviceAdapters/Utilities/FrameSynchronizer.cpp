@@ -0,0 +1,175 @@
+///////////////////////////////////////////////////////////////////////////////
+// FILE:          FrameSynchronizer.cpp
+// PROJECT:       Micro-Manager
+// SUBSYSTEM:     DeviceAdapters
+//-----------------------------------------------------------------------------
+// DESCRIPTION:   Pairs the frames of several cameras into multi-channel
+//                frames by camera frame number or timestamp
+//
+// LICENSE:       This file is distributed under the BSD license.
+//                License text is included with the source distribution.
+//
+//                This file is distributed in the hope that it will be useful,
+//                but WITHOUT ANY WARRANTY; without even the implied warranty
+//                of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+//
+//                IN NO EVENT SHALL THE COPYRIGHT OWNER OR
+//                CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+//                INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES.
+
+#include "FrameSynchronizer.h"
+
+#include <cmath>
+
+
+namespace {
+
+unsigned CountBits(unsigned mask)
+{
+   unsigned count = 0;
+   for (; mask != 0; mask &= mask - 1)
+      ++count;
+   return count;
+}
+
+} // anonymous namespace
+
+
+FrameSynchronizer::FrameSynchronizer() :
+   mode_(MatchFrameNumber),
+   tolerance_(0.5),
+   allMask_(0),
+   sequenceCounter_(0),
+   droppedFrames_(0),
+   completedSets_(0)
+{
+}
+
+void FrameSynchronizer::Reset(Mode mode, unsigned channelCount,
+      unsigned setCount, double toleranceMs)
+{
+   mode_ = mode;
+   // Frame numbers are integers and must be equal
+   tolerance_ = (mode == MatchFrameNumber) ? 0.5 : toleranceMs;
+   allMask_ = (1u << channelCount) - 1;
+   sets_.assign(setCount, Set());
+   channelSeen_.assign(channelCount, false);
+   lastKeys_.assign(channelCount, 0.0);
+   sequenceCounter_ = 0;
+   droppedFrames_ = 0;
+   completedSets_ = 0;
+}
+
+/**
+ * A set is hopeless if a channel whose frame it lacks has already delivered
+ * a frame that is too late to match it.
+ */
+bool FrameSynchronizer::IsHopeless(const Set& set) const
+{
+   for (unsigned ch = 0; ch < channelSeen_.size(); ++ch)
+   {
+      if ((set.reservedMask & (1u << ch)) == 0 && channelSeen_[ch] &&
+            lastKeys_[ch] > set.key + tolerance_)
+         return true;
+   }
+   return false;
+}
+
+void FrameSynchronizer::Discard(Set& set)
+{
+   droppedFrames_ += CountBits(set.filledMask);
+   set = Set();
+}
+
+int FrameSynchronizer::Reserve(unsigned channel, double key, bool& started)
+{
+   started = false;
+   if (channel >= channelSeen_.size())
+      return -1;
+   const unsigned bit = 1u << channel;
+   if (!channelSeen_[channel] || key > lastKeys_[channel])
+      lastKeys_[channel] = key;
+   channelSeen_[channel] = true;
+
+   int match = -1;
+   int freeSet = -1;
+   int oldest = -1;
+   for (int i = 0; i < (int)sets_.size(); ++i)
+   {
+      Set& set = sets_[i];
+      if (set.state == Set::Filling && set.copiesInFlight == 0 &&
+            IsHopeless(set))
+         Discard(set);
+
+      if (set.state == Set::Free)
+      {
+         if (freeSet < 0)
+            freeSet = i;
+         continue;
+      }
+      if (set.state != Set::Filling)
+         continue;
+
+      if (!(set.reservedMask & bit) &&
+            std::fabs(key - set.key) <= tolerance_ &&
+            (match < 0 ||
+             std::fabs(key - set.key) < std::fabs(key - sets_[match].key)))
+         match = i;
+      if (set.copiesInFlight == 0 &&
+            (oldest < 0 || set.sequenceNr < sets_[oldest].sequenceNr))
+         oldest = i;
+   }
+
+   if (match < 0)
+   {
+      Set newSet;
+      newSet.key = key;
+      newSet.reservedMask = bit;
+      if (IsHopeless(newSet))
+      {
+         // Another channel has moved past this frame
+         ++droppedFrames_;
+         return -1;
+      }
+
+      match = freeSet;
+      if (match < 0)
+      {
+         if (oldest < 0)
+         {
+            // All sets are being copied into or inserted
+            ++droppedFrames_;
+            return -1;
+         }
+         Discard(sets_[oldest]);
+         match = oldest;
+      }
+      Set& set = sets_[match];
+      set.state = Set::Filling;
+      set.key = key;
+      set.sequenceNr = sequenceCounter_++;
+      started = true;
+   }
+
+   Set& set = sets_[match];
+   set.reservedMask |= bit;
+   ++set.copiesInFlight;
+   return match;
+}
+
+bool FrameSynchronizer::Filled(int set, unsigned channel)
+{
+   Set& s = sets_[set];
+   --s.copiesInFlight;
+   s.filledMask |= 1u << channel;
+   if (s.filledMask != allMask_)
+      return false;
+   s.state = Set::Inserting;
+   ++completedSets_;
+   return true;
+}
+
+void FrameSynchronizer::Release(int set)
+{
+   sets_[set] = Set();
+}
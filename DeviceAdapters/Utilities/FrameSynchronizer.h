@@ -0,0 +1,99 @@
+///////////////////////////////////////////////////////////////////////////////
+// FILE:          FrameSynchronizer.h
+// PROJECT:       Micro-Manager
+// SUBSYSTEM:     DeviceAdapters
+//-----------------------------------------------------------------------------
+// DESCRIPTION:   Pairs the frames of several cameras into multi-channel
+//                frames by camera frame number or timestamp
+//
+// LICENSE:       This file is distributed under the BSD license.
+//                License text is included with the source distribution.
+//
+//                This file is distributed in the hope that it will be useful,
+//                but WITHOUT ANY WARRANTY; without even the implied warranty
+//                of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+//
+//                IN NO EVENT SHALL THE COPYRIGHT OWNER OR
+//                CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+//                INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES.
+
+#pragma once
+
+#include <vector>
+
+
+/**
+ * \brief Bookkeeping for assembling multi-channel frames
+ *
+ * Each channel (camera) delivers frames with a key: the frame number or the
+ * timestamp the camera gave the frame. Frames of different channels whose
+ * keys match (exactly for frame numbers, within a tolerance for timestamps)
+ * belong to the same set. Keys must increase per channel.
+ *
+ * A set that is still missing the frame of a channel that has already
+ * delivered a later frame can never be completed; it is discarded as soon as
+ * that is known, so that a frame dropped by one camera costs only the set it
+ * belonged to. When all sets are in use the oldest incomplete one is
+ * discarded.
+ *
+ * The caller stores the pixels: Reserve() a set for a frame, copy the frame
+ * into it, then call Filled(), which tells whether the set is complete. A
+ * complete set is Release()d after it has been inserted. This class does no
+ * locking; calls must be serialized by the caller.
+ */
+class FrameSynchronizer
+{
+public:
+   enum Mode
+   {
+      MatchFrameNumber,
+      MatchTimestamp
+   };
+
+   FrameSynchronizer();
+
+   // Discards all sets and counts
+   void Reset(Mode mode, unsigned channelCount, unsigned setCount,
+         double toleranceMs);
+
+   // Returns the index of the set that the frame goes into, setting started
+   // if the set is new, or -1 if the frame is to be discarded
+   int Reserve(unsigned channel, double key, bool& started);
+   // Returns true if the set is complete
+   bool Filled(int set, unsigned channel);
+   void Release(int set);
+
+   // Number of frames received from the channels but discarded, because
+   // they could not be completed into a set or no set was available
+   long GetDroppedFrameCount() const { return droppedFrames_; }
+   long GetCompletedSetCount() const { return completedSets_; }
+
+private:
+   struct Set
+   {
+      enum State { Free, Filling, Inserting };
+
+      Set() : state(Free), key(0.0), reservedMask(0), filledMask(0),
+         copiesInFlight(0), sequenceNr(0) {}
+
+      State state;
+      double key;
+      unsigned reservedMask;
+      unsigned filledMask;
+      int copiesInFlight;
+      unsigned long sequenceNr;
+   };
+
+   bool IsHopeless(const Set& set) const;
+   void Discard(Set& set);
+
+   Mode mode_;
+   double tolerance_;
+   unsigned allMask_;
+   std::vector<Set> sets_;
+   std::vector<bool> channelSeen_;
+   std::vector<double> lastKeys_;
+   unsigned long sequenceCounter_;
+   long droppedFrames_;
+   long completedSets_;
+};
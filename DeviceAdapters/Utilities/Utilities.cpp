@@ -59,6 +59,17 @@ const char* g_PropertyMinUm = "Stage Low Position(um)";
 const char* g_PropertyMaxUm = "Stage High Position(um)";
 const char* g_SyncNow = "Sync positions now";
 
+const char* g_MultiCameraSyncMode = "Synchronized Sequence";
+const char* g_MultiCameraSyncToleranceMs = "Synchronized Sequence Tolerance (ms)";
+const char* g_MultiCameraSyncDropped = "Synchronized Sequence Dropped Frames";
+const char* g_SyncModeOff = "Off";
+const char* g_SyncModeFrameNumber = "Frame number";
+const char* g_SyncModeTimestamp = "Timestamp";
+
+// Number of multi-channel frames that can be under assembly at the same time
+// in a synchronized sequence acquisition
+const unsigned g_NrSyncFrameSets = 4;
+
 const char* g_normalLogicString = "Normal";
 const char* g_invertedLogicString = "Inverted";
 
@@ -331,13 +342,23 @@ int MultiShutter::OnState(MM::PropertyBase* pProp, MM::ActionType eAct)
 MultiCamera::MultiCamera() :
    imageBuffer_(0),
    nrCamerasInUse_(0),
-   initialized_(false)
+   initialized_(false),
+   syncMode_(SyncOff),
+   syncToleranceMs_(5.0),
+   syncCallback_(this),
+   syncActive_(false),
+   syncStartMs_(0.0),
+   syncFallbackLogged_(false),
+   syncWidth_(0),
+   syncHeight_(0),
+   syncByteDepth_(0)
 {
    InitializeDefaultErrorMessages();
 
    SetErrorText(ERR_INVALID_DEVICE_NAME, "Please select a valid camera");
    SetErrorText(ERR_NO_PHYSICAL_CAMERA, "No physical camera assigned");
    SetErrorText(ERR_NO_EQUAL_SIZE, "Cameras differ in image size");
+   SetErrorText(ERR_NO_EQUAL_PIXEL_TYPE, "Cameras differ in pixel type");
 
    // Name                                                                   
    CreateProperty(MM::g_Keyword_Name, g_DeviceNameMultiCamera, MM::String, true); 
@@ -358,6 +379,7 @@ MultiCamera::~MultiCamera()
 
 int MultiCamera::Shutdown()
 {
+   RestorePhysicalCallbacks();
    delete imageBuffer_;
    // Rely on the cameras to shut themselves down
    return DEVICE_OK;
@@ -407,6 +429,22 @@ int MultiCamera::Initialize()
    CPropertyAction* pAct = new CPropertyAction(this, &MultiCamera::OnBinning);
    CreateProperty(MM::g_Keyword_Binning, "1", MM::Integer, false, pAct, false);
 
+   // In a synchronized sequence the frames of the physical cameras are paired
+   // by the image number or elapsed time the cameras tag them with, and
+   // inserted together as a single multi-channel image. Camera frames that
+   // cannot be paired are counted as dropped.
+   pAct = new CPropertyAction(this, &MultiCamera::OnSyncMode);
+   CreateStringProperty(g_MultiCameraSyncMode, g_SyncModeOff, false, pAct);
+   AddAllowedValue(g_MultiCameraSyncMode, g_SyncModeOff);
+   AddAllowedValue(g_MultiCameraSyncMode, g_SyncModeFrameNumber);
+   AddAllowedValue(g_MultiCameraSyncMode, g_SyncModeTimestamp);
+
+   pAct = new CPropertyAction(this, &MultiCamera::OnSyncToleranceMs);
+   CreateFloatProperty(g_MultiCameraSyncToleranceMs, syncToleranceMs_, false, pAct);
+
+   pAct = new CPropertyAction(this, &MultiCamera::OnSyncDroppedFrames);
+   CreateIntegerProperty(g_MultiCameraSyncDropped, 0, true, pAct);
+
    initialized_ = true;
 
    return DEVICE_OK;
@@ -425,20 +463,23 @@ int MultiCamera::SnapImage()
    if (!ImageSizesAreEqual())
       return ERR_NO_EQUAL_SIZE;
 
-   CameraSnapThread t[MAX_NUMBER_PHYSICAL_CAMERAS];
    for (unsigned int i = 0; i < usedCameras_.size(); i++)
    {
       MM::Camera* camera = (MM::Camera*) GetDevice(usedCameras_[i].c_str());
       if (camera != 0) 
-      {
-         t[i].SetCamera(camera);
-         t[i].Start();
-      }
+         snapThreads_[i].Snap(camera);
    }
-   // I think that the CameraSnapThread destructor waits until the SnapImage function is done
-   // So, we are likely to be waiting here until all cameras are done snapping
 
-   return DEVICE_OK;
+   // Wait until all cameras are done snapping, and report the first error
+   int ret = DEVICE_OK;
+   for (unsigned int i = 0; i < usedCameras_.size(); i++)
+   {
+      int snapRet = snapThreads_[i].WaitForSnap();
+      if (ret == DEVICE_OK)
+         ret = snapRet;
+   }
+
+   return ret;
 }
 
 /**
@@ -749,6 +790,9 @@ int MultiCamera::StartSequenceAcquisition(double interval)
    if (!ImageSizesAreEqual())
       return ERR_NO_EQUAL_SIZE;
 
+   if (syncMode_ != SyncOff)
+      return StartSynchronizedSequence(LONG_MAX, interval, false);
+
    for (unsigned int i = 0; i < usedCameras_.size(); i++)
    {
       MM::Camera* camera = (MM::Camera*) GetDevice(usedCameras_[i].c_str());
@@ -774,6 +818,13 @@ int MultiCamera::StartSequenceAcquisition(long numImages, double interval_ms, bo
    if (nrCamerasInUse_ < 1)
       return ERR_NO_PHYSICAL_CAMERA;
 
+   if (syncMode_ != SyncOff)
+   {
+      if (!ImageSizesAreEqual())
+         return ERR_NO_EQUAL_SIZE;
+      return StartSynchronizedSequence(numImages, interval_ms, stopOnOverflow);
+   }
+
    for (unsigned int i = 0; i < usedCameras_.size(); i++)
    {
       MM::Camera* camera = (MM::Camera*) GetDevice(usedCameras_[i].c_str());
@@ -807,9 +858,223 @@ int MultiCamera::StopSequenceAcquisition()
                  os.str().c_str());
       }
    }
+   RestorePhysicalCallbacks();
    return DEVICE_OK;
 }
 
+/**
+ * Starts the physical cameras with our callback installed, so that their
+ * frames can be paired and inserted as multi-channel images.
+ */
+int MultiCamera::StartSynchronizedSequence(long numImages, double interval_ms, bool stopOnOverflow)
+{
+   unsigned byteDepth = GetImageBytesPerPixel();
+   if (byteDepth == 0)
+      return ERR_NO_EQUAL_PIXEL_TYPE;
+
+   {
+      boost::mutex::scoped_lock lock(syncMutex_);
+      syncCameras_.clear();
+      for (unsigned int i = 0; i < usedCameras_.size(); i++)
+      {
+         MM::Device* camera = GetDevice(usedCameras_[i].c_str());
+         if (camera != 0)
+            syncCameras_.push_back(camera);
+      }
+      syncArrivalCounts_.assign(syncCameras_.size(), 0);
+      syncStartMs_ = GetCoreCallback()->GetCurrentMMTime().getMsec();
+      syncFallbackLogged_ = false;
+
+      syncWidth_ = GetImageWidth();
+      syncHeight_ = GetImageHeight();
+      syncByteDepth_ = byteDepth;
+      size_t frameBytes = (size_t) syncWidth_ * syncHeight_ * syncByteDepth_;
+
+      // allocate up front so that no allocation happens per frame
+      syncSets_.resize(g_NrSyncFrameSets);
+      for (unsigned i = 0; i < syncSets_.size(); i++)
+         syncSets_[i].pixels.resize(frameBytes * syncCameras_.size());
+      syncFrames_.Reset(syncMode_ == SyncTimestamp ?
+            FrameSynchronizer::MatchTimestamp :
+            FrameSynchronizer::MatchFrameNumber,
+            (unsigned) syncCameras_.size(), g_NrSyncFrameSets,
+            syncToleranceMs_);
+      syncCallback_.SetCore(GetCoreCallback());
+      syncActive_ = true;
+   }
+
+   for (unsigned int i = 0; i < syncCameras_.size(); i++)
+      syncCameras_[i]->SetCallback(&syncCallback_);
+
+   for (unsigned int i = 0; i < syncCameras_.size(); i++)
+   {
+      MM::Camera* camera = static_cast<MM::Camera*>(syncCameras_[i]);
+      int ret = camera->StartSequenceAcquisition(numImages, interval_ms, stopOnOverflow);
+      if (ret != DEVICE_OK)
+      {
+         for (unsigned int j = 0; j < i; j++)
+            static_cast<MM::Camera*>(syncCameras_[j])->StopSequenceAcquisition();
+         RestorePhysicalCallbacks();
+         return ret;
+      }
+   }
+   return DEVICE_OK;
+}
+
+/**
+ * Puts the core callback back on all physical cameras. Cameras are looked up
+ * by label, so that devices that have already been unloaded are skipped.
+ */
+void MultiCamera::RestorePhysicalCallbacks()
+{
+   {
+      boost::mutex::scoped_lock lock(syncMutex_);
+      if (!syncActive_)
+         return;
+      syncActive_ = false;
+   }
+
+   for (unsigned int i = 0; i < usedCameras_.size(); i++)
+   {
+      MM::Device* camera = GetDevice(usedCameras_[i].c_str());
+      if (camera != 0)
+         camera->SetCallback(GetCoreCallback());
+   }
+}
+
+/**
+ * Called (through MultiCameraSyncCallback) on the physical camera's thread
+ * for every image it inserts during a synchronized sequence.
+ */
+int MultiCamera::OnPhysicalFrame(const MM::Device* caller,
+      const unsigned char* buf, unsigned width, unsigned height,
+      unsigned byteDepth, const Metadata* md)
+{
+   MM::Core* core = syncCallback_.GetCore();
+   double arrivalMs = core->GetCurrentMMTime().getMsec();
+
+   int setIndex = -1;
+   SyncFrameSet* set = 0;
+   unsigned channel = 0;
+   size_t frameBytes = (size_t) width * height * byteDepth;
+   {
+      boost::mutex::scoped_lock lock(syncMutex_);
+      if (!syncActive_)
+         return core->InsertImage(caller, buf, width, height, byteDepth, md);
+
+      while (channel < syncCameras_.size() && syncCameras_[channel] != caller)
+         channel++;
+      if (channel == syncCameras_.size())
+         return core->InsertImage(caller, buf, width, height, byteDepth, md);
+
+      if (width != syncWidth_ || height != syncHeight_ || byteDepth != syncByteDepth_)
+         return DEVICE_INCOMPATIBLE_IMAGE;
+
+      bool started;
+      setIndex = syncFrames_.Reserve(channel,
+            GetSyncKey(channel, md, arrivalMs), started);
+      if (setIndex < 0)
+         return DEVICE_OK; // counted as dropped
+
+      set = &syncSets_[setIndex];
+      if (started)
+      {
+         set->firstArrivalMs = arrivalMs;
+         set->lastArrivalMs = arrivalMs;
+         set->md.Clear();
+      }
+      if (arrivalMs > set->lastArrivalMs)
+         set->lastArrivalMs = arrivalMs;
+      if (channel == 0 && md != 0)
+         set->md = *md;
+   }
+
+   memcpy(&set->pixels[channel * frameBytes], buf, frameBytes);
+
+   bool complete = false;
+   {
+      boost::mutex::scoped_lock lock(syncMutex_);
+      complete = syncFrames_.Filled(setIndex, channel);
+   }
+   if (!complete)
+      return DEVICE_OK;
+
+   set->md.PutImageTag("SyncTimeSkew-ms",
+         CDeviceUtils::ConvertToString(set->lastArrivalMs - set->firstArrivalMs));
+   int ret = GetCoreCallback()->InsertMultiChannel(this, &set->pixels[0],
+         (unsigned) syncCameras_.size(), width, height, byteDepth, &set->md);
+
+   boost::mutex::scoped_lock lock(syncMutex_);
+   syncFrames_.Release(setIndex);
+   return ret;
+}
+
+/**
+ * Returns the key by which a frame is paired: the frame number or the time
+ * that the camera tagged it with. Frames without those tags are numbered or
+ * timed by their arrival, which cannot tell a frame dropped by the camera.
+ * Must be called with syncMutex_ held.
+ */
+double MultiCamera::GetSyncKey(unsigned channel, const Metadata* md,
+      double arrivalMs)
+{
+   long arrivalNr = syncArrivalCounts_[channel]++;
+   if (md != 0)
+   {
+      try
+      {
+         if (syncMode_ == SyncFrameNumber)
+         {
+            return atof(md->GetSingleTag(
+                     MM::g_Keyword_Metadata_ImageNumber).GetValue().c_str());
+         }
+
+         // Elapsed times count from each camera's own start; make them
+         // comparable if the start is given
+         double elapsedMs = atof(md->GetSingleTag(
+                  MM::g_Keyword_Elapsed_Time_ms).GetValue().c_str());
+         try
+         {
+            elapsedMs += atof(md->GetSingleTag(
+                     MM::g_Keyword_Metadata_StartTime).GetValue().c_str());
+         }
+         catch (const MetadataKeyError&)
+         {
+         }
+         return elapsedMs;
+      }
+      catch (const MetadataKeyError&)
+      {
+      }
+   }
+
+   if (!syncFallbackLogged_)
+   {
+      syncFallbackLogged_ = true;
+      LogMessage(syncMode_ == SyncFrameNumber ?
+            "Camera frames carry no image number; pairing by arrival order" :
+            "Camera frames carry no elapsed time; pairing by arrival time");
+   }
+   if (syncMode_ == SyncFrameNumber)
+      return (double) arrivalNr;
+   return arrivalMs - syncStartMs_;
+}
+
+/**
+ * Called when a physical camera finishes its sequence. The callback is put
+ * back right away so that the camera never keeps a pointer to us beyond the
+ * acquisition.
+ */
+void MultiCamera::OnPhysicalAcqFinished(const MM::Device* caller)
+{
+   boost::mutex::scoped_lock lock(syncMutex_);
+   for (unsigned i = 0; i < syncCameras_.size(); i++)
+   {
+      if (syncCameras_[i] == caller)
+         syncCameras_[i]->SetCallback(syncCallback_.GetCore());
+   }
+}
+
 int MultiCamera::GetBinning() const
 {
    MM::Camera* camera0 = (MM::Camera*) GetDevice(usedCameras_[0].c_str());
@@ -961,6 +1226,426 @@ int MultiCamera::OnBinning(MM::PropertyBase* pProp, MM::ActionType eAct)
    return DEVICE_OK;
 }
 
+int MultiCamera::OnSyncMode(MM::PropertyBase* pProp, MM::ActionType eAct)
+{
+   if (eAct == MM::BeforeGet)
+   {
+      if (syncMode_ == SyncFrameNumber)
+         pProp->Set(g_SyncModeFrameNumber);
+      else if (syncMode_ == SyncTimestamp)
+         pProp->Set(g_SyncModeTimestamp);
+      else
+         pProp->Set(g_SyncModeOff);
+   }
+   else if (eAct == MM::AfterSet)
+   {
+      if (IsCapturing())
+         return DEVICE_CAMERA_BUSY_ACQUIRING;
+
+      std::string mode;
+      pProp->Get(mode);
+      if (mode == g_SyncModeFrameNumber)
+         syncMode_ = SyncFrameNumber;
+      else if (mode == g_SyncModeTimestamp)
+         syncMode_ = SyncTimestamp;
+      else
+         syncMode_ = SyncOff;
+   }
+   return DEVICE_OK;
+}
+
+int MultiCamera::OnSyncToleranceMs(MM::PropertyBase* pProp, MM::ActionType eAct)
+{
+   if (eAct == MM::BeforeGet)
+   {
+      pProp->Set(syncToleranceMs_);
+   }
+   else if (eAct == MM::AfterSet)
+   {
+      double tolerance;
+      pProp->Get(tolerance);
+      if (tolerance < 0.0)
+         return DEVICE_INVALID_PROPERTY_VALUE;
+      boost::mutex::scoped_lock lock(syncMutex_);
+      syncToleranceMs_ = tolerance;
+   }
+   return DEVICE_OK;
+}
+
+int MultiCamera::OnSyncDroppedFrames(MM::PropertyBase* pProp, MM::ActionType eAct)
+{
+   if (eAct == MM::BeforeGet)
+   {
+      boost::mutex::scoped_lock lock(syncMutex_);
+      pProp->Set(syncFrames_.GetDroppedFrameCount());
+   }
+   return DEVICE_OK;
+}
+
+
+/*
+ * CameraSnapThread implementation
+ */
+CameraSnapThread::CameraSnapThread() :
+   camera_(0),
+   started_(false),
+   stop_(false),
+   snapRequested_(false),
+   snapPending_(false),
+   snapResult_(DEVICE_OK)
+{
+}
+
+CameraSnapThread::~CameraSnapThread()
+{
+   Stop();
+}
+
+void CameraSnapThread::Snap(MM::Camera* camera)
+{
+   boost::mutex::scoped_lock lock(mutex_);
+   if (!started_)
+   {
+      activate();
+      started_ = true;
+   }
+   camera_ = camera;
+   snapRequested_ = true;
+   snapPending_ = true;
+   cond_.notify_all();
+}
+
+int CameraSnapThread::WaitForSnap()
+{
+   boost::mutex::scoped_lock lock(mutex_);
+   while (snapPending_)
+      cond_.wait(lock);
+   int ret = snapResult_;
+   snapResult_ = DEVICE_OK;
+   return ret;
+}
+
+void CameraSnapThread::Stop()
+{
+   {
+      boost::mutex::scoped_lock lock(mutex_);
+      if (!started_)
+         return;
+      stop_ = true;
+      cond_.notify_all();
+   }
+   wait();
+}
+
+int CameraSnapThread::svc()
+{
+   boost::mutex::scoped_lock lock(mutex_);
+   for (;;)
+   {
+      while (!snapRequested_ && !stop_)
+         cond_.wait(lock);
+      if (stop_)
+         return 0;
+
+      snapRequested_ = false;
+      MM::Camera* camera = camera_;
+      lock.unlock();
+      int ret = camera->SnapImage();
+      lock.lock();
+
+      snapResult_ = ret;
+      snapPending_ = false;
+      cond_.notify_all();
+   }
+}
+
+
+/*
+ * MultiCameraSyncCallback implementation
+ */
+MultiCameraSyncCallback::MultiCameraSyncCallback(MultiCamera* owner) :
+   owner_(owner),
+   core_(0)
+{
+}
+
+int MultiCameraSyncCallback::LogMessage(const MM::Device* caller, const char* msg, bool debugOnly) const
+{
+   return core_->LogMessage(caller, msg, debugOnly);
+}
+
+MM::Device* MultiCameraSyncCallback::GetDevice(const MM::Device* caller, const char* label)
+{
+   return core_->GetDevice(caller, label);
+}
+
+int MultiCameraSyncCallback::GetDeviceProperty(const char* deviceName, const char* propName, char* value)
+{
+   return core_->GetDeviceProperty(deviceName, propName, value);
+}
+
+int MultiCameraSyncCallback::SetDeviceProperty(const char* deviceName, const char* propName, const char* value)
+{
+   return core_->SetDeviceProperty(deviceName, propName, value);
+}
+
+void MultiCameraSyncCallback::GetLoadedDeviceOfType(const MM::Device* caller, MM::DeviceType devType, char* pDeviceName, const unsigned int deviceIterator)
+{
+   core_->GetLoadedDeviceOfType(caller, devType, pDeviceName, deviceIterator);
+}
+
+int MultiCameraSyncCallback::SetSerialProperties(const char* portName,
+      const char* answerTimeout, const char* baudRate,
+      const char* delayBetweenCharsMs, const char* handshaking,
+      const char* parity, const char* stopBits)
+{
+   return core_->SetSerialProperties(portName, answerTimeout, baudRate,
+         delayBetweenCharsMs, handshaking, parity, stopBits);
+}
+
+int MultiCameraSyncCallback::SetSerialCommand(const MM::Device* caller, const char* portName, const char* command, const char* term)
+{
+   return core_->SetSerialCommand(caller, portName, command, term);
+}
+
+int MultiCameraSyncCallback::GetSerialAnswer(const MM::Device* caller, const char* portName, unsigned long ansLength, char* answer, const char* term)
+{
+   return core_->GetSerialAnswer(caller, portName, ansLength, answer, term);
+}
+
+int MultiCameraSyncCallback::WriteToSerial(const MM::Device* caller, const char* port, const unsigned char* buf, unsigned long length)
+{
+   return core_->WriteToSerial(caller, port, buf, length);
+}
+
+int MultiCameraSyncCallback::ReadFromSerial(const MM::Device* caller, const char* port, unsigned char* buf, unsigned long length, unsigned long& read)
+{
+   return core_->ReadFromSerial(caller, port, buf, length, read);
+}
+
+int MultiCameraSyncCallback::PurgeSerial(const MM::Device* caller, const char* portName)
+{
+   return core_->PurgeSerial(caller, portName);
+}
+
+MM::PortType MultiCameraSyncCallback::GetSerialPortType(const char* portName) const
+{
+   return core_->GetSerialPortType(portName);
+}
+
+int MultiCameraSyncCallback::OnPropertiesChanged(const MM::Device* caller)
+{
+   return core_->OnPropertiesChanged(caller);
+}
+
+int MultiCameraSyncCallback::OnPropertyChanged(const MM::Device* caller, const char* propName, const char* propValue)
+{
+   return core_->OnPropertyChanged(caller, propName, propValue);
+}
+
+int MultiCameraSyncCallback::OnStagePositionChanged(const MM::Device* caller, double pos)
+{
+   return core_->OnStagePositionChanged(caller, pos);
+}
+
+int MultiCameraSyncCallback::OnXYStagePositionChanged(const MM::Device* caller, double xPos, double yPos)
+{
+   return core_->OnXYStagePositionChanged(caller, xPos, yPos);
+}
+
+int MultiCameraSyncCallback::OnExposureChanged(const MM::Device* caller, double newExposure)
+{
+   return core_->OnExposureChanged(caller, newExposure);
+}
+
+int MultiCameraSyncCallback::OnSLMExposureChanged(const MM::Device* caller, double newExposure)
+{
+   return core_->OnSLMExposureChanged(caller, newExposure);
+}
+
+int MultiCameraSyncCallback::OnMagnifierChanged(const MM::Device* caller)
+{
+   return core_->OnMagnifierChanged(caller);
+}
+
+int MultiCameraSyncCallback::OnBusyChanged(const MM::Device* caller, bool busy)
+{
+   return core_->OnBusyChanged(caller, busy);
+}
+
+unsigned long MultiCameraSyncCallback::GetClockTicksUs(const MM::Device* caller)
+{
+   return core_->GetClockTicksUs(caller);
+}
+
+MM::MMTime MultiCameraSyncCallback::GetCurrentMMTime()
+{
+   return core_->GetCurrentMMTime();
+}
+
+int MultiCameraSyncCallback::AcqFinished(const MM::Device* caller, int statusCode)
+{
+   MM::Core* core = core_;
+   owner_->OnPhysicalAcqFinished(caller);
+   return core->AcqFinished(caller, statusCode);
+}
+
+int MultiCameraSyncCallback::PrepareForAcq(const MM::Device* caller)
+{
+   return core_->PrepareForAcq(caller);
+}
+
+int MultiCameraSyncCallback::InsertImage(const MM::Device* caller, const ImgBuffer& buf)
+{
+   Metadata md = buf.GetMetadata();
+   return owner_->OnPhysicalFrame(caller, buf.GetPixels(), buf.Width(),
+         buf.Height(), buf.Depth(), &md);
+}
+
+int MultiCameraSyncCallback::InsertImage(const MM::Device* caller, const unsigned char* buf, unsigned width, unsigned height, unsigned byteDepth, unsigned nComponents, const char* serializedMetadata, const bool doProcess)
+{
+   // Multi-component (RGB) frames are not paired
+   if (nComponents != 1)
+      return core_->InsertImage(caller, buf, width, height, byteDepth,
+            nComponents, serializedMetadata, doProcess);
+
+   Metadata md;
+   md.Restore(serializedMetadata);
+   return owner_->OnPhysicalFrame(caller, buf, width, height, byteDepth, &md);
+}
+
+int MultiCameraSyncCallback::InsertImage(const MM::Device* caller, const unsigned char* buf, unsigned width, unsigned height, unsigned byteDepth, const Metadata* md, const bool /* doProcess */)
+{
+   return owner_->OnPhysicalFrame(caller, buf, width, height, byteDepth, md);
+}
+
+int MultiCameraSyncCallback::InsertImage(const MM::Device* caller, const unsigned char* buf, unsigned width, unsigned height, unsigned byteDepth, const char* serializedMetadata, const bool /* doProcess */)
+{
+   Metadata md;
+   md.Restore(serializedMetadata);
+   return owner_->OnPhysicalFrame(caller, buf, width, height, byteDepth, &md);
+}
+
+void MultiCameraSyncCallback::ClearImageBuffer(const MM::Device* caller)
+{
+   core_->ClearImageBuffer(caller);
+}
+
+bool MultiCameraSyncCallback::InitializeImageBuffer(unsigned channels, unsigned slices, unsigned int w, unsigned int h, unsigned int pixDepth)
+{
+   return core_->InitializeImageBuffer(channels, slices, w, h, pixDepth);
+}
+
+int MultiCameraSyncCallback::InsertMultiChannel(const MM::Device* caller, const unsigned char* buf, unsigned numChannels, unsigned width, unsigned height, unsigned byteDepth, Metadata* md)
+{
+   return core_->InsertMultiChannel(caller, buf, numChannels, width, height, byteDepth, md);
+}
+
+const char* MultiCameraSyncCallback::GetImage()
+{
+   return core_->GetImage();
+}
+
+int MultiCameraSyncCallback::GetImageDimensions(int& width, int& height, int& depth)
+{
+   return core_->GetImageDimensions(width, height, depth);
+}
+
+int MultiCameraSyncCallback::GetFocusPosition(double& pos)
+{
+   return core_->GetFocusPosition(pos);
+}
+
+int MultiCameraSyncCallback::SetFocusPosition(double pos)
+{
+   return core_->SetFocusPosition(pos);
+}
+
+int MultiCameraSyncCallback::MoveFocus(double velocity)
+{
+   return core_->MoveFocus(velocity);
+}
+
+int MultiCameraSyncCallback::SetXYPosition(double x, double y)
+{
+   return core_->SetXYPosition(x, y);
+}
+
+int MultiCameraSyncCallback::GetXYPosition(double& x, double& y)
+{
+   return core_->GetXYPosition(x, y);
+}
+
+int MultiCameraSyncCallback::MoveXYStage(double vX, double vY)
+{
+   return core_->MoveXYStage(vX, vY);
+}
+
+int MultiCameraSyncCallback::SetExposure(double expMs)
+{
+   return core_->SetExposure(expMs);
+}
+
+int MultiCameraSyncCallback::GetExposure(double& expMs)
+{
+   return core_->GetExposure(expMs);
+}
+
+int MultiCameraSyncCallback::SetConfig(const char* group, const char* name)
+{
+   return core_->SetConfig(group, name);
+}
+
+int MultiCameraSyncCallback::GetCurrentConfig(const char* group, int bufLen, char* name)
+{
+   return core_->GetCurrentConfig(group, bufLen, name);
+}
+
+int MultiCameraSyncCallback::GetChannelConfig(char* channelConfigName, const unsigned int channelConfigIterator)
+{
+   return core_->GetChannelConfig(channelConfigName, channelConfigIterator);
+}
+
+MM::ImageProcessor* MultiCameraSyncCallback::GetImageProcessor(const MM::Device* caller)
+{
+   return core_->GetImageProcessor(caller);
+}
+
+MM::AutoFocus* MultiCameraSyncCallback::GetAutoFocus(const MM::Device* caller)
+{
+   return core_->GetAutoFocus(caller);
+}
+
+MM::Hub* MultiCameraSyncCallback::GetParentHub(const MM::Device* caller) const
+{
+   return core_->GetParentHub(caller);
+}
+
+MM::State* MultiCameraSyncCallback::GetStateDevice(const MM::Device* caller, const char* deviceName)
+{
+   return core_->GetStateDevice(caller, deviceName);
+}
+
+MM::SignalIO* MultiCameraSyncCallback::GetSignalIODevice(const MM::Device* caller, const char* deviceName)
+{
+   return core_->GetSignalIODevice(caller, deviceName);
+}
+
+void MultiCameraSyncCallback::NextPostedError(int& errorCode, char* pMessage, int maxlen, int& messageLength)
+{
+   core_->NextPostedError(errorCode, pMessage, maxlen, messageLength);
+}
+
+void MultiCameraSyncCallback::PostError(const int errorCode, const char* pMessage)
+{
+   core_->PostError(errorCode, pMessage);
+}
+
+void MultiCameraSyncCallback::ClearPostedErrors()
+{
+   core_->ClearPostedErrors();
+}
+
 
 /*
  * MultiStage implementation
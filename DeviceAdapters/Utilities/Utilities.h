@@ -27,6 +27,11 @@
 #include "MMDevice.h"
 #include "DeviceBase.h"
 #include "ImgBuffer.h"
+#include "FrameSynchronizer.h"
+
+#include <boost/thread/condition_variable.hpp>
+#include <boost/thread/mutex.hpp>
+
 #include <string>
 #include <map>
 
@@ -47,6 +52,7 @@
 #define ERR_NO_EQUAL_SIZE                  10011
 #define ERR_AUTOFOCUS_NOT_SUPPORTED        10012
 #define ERR_NO_PHYSICAL_STAGE              10013
+#define ERR_NO_EQUAL_PIXEL_TYPE            10014
 #define ERR_TIMEOUT                        10021
 
 
@@ -98,27 +104,120 @@ private:
 };
 
 /**
- * CameraSnapThread: helper thread for MultiCamera
+ * CameraSnapThread: persistent helper thread for MultiCamera
+ *
+ * One worker is kept per physical camera slot for the lifetime of the
+ * MultiCamera, so that a snap costs a wakeup instead of a thread creation.
  */
 class CameraSnapThread : public MMDeviceThreadBase
 {
    public:
-      CameraSnapThread() :
-         camera_(0),
-         started_(false)
-      {}
-
-      ~CameraSnapThread() { if (started_) wait(); }
+      CameraSnapThread();
+      ~CameraSnapThread();
 
-      void SetCamera(MM::Camera* camera) { camera_ = camera; }
+      // Asks the worker to snap an image with the given camera. Returns
+      // immediately; call WaitForSnap() to collect the result.
+      void Snap(MM::Camera* camera);
+      int WaitForSnap();
 
-      int svc() { camera_->SnapImage(); return 0; }
-
-      void Start() { activate(); started_ = true; }
+      int svc();
 
    private:
+      void Stop();
+
       MM::Camera* camera_;
       bool started_;
+      bool stop_;
+      bool snapRequested_;
+      bool snapPending_;
+      int snapResult_;
+      boost::mutex mutex_;
+      boost::condition_variable cond_;
+};
+
+class MultiCamera;
+
+/**
+ * MultiCameraSyncCallback: core callback installed on the physical cameras
+ * while MultiCamera runs a synchronized sequence acquisition.
+ *
+ * Everything is forwarded to the real core, except that inserted images are
+ * routed to the MultiCamera so that they can be paired into multi-channel
+ * frames.
+ */
+class MultiCameraSyncCallback : public MM::Core
+{
+public:
+   MultiCameraSyncCallback(MultiCamera* owner);
+
+   void SetCore(MM::Core* core) { core_ = core; }
+   MM::Core* GetCore() const { return core_; }
+
+   int LogMessage(const MM::Device* caller, const char* msg, bool debugOnly) const;
+   MM::Device* GetDevice(const MM::Device* caller, const char* label);
+   int GetDeviceProperty(const char* deviceName, const char* propName, char* value);
+   int SetDeviceProperty(const char* deviceName, const char* propName, const char* value);
+   void GetLoadedDeviceOfType(const MM::Device* caller, MM::DeviceType devType, char* pDeviceName, const unsigned int deviceIterator);
+
+   int SetSerialProperties(const char* portName, const char* answerTimeout,
+         const char* baudRate, const char* delayBetweenCharsMs,
+         const char* handshaking, const char* parity, const char* stopBits);
+   int SetSerialCommand(const MM::Device* caller, const char* portName, const char* command, const char* term);
+   int GetSerialAnswer(const MM::Device* caller, const char* portName, unsigned long ansLength, char* answer, const char* term);
+   int WriteToSerial(const MM::Device* caller, const char* port, const unsigned char* buf, unsigned long length);
+   int ReadFromSerial(const MM::Device* caller, const char* port, unsigned char* buf, unsigned long length, unsigned long& read);
+   int PurgeSerial(const MM::Device* caller, const char* portName);
+   MM::PortType GetSerialPortType(const char* portName) const;
+
+   int OnPropertiesChanged(const MM::Device* caller);
+   int OnPropertyChanged(const MM::Device* caller, const char* propName, const char* propValue);
+   int OnStagePositionChanged(const MM::Device* caller, double pos);
+   int OnXYStagePositionChanged(const MM::Device* caller, double xPos, double yPos);
+   int OnExposureChanged(const MM::Device* caller, double newExposure);
+   int OnSLMExposureChanged(const MM::Device* caller, double newExposure);
+   int OnMagnifierChanged(const MM::Device* caller);
+   int OnBusyChanged(const MM::Device* caller, bool busy);
+
+   unsigned long GetClockTicksUs(const MM::Device* caller);
+   MM::MMTime GetCurrentMMTime();
+
+   int AcqFinished(const MM::Device* caller, int statusCode);
+   int PrepareForAcq(const MM::Device* caller);
+   int InsertImage(const MM::Device* caller, const ImgBuffer& buf);
+   int InsertImage(const MM::Device* caller, const unsigned char* buf, unsigned width, unsigned height, unsigned byteDepth, unsigned nComponents, const char* serializedMetadata, const bool doProcess = true);
+   int InsertImage(const MM::Device* caller, const unsigned char* buf, unsigned width, unsigned height, unsigned byteDepth, const Metadata* md = 0, const bool doProcess = true);
+   int InsertImage(const MM::Device* caller, const unsigned char* buf, unsigned width, unsigned height, unsigned byteDepth, const char* serializedMetadata, const bool doProcess = true);
+   void ClearImageBuffer(const MM::Device* caller);
+   bool InitializeImageBuffer(unsigned channels, unsigned slices, unsigned int w, unsigned int h, unsigned int pixDepth);
+   int InsertMultiChannel(const MM::Device* caller, const unsigned char* buf, unsigned numChannels, unsigned width, unsigned height, unsigned byteDepth, Metadata* md = 0);
+
+   const char* GetImage();
+   int GetImageDimensions(int& width, int& height, int& depth);
+   int GetFocusPosition(double& pos);
+   int SetFocusPosition(double pos);
+   int MoveFocus(double velocity);
+   int SetXYPosition(double x, double y);
+   int GetXYPosition(double& x, double& y);
+   int MoveXYStage(double vX, double vY);
+   int SetExposure(double expMs);
+   int GetExposure(double& expMs);
+   int SetConfig(const char* group, const char* name);
+   int GetCurrentConfig(const char* group, int bufLen, char* name);
+   int GetChannelConfig(char* channelConfigName, const unsigned int channelConfigIterator);
+
+   MM::ImageProcessor* GetImageProcessor(const MM::Device* caller);
+   MM::AutoFocus* GetAutoFocus(const MM::Device* caller);
+   MM::Hub* GetParentHub(const MM::Device* caller) const;
+   MM::State* GetStateDevice(const MM::Device* caller, const char* deviceName);
+   MM::SignalIO* GetSignalIODevice(const MM::Device* caller, const char* deviceName);
+
+   void NextPostedError(int& errorCode, char* pMessage, int maxlen, int& messageLength);
+   void PostError(const int errorCode, const char* pMessage);
+   void ClearPostedErrors();
+
+private:
+   MultiCamera* owner_;
+   MM::Core* core_;
 };
 
 /*
@@ -164,10 +263,44 @@ public:
    // ---------------
    int OnPhysicalCamera(MM::PropertyBase* pProp, MM::ActionType eAct, long nr);
    int OnBinning(MM::PropertyBase* pProp, MM::ActionType eAct);
+   int OnSyncMode(MM::PropertyBase* pProp, MM::ActionType eAct);
+   int OnSyncToleranceMs(MM::PropertyBase* pProp, MM::ActionType eAct);
+   int OnSyncDroppedFrames(MM::PropertyBase* pProp, MM::ActionType eAct);
 
 private:
+   friend class MultiCameraSyncCallback;
+
+   enum SyncMode
+   {
+      SyncOff,
+      SyncFrameNumber,
+      SyncTimestamp
+   };
+
+   // A multi-channel frame being assembled from the physical cameras, with
+   // the set of the same index in syncFrames_. The pixel memory is laid out
+   // as expected by InsertMultiChannel, so that each physical frame is
+   // copied exactly once, directly into its channel.
+   struct SyncFrameSet
+   {
+      SyncFrameSet() : firstArrivalMs(0.0), lastArrivalMs(0.0) {}
+
+      double firstArrivalMs;
+      double lastArrivalMs;
+      Metadata md;
+      std::vector<unsigned char> pixels;
+   };
+
    int Logical2Physical(int logical);
    bool ImageSizesAreEqual();
+
+   int StartSynchronizedSequence(long numImages, double interval_ms, bool stopOnOverflow);
+   void RestorePhysicalCallbacks();
+   int OnPhysicalFrame(const MM::Device* caller, const unsigned char* buf,
+         unsigned width, unsigned height, unsigned byteDepth, const Metadata* md);
+   void OnPhysicalAcqFinished(const MM::Device* caller);
+   double GetSyncKey(unsigned channel, const Metadata* md, double arrivalMs);
+
    unsigned char* imageBuffer_;
 
    std::vector<std::string> availableCameras_;
@@ -177,6 +310,24 @@ private:
    unsigned int nrCamerasInUse_;
    bool initialized_;
    ImgBuffer img_;
+
+   CameraSnapThread snapThreads_[MAX_NUMBER_PHYSICAL_CAMERAS];
+
+   SyncMode syncMode_;
+   double syncToleranceMs_;
+   MultiCameraSyncCallback syncCallback_;
+   boost::mutex syncMutex_;
+   bool syncActive_;
+   std::vector<MM::Device*> syncCameras_; // index is the logical channel
+   FrameSynchronizer syncFrames_;
+   std::vector<SyncFrameSet> syncSets_;
+   // Used for cameras that do not tag frames with a number or time
+   std::vector<long> syncArrivalCounts_;
+   double syncStartMs_;
+   bool syncFallbackLogged_;
+   unsigned syncWidth_;
+   unsigned syncHeight_;
+   unsigned syncByteDepth_;
 };
 
 
@@ -0,0 +1,156 @@
+// DESCRIPTION:   Unit tests for the MultiCamera frame synchronizer
+//
+// LICENSE:       This file is distributed under the BSD license.
+//                License text is included with the source distribution.
+//
+//                This file is distributed in the hope that it will be useful,
+//                but WITHOUT ANY WARRANTY; without even the implied warranty
+//                of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+//
+//                IN NO EVENT SHALL THE COPYRIGHT OWNER OR
+//                CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+//                INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES.
+
+#include <gtest/gtest.h>
+
+#include "FrameSynchronizer.h"
+
+#include <vector>
+
+
+namespace {
+
+const unsigned g_NrSets = 4;
+
+// Plays the part of MultiCamera: each set holds the key of the frame that
+// each channel copied into it, and completed sets are collected
+class FrameSynchronizerTest : public ::testing::Test
+{
+protected:
+   void Reset(FrameSynchronizer::Mode mode, unsigned channels,
+         double toleranceMs = 0.0)
+   {
+      sync_.Reset(mode, channels, g_NrSets, toleranceMs);
+      contents_.assign(g_NrSets, std::vector<double>(channels, -1.0));
+      completed_.clear();
+   }
+
+   // Delivers a frame; inserts and releases the set if it completes
+   void Deliver(unsigned channel, double key)
+   {
+      bool started;
+      int set = sync_.Reserve(channel, key, started);
+      if (set < 0)
+         return;
+      if (started)
+         contents_[set].assign(contents_[set].size(), -1.0);
+      contents_[set][channel] = key;
+      if (sync_.Filled(set, channel))
+      {
+         completed_.push_back(contents_[set]);
+         sync_.Release(set);
+      }
+   }
+
+   FrameSynchronizer sync_;
+   std::vector< std::vector<double> > contents_;
+   std::vector< std::vector<double> > completed_;
+};
+
+} // anonymous namespace
+
+TEST_F(FrameSynchronizerTest, PairsByFrameNumberAfterADroppedFrame)
+{
+   Reset(FrameSynchronizer::MatchFrameNumber, 2);
+   for (int n = 0; n < 20; ++n)
+   {
+      Deliver(0, n);
+      if (n != 4) // camera 1 drops frame 4
+         Deliver(1, n);
+   }
+
+   ASSERT_EQ(19u, completed_.size());
+   for (size_t i = 0; i < completed_.size(); ++i)
+      EXPECT_EQ(completed_[i][0], completed_[i][1]) << "set " << i;
+   EXPECT_EQ(3.0, completed_[3][0]);
+   EXPECT_EQ(5.0, completed_[4][0]);
+   // Only camera 0's frame 4 was lost
+   EXPECT_EQ(1, sync_.GetDroppedFrameCount());
+}
+
+TEST_F(FrameSynchronizerTest, PairsByFrameNumberWhenOneCameraLags)
+{
+   // Camera 1 delivers three frames behind camera 0, and drops frame 6
+   Reset(FrameSynchronizer::MatchFrameNumber, 2);
+   for (int n = 0; n < 3; ++n)
+      Deliver(0, n);
+   for (int n = 3; n < 20; ++n)
+   {
+      Deliver(0, n);
+      if (n - 3 != 6)
+         Deliver(1, n - 3);
+   }
+   for (int n = 17; n < 20; ++n)
+      Deliver(1, n);
+
+   ASSERT_EQ(19u, completed_.size());
+   for (size_t i = 0; i < completed_.size(); ++i)
+      EXPECT_EQ(completed_[i][0], completed_[i][1]) << "set " << i;
+   EXPECT_EQ(1, sync_.GetDroppedFrameCount());
+}
+
+TEST_F(FrameSynchronizerTest, PairsByTimestampAfterADroppedFrame)
+{
+   // 10 ms frames; the cameras' clocks differ by 1.5 ms, with jitter
+   Reset(FrameSynchronizer::MatchTimestamp, 3, 3.0);
+   for (int n = 0; n < 20; ++n)
+   {
+      const double t = 10.0 * n;
+      Deliver(0, t);
+      if (n != 7)
+         Deliver(1, t + 1.5 + 0.5 * (n % 2));
+      Deliver(2, t - 1.0);
+   }
+
+   ASSERT_EQ(19u, completed_.size());
+   for (size_t i = 0; i < completed_.size(); ++i)
+   {
+      EXPECT_NEAR(completed_[i][0], completed_[i][1], 3.0) << "set " << i;
+      EXPECT_NEAR(completed_[i][0], completed_[i][2], 3.0) << "set " << i;
+   }
+   EXPECT_EQ(80.0, completed_[7][0]);
+   // The frames of cameras 0 and 2 at 70 ms
+   EXPECT_EQ(2, sync_.GetDroppedFrameCount());
+}
+
+TEST_F(FrameSynchronizerTest, EvictsOldestSetWhenAllAreInUse)
+{
+   // Camera 1 delivers nothing, so its progress is unknown and sets can only
+   // be reclaimed oldest first
+   Reset(FrameSynchronizer::MatchFrameNumber, 2);
+   for (int n = 0; n < 6; ++n)
+      Deliver(0, n);
+   EXPECT_EQ(2, sync_.GetDroppedFrameCount());
+
+   Deliver(1, 5);
+   ASSERT_EQ(1u, completed_.size());
+   EXPECT_EQ(5.0, completed_[0][1]);
+   // Frames 2 to 4 of camera 0 can no longer be paired
+   EXPECT_EQ(5, sync_.GetDroppedFrameCount());
+}
+
+TEST_F(FrameSynchronizerTest, DropsFrameWhenNoSetIsAvailable)
+{
+   Reset(FrameSynchronizer::MatchFrameNumber, 2);
+   bool started;
+   for (int n = 0; n < (int)g_NrSets; ++n)
+      ASSERT_LE(0, sync_.Reserve(0, n, started)); // copies still in flight
+   EXPECT_EQ(-1, sync_.Reserve(0, g_NrSets, started));
+   EXPECT_EQ(1, sync_.GetDroppedFrameCount());
+}
+
+int main(int argc, char **argv)
+{
+   ::testing::InitGoogleTest(&argc, argv);
+   return RUN_ALL_TESTS();
+}
@@ -0,0 +1,213 @@
+///////////////////////////////////////////////////////////////////////////////
+// FILE:          AcquisitionPlan.cpp
+// PROJECT:       Micro-Manager
+// SUBSYSTEM:     MMCore
+//-----------------------------------------------------------------------------
+// DESCRIPTION:   List of frames to acquire, each with its hardware state,
+//                for execution as hardware-triggered sequences
+//
+// LICENSE:       This file is distributed under the "Lesser GPL" (LGPL) license.
+//                License text is included with the source distribution.
+//
+//                This file is distributed in the hope that it will be useful,
+//                but WITHOUT ANY WARRANTY; without even the implied warranty
+//                of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+//
+//                IN NO EVENT SHALL THE COPYRIGHT OWNER OR
+//                CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+//                INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES.
+
+#include "AcquisitionPlan.h"
+
+#include "ErrorCodes.h"
+
+#include <sstream>
+
+
+AcquisitionEvent::AcquisitionEvent() :
+   hasZ_(false),
+   z_(0.0),
+   hasXY_(false),
+   x_(0.0),
+   y_(0.0),
+   hasExposure_(false),
+   exposureMs_(0.0)
+{
+}
+
+void AcquisitionEvent::setZPosition(double z)
+{
+   hasZ_ = true;
+   z_ = z;
+}
+
+void AcquisitionEvent::setXYPosition(double x, double y)
+{
+   hasXY_ = true;
+   x_ = x;
+   y_ = y;
+}
+
+void AcquisitionEvent::setExposure(double exposureMs)
+{
+   hasExposure_ = true;
+   exposureMs_ = exposureMs;
+}
+
+void AcquisitionEvent::setConfig(const char* group, const char* preset)
+{
+   configs_.push_back(std::make_pair(std::string(group), std::string(preset)));
+}
+
+void AcquisitionEvent::setProperty(const char* device, const char* property,
+      const char* value)
+{
+   properties_.addSetting(PropertySetting(device, property, value));
+}
+
+std::string AcquisitionEvent::getConfigGroup(size_t index) const
+   throw (CMMError)
+{
+   if (index >= configs_.size())
+   {
+      std::ostringstream errTxt;
+      errTxt << (unsigned int)index << " - invalid acquisition event config index";
+      throw CMMError(errTxt.str().c_str(), MMERR_DEVICE_GENERIC);
+   }
+   return configs_[index].first;
+}
+
+std::string AcquisitionEvent::getConfigPreset(size_t index) const
+   throw (CMMError)
+{
+   if (index >= configs_.size())
+   {
+      std::ostringstream errTxt;
+      errTxt << (unsigned int)index << " - invalid acquisition event config index";
+      throw CMMError(errTxt.str().c_str(), MMERR_DEVICE_GENERIC);
+   }
+   return configs_[index].second;
+}
+
+std::string AcquisitionEvent::getVerbose() const
+{
+   std::ostringstream txt;
+   const char* sep = "";
+   if (hasZ_)
+   {
+      txt << "Z=" << z_;
+      sep = " ";
+   }
+   if (hasXY_)
+   {
+      txt << sep << "XY=" << x_ << "," << y_;
+      sep = " ";
+   }
+   if (hasExposure_)
+   {
+      txt << sep << "Exposure=" << exposureMs_;
+      sep = " ";
+   }
+   for (size_t i = 0; i < configs_.size(); ++i)
+   {
+      txt << sep << configs_[i].first << "=" << configs_[i].second;
+      sep = " ";
+   }
+   for (size_t i = 0; i < properties_.size(); ++i)
+   {
+      txt << sep << properties_.getSetting(i).getVerbose();
+      sep = " ";
+   }
+   return txt.str();
+}
+
+
+AcquisitionPlan::AcquisitionPlan() :
+   compiled_(false)
+{
+}
+
+void AcquisitionPlan::addEvent(const AcquisitionEvent& event)
+{
+   events_.push_back(event);
+   runs_.clear();
+   compiled_ = false;
+}
+
+AcquisitionEvent AcquisitionPlan::getEvent(size_t index) const throw (CMMError)
+{
+   if (index >= events_.size())
+   {
+      std::ostringstream errTxt;
+      errTxt << (unsigned int)index << " - invalid acquisition plan event index";
+      throw CMMError(errTxt.str().c_str(), MMERR_DEVICE_GENERIC);
+   }
+   return events_[index];
+}
+
+void AcquisitionPlan::clear()
+{
+   events_.clear();
+   runs_.clear();
+   compiled_ = false;
+}
+
+const AcquisitionPlan::Run& AcquisitionPlan::GetRun(size_t run) const
+   throw (CMMError)
+{
+   if (!compiled_)
+      throw CMMError("Acquisition plan has not been compiled",
+            MMERR_DEVICE_GENERIC);
+   if (run >= runs_.size())
+   {
+      std::ostringstream errTxt;
+      errTxt << (unsigned int)run << " - invalid acquisition plan run index";
+      throw CMMError(errTxt.str().c_str(), MMERR_DEVICE_GENERIC);
+   }
+   return runs_[run];
+}
+
+size_t AcquisitionPlan::getNumberOfRuns() const throw (CMMError)
+{
+   if (!compiled_)
+      throw CMMError("Acquisition plan has not been compiled",
+            MMERR_DEVICE_GENERIC);
+   return runs_.size();
+}
+
+long AcquisitionPlan::getRunStart(size_t run) const throw (CMMError)
+{
+   return GetRun(run).start;
+}
+
+long AcquisitionPlan::getRunLength(size_t run) const throw (CMMError)
+{
+   return GetRun(run).length;
+}
+
+std::vector<std::string> AcquisitionPlan::getRunSequencedAxes(size_t run) const
+   throw (CMMError)
+{
+   return GetRun(run).sequencedAxes;
+}
+
+std::string AcquisitionPlan::getVerbose() const
+{
+   std::ostringstream txt;
+   txt << events_.size() << " events";
+   if (!compiled_)
+      return txt.str() + " (not compiled)";
+   txt << " in " << runs_.size() << " runs";
+   for (size_t i = 0; i < runs_.size(); ++i)
+   {
+      const Run& run = runs_[i];
+      txt << "\n" << run.start << "-" << run.start + run.length - 1 << ":";
+      if (run.length == 1)
+         txt << " software";
+      else if (run.sequencedAxes.empty())
+         txt << " burst";
+      for (size_t j = 0; j < run.sequencedAxes.size(); ++j)
+         txt << " " << run.sequencedAxes[j];
+   }
+   return txt.str();
+}
@@ -0,0 +1,150 @@
+///////////////////////////////////////////////////////////////////////////////
+// FILE:          AcquisitionPlan.h
+// PROJECT:       Micro-Manager
+// SUBSYSTEM:     MMCore
+//-----------------------------------------------------------------------------
+// DESCRIPTION:   List of frames to acquire, each with its hardware state,
+//                for execution as hardware-triggered sequences
+//
+// LICENSE:       This file is distributed under the "Lesser GPL" (LGPL) license.
+//                License text is included with the source distribution.
+//
+//                This file is distributed in the hope that it will be useful,
+//                but WITHOUT ANY WARRANTY; without even the implied warranty
+//                of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+//
+//                IN NO EVENT SHALL THE COPYRIGHT OWNER OR
+//                CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+//                INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES.
+
+#pragma once
+
+#ifdef WIN32
+// disable exception scpecification warnings in MSVC
+#pragma warning( disable : 4290 )
+#endif
+
+#include "Configuration.h"
+#include "Error.h"
+
+#include <string>
+#include <utility>
+#include <vector>
+
+namespace mm { class AcquisitionPlanRunner; }
+
+
+/**
+ * One frame of an acquisition plan. Designed to be wrapped by SWIG.
+ *
+ * The event lists the hardware state in which the frame is taken. Anything
+ * that the event does not set stays as it was for the previous event.
+ */
+class AcquisitionEvent
+{
+public:
+   AcquisitionEvent();
+
+   /**
+    * Sets the position of the current focus device.
+    */
+   void setZPosition(double z);
+   /**
+    * Sets the position of the current XY stage.
+    */
+   void setXYPosition(double x, double y);
+   /**
+    * Sets the exposure of the current camera.
+    */
+   void setExposure(double exposureMs);
+   /**
+    * Applies a configuration preset. The preset is expanded into its
+    * property settings when the plan is compiled.
+    */
+   void setConfig(const char* group, const char* preset);
+   void setProperty(const char* device, const char* property,
+         const char* value);
+
+   bool hasZPosition() const { return hasZ_; }
+   double getZPosition() const { return z_; }
+   bool hasXYPosition() const { return hasXY_; }
+   double getXPosition() const { return x_; }
+   double getYPosition() const { return y_; }
+   bool hasExposure() const { return hasExposure_; }
+   double getExposure() const { return exposureMs_; }
+
+   size_t getNumberOfConfigs() const { return configs_.size(); }
+   std::string getConfigGroup(size_t index) const throw (CMMError);
+   std::string getConfigPreset(size_t index) const throw (CMMError);
+
+   /**
+    * Returns the properties set directly with setProperty().
+    */
+   Configuration getProperties() const { return properties_; }
+
+   std::string getVerbose() const;
+
+private:
+   bool hasZ_;
+   double z_;
+   bool hasXY_;
+   double x_;
+   double y_;
+   bool hasExposure_;
+   double exposureMs_;
+   std::vector< std::pair<std::string, std::string> > configs_;
+   Configuration properties_;
+};
+
+
+/**
+ * Ordered list of frames to acquire. Designed to be wrapped by SWIG.
+ *
+ * CMMCore::compileAcquisitionPlan() splits the events into runs: stretches
+ * of consecutive events in which everything that changes from frame to frame
+ * can be sequenced by the hardware, and which fit the sequence length of
+ * every device involved. Each run is acquired as a single camera sequence,
+ * with the devices stepping through their loaded sequences on the camera's
+ * trigger. Runs of one event are executed by setting the state in software.
+ */
+class AcquisitionPlan
+{
+public:
+   AcquisitionPlan();
+
+   void addEvent(const AcquisitionEvent& event);
+   AcquisitionEvent getEvent(size_t index) const throw (CMMError);
+   size_t getNumberOfEvents() const { return events_.size(); }
+   void clear();
+
+   /**
+    * Returns true if the plan has been compiled since the last change.
+    */
+   bool isCompiled() const { return compiled_; }
+   size_t getNumberOfRuns() const throw (CMMError);
+   long getRunStart(size_t run) const throw (CMMError);
+   long getRunLength(size_t run) const throw (CMMError);
+   /**
+    * Returns what the hardware steps through during the run: "Z", "XY",
+    * "Exposure", or "<device>-<property>".
+    */
+   std::vector<std::string> getRunSequencedAxes(size_t run) const
+      throw (CMMError);
+   std::string getVerbose() const;
+
+private:
+   friend class mm::AcquisitionPlanRunner;
+
+   struct Run
+   {
+      long start;
+      long length;
+      std::vector<std::string> sequencedAxes;
+   };
+
+   const Run& GetRun(size_t run) const throw (CMMError);
+
+   std::vector<AcquisitionEvent> events_;
+   std::vector<Run> runs_;
+   bool compiled_;
+};
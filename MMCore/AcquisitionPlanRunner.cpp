@@ -0,0 +1,506 @@
+///////////////////////////////////////////////////////////////////////////////
+// FILE:          AcquisitionPlanRunner.cpp
+// PROJECT:       Micro-Manager
+// SUBSYSTEM:     MMCore
+//-----------------------------------------------------------------------------
+// DESCRIPTION:   Splits an acquisition plan into hardware-triggered runs and
+//                executes them
+//
+// LICENSE:       This file is distributed under the "Lesser GPL" (LGPL) license.
+//                License text is included with the source distribution.
+//
+//                This file is distributed in the hope that it will be useful,
+//                but WITHOUT ANY WARRANTY; without even the implied warranty
+//                of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+//
+//                IN NO EVENT SHALL THE COPYRIGHT OWNER OR
+//                CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+//                INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES.
+
+#include "AcquisitionPlanRunner.h"
+
+#include "ErrorCodes.h"
+#include "MMCore.h"
+
+#include "../MMDevice/DeviceUtils.h"
+
+#include <algorithm>
+#include <climits>
+#include <set>
+
+
+namespace mm {
+
+bool
+AcquisitionPlanRunner::Axis::operator<(const Axis& rhs) const
+{
+   if (kind != rhs.kind)
+      return kind < rhs.kind;
+   if (device != rhs.device)
+      return device < rhs.device;
+   return property < rhs.property;
+}
+
+
+std::string
+AcquisitionPlanRunner::Axis::GetName() const
+{
+   switch (kind)
+   {
+      case Focus: return "Z";
+      case XYStage: return "XY";
+      case Exposure: return "Exposure";
+      default:
+         return PropertySetting::generateKey(device.c_str(), property.c_str());
+   }
+}
+
+
+AcquisitionPlanRunner::AcquisitionPlanRunner(CMMCore& core,
+      logging::Logger logger) :
+   core_(core),
+   logger_(logger)
+{
+}
+
+
+void
+AcquisitionPlanRunner::Compile(AcquisitionPlan& plan) throw (CMMError)
+{
+   // Sequenceability may have changed since the last compilation (e.g.
+   // through a device property), so query it afresh
+   capabilities_.clear();
+   ResolveStates(plan);
+
+   plan.runs_.clear();
+   plan.compiled_ = false;
+
+   const long count = static_cast<long>(states_.size());
+   long hardwareRuns = 0;
+   long start = 0;
+   while (start < count)
+   {
+      const State& first = states_[start];
+      std::set<Axis> varying;
+      long maxLength = LONG_MAX;
+      long end = start + 1;
+      for (; end < count; ++end)
+      {
+         // Does adding this event introduce an axis that cannot be
+         // sequenced, or that limits the run to fewer events?
+         bool fits = true;
+         long newMaxLength = maxLength;
+         std::vector<Axis> newlyVarying;
+         const State& next = states_[end];
+         for (State::const_iterator it = next.begin(), itEnd = next.end();
+               it != itEnd; ++it)
+         {
+            if (varying.count(it->first))
+               continue;
+            State::const_iterator inFirst = first.find(it->first);
+            if (inFirst != first.end() && inFirst->second == it->second)
+               continue;
+            // An axis first set within the run has no value for the
+            // run's first frame
+            if (inFirst == first.end())
+            {
+               fits = false;
+               break;
+            }
+            const Capability& capability = GetCapability(it->first);
+            if (!capability.sequenceable)
+            {
+               fits = false;
+               break;
+            }
+            newMaxLength = std::min(newMaxLength, capability.maxLength);
+            newlyVarying.push_back(it->first);
+         }
+         if (!fits || end - start + 1 > newMaxLength)
+            break;
+         varying.insert(newlyVarying.begin(), newlyVarying.end());
+         maxLength = newMaxLength;
+      }
+
+      AcquisitionPlan::Run run;
+      run.start = start;
+      run.length = end - start;
+      for (std::set<Axis>::const_iterator it = varying.begin(),
+            itEnd = varying.end(); it != itEnd; ++it)
+         run.sequencedAxes.push_back(it->GetName());
+      plan.runs_.push_back(run);
+      if (run.length > 1)
+         ++hardwareRuns;
+      start = end;
+   }
+   plan.compiled_ = true;
+
+   LOG_INFO(logger_) << "Compiled acquisition plan: " << count <<
+      " events in " << plan.runs_.size() << " runs (" << hardwareRuns <<
+      " hardware-timed)";
+}
+
+
+void
+AcquisitionPlanRunner::Run(AcquisitionPlan& plan,
+      const volatile bool& stopRequested) throw (CMMError)
+{
+   if (plan.isCompiled())
+      ResolveStates(plan);
+   else
+      Compile(plan);
+
+   if (cameraDevice_.empty())
+      throw CMMError("Acquisition plan requires a camera",
+            MMERR_CameraNotAvailable);
+
+   // Frames of all runs accumulate in the buffer; only clear it once
+   core_.initializeCircularBuffer();
+
+   State applied;
+   for (std::vector<AcquisitionPlan::Run>::const_iterator it =
+         plan.runs_.begin(), end = plan.runs_.end(); it != end; ++it)
+   {
+      if (stopRequested)
+      {
+         LOG_INFO(logger_) << "Acquisition plan stopped before event " <<
+            it->start;
+         return;
+      }
+      ExecuteRun(it->start, it->length, applied, stopRequested);
+   }
+   LOG_INFO(logger_) << "Acquisition plan finished";
+}
+
+
+void
+AcquisitionPlanRunner::ResolveStates(const AcquisitionPlan& plan)
+   throw (CMMError)
+{
+   focusDevice_ = core_.getFocusDevice();
+   xyStageDevice_ = core_.getXYStageDevice();
+   cameraDevice_ = core_.getCameraDevice();
+
+   states_.clear();
+   states_.reserve(plan.events_.size());
+   State state;
+   for (std::vector<AcquisitionEvent>::const_iterator it =
+         plan.events_.begin(), end = plan.events_.end(); it != end; ++it)
+   {
+      Axis axis;
+      Value value;
+      value.x = value.y = 0.0;
+
+      if (it->hasZPosition())
+      {
+         if (focusDevice_.empty())
+            throw CMMError("Acquisition plan sets a Z position but no "
+                  "focus device is selected", MMERR_InvalidStageDevice);
+         axis.kind = Axis::Focus;
+         axis.device = focusDevice_;
+         value.x = it->getZPosition();
+         state[axis] = value;
+      }
+      if (it->hasXYPosition())
+      {
+         if (xyStageDevice_.empty())
+            throw CMMError("Acquisition plan sets an XY position but no "
+                  "XY stage is selected", MMERR_InvalidXYStageDevice);
+         axis.kind = Axis::XYStage;
+         axis.device = xyStageDevice_;
+         value.x = it->getXPosition();
+         value.y = it->getYPosition();
+         state[axis] = value;
+      }
+      if (it->hasExposure())
+      {
+         if (cameraDevice_.empty())
+            throw CMMError("Acquisition plan sets an exposure but no "
+                  "camera is selected", MMERR_CameraNotAvailable);
+         axis.kind = Axis::Exposure;
+         axis.device = cameraDevice_;
+         value.x = it->getExposure();
+         value.y = 0.0;
+         state[axis] = value;
+      }
+
+      // Presets first, so that properties set explicitly take precedence
+      std::vector<Configuration> settings;
+      for (size_t i = 0; i < it->getNumberOfConfigs(); ++i)
+         settings.push_back(core_.getConfigData(
+                  it->getConfigGroup(i).c_str(),
+                  it->getConfigPreset(i).c_str()));
+      settings.push_back(it->getProperties());
+      axis.kind = Axis::Property;
+      value.x = value.y = 0.0;
+      for (std::vector<Configuration>::const_iterator cfg = settings.begin(),
+            cfgEnd = settings.end(); cfg != cfgEnd; ++cfg)
+      {
+         for (size_t i = 0; i < cfg->size(); ++i)
+         {
+            PropertySetting setting = cfg->getSetting(i);
+            axis.device = setting.getDeviceLabel();
+            axis.property = setting.getPropertyName();
+            value.text = setting.getPropertyValue();
+            state[axis] = value;
+         }
+      }
+
+      states_.push_back(state);
+   }
+}
+
+
+std::vector<AcquisitionPlanRunner::Axis>
+AcquisitionPlanRunner::GetVaryingAxes(long start, long length) const
+{
+   std::vector<Axis> varying;
+   const State& first = states_[start];
+   for (State::const_iterator it = first.begin(), end = first.end();
+         it != end; ++it)
+   {
+      for (long i = start + 1; i < start + length; ++i)
+      {
+         if (states_[i].find(it->first)->second != it->second)
+         {
+            varying.push_back(it->first);
+            break;
+         }
+      }
+   }
+   return varying;
+}
+
+
+const AcquisitionPlanRunner::Capability&
+AcquisitionPlanRunner::GetCapability(const Axis& axis) throw (CMMError)
+{
+   std::map<Axis, Capability>::iterator found = capabilities_.find(axis);
+   if (found != capabilities_.end())
+      return found->second;
+
+   const char* device = axis.device.c_str();
+   Capability capability;
+   capability.maxLength = 0;
+   switch (axis.kind)
+   {
+      case Axis::Focus:
+         capability.sequenceable = core_.isStageSequenceable(device);
+         if (capability.sequenceable)
+         {
+            // A streamed sequence is not limited by the stage's memory
+            if (core_.isStageSequenceStreamable(device))
+               capability.maxLength = LONG_MAX;
+            else
+               capability.maxLength = core_.getStageSequenceMaxLength(device);
+         }
+         break;
+      case Axis::XYStage:
+         capability.sequenceable = core_.isXYStageSequenceable(device);
+         if (capability.sequenceable)
+            capability.maxLength = core_.getXYStageSequenceMaxLength(device);
+         break;
+      case Axis::Exposure:
+         capability.sequenceable = core_.isExposureSequenceable(device);
+         if (capability.sequenceable)
+            capability.maxLength = core_.getExposureSequenceMaxLength(device);
+         break;
+      case Axis::Property:
+         capability.sequenceable = core_.isPropertySequenceable(device,
+               axis.property.c_str());
+         if (capability.sequenceable)
+            capability.maxLength = core_.getPropertySequenceMaxLength(device,
+                  axis.property.c_str());
+         break;
+   }
+   LOG_DEBUG(logger_) << "Acquisition plan axis " << axis.GetName() <<
+      (capability.sequenceable ? " is sequenceable, max length " :
+       " is not sequenceable") <<
+      (capability.sequenceable ?
+       CDeviceUtils::ConvertToString(capability.maxLength) : "");
+   return capabilities_[axis] = capability;
+}
+
+
+void
+AcquisitionPlanRunner::ExecuteRun(long start, long length, State& applied,
+      const volatile bool& stopRequested) throw (CMMError)
+{
+   // Set in software whatever differs from the previous run's end state,
+   // including the first value of each sequenced axis
+   const State& first = states_[start];
+   std::vector<std::string> changedDevices;
+   for (State::const_iterator it = first.begin(), end = first.end();
+         it != end; ++it)
+   {
+      State::iterator previous = applied.find(it->first);
+      if (previous != applied.end() && previous->second == it->second)
+         continue;
+      Apply(it->first, it->second);
+      applied[it->first] = it->second;
+      changedDevices.push_back(it->first.device);
+   }
+   std::sort(changedDevices.begin(), changedDevices.end());
+   changedDevices.erase(std::unique(changedDevices.begin(),
+            changedDevices.end()), changedDevices.end());
+   for (std::vector<std::string>::const_iterator it = changedDevices.begin(),
+         end = changedDevices.end(); it != end; ++it)
+      core_.waitForDevice(it->c_str());
+
+   std::vector<Axis> sequenced;
+   if (length > 1)
+      sequenced = GetVaryingAxes(start, length);
+   for (std::vector<Axis>::const_iterator it = sequenced.begin(),
+         end = sequenced.end(); it != end; ++it)
+      LoadSequence(*it, start, length);
+
+   LOG_DEBUG(logger_) << "Acquisition plan run of " << length <<
+      " events from event " << start << ", " << sequenced.size() <<
+      " sequenced axes";
+
+   size_t started = 0;
+   try
+   {
+      for (; started < sequenced.size(); ++started)
+         StartSequence(sequenced[started]);
+
+      core_.startSequenceAcquisition(cameraDevice_.c_str(), length, 0.0,
+            true);
+      while (core_.isSequenceRunning(cameraDevice_.c_str()))
+      {
+         if (stopRequested)
+         {
+            core_.stopSequenceAcquisition(cameraDevice_.c_str());
+            break;
+         }
+         CDeviceUtils::SleepMs(1);
+      }
+   }
+   catch (const CMMError&)
+   {
+      for (size_t i = 0; i < started; ++i)
+      {
+         try
+         {
+            StopSequence(sequenced[i]);
+         }
+         catch (const CMMError& e)
+         {
+            LOG_ERROR(logger_) << "Failed to stop sequence of " <<
+               sequenced[i].GetName() << ": " << e.getMsg();
+         }
+      }
+      throw;
+   }
+
+   const State& last = states_[start + length - 1];
+   for (std::vector<Axis>::const_iterator it = sequenced.begin(),
+         end = sequenced.end(); it != end; ++it)
+   {
+      StopSequence(*it);
+      applied[*it] = last.find(*it)->second;
+   }
+}
+
+
+void
+AcquisitionPlanRunner::Apply(const Axis& axis, const Value& value)
+   throw (CMMError)
+{
+   const char* device = axis.device.c_str();
+   switch (axis.kind)
+   {
+      case Axis::Focus:
+         core_.setPosition(device, value.x);
+         break;
+      case Axis::XYStage:
+         core_.setXYPosition(device, value.x, value.y);
+         break;
+      case Axis::Exposure:
+         core_.setExposure(device, value.x);
+         break;
+      case Axis::Property:
+         core_.setProperty(device, axis.property.c_str(), value.text.c_str());
+         break;
+   }
+}
+
+
+void
+AcquisitionPlanRunner::LoadSequence(const Axis& axis, long start, long length)
+   throw (CMMError)
+{
+   std::vector<double> xs;
+   std::vector<double> ys;
+   std::vector<std::string> texts;
+   for (long i = start; i < start + length; ++i)
+   {
+      const Value& value = states_[i].find(axis)->second;
+      xs.push_back(value.x);
+      ys.push_back(value.y);
+      texts.push_back(value.text);
+   }
+
+   const char* device = axis.device.c_str();
+   switch (axis.kind)
+   {
+      case Axis::Focus:
+         core_.loadStageSequence(device, xs);
+         break;
+      case Axis::XYStage:
+         core_.loadXYStageSequence(device, xs, ys);
+         break;
+      case Axis::Exposure:
+         core_.loadExposureSequence(device, xs);
+         break;
+      case Axis::Property:
+         core_.loadPropertySequence(device, axis.property.c_str(), texts);
+         break;
+   }
+}
+
+
+void
+AcquisitionPlanRunner::StartSequence(const Axis& axis) throw (CMMError)
+{
+   const char* device = axis.device.c_str();
+   switch (axis.kind)
+   {
+      case Axis::Focus:
+         core_.startStageSequence(device);
+         break;
+      case Axis::XYStage:
+         core_.startXYStageSequence(device);
+         break;
+      case Axis::Exposure:
+         core_.startExposureSequence(device);
+         break;
+      case Axis::Property:
+         core_.startPropertySequence(device, axis.property.c_str());
+         break;
+   }
+}
+
+
+void
+AcquisitionPlanRunner::StopSequence(const Axis& axis) throw (CMMError)
+{
+   const char* device = axis.device.c_str();
+   switch (axis.kind)
+   {
+      case Axis::Focus:
+         core_.stopStageSequence(device);
+         break;
+      case Axis::XYStage:
+         core_.stopXYStageSequence(device);
+         break;
+      case Axis::Exposure:
+         core_.stopExposureSequence(device);
+         break;
+      case Axis::Property:
+         core_.stopPropertySequence(device, axis.property.c_str());
+         break;
+   }
+}
+
+} // namespace mm
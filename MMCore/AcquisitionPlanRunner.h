@@ -0,0 +1,107 @@
+///////////////////////////////////////////////////////////////////////////////
+// FILE:          AcquisitionPlanRunner.h
+// PROJECT:       Micro-Manager
+// SUBSYSTEM:     MMCore
+//-----------------------------------------------------------------------------
+// DESCRIPTION:   Splits an acquisition plan into hardware-triggered runs and
+//                executes them
+//
+// LICENSE:       This file is distributed under the "Lesser GPL" (LGPL) license.
+//                License text is included with the source distribution.
+//
+//                This file is distributed in the hope that it will be useful,
+//                but WITHOUT ANY WARRANTY; without even the implied warranty
+//                of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+//
+//                IN NO EVENT SHALL THE COPYRIGHT OWNER OR
+//                CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+//                INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES.
+
+#pragma once
+
+#include "AcquisitionPlan.h"
+#include "Error.h"
+#include "Logging/Logger.h"
+
+#include <map>
+#include <string>
+#include <vector>
+
+class CMMCore;
+
+namespace mm {
+
+/**
+ * \brief Compiles and executes an AcquisitionPlan through the public API of
+ * the core
+ *
+ * The state of each event is resolved into axes: the focus position, the XY
+ * position, the camera exposure, and each device property (configuration
+ * presets are expanded into their properties). A run is extended one event
+ * at a time for as long as every axis that changes within it is sequenceable
+ * and the run fits the sequence length of each of those axes.
+ */
+class AcquisitionPlanRunner /* final */
+{
+public:
+   AcquisitionPlanRunner(CMMCore& core, logging::Logger logger);
+
+   void Compile(AcquisitionPlan& plan) throw (CMMError);
+   // Acquires all frames of the plan into the circular buffer, compiling the
+   // plan first if needed. Returns early, after stopping the current run, if
+   // stopRequested becomes true.
+   void Run(AcquisitionPlan& plan, const volatile bool& stopRequested)
+      throw (CMMError);
+
+private:
+   struct Axis
+   {
+      enum Kind { Focus, XYStage, Exposure, Property };
+      Kind kind;
+      std::string device;
+      std::string property;
+
+      bool operator<(const Axis& rhs) const;
+      std::string GetName() const;
+   };
+
+   struct Value
+   {
+      std::string text;
+      double x;
+      double y;
+
+      bool operator==(const Value& rhs) const
+      { return text == rhs.text && x == rhs.x && y == rhs.y; }
+      bool operator!=(const Value& rhs) const { return !(*this == rhs); }
+   };
+
+   typedef std::map<Axis, Value> State;
+
+   struct Capability
+   {
+      bool sequenceable;
+      long maxLength;
+   };
+
+   void ResolveStates(const AcquisitionPlan& plan) throw (CMMError);
+   std::vector<Axis> GetVaryingAxes(long start, long length) const;
+   const Capability& GetCapability(const Axis& axis) throw (CMMError);
+   void ExecuteRun(long start, long length, State& applied,
+         const volatile bool& stopRequested) throw (CMMError);
+   void Apply(const Axis& axis, const Value& value) throw (CMMError);
+   void LoadSequence(const Axis& axis, long start, long length)
+      throw (CMMError);
+   void StartSequence(const Axis& axis) throw (CMMError);
+   void StopSequence(const Axis& axis) throw (CMMError);
+
+   CMMCore& core_;
+   logging::Logger logger_;
+   std::string focusDevice_;
+   std::string xyStageDevice_;
+   std::string cameraDevice_;
+   std::vector<State> states_;
+   std::map<Axis, Capability> capabilities_;
+};
+
+} // namespace mm
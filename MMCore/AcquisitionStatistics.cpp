@@ -0,0 +1,418 @@
+///////////////////////////////////////////////////////////////////////////////
+// FILE:          AcquisitionStatistics.cpp
+// PROJECT:       Micro-Manager
+// SUBSYSTEM:     MMCore
+//-----------------------------------------------------------------------------
+// DESCRIPTION:   Per-stage latency histograms for the image insertion path
+//
+// LICENSE:       This file is distributed under the "Lesser GPL" (LGPL) license.
+//                License text is included with the source distribution.
+//
+//                This file is distributed in the hope that it will be useful,
+//                but WITHOUT ANY WARRANTY; without even the implied warranty
+//                of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+//
+//                IN NO EVENT SHALL THE COPYRIGHT OWNER OR
+//                CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+//                INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES.
+
+#include "AcquisitionStatistics.h"
+
+#include "Logging/Metadata.h"
+
+#include "../MMDevice/DeviceUtils.h"
+
+#include <algorithm>
+#include <fstream>
+#include <iomanip>
+#include <sstream>
+
+#ifdef _WIN32
+#include <windows.h>
+#endif
+
+
+namespace mm {
+
+namespace {
+
+// The counters are updated from camera threads while the application reads
+// them, so they are modified with the compiler's atomic intrinsics (the core
+// is built as C++03 and cannot rely on std::atomic or on Boost.Atomic being
+// available).
+#ifdef _WIN32
+
+inline long long AtomicAdd(volatile long long* target, long long value)
+{ return ::InterlockedExchangeAdd64(target, value); }
+
+inline long long AtomicCompareExchange(volatile long long* target,
+      long long expected, long long desired)
+{ return ::InterlockedCompareExchange64(target, desired, expected); }
+
+#else
+
+inline long long AtomicAdd(volatile long long* target, long long value)
+{ return __sync_fetch_and_add(target, value); }
+
+inline long long AtomicCompareExchange(volatile long long* target,
+      long long expected, long long desired)
+{ return __sync_val_compare_and_swap(target, expected, desired); }
+
+#endif
+
+inline long long AtomicLoad(const volatile long long* target)
+{ return AtomicAdd(const_cast<volatile long long*>(target), 0); }
+
+inline void AtomicStore(volatile long long* target, long long value)
+{
+   long long current = AtomicLoad(target);
+   for (;;)
+   {
+      long long previous = AtomicCompareExchange(target, current, value);
+      if (previous == current)
+         return;
+      current = previous;
+   }
+}
+
+inline void AtomicMax(volatile long long* target, long long value)
+{
+   long long current = AtomicLoad(target);
+   while (value > current)
+   {
+      long long previous = AtomicCompareExchange(target, current, value);
+      if (previous == current)
+         return;
+      current = previous;
+   }
+}
+
+int BucketIndex(long long us)
+{
+   int bucket = 0;
+   while (us > 0 && bucket < LatencyHistogram::BucketCount - 1)
+   {
+      us >>= 1;
+      ++bucket;
+   }
+   return bucket;
+}
+
+unsigned long long CurrentThreadId()
+{
+   // pthread_t is an integer on the platforms we support
+   return (unsigned long long)(logging::internal::GetTid());
+}
+
+} // anonymous namespace
+
+
+long long
+LatencyHistogram::Snapshot::PercentileUs(double percent) const
+{
+   if (count == 0)
+      return 0;
+   long long rank = (long long)(percent / 100.0 * count + 0.5);
+   if (rank < 1)
+      rank = 1;
+   long long seen = 0;
+   for (int i = 0; i < BucketCount; ++i)
+   {
+      seen += buckets[i];
+      if (seen >= rank)
+         return std::min(BucketUpperBoundUs(i), maxUs);
+   }
+   return maxUs;
+}
+
+
+void
+LatencyHistogram::Record(long long us)
+{
+   if (us < 0)
+      us = 0;
+   AtomicAdd(&buckets_[BucketIndex(us)], 1);
+   AtomicAdd(&sumUs_, us);
+   AtomicMax(&maxUs_, us);
+}
+
+
+void
+LatencyHistogram::Reset()
+{
+   for (int i = 0; i < BucketCount; ++i)
+      AtomicStore(&buckets_[i], 0);
+   AtomicStore(&sumUs_, 0);
+   AtomicStore(&maxUs_, 0);
+}
+
+
+LatencyHistogram::Snapshot
+LatencyHistogram::GetSnapshot() const
+{
+   // Not a consistent snapshot while frames are being recorded, but each
+   // field is read atomically
+   Snapshot s;
+   s.count = 0;
+   for (int i = 0; i < BucketCount; ++i)
+   {
+      s.buckets[i] = AtomicLoad(&buckets_[i]);
+      s.count += s.buckets[i];
+   }
+   s.sumUs = AtomicLoad(&sumUs_);
+   s.maxUs = AtomicLoad(&maxUs_);
+   return s;
+}
+
+
+long long
+LatencyHistogram::BucketUpperBoundUs(int bucket)
+{
+   return (1LL << bucket) - 1;
+}
+
+
+AcquisitionStatistics::AcquisitionStatistics() :
+   inserted_(0),
+   refused_(0),
+   popped_(0),
+   lastArrivalUs_(0),
+   tracing_(0),
+   maxTraceEvents_(0),
+   traceStartUs_(0)
+{
+}
+
+
+const char*
+AcquisitionStatistics::GetStageName(Stage stage)
+{
+   switch (stage)
+   {
+      case StageInterval: return "Interval";
+      case StageMetadata: return "Metadata";
+      case StageProcess: return "Process";
+      case StageBufferWait: return "BufferWait";
+      case StageBufferMetadata: return "BufferMetadata";
+      case StageCopy: return "Copy";
+      case StageInsert: return "Insert";
+      case StageQueue: return "Queue";
+      default: return "Unknown";
+   }
+}
+
+
+void
+AcquisitionStatistics::Record(Stage stage, long long startUs,
+      long long durationUs, long long frameId)
+{
+   histograms_[stage].Record(durationUs);
+   if (AtomicLoad(&tracing_))
+      AddTraceEvent(stage, startUs, durationUs, frameId);
+}
+
+
+void
+AcquisitionStatistics::RecordArrival(long long nowUs)
+{
+   long long previous = AtomicLoad(&lastArrivalUs_);
+   for (;;)
+   {
+      long long seen = AtomicCompareExchange(&lastArrivalUs_, previous, nowUs);
+      if (seen == previous)
+         break;
+      previous = seen;
+   }
+   if (previous != 0)
+      histograms_[StageInterval].Record(nowUs - previous);
+}
+
+
+void
+AcquisitionStatistics::CountInserted()
+{
+   AtomicAdd(&inserted_, 1);
+}
+
+
+void
+AcquisitionStatistics::CountRefused()
+{
+   AtomicAdd(&refused_, 1);
+}
+
+
+void
+AcquisitionStatistics::CountPopped()
+{
+   AtomicAdd(&popped_, 1);
+}
+
+
+void
+AcquisitionStatistics::Reset()
+{
+   for (int i = 0; i < StageCount; ++i)
+      histograms_[i].Reset();
+   AtomicStore(&inserted_, 0);
+   AtomicStore(&refused_, 0);
+   AtomicStore(&popped_, 0);
+   AtomicStore(&lastArrivalUs_, 0);
+}
+
+
+LatencyHistogram::Snapshot
+AcquisitionStatistics::GetSnapshot(Stage stage) const
+{
+   return histograms_[stage].GetSnapshot();
+}
+
+
+long long
+AcquisitionStatistics::GetInsertedCount() const
+{
+   return AtomicLoad(&inserted_);
+}
+
+
+long long
+AcquisitionStatistics::GetRefusedCount() const
+{
+   return AtomicLoad(&refused_);
+}
+
+
+long long
+AcquisitionStatistics::GetPoppedCount() const
+{
+   return AtomicLoad(&popped_);
+}
+
+
+std::string
+AcquisitionStatistics::Format(long long droppedInBuffer) const
+{
+   std::ostringstream out;
+   out << "frames\tinserted=" << GetInsertedCount() <<
+      "\trefused=" << GetRefusedCount() <<
+      "\tdropped=" << droppedInBuffer <<
+      "\tpopped=" << GetPoppedCount() << '\n';
+   out << "stage\tcount\tmean_us\tp50_us\tp90_us\tp99_us\tmax_us\t"
+      "histogram(<1us,<2us,<4us,...)\n";
+   out << std::fixed << std::setprecision(1);
+   for (int i = 0; i < StageCount; ++i)
+   {
+      LatencyHistogram::Snapshot s = histograms_[i].GetSnapshot();
+      out << GetStageName(Stage(i)) << '\t' << s.count << '\t' <<
+         (s.count ? double(s.sumUs) / s.count : 0.0) << '\t' <<
+         s.PercentileUs(50.0) << '\t' <<
+         s.PercentileUs(90.0) << '\t' <<
+         s.PercentileUs(99.0) << '\t' <<
+         s.maxUs << '\t';
+      // Omit the empty tail of the histogram
+      int last = LatencyHistogram::BucketCount - 1;
+      while (last > 0 && s.buckets[last] == 0)
+         --last;
+      for (int b = 0; b <= last; ++b)
+         out << (b ? "," : "") << s.buckets[b];
+      out << '\n';
+   }
+   return out.str();
+}
+
+
+void
+AcquisitionStatistics::StartTrace(size_t maxEvents)
+{
+   boost::mutex::scoped_lock lock(traceMutex_);
+   trace_.clear();
+   trace_.reserve(maxEvents);
+   maxTraceEvents_ = maxEvents;
+   traceStartUs_ = CDeviceUtils::GetMonotonicTimeUs();
+   AtomicStore(&tracing_, 1);
+}
+
+
+bool
+AcquisitionStatistics::IsTracing() const
+{
+   return AtomicLoad(&tracing_) != 0;
+}
+
+
+void
+AcquisitionStatistics::AddTraceEvent(Stage stage, long long startUs,
+      long long durationUs, long long frameId)
+{
+   boost::mutex::scoped_lock lock(traceMutex_);
+   if (trace_.size() >= maxTraceEvents_)
+   {
+      // Keep the beginning of the acquisition and stop paying for the lock
+      AtomicStore(&tracing_, 0);
+      return;
+   }
+   TraceEvent e;
+   e.stage = stage;
+   e.startUs = startUs;
+   e.durationUs = durationUs;
+   e.frameId = frameId;
+   e.threadId = CurrentThreadId();
+   trace_.push_back(e);
+}
+
+
+bool
+AcquisitionStatistics::SaveTrace(const std::string& filename)
+{
+   AtomicStore(&tracing_, 0);
+
+   std::vector<TraceEvent> events;
+   long long originUs;
+   {
+      boost::mutex::scoped_lock lock(traceMutex_);
+      events.swap(trace_);
+      originUs = traceStartUs_;
+   }
+
+   std::ofstream out(filename.c_str());
+   if (!out)
+      return false;
+
+   // Chrome trace event format. Stages are complete ("X") events on the
+   // thread that recorded them; the time a frame spends in the buffer is an
+   // async ("b"/"e") pair keyed by the frame's buffer index, since it is
+   // entered and left on different threads.
+   out << "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n";
+   out << "{\"name\":\"process_name\",\"ph\":\"M\",\"pid\":1,\"tid\":0,"
+      "\"args\":{\"name\":\"MMCore\"}}";
+   for (std::vector<TraceEvent>::const_iterator it = events.begin(),
+         end = events.end(); it != end; ++it)
+   {
+      const char* name = GetStageName(it->stage);
+      long long ts = it->startUs - originUs;
+      out << ",\n";
+      if (it->stage == StageQueue)
+      {
+         out << "{\"name\":\"" << name << "\",\"cat\":\"frame\","
+            "\"ph\":\"b\",\"id\":" << it->frameId << ",\"pid\":1,\"tid\":" <<
+            it->threadId << ",\"ts\":" << ts << "},\n";
+         out << "{\"name\":\"" << name << "\",\"cat\":\"frame\","
+            "\"ph\":\"e\",\"id\":" << it->frameId << ",\"pid\":1,\"tid\":" <<
+            it->threadId << ",\"ts\":" << ts + it->durationUs << "}";
+      }
+      else
+      {
+         out << "{\"name\":\"" << name << "\",\"cat\":\"insert\","
+            "\"ph\":\"X\",\"pid\":1,\"tid\":" << it->threadId <<
+            ",\"ts\":" << ts << ",\"dur\":" << it->durationUs;
+         if (it->frameId >= 0)
+            out << ",\"args\":{\"frame\":" << it->frameId << "}";
+         out << "}";
+      }
+   }
+   out << "\n]}\n";
+   out.close();
+   return !out.fail();
+}
+
+} // namespace mm
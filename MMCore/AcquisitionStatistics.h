@@ -0,0 +1,149 @@
+///////////////////////////////////////////////////////////////////////////////
+// FILE:          AcquisitionStatistics.h
+// PROJECT:       Micro-Manager
+// SUBSYSTEM:     MMCore
+//-----------------------------------------------------------------------------
+// DESCRIPTION:   Per-stage latency histograms for the image insertion path
+//
+// LICENSE:       This file is distributed under the "Lesser GPL" (LGPL) license.
+//                License text is included with the source distribution.
+//
+//                This file is distributed in the hope that it will be useful,
+//                but WITHOUT ANY WARRANTY; without even the implied warranty
+//                of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+//
+//                IN NO EVENT SHALL THE COPYRIGHT OWNER OR
+//                CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+//                INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES.
+
+#pragma once
+
+#include <boost/thread/mutex.hpp>
+
+#include <string>
+#include <vector>
+
+namespace mm {
+
+/**
+ * \brief Histogram of durations with power-of-two microsecond buckets
+ *
+ * Bucket 0 counts durations under 1 us; bucket i counts [2^(i-1), 2^i) us;
+ * the last bucket also counts everything longer. Record() uses atomic
+ * operations only, so it can be called from any thread without locking.
+ */
+class LatencyHistogram
+{
+public:
+   enum { BucketCount = 32 };
+
+   struct Snapshot
+   {
+      long long count;
+      long long sumUs;
+      long long maxUs;
+      long long buckets[BucketCount];
+
+      // Upper bound of the bucket containing the given percentile
+      long long PercentileUs(double percent) const;
+   };
+
+   LatencyHistogram() { Reset(); }
+
+   void Record(long long us);
+   void Reset();
+   Snapshot GetSnapshot() const;
+
+   static long long BucketUpperBoundUs(int bucket);
+
+private:
+   volatile long long sumUs_;
+   volatile long long maxUs_;
+   volatile long long buckets_[BucketCount];
+};
+
+
+/**
+ * \brief Where the time goes between a camera inserting a frame and the
+ * application popping it
+ *
+ * The statistics are always collected; recording a stage costs a few atomic
+ * increments. Optionally, each recorded stage is also kept as an event for a
+ * trace in the Chrome trace event format (chrome://tracing, Perfetto).
+ */
+class AcquisitionStatistics /* final */
+{
+public:
+   enum Stage
+   {
+      StageInterval, // Between successive frames (from any camera)
+      StageMetadata, // Camera metadata in the core callback
+      StageProcess, // Image processor and frame accumulation, if any
+      StageBufferWait, // Waiting for the buffer insert lock or for space
+      StageBufferMetadata, // Metadata assembly in the circular buffer
+      StageCopy, // Copying the pixels into the circular buffer
+      StageInsert, // The whole insert call, from the camera's point of view
+      StageQueue, // From insertion to the application popping the frame
+      StageCount
+   };
+
+   AcquisitionStatistics();
+
+   static const char* GetStageName(Stage stage);
+
+   // frameId identifies the frame in the trace (-1 if not known); for
+   // StageQueue it must be the same as that passed to the matching insert.
+   void Record(Stage stage, long long startUs, long long durationUs,
+         long long frameId = -1);
+   // Records StageInterval since the previous arrival
+   void RecordArrival(long long nowUs);
+   void CountInserted();
+   void CountRefused();
+   void CountPopped();
+
+   void Reset();
+   LatencyHistogram::Snapshot GetSnapshot(Stage stage) const;
+   long long GetInsertedCount() const;
+   long long GetRefusedCount() const;
+   long long GetPoppedCount() const;
+
+   // One line of counters, then one tab-separated line per stage with
+   // count, mean, percentiles, max and the histogram bucket counts
+   std::string Format(long long droppedInBuffer) const;
+
+   void StartTrace(size_t maxEvents);
+   bool IsTracing() const;
+   // Stops tracing and writes the events as a Chrome trace JSON file;
+   // returns false if the file could not be written
+   bool SaveTrace(const std::string& filename);
+
+private:
+   AcquisitionStatistics(const AcquisitionStatistics&);
+   AcquisitionStatistics& operator=(const AcquisitionStatistics&);
+
+   struct TraceEvent
+   {
+      Stage stage;
+      long long startUs;
+      long long durationUs;
+      long long frameId;
+      unsigned long long threadId;
+   };
+
+   void AddTraceEvent(Stage stage, long long startUs, long long durationUs,
+         long long frameId);
+
+   LatencyHistogram histograms_[StageCount];
+   volatile long long inserted_;
+   volatile long long refused_;
+   volatile long long popped_;
+   volatile long long lastArrivalUs_;
+
+   volatile long long tracing_;
+   boost::mutex traceMutex_;
+   std::vector<TraceEvent> trace_;
+   size_t maxTraceEvents_;
+   long long traceStartUs_;
+};
+
+} // namespace mm
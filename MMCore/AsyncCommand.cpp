@@ -0,0 +1,57 @@
+///////////////////////////////////////////////////////////////////////////////
+// FILE:          AsyncCommand.cpp
+// PROJECT:       Micro-Manager
+// SUBSYSTEM:     MMCore
+//-----------------------------------------------------------------------------
+// DESCRIPTION:   Completion handle for device commands executed in the
+//                background
+//
+// LICENSE:       This file is distributed under the "Lesser GPL" (LGPL) license.
+//                License text is included with the source distribution.
+//
+//                This file is distributed in the hope that it will be useful,
+//                but WITHOUT ANY WARRANTY; without even the implied warranty
+//                of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+//
+//                IN NO EVENT SHALL THE COPYRIGHT OWNER OR
+//                CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+//                INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES.
+
+#include "AsyncCommand.h"
+
+#include "DeviceCommandExecutor.h"
+
+
+AsyncCommand::AsyncCommand()
+{
+}
+
+AsyncCommand::AsyncCommand(boost::shared_ptr<mm::AsyncCommandState> state) :
+   state_(state)
+{
+}
+
+std::string AsyncCommand::getDescription() const
+{
+   if (!state_)
+      return std::string();
+   return state_->GetDescription();
+}
+
+bool AsyncCommand::isDone() const
+{
+   return !state_ || state_->IsDone();
+}
+
+void AsyncCommand::waitForCompletion() const throw (CMMError)
+{
+   if (state_)
+      state_->Wait(-1);
+}
+
+bool AsyncCommand::waitForCompletion(long timeoutMs) const throw (CMMError)
+{
+   if (!state_)
+      return true;
+   return state_->Wait(timeoutMs < 0 ? 0 : timeoutMs);
+}
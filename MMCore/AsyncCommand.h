@@ -0,0 +1,73 @@
+///////////////////////////////////////////////////////////////////////////////
+// FILE:          AsyncCommand.h
+// PROJECT:       Micro-Manager
+// SUBSYSTEM:     MMCore
+//-----------------------------------------------------------------------------
+// DESCRIPTION:   Completion handle for device commands executed in the
+//                background
+//
+// LICENSE:       This file is distributed under the "Lesser GPL" (LGPL) license.
+//                License text is included with the source distribution.
+//
+//                This file is distributed in the hope that it will be useful,
+//                but WITHOUT ANY WARRANTY; without even the implied warranty
+//                of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+//
+//                IN NO EVENT SHALL THE COPYRIGHT OWNER OR
+//                CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+//                INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES.
+
+#pragma once
+
+#ifdef WIN32
+// disable exception scpecification warnings in MSVC
+#pragma warning( disable : 4290 )
+#endif
+
+#include "Error.h"
+
+#include <boost/shared_ptr.hpp>
+
+#include <string>
+
+namespace mm {
+   class AsyncCommandState;
+   class DeviceCommandExecutor;
+}
+
+
+/**
+ * Completion handle for a command queued by one of the asynchronous CMMCore
+ * methods, such as CMMCore::setXYPositionAsync(). Designed to be wrapped by
+ * SWIG.
+ *
+ * The command is done once the device has finished the action (for example,
+ * when a stage has stopped moving), or when it has failed. Copies of a handle
+ * refer to the same command. A default-constructed handle refers to no
+ * command and is always done.
+ */
+class AsyncCommand
+{
+public:
+   AsyncCommand();
+
+   std::string getDescription() const;
+   bool isDone() const;
+   /**
+    * Waits for the command to finish, and throws the error it failed with,
+    * if any.
+    */
+   void waitForCompletion() const throw (CMMError);
+   /**
+    * Like waitForCompletion(), but returns false if the command has not
+    * finished within timeoutMs.
+    */
+   bool waitForCompletion(long timeoutMs) const throw (CMMError);
+
+private:
+   friend class mm::DeviceCommandExecutor;
+
+   explicit AsyncCommand(boost::shared_ptr<mm::AsyncCommandState> state);
+
+   boost::shared_ptr<mm::AsyncCommandState> state_;
+};
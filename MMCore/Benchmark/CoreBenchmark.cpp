@@ -0,0 +1,743 @@
+///////////////////////////////////////////////////////////////////////////////
+// FILE:          CoreBenchmark.cpp
+// PROJECT:       Micro-Manager
+// SUBSYSTEM:     MMCore
+//-----------------------------------------------------------------------------
+// DESCRIPTION:   Performance benchmarks for the frame path, configuration
+//                presets, system state and configuration loading.
+//
+//                Usage: mmcorebench [--quick] [--adapters <dir>]...
+//                          [--workdir <dir>] [benchmark...]
+//
+//                Benchmarks: buffer, sequence, setconfig, systemstate,
+//                configload (default: all). The DemoCamera and Utilities
+//                adapters (and SequenceTester, if present) are loaded from
+//                the --adapters directories (default: current directory).
+//
+//                Each result is one line of three tab-separated fields:
+//                benchmark name, parameters, and space-separated
+//                name=value metrics. Times are in microseconds unless the
+//                name says otherwise; "dropped" counts frames lost in the
+//                circular buffer or never delivered. "insert" is the time a
+//                camera spends inserting a frame, and "lockwait" the part of
+//                it spent waiting for other inserts (lock contention). Lines
+//                starting with '#' are comments (including skipped
+//                benchmarks). The exit status is nonzero if a benchmark
+//                failed.
+//
+// LICENSE:       This file is distributed under the "Lesser GPL" (LGPL) license.
+//                License text is included with the source distribution.
+//
+//                This file is distributed in the hope that it will be useful,
+//                but WITHOUT ANY WARRANTY; without even the implied warranty
+//                of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+//
+//                IN NO EVENT SHALL THE COPYRIGHT OWNER OR
+//                CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+//                INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES.
+
+#include "../AcquisitionStatistics.h"
+#include "../CircularBuffer.h"
+#include "../Configuration.h"
+#include "../Error.h"
+#include "../MMCore.h"
+
+#include "../../MMDevice/DeviceUtils.h"
+#include "../../MMDevice/ImageMetadata.h"
+
+#include <boost/bind.hpp>
+#include <boost/date_time/posix_time/posix_time.hpp>
+#include <boost/make_shared.hpp>
+#include <boost/ptr_container/ptr_vector.hpp>
+#include <boost/thread/mutex.hpp>
+#include <boost/thread/thread.hpp>
+
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <iomanip>
+#include <iostream>
+#include <memory>
+#include <set>
+#include <sstream>
+#include <string>
+#include <vector>
+
+
+namespace {
+
+struct Options
+{
+   Options() : quick(false), workDir(".") {}
+
+   bool quick;
+   std::vector<std::string> adapterPaths;
+   std::string workDir;
+   std::set<std::string> benchmarks;
+};
+
+
+class Samples
+{
+public:
+   void Reserve(size_t n) { values_.reserve(n); }
+   void Add(double value) { values_.push_back(value); }
+   void Add(const Samples& other)
+   { values_.insert(values_.end(), other.values_.begin(), other.values_.end()); }
+
+   double Percentile(double p)
+   {
+      if (values_.empty())
+         return 0.0;
+      std::sort(values_.begin(), values_.end());
+      size_t i = (size_t)(p / 100.0 * (values_.size() - 1) + 0.5);
+      return values_[i];
+   }
+
+   // name_p50=... name_p90=... name_p99=... name_max=...
+   std::string Summary(const std::string& name)
+   {
+      std::ostringstream os;
+      os << std::fixed << std::setprecision(1) <<
+         name << "_p50=" << Percentile(50) << " " <<
+         name << "_p90=" << Percentile(90) << " " <<
+         name << "_p99=" << Percentile(99) << " " <<
+         name << "_max=" << Percentile(100);
+      return os.str();
+   }
+
+private:
+   std::vector<double> values_;
+};
+
+
+// name_mean=... name_p50=... name_p90=... name_p99=... name_max=..., from
+// the histogram of a stage (percentiles are bucket upper bounds)
+std::string HistogramSummary(const std::string& name,
+      const mm::LatencyHistogram::Snapshot& s)
+{
+   std::ostringstream os;
+   os << std::fixed << std::setprecision(1) <<
+      name << "_mean=" << (s.count ? double(s.sumUs) / s.count : 0.0) << " " <<
+      name << "_p50=" << s.PercentileUs(50.0) << " " <<
+      name << "_p90=" << s.PercentileUs(90.0) << " " <<
+      name << "_p99=" << s.PercentileUs(99.0) << " " <<
+      name << "_max=" << s.maxUs;
+   return os.str();
+}
+
+// The same, from the line of a stage in CMMCore::getAcquisitionStatistics()
+std::string StageSummary(const std::string& name,
+      const std::string& statistics, const std::string& stage)
+{
+   std::istringstream lines(statistics);
+   std::string line;
+   while (std::getline(lines, line))
+   {
+      if (line.compare(0, stage.size() + 1, stage + "\t") != 0)
+         continue;
+      std::vector<std::string> fields;
+      std::istringstream fieldStream(line);
+      std::string field;
+      while (std::getline(fieldStream, field, '\t'))
+         fields.push_back(field);
+      if (fields.size() < 7)
+         break;
+      return name + "_mean=" + fields[2] + " " + name + "_p50=" + fields[3] +
+         " " + name + "_p90=" + fields[4] + " " + name + "_p99=" +
+         fields[5] + " " + name + "_max=" + fields[6];
+   }
+   return name + "_count=0";
+}
+
+void Report(const std::string& benchmark, const std::string& parameters,
+      const std::string& metrics)
+{
+   std::cout << benchmark << "\t" << parameters << "\t" << metrics << std::endl;
+}
+
+void Skip(const std::string& benchmark, const std::string& reason)
+{
+   std::cout << "# skipped " << benchmark << ": " << reason << std::endl;
+}
+
+double ElapsedSeconds(long long startUs)
+{
+   return (CDeviceUtils::GetMonotonicTimeUs() - startUs) / 1e6;
+}
+
+std::string FrameParameters(unsigned width, unsigned height,
+      unsigned bytesPerPixel, unsigned channels)
+{
+   std::ostringstream os;
+   os << "size=" << width << "x" << height << "x" << bytesPerPixel <<
+      " channels=" << channels;
+   return os.str();
+}
+
+CMMCore* NewCore(const Options& options)
+{
+   CMMCore* core = new CMMCore();
+   core->enableStderrLog(false);
+   if (!options.adapterPaths.empty())
+      core->setDeviceAdapterSearchPaths(options.adapterPaths);
+   else
+      core->setDeviceAdapterSearchPaths(std::vector<std::string>(1, "."));
+   return core;
+}
+
+
+///////////////////////////////////////////////////////////////////////////////
+// buffer: circular buffer inserts from one or more producers, and pops by a
+// concurrent consumer
+
+class BufferRun
+{
+public:
+   BufferRun(CircularBuffer& buffer, size_t frameBytes) :
+      buffer(buffer), frameBytes(frameBytes), popped(0), done_(false)
+   {}
+
+   // Tells the consumer to stop once the buffer is empty
+   void SetDone()
+   {
+      boost::mutex::scoped_lock lock(mutex_);
+      done_ = true;
+   }
+
+   bool IsDone()
+   {
+      boost::mutex::scoped_lock lock(mutex_);
+      return done_;
+   }
+
+   CircularBuffer& buffer;
+   const size_t frameBytes;
+   // Only used by the consumer until it has been joined
+   unsigned long popped;
+   Samples popUs;
+
+private:
+   boost::mutex mutex_;
+   bool done_;
+};
+
+// Frames inserted by each producer
+struct BufferFrames
+{
+   const unsigned char* pixels;
+   unsigned channels;
+   unsigned width;
+   unsigned height;
+   unsigned bytesPerPixel;
+   long long startUs;
+   long long endUs;
+   long long intervalUs; // 0 for no wait
+};
+
+// Inserts frames until endUs
+struct BufferProducer
+{
+   BufferProducer() : inserted(0) {}
+
+   void Run(CircularBuffer* buffer, const BufferFrames* frames)
+   {
+      Metadata md;
+      md.PutImageTag("Camera", "Benchmark");
+      for (;;)
+      {
+         long long t0 = CDeviceUtils::GetMonotonicTimeUs();
+         if (t0 >= frames->endUs)
+            break;
+         buffer->InsertMultiChannel(frames->pixels, frames->channels,
+               frames->width, frames->height, frames->bytesPerPixel, &md);
+         insertUs.Add((double)(CDeviceUtils::GetMonotonicTimeUs() - t0));
+         ++inserted;
+         if (frames->intervalUs > 0)
+            CDeviceUtils::SleepUntilMonotonicUs(frames->startUs +
+                  inserted * frames->intervalUs);
+      }
+   }
+
+   unsigned long inserted;
+   Samples insertUs;
+};
+
+void ConsumeBuffer(BufferRun* run)
+{
+   std::vector<unsigned char> copy(run->frameBytes);
+   for (;;)
+   {
+      long long t0 = CDeviceUtils::GetMonotonicTimeUs();
+      const mm::ImgBuffer* img = run->buffer.GetNextImageBuffer(0);
+      long long t1 = CDeviceUtils::GetMonotonicTimeUs();
+      if (img)
+      {
+         run->popUs.Add((double)(t1 - t0));
+         memcpy(&copy[0], img->GetPixels(), run->frameBytes);
+         ++run->popped;
+      }
+      else if (run->IsDone())
+      {
+         break;
+      }
+      else
+      {
+         boost::this_thread::yield();
+      }
+   }
+}
+
+// framesPerSecond is per producer
+void BenchmarkBuffer(unsigned width, unsigned height, unsigned bytesPerPixel,
+      unsigned channels, unsigned producers, double framesPerSecond,
+      double seconds)
+{
+   CircularBuffer buffer(256);
+   if (!buffer.Initialize(channels, width, height, bytesPerPixel))
+      throw CMMError("Cannot initialize circular buffer");
+   buffer.SetOverflowPolicy(CircularBuffer::OverflowDropNewest);
+   boost::shared_ptr<mm::AcquisitionStatistics> stats =
+      boost::make_shared<mm::AcquisitionStatistics>();
+   buffer.SetStatistics(stats);
+
+   const size_t frameBytes = (size_t)width * height * bytesPerPixel;
+   std::vector<unsigned char> pixels(frameBytes * channels, 1);
+
+   BufferRun run(buffer, frameBytes);
+   boost::thread consumer(boost::bind(&ConsumeBuffer, &run));
+
+   const long long startUs = CDeviceUtils::GetMonotonicTimeUs();
+   BufferFrames frames;
+   frames.pixels = &pixels[0];
+   frames.channels = channels;
+   frames.width = width;
+   frames.height = height;
+   frames.bytesPerPixel = bytesPerPixel;
+   frames.startUs = startUs;
+   frames.endUs = startUs + (long long)(seconds * 1e6);
+   frames.intervalUs = framesPerSecond > 0.0 ?
+      (long long)(1e6 / framesPerSecond) : 0;
+   boost::ptr_vector<BufferProducer> producerRuns;
+   boost::thread_group producerThreads;
+   for (unsigned i = 0; i < producers; ++i)
+   {
+      producerRuns.push_back(new BufferProducer());
+      producerThreads.create_thread(boost::bind(&BufferProducer::Run,
+               &producerRuns.back(), &buffer, &frames));
+   }
+   producerThreads.join_all();
+   run.SetDone();
+   consumer.join();
+   const double elapsed = ElapsedSeconds(startUs);
+
+   Samples insertUs;
+   unsigned long inserted = 0;
+   for (unsigned i = 0; i < producers; ++i)
+   {
+      insertUs.Add(producerRuns[i].insertUs);
+      inserted += producerRuns[i].inserted;
+   }
+
+   std::ostringstream params;
+   params << FrameParameters(width, height, bytesPerPixel, channels) <<
+      " producers=" << producers << " rate=";
+   if (framesPerSecond > 0.0)
+      params << framesPerSecond;
+   else
+      params << "max";
+
+   std::ostringstream metrics;
+   metrics << std::fixed << std::setprecision(1) <<
+      "frames=" << inserted << " " <<
+      insertUs.Summary("insert") << " " <<
+      HistogramSummary("lockwait",
+            stats->GetSnapshot(mm::AcquisitionStatistics::StageBufferWait)) << " " <<
+      run.popUs.Summary("pop") << " " <<
+      "consumer_fps=" << run.popped / elapsed << " " <<
+      "consumer_MBps=" << run.popped * frameBytes * channels / elapsed / 1048576.0 << " " <<
+      "dropped=" << buffer.GetDroppedImageCount();
+   Report("buffer", params.str(), metrics.str());
+}
+
+void RunBufferBenchmarks(const Options& options)
+{
+   const double seconds = options.quick ? 0.5 : 3.0;
+   const unsigned sizes[][3] = { {512, 512, 2}, {2048, 2048, 2} };
+   const unsigned channelCounts[] = { 1, 4 };
+   const double rates[] = { 0.0, 100.0 };
+   // Several producers, as with several cameras, contend for the insert lock
+   const unsigned producerCounts[] = { 1, 4 };
+   for (unsigned s = 0; s < 2; ++s)
+      for (unsigned c = 0; c < 2; ++c)
+         for (unsigned r = 0; r < 2; ++r)
+            for (unsigned p = 0; p < 2; ++p)
+            {
+               if (options.quick && (c > 0 || r > 0))
+                  continue;
+               BenchmarkBuffer(sizes[s][0], sizes[s][1], sizes[s][2],
+                     channelCounts[c], producerCounts[p], rates[r], seconds);
+            }
+}
+
+
+///////////////////////////////////////////////////////////////////////////////
+// sequence: startSequenceAcquisition and popNextImageMD through real cameras
+
+boost::posix_time::ptime ParseCoreTime(const std::string& s)
+{
+   // "%Y-%m-%d %H:%M:%s", local time (see CircularBuffer)
+   return boost::posix_time::time_from_string(s);
+}
+
+void BenchmarkSequence(CMMCore& core, const std::string& cameraLabel,
+      const std::string& description, unsigned channels, double exposureMs,
+      long frames)
+{
+   core.setCameraDevice(cameraLabel.c_str());
+   core.setExposure(exposureMs);
+   core.setCircularBufferOverflowPolicy("DropNewest");
+   const unsigned width = core.getImageWidth();
+   const unsigned height = core.getImageHeight();
+   const unsigned bytesPerPixel = core.getBytesPerPixel();
+   const size_t frameBytes = (size_t)width * height * bytesPerPixel;
+
+   Samples popUs;
+   Samples latencyUs;
+   long popped = 0;
+   std::vector<unsigned char> copy(frameBytes);
+   core.resetAcquisitionStatistics();
+   const long long startUs = CDeviceUtils::GetMonotonicTimeUs();
+   core.startSequenceAcquisition(frames, 0.0, false);
+   for (;;)
+   {
+      if (core.getRemainingImageCount() > 0)
+      {
+         Metadata md;
+         long long t0 = CDeviceUtils::GetMonotonicTimeUs();
+         void* pixels = core.popNextImageMD(md);
+         long long t1 = CDeviceUtils::GetMonotonicTimeUs();
+         popUs.Add((double)(t1 - t0));
+         memcpy(&copy[0], pixels, frameBytes);
+         ++popped;
+         try
+         {
+            boost::posix_time::ptime received = ParseCoreTime(
+                  md.GetSingleTag(MM::g_Keyword_Metadata_TimeInCore).GetValue());
+            boost::posix_time::ptime now =
+               boost::posix_time::microsec_clock::local_time();
+            latencyUs.Add((double)(now - received).total_microseconds());
+         }
+         catch (...)
+         {
+         }
+      }
+      else if (!core.isSequenceRunning() && core.getRemainingImageCount() == 0)
+      {
+         break;
+      }
+      else
+      {
+         boost::this_thread::yield();
+      }
+   }
+   const double elapsed = ElapsedSeconds(startUs);
+   const std::string statistics = core.getAcquisitionStatistics();
+
+   // Frames of all channels are popped individually
+   const long expected = frames * channels;
+   const long dropped = std::max(core.getCircularBufferDroppedImageCount(),
+         expected - popped);
+
+   std::ostringstream params;
+   params << "camera=" << description << " " <<
+      FrameParameters(width, height, bytesPerPixel, channels) <<
+      " exposure_ms=" << exposureMs;
+
+   std::ostringstream metrics;
+   metrics << std::fixed << std::setprecision(1) <<
+      "frames=" << popped << " " <<
+      StageSummary("insert", statistics, "Insert") << " " <<
+      StageSummary("lockwait", statistics, "BufferWait") << " " <<
+      popUs.Summary("pop") << " " <<
+      latencyUs.Summary("insert_to_pop") << " " <<
+      "consumer_fps=" << popped / elapsed << " " <<
+      "consumer_MBps=" << popped * frameBytes / elapsed / 1048576.0 << " " <<
+      "dropped=" << dropped;
+   Report("sequence", params.str(), metrics.str());
+}
+
+void SetDemoCameraSize(CMMCore& core, const std::string& label, unsigned size)
+{
+   core.setProperty(label.c_str(), "OnCameraCCDXSize", (long)size);
+   core.setProperty(label.c_str(), "OnCameraCCDYSize", (long)size);
+   core.setProperty(label.c_str(), "PixelType", "16bit");
+   core.setProperty(label.c_str(), "FastImage", "1");
+}
+
+void RunDemoSequenceBenchmarks(const Options& options)
+{
+   std::auto_ptr<CMMCore> core(NewCore(options));
+   const unsigned maxChannels = 4;
+   std::vector<std::string> cameras;
+   for (unsigned i = 0; i < maxChannels; ++i)
+   {
+      std::ostringstream label;
+      label << "Camera" << i + 1;
+      cameras.push_back(label.str());
+      core->loadDevice(label.str().c_str(), "DemoCamera", "DCam");
+   }
+   core->loadDevice("Multi", "Utilities", "Multi Camera");
+   core->initializeAllDevices();
+   for (unsigned i = 0; i < maxChannels; ++i)
+   {
+      std::ostringstream name;
+      name << "Physical Camera " << i + 1;
+      core->setProperty("Multi", name.str().c_str(), cameras[i].c_str());
+   }
+
+   const long frames = options.quick ? 50 : 500;
+   const unsigned sizes[] = { 512, 2048 };
+   const double exposures[] = { 10.0, 1.0 };
+   for (unsigned s = 0; s < 2; ++s)
+   {
+      for (unsigned i = 0; i < maxChannels; ++i)
+         SetDemoCameraSize(*core, cameras[i], sizes[s]);
+      for (unsigned e = 0; e < 2; ++e)
+      {
+         if (options.quick && e > 0)
+            continue;
+         BenchmarkSequence(*core, cameras[0], "DemoCamera", 1,
+               exposures[e], frames);
+         if (!options.quick)
+            BenchmarkSequence(*core, "Multi", "DemoCamera", maxChannels,
+                  exposures[e], frames);
+      }
+   }
+}
+
+void RunSequenceTesterBenchmarks(const Options& options)
+{
+   std::auto_ptr<CMMCore> core(NewCore(options));
+   try
+   {
+      core->loadDevice("THub", "SequenceTester", "THub");
+      core->loadDevice("TCamera-0", "SequenceTester", "TCamera-0");
+      core->setParentLabel("TCamera-0", "THub");
+      core->setProperty("TCamera-0", "ImageMode", "MachineReadable");
+      core->setProperty("TCamera-0", "ImageWidth", 1024L);
+      core->setProperty("TCamera-0", "ImageHeight", 1024L);
+      core->initializeAllDevices();
+   }
+   catch (const CMMError& e)
+   {
+      Skip("sequence camera=SequenceTester", e.getFullMsg());
+      return;
+   }
+
+   const long frames = options.quick ? 50 : 500;
+   BenchmarkSequence(*core, "TCamera-0", "SequenceTester", 1, 1.0, frames);
+   if (!options.quick)
+      BenchmarkSequence(*core, "TCamera-0", "SequenceTester", 1, 0.1, frames);
+}
+
+void RunSequenceBenchmarks(const Options& options)
+{
+   RunDemoSequenceBenchmarks(options);
+   RunSequenceTesterBenchmarks(options);
+}
+
+
+///////////////////////////////////////////////////////////////////////////////
+// setconfig, systemstate, configload: demo devices and presets
+
+void LoadDemoSystem(CMMCore& core)
+{
+   core.loadDevice("Camera", "DemoCamera", "DCam");
+   core.loadDevice("Wheel", "DemoCamera", "DWheel");
+   core.loadDevice("Dichroic", "DemoCamera", "DStateDevice");
+   core.loadDevice("Objective", "DemoCamera", "DObjective");
+   core.loadDevice("Z", "DemoCamera", "DStage");
+   core.loadDevice("XY", "DemoCamera", "DXYStage");
+   core.loadDevice("Shutter", "DemoCamera", "DShutter");
+   core.initializeAllDevices();
+   core.setCameraDevice("Camera");
+   core.setFocusDevice("Z");
+   core.setXYStageDevice("XY");
+   core.setShutterDevice("Shutter");
+
+   const char* channels[] = { "DAPI", "FITC", "TRITC", "Cy5" };
+   for (int i = 0; i < 4; ++i)
+   {
+      std::ostringstream state, exposure;
+      state << i;
+      exposure << 10 * (i + 1);
+      core.defineConfig("Channel", channels[i], "Wheel", "State",
+            state.str().c_str());
+      core.defineConfig("Channel", channels[i], "Dichroic", "State",
+            state.str().c_str());
+      core.defineConfig("Channel", channels[i], "Camera", "Exposure",
+            exposure.str().c_str());
+   }
+}
+
+void RunSetConfigBenchmarks(const Options& options)
+{
+   std::auto_ptr<CMMCore> core(NewCore(options));
+   LoadDemoSystem(*core);
+
+   const int iterations = options.quick ? 200 : 2000;
+   const char* channels[] = { "DAPI", "FITC", "TRITC", "Cy5" };
+   Samples setUs;
+   setUs.Reserve(iterations);
+   const long long startUs = CDeviceUtils::GetMonotonicTimeUs();
+   for (int i = 0; i < iterations; ++i)
+   {
+      long long t0 = CDeviceUtils::GetMonotonicTimeUs();
+      core->setConfig("Channel", channels[i % 4]);
+      core->waitForConfig("Channel", channels[i % 4]);
+      setUs.Add((double)(CDeviceUtils::GetMonotonicTimeUs() - t0));
+   }
+   const double elapsed = ElapsedSeconds(startUs);
+
+   std::ostringstream metrics;
+   metrics << std::fixed << std::setprecision(1) <<
+      "calls=" << iterations << " " << setUs.Summary("setconfig") << " " <<
+      "calls_per_s=" << iterations / elapsed;
+   Report("setconfig", "presets=4 properties=3", metrics.str());
+}
+
+void RunSystemStateBenchmarks(const Options& options)
+{
+   std::auto_ptr<CMMCore> core(NewCore(options));
+   LoadDemoSystem(*core);
+
+   const int iterations = options.quick ? 50 : 500;
+   Samples stateUs, cacheUs;
+   size_t properties = 0;
+   for (int i = 0; i < iterations; ++i)
+   {
+      long long t0 = CDeviceUtils::GetMonotonicTimeUs();
+      Configuration state = core->getSystemState();
+      long long t1 = CDeviceUtils::GetMonotonicTimeUs();
+      Configuration cache = core->getSystemStateCache();
+      long long t2 = CDeviceUtils::GetMonotonicTimeUs();
+      stateUs.Add((double)(t1 - t0));
+      cacheUs.Add((double)(t2 - t1));
+      properties = state.size();
+   }
+
+   std::ostringstream params;
+   params << "properties=" << properties;
+   std::ostringstream metrics;
+   metrics << "calls=" << iterations << " " <<
+      stateUs.Summary("getsystemstate") << " " <<
+      cacheUs.Summary("getsystemstatecache");
+   Report("systemstate", params.str(), metrics.str());
+}
+
+void RunConfigLoadBenchmarks(const Options& options)
+{
+   const std::string path = options.workDir + "/mmcorebench.cfg";
+   {
+      std::auto_ptr<CMMCore> core(NewCore(options));
+      LoadDemoSystem(*core);
+      core->saveSystemConfiguration(path.c_str());
+   }
+
+   const int iterations = options.quick ? 3 : 20;
+   std::auto_ptr<CMMCore> core(NewCore(options));
+   Samples loadUs;
+   for (int i = 0; i < iterations; ++i)
+   {
+      long long t0 = CDeviceUtils::GetMonotonicTimeUs();
+      core->loadSystemConfiguration(path.c_str());
+      loadUs.Add((double)(CDeviceUtils::GetMonotonicTimeUs() - t0));
+   }
+   std::remove(path.c_str());
+
+   std::ostringstream params;
+   params << "devices=" << core->getLoadedDevices().size();
+   std::ostringstream metrics;
+   metrics << "loads=" << iterations << " " << loadUs.Summary("load");
+   Report("configload", params.str(), metrics.str());
+}
+
+
+struct Benchmark
+{
+   const char* name;
+   void (*run)(const Options&);
+};
+
+const Benchmark g_Benchmarks[] = {
+   { "buffer", &RunBufferBenchmarks },
+   { "sequence", &RunSequenceBenchmarks },
+   { "setconfig", &RunSetConfigBenchmarks },
+   { "systemstate", &RunSystemStateBenchmarks },
+   { "configload", &RunConfigLoadBenchmarks },
+};
+const size_t g_NrBenchmarks = sizeof(g_Benchmarks) / sizeof(g_Benchmarks[0]);
+
+int Usage()
+{
+   std::cerr << "Usage: mmcorebench [--quick] [--adapters <dir>]... "
+      "[--workdir <dir>] [benchmark...]\nBenchmarks:";
+   for (size_t i = 0; i < g_NrBenchmarks; ++i)
+      std::cerr << " " << g_Benchmarks[i].name;
+   std::cerr << "\n";
+   return 2;
+}
+
+} // anonymous namespace
+
+
+int main(int argc, char* argv[])
+{
+   Options options;
+   for (int i = 1; i < argc; ++i)
+   {
+      const std::string arg = argv[i];
+      if (arg == "--quick")
+         options.quick = true;
+      else if (arg == "--adapters" && i + 1 < argc)
+         options.adapterPaths.push_back(argv[++i]);
+      else if (arg == "--workdir" && i + 1 < argc)
+         options.workDir = argv[++i];
+      else if (!arg.empty() && arg[0] != '-')
+         options.benchmarks.insert(arg);
+      else
+         return Usage();
+   }
+   for (std::set<std::string>::const_iterator it = options.benchmarks.begin();
+         it != options.benchmarks.end(); ++it)
+   {
+      bool known = false;
+      for (size_t i = 0; i < g_NrBenchmarks; ++i)
+         known = known || *it == g_Benchmarks[i].name;
+      if (!known)
+         return Usage();
+   }
+
+   std::cout << "# mmcorebench " << CMMCore().getVersionInfo() <<
+      (options.quick ? " (quick)" : "") << std::endl;
+
+   int failures = 0;
+   for (size_t i = 0; i < g_NrBenchmarks; ++i)
+   {
+      if (!options.benchmarks.empty() &&
+            !options.benchmarks.count(g_Benchmarks[i].name))
+         continue;
+      try
+      {
+         g_Benchmarks[i].run(options);
+      }
+      catch (const CMMError& e)
+      {
+         std::cout << "# failed " << g_Benchmarks[i].name << ": " <<
+            e.getFullMsg() << std::endl;
+         ++failures;
+      }
+   }
+   return failures > 0 ? 1 : 0;
+}
@@ -24,13 +24,19 @@
 // AUTHOR:        Nenad Amodaj, nenad@amodaj.com, 01/05/2007
 // 
 #include "CircularBuffer.h"
+#include "AcquisitionStatistics.h"
 #include "CoreUtils.h"
+#include "DiskStreamSink.h"
 
 #include "TaskSet_CopyMemory.h"
 
 #include "../MMDevice/DeviceUtils.h"
 
 #include <boost/make_shared.hpp>
+#include <boost/thread/thread_time.hpp>
+
+#include <cstdlib>
+#include <sstream>
 
 
 const long long bytesInMB = 1 << 20;
@@ -41,6 +47,45 @@ const long adjustThreshold = LONG_MAX / 2;
 // division by zero can be added.
 const unsigned long maxCBSize = 10000000;
 
+namespace {
+
+// Like MMThreadGuard, but can be released and retaken
+class InsertLockGuard
+{
+public:
+   explicit InsertLockGuard(MMThreadLock& lock) : lock_(lock), locked_(true)
+   {
+      lock_.Lock();
+   }
+
+   ~InsertLockGuard()
+   {
+      if (locked_)
+         lock_.Unlock();
+   }
+
+   void Lock() { lock_.Lock(); locked_ = true; }
+   void Unlock() { lock_.Unlock(); locked_ = false; }
+
+private:
+   InsertLockGuard(const InsertLockGuard&);
+   InsertLockGuard& operator=(const InsertLockGuard&);
+
+   MMThreadLock& lock_;
+   bool locked_;
+};
+
+int SeekSpillFile(std::FILE* file, long long offset)
+{
+#ifdef _MSC_VER
+   return _fseeki64(file, offset, SEEK_SET);
+#else
+   return fseeko(file, (off_t)offset, SEEK_SET);
+#endif
+}
+
+} // anonymous namespace
+
 CircularBuffer::CircularBuffer(unsigned int memorySizeMB) :
    width_(0), 
    height_(0), 
@@ -51,16 +96,32 @@ CircularBuffer::CircularBuffer(unsigned int memorySizeMB) :
    memorySizeMB_(memorySizeMB), 
    overflow_(false),
    threadPool_(boost::make_shared<ThreadPool>()),
-   tasksMemCopy_(boost::make_shared<TaskSet_CopyMemory>(threadPool_))
+   tasksMemCopy_(boost::make_shared<TaskSet_CopyMemory>(threadPool_)),
+   overflowPolicy_(OverflowError),
+   overflowBlockTimeoutMs_(1000),
+   droppedImageCount_(0),
+   spilledImageCount_(0),
+   spillFile_(0),
+   spillReadOffset_(0),
+   spillWriteOffset_(0),
+   spillCount_(0),
+   spillPendingCount_(0),
+   spillGeneration_(0),
+   coordinateIndexEnabled_(false)
 {
    facet = new boost::posix_time::time_facet("%Y-%m-%d %H:%M:%s");
    tStream.imbue(std::locale(tStream.getloc(), facet));
 }
 
-CircularBuffer::~CircularBuffer() {}
+CircularBuffer::~CircularBuffer()
+{
+   DiscardSpill();
+}
 
 bool CircularBuffer::Initialize(unsigned channels, unsigned int w, unsigned int h, unsigned int pixDepth)
 {
+   // spillLock_ first, so that no spill file I/O is in progress
+   MMThreadGuard spillGuard(spillLock_);
    MMThreadGuard guard(g_bufferLock);
    imageNumbers_.clear();
    boost::posix_time::ptime t = boost::posix_time::microsec_clock::local_time();
@@ -76,6 +137,13 @@ bool CircularBuffer::Initialize(unsigned channels, unsigned int w, unsigned int
          if (frameArray_.size() > 0)
             return true; // nothing to change
 
+      // the application may still be using the pixels of pinned images
+      if (!pinnedImages_.empty())
+         return false;
+
+      // frames queued on disk no longer fit the buffer
+      DiscardSpill();
+
       width_ = w;
       height_ = h;
       pixDepth_ = pixDepth;
@@ -84,6 +152,10 @@ bool CircularBuffer::Initialize(unsigned channels, unsigned int w, unsigned int
       insertIndex_ = 0;
       saveIndex_ = 0;
       overflow_ = false;
+      pinnedImages_.clear();
+      pinnedFrames_.clear();
+      coordinateIndex_.clear();
+      slotCoordinates_.clear();
 
       // calculate the size of the entire buffer array once all images get allocated
       // the actual size at the time of the creation is going to be less, because
@@ -94,6 +166,7 @@ bool CircularBuffer::Initialize(unsigned channels, unsigned int w, unsigned int
       if (cbSize == 0) 
       {
          frameArray_.resize(0);
+         insertTimesUs_.clear();
          return false; // memory footprint too small
       }
 
@@ -108,6 +181,8 @@ bool CircularBuffer::Initialize(unsigned channels, unsigned int w, unsigned int
 
       // allocate buffers  - could conceivably throw an out-of-memory exception
       frameArray_.resize(cbSize);
+      insertTimesUs_.assign(cbSize, 0);
+      slotCoordinates_.resize(cbSize);
       for (unsigned long i=0; i<frameArray_.size(); i++)
       {
          frameArray_[i].Resize(w, h, pixDepth);
@@ -118,6 +193,7 @@ bool CircularBuffer::Initialize(unsigned channels, unsigned int w, unsigned int
    catch( ... /* std::bad_alloc& ex */)
    {
       frameArray_.resize(0);
+      insertTimesUs_.clear();
       ret = false;
    }
    return ret;
@@ -125,13 +201,144 @@ bool CircularBuffer::Initialize(unsigned channels, unsigned int w, unsigned int
 
 void CircularBuffer::Clear() 
 {
-   MMThreadGuard guard(g_bufferLock); 
-   insertIndex_=0; 
-   saveIndex_=0; 
-   overflow_ = false;
-   boost::posix_time::ptime t = boost::posix_time::microsec_clock::local_time();
-   startTime_ = GetMMTimeNow(t);
-   imageNumbers_.clear();
+   {
+      MMThreadGuard spillGuard(spillLock_);
+      MMThreadGuard guard(g_bufferLock); 
+      if (pinnedImages_.empty())
+      {
+         insertIndex_=0; 
+         saveIndex_=0; 
+      }
+      else
+      {
+         // keep the frame numbering so that pinned slots stay reserved
+         saveIndex_ = insertIndex_;
+      }
+      overflow_ = false;
+      droppedImageCount_ = 0;
+      spilledImageCount_ = 0;
+      coordinateIndex_.clear();
+      for (size_t i = 0; i < slotCoordinates_.size(); ++i)
+         slotCoordinates_[i].clear();
+      boost::posix_time::ptime t = boost::posix_time::microsec_clock::local_time();
+      startTime_ = GetMMTimeNow(t);
+      imageNumbers_.clear();
+      DiscardSpill();
+   }
+   {
+      boost::mutex::scoped_lock lock(spaceMutex_);
+   }
+   spaceCond_.notify_all();
+}
+
+void CircularBuffer::SetOverflowPolicy(OverflowPolicy policy)
+{
+   MMThreadGuard guard(g_bufferLock);
+   overflowPolicy_ = policy;
+}
+
+CircularBuffer::OverflowPolicy CircularBuffer::GetOverflowPolicy() const
+{
+   MMThreadGuard guard(g_bufferLock);
+   return overflowPolicy_;
+}
+
+void CircularBuffer::SetOverflowBlockTimeoutMs(long timeoutMs)
+{
+   MMThreadGuard guard(g_bufferLock);
+   overflowBlockTimeoutMs_ = timeoutMs;
+}
+
+long CircularBuffer::GetOverflowBlockTimeoutMs() const
+{
+   MMThreadGuard guard(g_bufferLock);
+   return overflowBlockTimeoutMs_;
+}
+
+void CircularBuffer::SetSpillDirectory(const std::string& directory)
+{
+   MMThreadGuard guard(spillLock_);
+   spillDirectory_ = directory;
+}
+
+std::string CircularBuffer::GetSpillDirectory() const
+{
+   MMThreadGuard guard(spillLock_);
+   return spillDirectory_;
+}
+
+unsigned long CircularBuffer::GetDroppedImageCount() const
+{
+   MMThreadGuard guard(g_bufferLock);
+   return droppedImageCount_;
+}
+
+unsigned long CircularBuffer::GetSpilledImageCount() const
+{
+   MMThreadGuard guard(g_bufferLock);
+   return spilledImageCount_;
+}
+
+void CircularBuffer::SetStreamSink(boost::shared_ptr<mm::DiskStreamSink> sink)
+{
+   MMThreadGuard guard(g_bufferLock);
+   streamSink_ = sink;
+}
+
+boost::shared_ptr<mm::DiskStreamSink> CircularBuffer::GetStreamSink() const
+{
+   MMThreadGuard guard(g_bufferLock);
+   return streamSink_;
+}
+
+void CircularBuffer::SetStatistics(boost::shared_ptr<mm::AcquisitionStatistics> stats)
+{
+   MMThreadGuard guard(g_bufferLock);
+   statistics_ = stats;
+}
+
+boost::shared_ptr<mm::AcquisitionStatistics> CircularBuffer::GetStatistics() const
+{
+   MMThreadGuard guard(g_bufferLock);
+   return statistics_;
+}
+
+void CircularBuffer::SetCoordinateIndexEnabled(bool enabled)
+{
+   MMThreadGuard guard(g_bufferLock);
+   coordinateIndexEnabled_ = enabled;
+}
+
+bool CircularBuffer::IsCoordinateIndexEnabled() const
+{
+   MMThreadGuard guard(g_bufferLock);
+   return coordinateIndexEnabled_;
+}
+
+/**
+* Returns the most recently inserted image with the given coordinates, or null
+* if there is none in the buffer. The image is not removed from the buffer.
+*/
+const mm::ImgBuffer* CircularBuffer::GetImageBufferAt(const Coordinates& coords) const
+{
+   MMThreadGuard guard(g_bufferLock);
+   CoordinateIndex::const_iterator it = coordinateIndex_.find(coords);
+   if (it == coordinateIndex_.end())
+      return 0;
+   return frameArray_[it->second.frameIndex % frameArray_.size()].FindImage(it->second.channel);
+}
+
+/**
+* Like GetImageBufferAt(), but pins the image until ReleasePinnedImage() is
+* called with its pixels.
+*/
+const mm::ImgBuffer* CircularBuffer::GetImageBufferAtPinned(const Coordinates& coords)
+{
+   MMThreadGuard guard(g_bufferLock);
+   CoordinateIndex::const_iterator it = coordinateIndex_.find(coords);
+   if (it == coordinateIndex_.end())
+      return 0;
+   return PinFrame(it->second.frameIndex, it->second.channel);
 }
 
 unsigned long CircularBuffer::GetSize() const
@@ -143,7 +350,7 @@ unsigned long CircularBuffer::GetSize() const
 unsigned long CircularBuffer::GetFreeSize() const
 {
    MMThreadGuard guard(g_bufferLock);
-   long freeSize = (long)frameArray_.size() - (insertIndex_ - saveIndex_);
+   long freeSize = (long)frameArray_.size() - OccupiedSlotCount();
    if (freeSize < 0)
       return 0;
    else
@@ -153,7 +360,7 @@ unsigned long CircularBuffer::GetFreeSize() const
 unsigned long CircularBuffer::GetRemainingImageCount() const
 {
    MMThreadGuard guard(g_bufferLock);
-   return (unsigned long)(insertIndex_ - saveIndex_);
+   return (unsigned long)(insertIndex_ - saveIndex_) + spillCount_;
 }
 
 /**
@@ -182,13 +389,26 @@ bool CircularBuffer::InsertImage(const unsigned char* pixArray, unsigned int wid
  
 /**
 * Inserts a multi-channel frame in the buffer.
+*
+* If the buffer is full, the frame is handled according to the overflow
+* policy. Returns false only if the frame was refused and the overflow should
+* be reported to the camera (OverflowError).
 */
 bool CircularBuffer::InsertMultiChannel(const unsigned char* pixArray, unsigned int numChannels, unsigned int width, unsigned int height, unsigned int byteDepth, unsigned int nComponents, const Metadata* pMd) throw (CMMError)
 {
-    MMThreadGuard guard(g_insertLock);
+    // Frames queued on disk go first; the file is read outside the locks
+    RefillFromSpill();
+
+    long long waitStartUs = CDeviceUtils::GetMonotonicTimeUs();
+    InsertLockGuard insertGuard(g_insertLock);
+    long long waitUs = CDeviceUtils::GetMonotonicTimeUs() - waitStartUs;
  
     mm::ImgBuffer* pImg;
     unsigned long singleChannelSize = (unsigned long)width * height * byteDepth;
+    bool spill = false;
+    unsigned long spillGeneration = 0;
+    boost::shared_ptr<mm::DiskStreamSink> sink;
+    boost::shared_ptr<mm::AcquisitionStatistics> stats;
  
     {
        MMThreadGuard guard(g_bufferLock);
@@ -196,71 +416,148 @@ bool CircularBuffer::InsertMultiChannel(const unsigned char* pixArray, unsigned
        // check image dimensions
        if (width != width_ || height != height_ || byteDepth != pixDepth_)
           throw CMMError("Incompatible image dimensions in the circular buffer", MMERR_CircularBufferIncompatibleImage);
- 
-       bool overflowed = (insertIndex_ - saveIndex_) >= static_cast<long>(frameArray_.size());
-       if (overflowed) {
-          overflow_ = true;
-          return false;
+       sink = streamSink_;
+       stats = statistics_;
+    }
+
+    // The stream sink gets every frame, even one that is dropped below
+    std::vector<Metadata> mds;
+    if (sink)
+    {
+       long long mdStartUs = CDeviceUtils::GetMonotonicTimeUs();
+       mds.resize(numChannels);
+       for (unsigned i=0; i<numChannels; i++)
+          BuildChannelMetadata(mds[i], pMd, width, height, byteDepth, nComponents);
+       if (stats)
+          stats->Record(mm::AcquisitionStatistics::StageBufferMetadata,
+                mdStartUs, CDeviceUtils::GetMonotonicTimeUs() - mdStartUs);
+       for (unsigned i=0; i<numChannels; i++)
+          sink->Submit(pixArray + i * singleChannelSize, width, height, byteDepth, mds[i]);
+    }
+
+    bool blocking = false;
+    boost::system_time blockDeadline;
+    for (;;)
+    {
+       bool block = false;
+       {
+          MMThreadGuard guard(g_bufferLock);
+
+          bool overflowed = OccupiedSlotCount() >= static_cast<long>(frameArray_.size());
+          if (spillCount_ > 0 || spillPendingCount_ > 0 ||
+                (overflowed && overflowPolicy_ == OverflowSpillToDisk))
+          {
+             // Once frames are queued on disk, new frames must queue behind
+             // them (even if the policy has been changed since)
+             spill = true;
+             ++spillPendingCount_;
+             spillGeneration = spillGeneration_;
+          }
+          else if (overflowed)
+          {
+             switch (overflowPolicy_)
+             {
+                case OverflowDropNewest:
+                   ++droppedImageCount_;
+                   return true;
+                case OverflowDropOldest:
+                   // overwrite the oldest unread frame, unless the slot is pinned
+                   ++droppedImageCount_;
+                   if (!pinnedFrames_.empty() && *pinnedFrames_.begin() <= saveIndex_)
+                      return true;
+                   ++saveIndex_;
+                   break;
+                case OverflowBlock:
+                   block = true;
+                   break;
+                default:
+                   overflow_ = true;
+                   ++droppedImageCount_;
+                   return false;
+             }
+          }
+       }
+       if (!block)
+          break;
+
+       // Wait for the consumer without holding up other cameras; the
+       // buffer state is checked again once the insert lock is retaken
+       if (!blocking)
+       {
+          blocking = true;
+          blockDeadline = boost::get_system_time() +
+             boost::posix_time::milliseconds(GetOverflowBlockTimeoutMs());
+       }
+       long long blockStartUs = CDeviceUtils::GetMonotonicTimeUs();
+       insertGuard.Unlock();
+       bool hasSpace = WaitForSpace(blockDeadline);
+       insertGuard.Lock();
+       waitUs += CDeviceUtils::GetMonotonicTimeUs() - blockStartUs;
+       if (!hasSpace)
+       {
+          if (stats)
+             stats->Record(mm::AcquisitionStatistics::StageBufferWait,
+                   waitStartUs, waitUs);
+          MMThreadGuard guard(g_bufferLock);
+          ++droppedImageCount_;
+          return true;
        }
     }
+    if (stats)
+       stats->Record(mm::AcquisitionStatistics::StageBufferWait,
+             waitStartUs, waitUs);
+
+    if (spill)
+    {
+       // The frame is written to disk without holding up other cameras;
+       // frames spilled later queue behind it in the file
+       insertGuard.Unlock();
+       if (mds.empty())
+       {
+          mds.resize(numChannels);
+          for (unsigned i=0; i<numChannels; i++)
+             BuildChannelMetadata(mds[i], pMd, width, height, byteDepth, nComponents);
+       }
+       SpillFrame(pixArray, numChannels, singleChannelSize, mds, spillGeneration);
+       return true;
+    }
  
+    long long copyStartUs = 0;
+    long long copyUs = 0;
+    bool indexCoordinates = false;
+    std::vector<std::pair<unsigned, Coordinates> > coordinates;
     for (unsigned i=0; i<numChannels; i++)
     {
        Metadata md;
        {
           MMThreadGuard guard(g_bufferLock);
           // we assume that all buffers are pre-allocated
-          pImg = frameArray_[insertIndex_ % frameArray_.size()].FindImage(i);
+          long slot = insertIndex_ % frameArray_.size();
+          pImg = frameArray_[slot].FindImage(i);
           if (!pImg)
              return false;
- 
-          if (pMd)
+          if (i == 0)
           {
-             // TODO: the same metadata is inserted for each channel ???
-             // Perhaps we need to add specific tags to each channel
-             md = *pMd;
+             // the slot's previous frame can no longer be looked up
+             EvictCoordinates(slot);
+             indexCoordinates = coordinateIndexEnabled_;
           }
+       }
 
-         std::string cameraName = md.GetSingleTag("Camera").GetValue();
-         if (imageNumbers_.end() == imageNumbers_.find(cameraName))
-         {
-            imageNumbers_[cameraName] = 0;
-         }
-
-         // insert image number. 
-         md.put(MM::g_Keyword_Metadata_ImageNumber, CDeviceUtils::ConvertToString(imageNumbers_[cameraName]));
-         ++imageNumbers_[cameraName];
-      }
-
-      boost::posix_time::ptime t = boost::posix_time::microsec_clock::local_time();
-      if (!md.HasTag(MM::g_Keyword_Elapsed_Time_ms))
+      if (mds.empty())
       {
-         // if time tag was not supplied by the camera insert current timestamp
-         MM::MMTime timestamp = GetMMTimeNow(t);
-         md.PutImageTag(MM::g_Keyword_Elapsed_Time_ms, CDeviceUtils::ConvertToString((timestamp - startTime_).getMsec()));
+         long long mdStartUs = CDeviceUtils::GetMonotonicTimeUs();
+         BuildChannelMetadata(md, pMd, width, height, byteDepth, nComponents);
+         if (stats)
+            stats->Record(mm::AcquisitionStatistics::StageBufferMetadata,
+                  mdStartUs, CDeviceUtils::GetMonotonicTimeUs() - mdStartUs);
       }
-      tStream << t;
-      md.PutImageTag(MM::g_Keyword_Metadata_TimeInCore, tStream.str().c_str());
-      tStream.str(std::string());
-      tStream.clear();
-
-      md.PutImageTag("Width",width);
-      md.PutImageTag("Height",height);
-      if (byteDepth == 1)
-         md.PutImageTag("PixelType","GRAY8");
-      else if (byteDepth == 2)
-         md.PutImageTag("PixelType","GRAY16");
-      else if (byteDepth == 4)
-      {
-         if (nComponents == 1)
-            md.PutImageTag("PixelType","GRAY32");
-         else
-            md.PutImageTag("PixelType","RGB32");
-      }
-      else if (byteDepth == 8)
-         md.PutImageTag("PixelType","RGB64");
       else
-         md.PutImageTag("PixelType","Unknown"); 
+         md = mds[i];
+
+      Coordinates coords;
+      if (indexCoordinates && ReadCoordinates(md, i, coords))
+         coordinates.push_back(std::make_pair(i, coords));
 
       pImg->SetMetadata(md);
       //pImg->SetPixels(pixArray + i * singleChannelSize);
@@ -268,27 +565,532 @@ bool CircularBuffer::InsertMultiChannel(const unsigned char* pixArray, unsigned
       //       It would be better to have something like ImgBuffer::GetPixelsRW() in MMDevice.
       //       Or even better - pass tasksMemCopy_ to ImgBuffer constructor
       //       and utilize parallel copy also in single snap acquisitions.
+      long long startUs = CDeviceUtils::GetMonotonicTimeUs();
       tasksMemCopy_->MemCopy((void*)pImg->GetPixels(),
             pixArray + i * singleChannelSize, singleChannelSize);
+      if (i == 0)
+         copyStartUs = startUs;
+      copyUs += CDeviceUtils::GetMonotonicTimeUs() - startUs;
+   }
+
+   {
+      MMThreadGuard guard(g_bufferLock);
+      if (stats)
+         stats->Record(mm::AcquisitionStatistics::StageCopy, copyStartUs,
+               copyUs, insertIndex_);
+      for (size_t i = 0; i < coordinates.size(); ++i)
+         IndexCoordinates(coordinates[i].second, coordinates[i].first);
+      AdvanceInsertIndex();
    }
 
+   return true;
+}
+
+/**
+* Fills in the per-channel metadata of a frame being inserted.
+*/
+void CircularBuffer::BuildChannelMetadata(Metadata& md, const Metadata* pMd,
+      unsigned int width, unsigned int height, unsigned int byteDepth,
+      unsigned int nComponents)
+{
    {
       MMThreadGuard guard(g_bufferLock);
+      if (pMd)
+      {
+         // TODO: the same metadata is inserted for each channel ???
+         // Perhaps we need to add specific tags to each channel
+         md = *pMd;
+      }
 
-      imageCounter_++;
-      insertIndex_++;
-      if ((insertIndex_ - (long)frameArray_.size()) > adjustThreshold && (saveIndex_- (long)frameArray_.size()) > adjustThreshold)
+      std::string cameraName = md.GetSingleTag("Camera").GetValue();
+      if (imageNumbers_.end() == imageNumbers_.find(cameraName))
       {
-         // adjust buffer indices to avoid overflowing integer size
-         insertIndex_ -= adjustThreshold;
-         saveIndex_ -= adjustThreshold;
+         imageNumbers_[cameraName] = 0;
       }
+
+      // insert image number. 
+      md.put(MM::g_Keyword_Metadata_ImageNumber, CDeviceUtils::ConvertToString(imageNumbers_[cameraName]));
+      ++imageNumbers_[cameraName];
    }
 
+   boost::posix_time::ptime t = boost::posix_time::microsec_clock::local_time();
+   if (!md.HasTag(MM::g_Keyword_Elapsed_Time_ms))
+   {
+      // if time tag was not supplied by the camera insert current timestamp
+      MM::MMTime timestamp = GetMMTimeNow(t);
+      md.PutImageTag(MM::g_Keyword_Elapsed_Time_ms, CDeviceUtils::ConvertToString((timestamp - startTime_).getMsec()));
+   }
+   tStream << t;
+   md.PutImageTag(MM::g_Keyword_Metadata_TimeInCore, tStream.str().c_str());
+   tStream.str(std::string());
+   tStream.clear();
+
+   md.PutImageTag("Width",width);
+   md.PutImageTag("Height",height);
+   if (byteDepth == 1)
+      md.PutImageTag("PixelType","GRAY8");
+   else if (byteDepth == 2)
+      md.PutImageTag("PixelType","GRAY16");
+   else if (byteDepth == 4)
+   {
+      if (nComponents == 1)
+         md.PutImageTag("PixelType","GRAY32");
+      else
+         md.PutImageTag("PixelType","RGB32");
+   }
+   else if (byteDepth == 8)
+      md.PutImageTag("PixelType","RGB64");
+   else
+      md.PutImageTag("PixelType","Unknown"); 
+}
+
+/**
+* Must be called with g_bufferLock held.
+*/
+void CircularBuffer::AdvanceInsertIndex()
+{
+   if (statistics_)
+   {
+      insertTimesUs_[insertIndex_ % insertTimesUs_.size()] =
+         CDeviceUtils::GetMonotonicTimeUs();
+      statistics_->CountInserted();
+   }
+   imageCounter_++;
+   insertIndex_++;
+   if ((insertIndex_ - (long)frameArray_.size()) > adjustThreshold && (saveIndex_- (long)frameArray_.size()) > adjustThreshold &&
+         pinnedFrames_.empty())
+   {
+      // adjust buffer indices to avoid overflowing integer size
+      insertIndex_ -= adjustThreshold;
+      saveIndex_ -= adjustThreshold;
+      for (CoordinateIndex::iterator it = coordinateIndex_.begin(),
+            end = coordinateIndex_.end(); it != end; ++it)
+         it->second.frameIndex -= adjustThreshold;
+   }
+}
+
+/**
+* Records how long a frame waited in the buffer before being popped.
+* Must be called with g_bufferLock held.
+*/
+void CircularBuffer::RecordPop(long frameIndex)
+{
+   if (!statistics_)
+      return;
+   long long insertedUs = insertTimesUs_[frameIndex % insertTimesUs_.size()];
+   statistics_->CountPopped();
+   if (insertedUs > 0)
+      statistics_->Record(mm::AcquisitionStatistics::StageQueue, insertedUs,
+            CDeviceUtils::GetMonotonicTimeUs() - insertedUs, frameIndex);
+}
+
+/**
+* Reads the coordinate tags of a channel of a frame. Missing coordinates are
+* 0. All channels of a frame carry the same tags, so the channels are
+* numbered from the ChannelIndex tag. Returns false if the frame has none of
+* the tags.
+*/
+bool CircularBuffer::ReadCoordinates(Metadata& md, unsigned channel,
+      Coordinates& coords)
+{
+   const char* const keys[] = {
+      MM::g_Keyword_Metadata_PositionIndex,
+      MM::g_Keyword_Metadata_ChannelIndex,
+      MM::g_Keyword_Metadata_SliceIndex,
+      MM::g_Keyword_Metadata_FrameIndex,
+   };
+   long* const values[] = {
+      &coords.position, &coords.channel, &coords.slice, &coords.frame,
+   };
+   bool found = false;
+   for (int i = 0; i < 4; ++i)
+   {
+      *values[i] = 0;
+      if (md.HasTag(keys[i]))
+      {
+         *values[i] = atol(md.GetSingleTag(keys[i]).GetValue().c_str());
+         found = true;
+      }
+   }
+   coords.channel += channel;
+   coords.camera = md.HasTag(MM::g_Keyword_CoreCamera) ?
+      md.GetSingleTag(MM::g_Keyword_CoreCamera).GetValue() : std::string();
+   return found;
+}
+
+/**
+* Removes the index entries of the frame held in a slot that is about to be
+* overwritten. An entry that has since been taken over by a newer frame with
+* the same coordinates is kept.
+* Must be called with g_bufferLock held.
+*/
+void CircularBuffer::EvictCoordinates(long slot)
+{
+   if (slotCoordinates_.empty())
+      return;
+   std::vector<Coordinates>& held = slotCoordinates_[slot];
+   for (std::vector<Coordinates>::const_iterator it = held.begin(),
+         end = held.end(); it != end; ++it)
+   {
+      CoordinateIndex::iterator entry = coordinateIndex_.find(*it);
+      if (entry != coordinateIndex_.end() &&
+            entry->second.frameIndex % (long)frameArray_.size() == slot)
+         coordinateIndex_.erase(entry);
+   }
+   held.clear();
+}
+
+/**
+* Makes a channel of the frame being inserted at insertIndex_ findable by its
+* coordinates.
+* Must be called with g_bufferLock held.
+*/
+void CircularBuffer::IndexCoordinates(const Coordinates& coords, unsigned channel)
+{
+   long slot = insertIndex_ % frameArray_.size();
+   IndexEntry entry;
+   entry.frameIndex = insertIndex_;
+   entry.channel = channel;
+   coordinateIndex_[coords] = entry;
+   slotCoordinates_[slot].push_back(coords);
+}
+
+/**
+* Returns the number of slots that may not be overwritten: unread frames plus
+* any older frames that are still pinned.
+* Must be called with g_bufferLock held.
+*/
+long CircularBuffer::OccupiedSlotCount() const
+{
+   long oldest = saveIndex_;
+   if (!pinnedFrames_.empty() && *pinnedFrames_.begin() < oldest)
+      oldest = *pinnedFrames_.begin();
+   return insertIndex_ - oldest;
+}
+
+/**
+* Blocks until the consumer frees a slot or the deadline passes.
+* Returns false on timeout. Must be called with neither g_insertLock nor
+* g_bufferLock held.
+*/
+bool CircularBuffer::WaitForSpace(const boost::system_time& deadline)
+{
+   boost::mutex::scoped_lock lock(spaceMutex_);
+   for (;;)
+   {
+      {
+         MMThreadGuard guard(g_bufferLock);
+         if (OccupiedSlotCount() < static_cast<long>(frameArray_.size()))
+            return true;
+      }
+      if (!spaceCond_.timed_wait(lock, deadline))
+      {
+         MMThreadGuard guard(g_bufferLock);
+         return OccupiedSlotCount() < static_cast<long>(frameArray_.size());
+      }
+   }
+}
+
+/**
+* Appends a frame to the spill file. Each record is the channel count and
+* channel size, followed by the serialized metadata and the pixels of each
+* channel.
+*
+* The frame must have been counted in spillPendingCount_ when the decision
+* to spill it was taken; generation is the spill generation at that time.
+* Must be called with neither g_insertLock nor g_bufferLock held, so that
+* the disk write holds up neither other cameras nor readers.
+*/
+void CircularBuffer::SpillFrame(const unsigned char* pixArray,
+      unsigned int numChannels, unsigned long singleChannelSize,
+      const std::vector<Metadata>& mds, unsigned long generation)
+{
+   MMThreadGuard spillGuard(spillLock_);
+
+   bool current;
+   {
+      MMThreadGuard guard(g_bufferLock);
+      // Clear() and Initialize() take spillLock_, so the generation cannot
+      // change while it is held
+      current = generation == spillGeneration_;
+   }
+
+   bool ok = current && WriteSpillRecord(pixArray, numChannels,
+         singleChannelSize, mds);
+
+   MMThreadGuard guard(g_bufferLock);
+   --spillPendingCount_;
+   if (!current)
+      return; // buffer was cleared after the frame arrived
+   if (ok)
+   {
+      ++spillCount_;
+      ++spilledImageCount_;
+   }
+   else
+      ++droppedImageCount_;
+}
+
+/**
+* Must be called with spillLock_ held.
+*/
+bool CircularBuffer::WriteSpillRecord(const unsigned char* pixArray,
+      unsigned int numChannels, unsigned long singleChannelSize,
+      const std::vector<Metadata>& mds)
+{
+   if (!spillFile_)
+   {
+      if (spillDirectory_.empty())
+      {
+         spillFile_ = std::tmpfile();
+      }
+      else
+      {
+         std::ostringstream path;
+         path << spillDirectory_ << "/mmcore-buffer-spill-" << this << ".bin";
+         spillPath_ = path.str();
+         spillFile_ = std::fopen(spillPath_.c_str(), "w+b");
+      }
+      spillReadOffset_ = 0;
+      spillWriteOffset_ = 0;
+      if (!spillFile_)
+         return false;
+   }
+
+   if (SeekSpillFile(spillFile_, spillWriteOffset_) != 0)
+      return false;
+
+   unsigned long long channelSize = singleChannelSize;
+   bool ok = std::fwrite(&numChannels, sizeof(numChannels), 1, spillFile_) == 1 &&
+      std::fwrite(&channelSize, sizeof(channelSize), 1, spillFile_) == 1;
+   long long recordSize = sizeof(numChannels) + sizeof(channelSize);
+   for (unsigned i = 0; ok && i < numChannels; i++)
+   {
+      std::string serializedMd = mds[i].Serialize();
+      unsigned long long mdSize = serializedMd.size();
+      ok = std::fwrite(&mdSize, sizeof(mdSize), 1, spillFile_) == 1 &&
+         std::fwrite(serializedMd.data(), 1, serializedMd.size(), spillFile_) == serializedMd.size() &&
+         std::fwrite(pixArray + i * singleChannelSize, 1, singleChannelSize, spillFile_) == singleChannelSize;
+      recordSize += sizeof(mdSize) + serializedMd.size() + singleChannelSize;
+   }
+   if (!ok)
+      return false;
+
+   spillWriteOffset_ += recordSize;
    return true;
 }
+
+/**
+* Moves spilled frames back into free slots, oldest first.
+*
+* Must be called with neither g_insertLock nor g_bufferLock held. The file
+* is read into the free slot without g_bufferLock: the slot is not visible
+* to readers until the insert index is advanced past it, and inserts do not
+* write to the buffer while frames are queued on disk.
+*/
+void CircularBuffer::RefillFromSpill()
+{
+   {
+      MMThreadGuard guard(g_bufferLock);
+      if (spillCount_ == 0)
+         return;
+   }
+
+   MMThreadGuard spillGuard(spillLock_);
+
+   std::string serializedMd;
+   for (;;)
+   {
+      long slot;
+      unsigned long long expectedChannelSize;
+      {
+         MMThreadGuard guard(g_bufferLock);
+         if (spillCount_ == 0 ||
+               OccupiedSlotCount() >= static_cast<long>(frameArray_.size()))
+            break;
+         slot = insertIndex_ % frameArray_.size();
+         EvictCoordinates(slot);
+         expectedChannelSize = (unsigned long long)width_ * height_ * pixDepth_;
+      }
+      // frameArray_ is only resized by Initialize(), which takes spillLock_
+      mm::FrameBuffer& frame = frameArray_[slot];
+
+      unsigned int numChannels = 0;
+      unsigned long long channelSize = 0;
+      bool ok = SeekSpillFile(spillFile_, spillReadOffset_) == 0 &&
+         std::fread(&numChannels, sizeof(numChannels), 1, spillFile_) == 1 &&
+         std::fread(&channelSize, sizeof(channelSize), 1, spillFile_) == 1 &&
+         channelSize == expectedChannelSize;
+      long long recordSize = sizeof(numChannels) + sizeof(channelSize);
+      std::vector<Metadata> mds;
+      for (unsigned i = 0; ok && i < numChannels; i++)
+      {
+         mm::ImgBuffer* pImg = frame.FindImage(i);
+         unsigned long long mdSize = 0;
+         ok = pImg != 0 &&
+            std::fread(&mdSize, sizeof(mdSize), 1, spillFile_) == 1;
+         if (!ok)
+            break;
+         serializedMd.resize((size_t)mdSize);
+         ok = (mdSize == 0 || std::fread(&serializedMd[0], 1, (size_t)mdSize, spillFile_) == mdSize) &&
+            std::fread((void*)pImg->GetPixels(), 1, (size_t)channelSize, spillFile_) == channelSize;
+         if (ok)
+         {
+            mds.push_back(Metadata());
+            mds.back().Restore(serializedMd.c_str());
+         }
+         recordSize += sizeof(mdSize) + mdSize + channelSize;
+      }
+
+      MMThreadGuard guard(g_bufferLock);
+      if (!ok)
+      {
+         // The rest of the spill file cannot be trusted
+         droppedImageCount_ += spillCount_;
+         spillCount_ = 0;
+         break;
+      }
+
+      for (unsigned i = 0; i < numChannels; i++)
+      {
+         frame.FindImage(i)->SetMetadata(mds[i]);
+         Coordinates coords;
+         if (coordinateIndexEnabled_ && ReadCoordinates(mds[i], i, coords))
+            IndexCoordinates(coords, i);
+      }
+      spillReadOffset_ += recordSize;
+      --spillCount_;
+      AdvanceInsertIndex();
+   }
+
+   MMThreadGuard guard(g_bufferLock);
+   if (spillCount_ == 0 && spillPendingCount_ == 0)
+   {
+      // start over at the beginning of the file (frames still being
+      // spilled wait for spillLock_ and are then written from the start)
+      spillReadOffset_ = 0;
+      spillWriteOffset_ = 0;
+   }
+}
+
+/**
+* Throws away all frames queued on disk and closes the spill file. Frames
+* being spilled at the time are discarded when their turn comes.
+* Must be called with spillLock_ and g_bufferLock held (except from the
+* destructor).
+*/
+void CircularBuffer::DiscardSpill()
+{
+   if (spillFile_)
+   {
+      std::fclose(spillFile_);
+      spillFile_ = 0;
+      if (!spillPath_.empty())
+         std::remove(spillPath_.c_str());
+   }
+   spillPath_.clear();
+   spillReadOffset_ = 0;
+   spillWriteOffset_ = 0;
+   spillCount_ = 0;
+   ++spillGeneration_;
+}
  
 
+/**
+* Removes the next image from the buffer like GetNextImageBuffer(), but keeps
+* its slot from being reused until ReleasePinnedImage() is called with its
+* pixels.
+*/
+const mm::ImgBuffer* CircularBuffer::GetNextImageBufferPinned(unsigned channel)
+{
+   RefillFromSpill();
+
+   MMThreadGuard guard(g_bufferLock);
+
+   if (insertIndex_ - saveIndex_ < 1)
+      return 0;
+
+   const mm::ImgBuffer* img = PinFrame(saveIndex_, channel);
+   if (img)
+   {
+      RecordPop(saveIndex_);
+      ++saveIndex_;
+   }
+   return img;
+}
+
+/**
+* Returns the last inserted image, pinned until ReleasePinnedImage() is
+* called with its pixels.
+*/
+const mm::ImgBuffer* CircularBuffer::GetTopImageBufferPinned(unsigned channel)
+{
+   MMThreadGuard guard(g_bufferLock);
+
+   if (insertIndex_ - saveIndex_ < 1)
+      return 0;
+
+   return PinFrame(insertIndex_ - 1, channel);
+}
+
+/**
+* Must be called with g_bufferLock held.
+*/
+const mm::ImgBuffer* CircularBuffer::PinFrame(long frameIndex, unsigned channel)
+{
+   const mm::ImgBuffer* img = frameArray_[frameIndex % frameArray_.size()].FindImage(channel);
+   if (!img)
+      return 0;
+   pinnedImages_.insert(std::make_pair(img->GetPixels(), frameIndex));
+   pinnedFrames_.insert(frameIndex);
+   return img;
+}
+
+/**
+* Releases one pin taken by GetNextImageBufferPinned() or
+* GetTopImageBufferPinned(). Returns false if the pixels were not pinned.
+*/
+bool CircularBuffer::ReleasePinnedImage(const unsigned char* pixels)
+{
+   bool notifyProducer = false;
+   {
+      MMThreadGuard guard(g_bufferLock);
+      std::multimap<const unsigned char*, long>::iterator it = pinnedImages_.find(pixels);
+      if (it == pinnedImages_.end())
+         return false;
+      pinnedFrames_.erase(pinnedFrames_.find(it->second));
+      pinnedImages_.erase(it);
+      notifyProducer = (overflowPolicy_ == OverflowBlock);
+   }
+
+   if (notifyProducer)
+   {
+      {
+         boost::mutex::scoped_lock lock(spaceMutex_);
+      }
+      spaceCond_.notify_all();
+   }
+   return true;
+}
+
+unsigned long CircularBuffer::GetPinnedImageCount() const
+{
+   MMThreadGuard guard(g_bufferLock);
+   return (unsigned long)pinnedImages_.size();
+}
+
+/**
+* Returns the size in bytes of a pinned image, or 0 if the pixels are not
+* pinned.
+*/
+unsigned long CircularBuffer::GetPinnedImageByteCount(const unsigned char* pixels) const
+{
+   MMThreadGuard guard(g_bufferLock);
+   if (pinnedImages_.find(pixels) == pinnedImages_.end())
+      return 0;
+   return (unsigned long)width_ * height_ * pixDepth_;
+}
+
 const unsigned char* CircularBuffer::GetTopImage() const
 {
    const mm::ImgBuffer* img = GetNthFromTopImageBuffer(0, 0);
@@ -334,13 +1136,32 @@ const unsigned char* CircularBuffer::GetNextImage()
 
 const mm::ImgBuffer* CircularBuffer::GetNextImageBuffer(unsigned channel)
 {
-   MMThreadGuard guard(g_bufferLock);
+   const mm::ImgBuffer* img = 0;
+   bool notifyProducer = false;
 
-   long availableImages = insertIndex_ - saveIndex_;
-   if (availableImages < 1)
-      return 0;
+   // The slot returned by the previous call is free now
+   RefillFromSpill();
 
-   long targetIndex = saveIndex_ % frameArray_.size();
-   ++saveIndex_;
-   return frameArray_[targetIndex].FindImage(channel);
+   {
+      MMThreadGuard guard(g_bufferLock);
+
+      long availableImages = insertIndex_ - saveIndex_;
+      if (availableImages < 1)
+         return 0;
+
+      long targetIndex = saveIndex_ % frameArray_.size();
+      RecordPop(saveIndex_);
+      ++saveIndex_;
+      img = frameArray_[targetIndex].FindImage(channel);
+      notifyProducer = (overflowPolicy_ == OverflowBlock);
+   }
+
+   if (notifyProducer)
+   {
+      {
+         boost::mutex::scoped_lock lock(spaceMutex_);
+      }
+      spaceCond_.notify_all();
+   }
+   return img;
 }
@@ -32,8 +32,17 @@
 #include "../MMDevice/MMDevice.h"
 
 #include <boost/date_time/posix_time/posix_time.hpp>
+#include <boost/functional/hash.hpp>
 #include <boost/smart_ptr/shared_ptr.hpp>
+#include <boost/thread/condition_variable.hpp>
+#include <boost/thread/mutex.hpp>
+#include <boost/thread/thread_time.hpp>
+#include <boost/unordered_map.hpp>
 
+#include <cstdio>
+#include <map>
+#include <set>
+#include <string>
 #include <vector>
 
 #ifdef _MSC_VER
@@ -44,9 +53,51 @@
 class ThreadPool;
 class TaskSet_CopyMemory;
 
+namespace mm { class DiskStreamSink; }
+namespace mm { class AcquisitionStatistics; }
+
 class CircularBuffer
 {
 public:
+   // What to do with a new frame when the buffer is full
+   enum OverflowPolicy
+   {
+      OverflowError, // Refuse the frame and report the overflow to the camera
+      OverflowDropNewest, // Discard the new frame
+      OverflowDropOldest, // Discard the oldest unread frame to make room
+      OverflowBlock, // Wait for the consumer, then discard the new frame
+      OverflowSpillToDisk // Queue frames in a file until there is room
+   };
+
+   // Acquisition coordinates of a frame, from its metadata tags
+   // (MM::g_Keyword_Metadata_PositionIndex and so on), qualified by the label
+   // of the camera that inserted it
+   struct Coordinates
+   {
+      std::string camera;
+      long position;
+      long channel;
+      long slice;
+      long frame;
+
+      bool operator==(const Coordinates& rhs) const
+      {
+         return position == rhs.position && channel == rhs.channel &&
+            slice == rhs.slice && frame == rhs.frame && camera == rhs.camera;
+      }
+
+      friend std::size_t hash_value(const Coordinates& c)
+      {
+         std::size_t seed = 0;
+         boost::hash_combine(seed, c.camera);
+         boost::hash_combine(seed, c.position);
+         boost::hash_combine(seed, c.channel);
+         boost::hash_combine(seed, c.slice);
+         boost::hash_combine(seed, c.frame);
+         return seed;
+      }
+   };
+
    CircularBuffer(unsigned int memorySizeMB);
    ~CircularBuffer();
 
@@ -73,12 +124,71 @@ public:
    const mm::ImgBuffer* GetNextImageBuffer(unsigned channel);
    void Clear(); 
 
+   // Pinned frames are not overwritten or freed until released, so their
+   // pixels can be handed out without copying. Clear() keeps pinned slots
+   // reserved, and Initialize() fails if it would reallocate the frames
+   // while any are pinned.
+   const mm::ImgBuffer* GetNextImageBufferPinned(unsigned channel);
+   const mm::ImgBuffer* GetTopImageBufferPinned(unsigned channel);
+   bool ReleasePinnedImage(const unsigned char* pixels);
+   unsigned long GetPinnedImageCount() const;
+   unsigned long GetPinnedImageByteCount(const unsigned char* pixels) const;
+
    bool Overflow() {MMThreadGuard guard(g_bufferLock); return overflow_;}
 
+   void SetOverflowPolicy(OverflowPolicy policy);
+   OverflowPolicy GetOverflowPolicy() const;
+   void SetOverflowBlockTimeoutMs(long timeoutMs);
+   long GetOverflowBlockTimeoutMs() const;
+   void SetSpillDirectory(const std::string& directory);
+   std::string GetSpillDirectory() const;
+   // Counts since the buffer was last cleared
+   unsigned long GetDroppedImageCount() const;
+   unsigned long GetSpilledImageCount() const;
+
+   // Every inserted frame is also passed to the sink, if set, regardless of
+   // the overflow policy
+   void SetStreamSink(boost::shared_ptr<mm::DiskStreamSink> sink);
+   boost::shared_ptr<mm::DiskStreamSink> GetStreamSink() const;
+
+   // Inserts and pops are timed into the statistics, if set
+   void SetStatistics(boost::shared_ptr<mm::AcquisitionStatistics> stats);
+   boost::shared_ptr<mm::AcquisitionStatistics> GetStatistics() const;
+
+   // When enabled, frames carrying coordinate tags can be looked up by their
+   // coordinates for as long as their slot has not been overwritten, whether
+   // or not they have been popped. Frames inserted while disabled are not
+   // indexed.
+   void SetCoordinateIndexEnabled(bool enabled);
+   bool IsCoordinateIndexEnabled() const;
+   const mm::ImgBuffer* GetImageBufferAt(const Coordinates& coords) const;
+   const mm::ImgBuffer* GetImageBufferAtPinned(const Coordinates& coords);
+
    mutable MMThreadLock g_bufferLock;
    mutable MMThreadLock g_insertLock;
 
 private:
+   void BuildChannelMetadata(Metadata& md, const Metadata* pMd,
+         unsigned int width, unsigned int height, unsigned int byteDepth,
+         unsigned int nComponents);
+   long OccupiedSlotCount() const;
+   const mm::ImgBuffer* PinFrame(long frameIndex, unsigned channel);
+   void AdvanceInsertIndex();
+   void RecordPop(long frameIndex);
+   static bool ReadCoordinates(Metadata& md, unsigned channel,
+         Coordinates& coords);
+   void EvictCoordinates(long slot);
+   void IndexCoordinates(const Coordinates& coords, unsigned channel);
+   bool WaitForSpace(const boost::system_time& deadline);
+   void SpillFrame(const unsigned char* pixArray, unsigned int numChannels,
+         unsigned long singleChannelSize, const std::vector<Metadata>& mds,
+         unsigned long generation);
+   bool WriteSpillRecord(const unsigned char* pixArray,
+         unsigned int numChannels, unsigned long singleChannelSize,
+         const std::vector<Metadata>& mds);
+   void RefillFromSpill();
+   void DiscardSpill();
+
    unsigned int width_;
    unsigned int height_;
    unsigned int pixDepth_;
@@ -102,4 +212,53 @@ private:
 
    boost::posix_time::time_facet * facet;
    std::ostringstream tStream;
+
+   // Frame index of each pinned image, by pixel address
+   std::multimap<const unsigned char*, long> pinnedImages_;
+   std::multiset<long> pinnedFrames_;
+
+   OverflowPolicy overflowPolicy_;
+   long overflowBlockTimeoutMs_;
+   unsigned long droppedImageCount_;
+   unsigned long spilledImageCount_;
+
+   // Signalled when the consumer frees a slot (used by OverflowBlock)
+   boost::mutex spaceMutex_;
+   boost::condition_variable spaceCond_;
+
+   // Spill file and its offsets, guarded by spillLock_, which is held for
+   // the duration of spill file I/O. When both spillLock_ and g_bufferLock
+   // are needed, spillLock_ must be acquired first; g_insertLock is never
+   // held while waiting for spillLock_.
+   mutable MMThreadLock spillLock_;
+   std::string spillDirectory_;
+   std::string spillPath_;
+   std::FILE* spillFile_;
+   long long spillReadOffset_;
+   long long spillWriteOffset_;
+   // Frames in the spill file, frames being written to it, and a count of
+   // discards of the spill file; guarded by g_bufferLock
+   unsigned long spillCount_;
+   unsigned long spillPendingCount_;
+   unsigned long spillGeneration_;
+
+   boost::shared_ptr<mm::DiskStreamSink> streamSink_;
+
+   boost::shared_ptr<mm::AcquisitionStatistics> statistics_;
+   // Monotonic time at which the frame in each slot was inserted
+   std::vector<long long> insertTimesUs_;
+
+   // Where each frame inserted with coordinate tags can be found, and the
+   // coordinates held by each slot so that they can be evicted when the slot
+   // is overwritten. Guarded by g_bufferLock.
+   struct IndexEntry
+   {
+      long frameIndex;
+      unsigned channel;
+   };
+   typedef boost::unordered_map<Coordinates, IndexEntry,
+           boost::hash<Coordinates> > CoordinateIndex;
+   bool coordinateIndexEnabled_;
+   CoordinateIndex coordinateIndex_;
+   std::vector< std::vector<Coordinates> > slotCoordinates_;
 };
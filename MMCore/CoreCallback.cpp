@@ -28,9 +28,12 @@
 #include "../MMDevice/DeviceThreads.h"
 #include "../MMDevice/DeviceUtils.h"
 #include "../MMDevice/ImgBuffer.h"
+#include "AcquisitionStatistics.h"
 #include "CircularBuffer.h"
 #include "CoreCallback.h"
 #include "DeviceManager.h"
+#include "EventDispatcher.h"
+#include "FrameAccumulator.h"
 
 #include <boost/date_time/posix_time/posix_time.hpp>
 #include <string>
@@ -223,20 +226,14 @@ CoreCallback::AddCameraMetadata(const MM::Device* caller, const Metadata* pMd)
    std::string label = camera->GetLabel();
    newMD.put("Camera", label);
 
-   std::string serializedMD;
    try
    {
-      serializedMD = camera->GetTags();
+      camera->MergeTagsInto(newMD);
    }
    catch (const CMMError&)
    {
-      return newMD;
    }
 
-   Metadata devMD;
-   devMD.Restore(serializedMD.c_str());
-   newMD.Merge(devMD);
-
    return newMD;
 }
 
@@ -249,27 +246,7 @@ int CoreCallback::InsertImage(const MM::Device* caller, const unsigned char* buf
 
 int CoreCallback::InsertImage(const MM::Device* caller, const unsigned char* buf, unsigned width, unsigned height, unsigned byteDepth, const Metadata* pMd, bool doProcess)
 {
-   try 
-   {
-      Metadata md = AddCameraMetadata(caller, pMd);
-
-      if(doProcess)
-      {
-         MM::ImageProcessor* ip = GetImageProcessor(caller);
-         if( NULL != ip)
-         {
-            ip->Process(const_cast<unsigned char*>(buf), width, height, byteDepth);
-         }
-      }
-      if (core_->cbuf_->InsertImage(buf, width, height, byteDepth, &md))
-         return DEVICE_OK;
-      else
-         return DEVICE_BUFFER_OVERFLOW;
-   }
-   catch (CMMError& /*e*/)
-   {
-      return DEVICE_INCOMPATIBLE_IMAGE;
-   }
+   return InsertTimed(caller, buf, 1, width, height, byteDepth, 1, pMd, doProcess);
 }
 
 int CoreCallback::InsertImage(const MM::Device* caller, const unsigned char* buf, unsigned width, unsigned height, unsigned byteDepth, unsigned nComponents, const char* serializedMetadata, const bool doProcess)
@@ -281,27 +258,7 @@ int CoreCallback::InsertImage(const MM::Device* caller, const unsigned char* buf
 
 int CoreCallback::InsertImage(const MM::Device* caller, const unsigned char* buf, unsigned width, unsigned height, unsigned byteDepth, unsigned nComponents, const Metadata* pMd, bool doProcess)
 {
-   try 
-   {
-      Metadata md = AddCameraMetadata(caller, pMd);
-
-      if(doProcess)
-      {
-         MM::ImageProcessor* ip = GetImageProcessor(caller);
-         if( NULL != ip)
-         {
-            ip->Process(const_cast<unsigned char*>(buf), width, height, byteDepth);
-         }
-      }
-      if (core_->cbuf_->InsertImage(buf, width, height, byteDepth, nComponents, &md))
-         return DEVICE_OK;
-      else
-         return DEVICE_BUFFER_OVERFLOW;
-   }
-   catch (CMMError& /*e*/)
-   {
-      return DEVICE_INCOMPATIBLE_IMAGE;
-   }
+   return InsertTimed(caller, buf, 1, width, height, byteDepth, nComponents, pMd, doProcess);
 }
 
 int CoreCallback::InsertImage(const MM::Device* caller, const ImgBuffer & imgBuf)
@@ -341,25 +298,81 @@ int CoreCallback::InsertMultiChannel(const MM::Device* caller,
                               unsigned byteDepth,
                               Metadata* pMd)
 {
+   return InsertTimed(caller, buf, numChannels, width, height, byteDepth, 1, pMd, true);
+}
+
+/**
+ * Common implementation of the insert calls. Each step is timed into the
+ * core's acquisition statistics.
+ */
+int CoreCallback::InsertTimed(const MM::Device* caller,
+                              const unsigned char* buf,
+                              unsigned numChannels,
+                              unsigned width,
+                              unsigned height,
+                              unsigned byteDepth,
+                              unsigned nComponents,
+                              const Metadata* pMd,
+                              bool doProcess)
+{
+   mm::AcquisitionStatistics& stats = *core_->acqStats_;
+   long long startUs = CDeviceUtils::GetMonotonicTimeUs();
+   stats.RecordArrival(startUs);
    try
    {
       Metadata md = AddCameraMetadata(caller, pMd);
+      long long metadataDoneUs = CDeviceUtils::GetMonotonicTimeUs();
+      stats.Record(mm::AcquisitionStatistics::StageMetadata, startUs,
+            metadataDoneUs - startUs);
 
-      MM::ImageProcessor* ip = GetImageProcessor(caller);
-      if( NULL != ip)
+      if (doProcess)
       {
-         ip->Process( const_cast<unsigned char*>(buf), width, height, byteDepth);
+         MM::ImageProcessor* ip = GetImageProcessor(caller);
+         if( NULL != ip)
+         {
+            ip->Process(const_cast<unsigned char*>(buf), width, height, byteDepth);
+            stats.Record(mm::AcquisitionStatistics::StageProcess,
+                  metadataDoneUs,
+                  CDeviceUtils::GetMonotonicTimeUs() - metadataDoneUs);
+         }
       }
-      if (core_->cbuf_->InsertMultiChannel(buf, numChannels, width, height, byteDepth, &md))
+
+      boost::shared_ptr<mm::FrameAccumulator> accumulator =
+         core_->getFrameAccumulator();
+      // Keeps the accumulated pixels alive until they have been inserted
+      mm::FrameAccumulator::Result accumulated;
+      if (accumulator)
+      {
+         long long accumulateStartUs = CDeviceUtils::GetMonotonicTimeUs();
+         bool due = accumulator->Add(caller, buf, width, height, byteDepth,
+               nComponents, numChannels, accumulated);
+         stats.Record(mm::AcquisitionStatistics::StageProcess,
+               accumulateStartUs,
+               CDeviceUtils::GetMonotonicTimeUs() - accumulateStartUs);
+         if (!due)
+            return DEVICE_OK;
+         if (accumulated)
+         {
+            buf = &(*accumulated)[0];
+            md.PutImageTag<std::string>("FrameAccumulationMode",
+                  mm::FrameAccumulator::GetModeName(accumulator->GetMode()));
+            md.PutImageTag("AccumulatedFrames", accumulator->GetFrameCount());
+         }
+      }
+      bool inserted = core_->cbuf_->InsertMultiChannel(buf, numChannels,
+            width, height, byteDepth, nComponents, &md);
+      stats.Record(mm::AcquisitionStatistics::StageInsert, startUs,
+            CDeviceUtils::GetMonotonicTimeUs() - startUs);
+      if (inserted)
          return DEVICE_OK;
-      else
-         return DEVICE_BUFFER_OVERFLOW;
+      stats.CountRefused();
+      return DEVICE_BUFFER_OVERFLOW;
    }
    catch (CMMError& /*e*/)
    {
+      stats.CountRefused();
       return DEVICE_INCOMPATIBLE_IMAGE;
    }
-
 }
 
 int CoreCallback::AcqFinished(const MM::Device* caller, int /*statusCode*/)
@@ -448,8 +461,11 @@ int CoreCallback::PrepareForAcq(const MM::Device* /*caller*/)
  */
 int CoreCallback::OnPropertiesChanged(const MM::Device* /* caller */)
 {
+   if (core_->deferPropertyCallback())
+      return DEVICE_OK;
+
    if (core_->externalCallback_)
-      core_->externalCallback_->onPropertiesChanged();
+      core_->eventDispatcher_->PostPropertiesChanged();
 
    // TODO It is inconsistent that we do not update the system state cache in
    // this case. However, doing so would be time-consuming (if not unsafe).
@@ -462,6 +478,11 @@ int CoreCallback::OnPropertiesChanged(const MM::Device* /* caller */)
  */
 int CoreCallback::OnPropertyChanged(const MM::Device* device, const char* propName, const char* value)
 {
+   // While a configuration is loading, the state cache is refreshed as a
+   // whole at the end
+   if (core_->deferPropertyCallback())
+      return DEVICE_OK;
+
    if (core_->externalCallback_) 
    {
       MMThreadGuard g(*pValueChangeLock_);
@@ -472,9 +493,9 @@ int CoreCallback::OnPropertyChanged(const MM::Device* device, const char* propNa
       const PropertySetting* ps = new PropertySetting(label, propName, value, readOnly);
       {
          MMThreadGuard scg(core_->stateCacheLock_);
-         core_->stateCache_.addSetting(*ps);
+         core_->addStateCacheSetting(*ps);
       }
-      core_->externalCallback_->onPropertyChanged(label, propName, value);
+      core_->eventDispatcher_->PostPropertyChanged(label, propName, value);
 
       // Find all configs that contain this property and callback to indicate 
       // that the config group changed
@@ -541,7 +562,8 @@ int CoreCallback::OnPropertyChanged(const MM::Device* device, const char* propNa
 int CoreCallback::OnConfigGroupChanged(const char* groupName, const char* newConfigName)
 {
    if (core_->externalCallback_) {
-      core_->externalCallback_->onConfigGroupChanged(groupName, newConfigName);
+      core_->eventDispatcher_->PostConfigGroupChanged(groupName,
+            newConfigName);
    }
 
    return DEVICE_OK;
@@ -553,7 +575,7 @@ int CoreCallback::OnConfigGroupChanged(const char* groupName, const char* newCon
 int CoreCallback::OnPixelSizeChanged(double newPixelSizeUm)
 {
    if (core_->externalCallback_) {
-      core_->externalCallback_->onPixelSizeChanged(newPixelSizeUm);
+      core_->eventDispatcher_->PostPixelSizeChanged(newPixelSizeUm);
    }
 
    return DEVICE_OK;
@@ -566,12 +588,7 @@ int CoreCallback::OnPixelSizeChanged(double newPixelSizeUm)
 int CoreCallback::OnPixelSizeAffineChanged(std::vector<double> newPixelSizeAffine)
 {
    if (core_->externalCallback_ && newPixelSizeAffine.size() == 6) {
-      core_->externalCallback_->onPixelSizeAffineChanged(newPixelSizeAffine[0],
-            newPixelSizeAffine[1],
-            newPixelSizeAffine[2],
-            newPixelSizeAffine[3],
-            newPixelSizeAffine[4],
-            newPixelSizeAffine[5]);
+      core_->eventDispatcher_->PostPixelSizeAffineChanged(newPixelSizeAffine);
    }
 
    return DEVICE_OK;
@@ -585,7 +602,7 @@ int CoreCallback::OnStagePositionChanged(const MM::Device* device, double pos)
    if (core_->externalCallback_) {
       char label[MM::MaxStrLength];
       device->GetLabel(label);
-      core_->externalCallback_->onStagePositionChanged(label, pos);
+      core_->eventDispatcher_->PostStagePositionChanged(label, pos);
    }
 
    return DEVICE_OK;
@@ -599,7 +616,7 @@ int CoreCallback::OnXYStagePositionChanged(const MM::Device* device, double xPos
    if (core_->externalCallback_) {
       char label[MM::MaxStrLength];
       device->GetLabel(label);
-      core_->externalCallback_->onXYStagePositionChanged(label, xPos, yPos);
+      core_->eventDispatcher_->PostXYStagePositionChanged(label, xPos, yPos);
    }
 
    return DEVICE_OK;
@@ -614,7 +631,7 @@ int CoreCallback::OnExposureChanged(const MM::Device* device, double newExposure
    if (core_->externalCallback_) {
       char label[MM::MaxStrLength];
       device->GetLabel(label);
-      core_->externalCallback_->onExposureChanged(label, newExposure);
+      core_->eventDispatcher_->PostExposureChanged(label, newExposure);
    }
    return DEVICE_OK;
 }
@@ -626,10 +643,9 @@ int CoreCallback::OnExposureChanged(const MM::Device* device, double newExposure
 int CoreCallback::OnSLMExposureChanged(const MM::Device* device, double newExposure)
 {
    if (core_->externalCallback_) {
-      MMThreadGuard g(*pValueChangeLock_);
       char label[MM::MaxStrLength];
       device->GetLabel(label);
-      core_->externalCallback_->onSLMExposureChanged(label, newExposure);
+      core_->eventDispatcher_->PostSLMExposureChanged(label, newExposure);
    }
    return DEVICE_OK;
 }
@@ -657,6 +673,16 @@ int CoreCallback::OnMagnifierChanged(const MM::Device* /* device */)
    return DEVICE_OK;
 }
 
+/**
+ * Handler for busy state changes reported by devices.
+ * Wakes up threads blocked in waitForDevice() and friends.
+ */
+int CoreCallback::OnBusyChanged(const MM::Device* /* device */, bool /* busy */)
+{
+   core_->notifyBusyChanged();
+   return DEVICE_OK;
+}
+
 
 
 int CoreCallback::SetSerialProperties(const char* portName,
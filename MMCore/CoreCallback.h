@@ -122,6 +122,7 @@ public:
    int OnExposureChanged(const MM::Device* device, double newExposure);
    int OnSLMExposureChanged(const MM::Device* device, double newExposure);
    int OnMagnifierChanged(const MM::Device* device);
+   int OnBusyChanged(const MM::Device* device, bool busy);
 
 
    void NextPostedError(int& errorCode, char* pMessage, int maxlen, int& messageLength);
@@ -143,6 +144,10 @@ private:
    MMThreadLock* pValueChangeLock_;
 
    Metadata AddCameraMetadata(const MM::Device* caller, const Metadata* pMd);
+   int InsertTimed(const MM::Device* caller, const unsigned char* buf,
+         unsigned numChannels, unsigned width, unsigned height,
+         unsigned byteDepth, unsigned nComponents, const Metadata* pMd,
+         bool doProcess);
 
    int OnConfigGroupChanged(const char* groupName, const char* newConfigName);
    int OnPixelSizeChanged(double newPixelSizeUm);
@@ -0,0 +1,62 @@
+///////////////////////////////////////////////////////////////////////////////
+// FILE:          DeviceAdapterProbe.cpp
+// PROJECT:       Micro-Manager
+// SUBSYSTEM:     MMCore
+//-----------------------------------------------------------------------------
+// DESCRIPTION:   Lists the devices in a device adapter module, for the
+//                device adapter index (see DeviceAdapterIndex.h).
+//
+//                Usage: mmdeviceprobe <module name> <module path>
+//
+//                Writes one index record to standard output. A module that
+//                cannot be loaded is reported in the record, not through the
+//                exit status.
+//
+// LICENSE:       This file is distributed under the "Lesser GPL" (LGPL) license.
+//                License text is included with the source distribution.
+//
+//                This file is distributed in the hope that it will be useful,
+//                but WITHOUT ANY WARRANTY; without even the implied warranty
+//                of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+//
+//                IN NO EVENT SHALL THE COPYRIGHT OWNER OR
+//                CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+//                INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES.
+
+#include "../Error.h"
+#include "../LoadableModules/DeviceAdapterIndex.h"
+#include "../LoadableModules/LoadedDeviceAdapter.h"
+
+#include <iostream>
+#include <sstream>
+
+
+int main(int argc, char* argv[])
+{
+   if (argc != 3)
+   {
+      std::cerr << "Usage: mmdeviceprobe <module name> <module path>\n";
+      return 2;
+   }
+
+   mm::AdapterModuleInfo info;
+   info.name = argv[1];
+   info.path = argv[2];
+   try
+   {
+      LoadedDeviceAdapter adapter(info.name, info.path);
+      mm::DeviceAdapterIndex::DescribeModule(adapter, info);
+   }
+   catch (const CMMError& e)
+   {
+      info.devices.clear();
+      info.error = e.getFullMsg();
+   }
+
+   // Write the record in one piece, so that diagnostic output from the
+   // adapter cannot end up in the middle of it
+   std::ostringstream record;
+   mm::DeviceAdapterIndex::WriteRecord(record, info);
+   std::cout << record.str() << std::flush;
+   return std::cout.good() ? 0 : 1;
+}
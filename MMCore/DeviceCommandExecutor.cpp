@@ -0,0 +1,219 @@
+///////////////////////////////////////////////////////////////////////////////
+// FILE:          DeviceCommandExecutor.cpp
+// PROJECT:       Micro-Manager
+// SUBSYSTEM:     MMCore
+//-----------------------------------------------------------------------------
+// DESCRIPTION:   Background execution of device commands, ordered per device
+//
+// LICENSE:       This file is distributed under the "Lesser GPL" (LGPL) license.
+//                License text is included with the source distribution.
+//
+//                This file is distributed in the hope that it will be useful,
+//                but WITHOUT ANY WARRANTY; without even the implied warranty
+//                of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+//
+//                IN NO EVENT SHALL THE COPYRIGHT OWNER OR
+//                CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+//                INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES.
+
+#include "DeviceCommandExecutor.h"
+
+#include <boost/bind.hpp>
+#include <boost/date_time/posix_time/posix_time.hpp>
+#include <boost/make_shared.hpp>
+
+#include <exception>
+
+namespace mm {
+
+namespace {
+
+// Commands mostly wait on hardware, so a thread is needed for each command
+// that should overlap with the others; this only bounds runaway submission.
+const size_t g_MaxThreads = 16;
+
+} // anonymous namespace
+
+
+AsyncCommandState::AsyncCommandState(const std::string& description,
+      const std::vector<std::string>& devices,
+      boost::function<void ()> work) :
+   description_(description),
+   devices_(devices),
+   work_(work),
+   done_(false)
+{
+}
+
+void AsyncCommandState::Execute()
+{
+   boost::shared_ptr<CMMError> error;
+   try
+   {
+      work_();
+   }
+   catch (const CMMError& e)
+   {
+      error = boost::make_shared<CMMError>(e);
+   }
+   catch (const std::exception& e)
+   {
+      error = boost::make_shared<CMMError>(e.what());
+   }
+   catch (...)
+   {
+      error = boost::make_shared<CMMError>("Unknown error in " + description_);
+   }
+
+   boost::mutex::scoped_lock lock(mutex_);
+   error_ = error;
+   done_ = true;
+   doneCond_.notify_all();
+}
+
+bool AsyncCommandState::IsDone()
+{
+   boost::mutex::scoped_lock lock(mutex_);
+   return done_;
+}
+
+bool AsyncCommandState::Wait(long timeoutMs) throw (CMMError)
+{
+   boost::mutex::scoped_lock lock(mutex_);
+   if (timeoutMs < 0)
+   {
+      while (!done_)
+         doneCond_.wait(lock);
+   }
+   else
+   {
+      boost::system_time deadline = boost::get_system_time() +
+         boost::posix_time::milliseconds(timeoutMs);
+      while (!done_)
+      {
+         if (!doneCond_.timed_wait(lock, deadline))
+            return done_ ? true : false;
+      }
+   }
+   if (error_)
+      throw CMMError(description_ + " failed", error_->getCode(), *error_);
+   return true;
+}
+
+std::string AsyncCommandState::GetErrorText()
+{
+   boost::mutex::scoped_lock lock(mutex_);
+   return error_ ? error_->getFullMsg() : std::string();
+}
+
+
+DeviceCommandExecutor::DeviceCommandExecutor(logging::Logger logger) :
+   logger_(logger),
+   runningCount_(0),
+   idleThreadCount_(0),
+   shutdown_(false)
+{
+}
+
+DeviceCommandExecutor::~DeviceCommandExecutor()
+{
+   {
+      boost::mutex::scoped_lock lock(mutex_);
+      shutdown_ = true;
+   }
+   workCond_.notify_all();
+   for (size_t i = 0; i < threads_.size(); ++i)
+      threads_[i]->join();
+}
+
+AsyncCommand DeviceCommandExecutor::Submit(const std::string& description,
+      const std::vector<std::string>& devices,
+      boost::function<void ()> work)
+{
+   boost::shared_ptr<AsyncCommandState> state =
+      boost::make_shared<AsyncCommandState>(description, devices, work);
+
+   boost::mutex::scoped_lock lock(mutex_);
+   queue_.push_back(state);
+   if (idleThreadCount_ == 0 && threads_.size() < g_MaxThreads)
+   {
+      threads_.push_back(boost::make_shared<boost::thread>(
+               boost::bind(&DeviceCommandExecutor::ThreadFunc, this)));
+   }
+   workCond_.notify_one();
+   return AsyncCommand(state);
+}
+
+void DeviceCommandExecutor::WaitForIdle()
+{
+   boost::mutex::scoped_lock lock(mutex_);
+   while (!queue_.empty() || runningCount_ > 0)
+      idleCond_.wait(lock);
+}
+
+boost::shared_ptr<AsyncCommandState> DeviceCommandExecutor::TakeRunnable()
+{
+   // Devices of running commands and of skipped (earlier) queued commands
+   std::set<std::string> blocked(busyDevices_);
+   for (std::deque< boost::shared_ptr<AsyncCommandState> >::iterator
+         it = queue_.begin(), end = queue_.end(); it != end; ++it)
+   {
+      const std::vector<std::string>& devices = (*it)->GetDevices();
+      bool runnable = true;
+      for (size_t i = 0; i < devices.size() && runnable; ++i)
+      {
+         if (blocked.count(devices[i]))
+            runnable = false;
+      }
+      if (runnable)
+      {
+         boost::shared_ptr<AsyncCommandState> state = *it;
+         queue_.erase(it);
+         busyDevices_.insert(devices.begin(), devices.end());
+         return state;
+      }
+      blocked.insert(devices.begin(), devices.end());
+   }
+   return boost::shared_ptr<AsyncCommandState>();
+}
+
+void DeviceCommandExecutor::ThreadFunc()
+{
+   boost::mutex::scoped_lock lock(mutex_);
+   for (;;)
+   {
+      boost::shared_ptr<AsyncCommandState> state = TakeRunnable();
+      if (!state)
+      {
+         if (shutdown_ && queue_.empty())
+            return;
+         ++idleThreadCount_;
+         workCond_.wait(lock);
+         --idleThreadCount_;
+         continue;
+      }
+
+      ++runningCount_;
+      lock.unlock();
+      LOG_DEBUG(logger_) << "Will execute " << state->GetDescription();
+      state->Execute();
+      std::string errorText = state->GetErrorText();
+      if (errorText.empty())
+         LOG_DEBUG(logger_) << "Did execute " << state->GetDescription();
+      else
+         LOG_ERROR(logger_) << state->GetDescription() << " failed: " <<
+            errorText;
+      lock.lock();
+      --runningCount_;
+
+      const std::vector<std::string>& devices = state->GetDevices();
+      for (size_t i = 0; i < devices.size(); ++i)
+         busyDevices_.erase(devices[i]);
+      // Commands queued behind this one may now be runnable
+      workCond_.notify_all();
+      if (queue_.empty() && runningCount_ == 0)
+         idleCond_.notify_all();
+   }
+}
+
+} // namespace mm
@@ -0,0 +1,111 @@
+///////////////////////////////////////////////////////////////////////////////
+// FILE:          DeviceCommandExecutor.h
+// PROJECT:       Micro-Manager
+// SUBSYSTEM:     MMCore
+//-----------------------------------------------------------------------------
+// DESCRIPTION:   Background execution of device commands, ordered per device
+//
+// LICENSE:       This file is distributed under the "Lesser GPL" (LGPL) license.
+//                License text is included with the source distribution.
+//
+//                This file is distributed in the hope that it will be useful,
+//                but WITHOUT ANY WARRANTY; without even the implied warranty
+//                of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+//
+//                IN NO EVENT SHALL THE COPYRIGHT OWNER OR
+//                CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+//                INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES.
+
+#pragma once
+
+#include "AsyncCommand.h"
+#include "Error.h"
+#include "Logging/Logger.h"
+
+#include <boost/function.hpp>
+#include <boost/shared_ptr.hpp>
+#include <boost/thread/condition_variable.hpp>
+#include <boost/thread/mutex.hpp>
+#include <boost/thread/thread.hpp>
+#include <boost/utility.hpp>
+
+#include <deque>
+#include <set>
+#include <string>
+#include <vector>
+
+namespace mm {
+
+// Shared by the executor and the AsyncCommand handles of one command
+class AsyncCommandState : boost::noncopyable
+{
+public:
+   AsyncCommandState(const std::string& description,
+         const std::vector<std::string>& devices,
+         boost::function<void ()> work);
+
+   const std::string& GetDescription() const { return description_; }
+   const std::vector<std::string>& GetDevices() const { return devices_; }
+
+   void Execute();
+   bool IsDone();
+   // Returns false on timeout (timeoutMs < 0: wait indefinitely); throws the
+   // error of a failed command.
+   bool Wait(long timeoutMs) throw (CMMError);
+   // Exceptions thrown by the work, for logging; empty if it succeeded
+   std::string GetErrorText();
+
+private:
+   const std::string description_;
+   const std::vector<std::string> devices_;
+   boost::function<void ()> work_;
+
+   boost::mutex mutex_;
+   boost::condition_variable doneCond_;
+   bool done_;
+   boost::shared_ptr<CMMError> error_;
+};
+
+
+/**
+ * \brief Runs device commands on core-managed threads
+ *
+ * Each command names the devices it uses. A command starts only after every
+ * command submitted earlier that shares a device with it has finished, so
+ * commands to the same device are executed in submission order, while
+ * commands to different devices overlap. Threads are started as needed (up
+ * to a fixed limit) and kept until the executor is destroyed.
+ */
+class DeviceCommandExecutor /* final */ : boost::noncopyable
+{
+public:
+   explicit DeviceCommandExecutor(logging::Logger logger);
+   // Finishes all submitted commands before returning
+   ~DeviceCommandExecutor();
+
+   AsyncCommand Submit(const std::string& description,
+         const std::vector<std::string>& devices,
+         boost::function<void ()> work);
+   // Blocks until no submitted command is queued or running
+   void WaitForIdle();
+
+private:
+   void ThreadFunc();
+   // Removes and returns the first queued command whose devices are free;
+   // called with mutex_ held
+   boost::shared_ptr<AsyncCommandState> TakeRunnable();
+
+   logging::Logger logger_;
+
+   boost::mutex mutex_;
+   boost::condition_variable workCond_;
+   boost::condition_variable idleCond_;
+   std::deque< boost::shared_ptr<AsyncCommandState> > queue_;
+   std::set<std::string> busyDevices_;
+   size_t runningCount_;
+   size_t idleThreadCount_;
+   bool shutdown_;
+   std::vector< boost::shared_ptr<boost::thread> > threads_;
+};
+
+} // namespace mm
@@ -0,0 +1,60 @@
+///////////////////////////////////////////////////////////////////////////////
+// FILE:          DeviceHandle.h
+// PROJECT:       Micro-Manager
+// SUBSYSTEM:     MMCore
+//-----------------------------------------------------------------------------
+// DESCRIPTION:   Reference to a loaded device, resolved once from its label
+//
+// LICENSE:       This file is distributed under the "Lesser GPL" (LGPL) license.
+//                License text is included with the source distribution.
+//
+//                This file is distributed in the hope that it will be useful,
+//                but WITHOUT ANY WARRANTY; without even the implied warranty
+//                of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+//
+//                IN NO EVENT SHALL THE COPYRIGHT OWNER OR
+//                CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+//                INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES.
+
+#pragma once
+
+#include <boost/weak_ptr.hpp>
+
+#include <string>
+
+class CMMCore;
+class DeviceInstance;
+
+
+/**
+ * Reference to a loaded device, obtained from CMMCore::getDeviceHandle().
+ * Designed to be wrapped by SWIG.
+ *
+ * The CMMCore overloads that take a handle instead of a device label skip the
+ * label lookup, so a handle is meant to be obtained once and reused for
+ * frequent calls (e.g. in an acquisition loop).
+ *
+ * A handle refers to the device that was loaded when it was obtained. Once
+ * that device is unloaded, the handle is invalid, even if another device is
+ * later loaded with the same label.
+ */
+class DeviceHandle
+{
+public:
+   DeviceHandle() {}
+
+   std::string getLabel() const { return label_; }
+   bool isValid() const { return !device_.expired(); }
+
+private:
+   friend class CMMCore;
+
+   DeviceHandle(const std::string& label,
+         boost::weak_ptr<DeviceInstance> device) :
+      label_(label),
+      device_(device)
+   {}
+
+   std::string label_;
+   boost::weak_ptr<DeviceInstance> device_;
+};
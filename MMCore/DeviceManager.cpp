@@ -23,8 +23,6 @@
 #include "Error.h"
 #include "LoadableModules/LoadedDeviceAdapter.h"
 
-#include <algorithm>
-
 namespace mm
 {
 
@@ -41,13 +39,10 @@ DeviceManager::LoadDevice(boost::shared_ptr<LoadedDeviceAdapter> module,
       mm::logging::Logger deviceLogger,
       mm::logging::Logger coreLogger)
 {
-   for (DeviceConstIterator it = devices_.begin(), end = devices_.end(); it != end; ++it)
+   if (labelIndex_.count(label))
    {
-      if (it->first == label)
-      {
-         throw CMMError("The specified device label " + ToQuotedString(label) +
-               " is already in use", MMERR_DuplicateLabel);
-      }
+      throw CMMError("The specified device label " + ToQuotedString(label) +
+            " is already in use", MMERR_DuplicateLabel);
    }
 
    boost::shared_ptr<DeviceInstance> device = module->LoadDevice(core,
@@ -73,6 +68,7 @@ DeviceManager::LoadDevice(boost::shared_ptr<LoadedDeviceAdapter> module,
    }
 
    devices_.push_back(std::make_pair(label, device));
+   labelIndex_.insert(std::make_pair(label, device));
    deviceRawPtrIndex_.insert(std::make_pair(device->GetRawPtr(), device));
    return device;
 }
@@ -90,6 +86,7 @@ DeviceManager::UnloadDevice(boost::shared_ptr<DeviceInstance> device)
       {
          device->Shutdown(); // TODO Should be automatic
          deviceRawPtrIndex_.erase(it->second->GetRawPtr());
+         labelIndex_.erase(it->first);
          devices_.erase(it);
          break;
       }
@@ -140,6 +137,7 @@ DeviceManager::UnloadAllDevices()
    }
 
    deviceRawPtrIndex_.clear();
+   labelIndex_.clear();
    devices_.clear();
 
    // Now the only remaining references to the device objects should be in
@@ -157,14 +155,10 @@ DeviceManager::UnloadAllDevices()
 
 namespace
 {
-   class DevicePairMatcheslabel
+   struct CStringEqualsLabel
    {
-      std::string s_;
-   public:
-      DevicePairMatcheslabel(const std::string& s) : s_(s) {}
-      bool operator()(const std::pair< std::string,
-            boost::shared_ptr<DeviceInstance> >& p) const
-      { return p.first == s_; }
+      bool operator()(const char* s, const std::string& label) const
+      { return label == s; }
    };
 } // anonymous namespace
 
@@ -172,10 +166,8 @@ namespace
 boost::shared_ptr<DeviceInstance>
 DeviceManager::GetDevice(const std::string& label) const
 {
-   DeviceConstIterator found =
-      std::find_if(devices_.begin(), devices_.end(),
-            DevicePairMatcheslabel(label));
-   if (found == devices_.end())
+   LabelIndex::const_iterator found = labelIndex_.find(label);
+   if (found == labelIndex_.end())
    {
       throw CMMError("No device with label " + ToQuotedString(label));
    }
@@ -190,14 +182,20 @@ DeviceManager::GetDevice(const char* label) const
    {
       throw CMMError("Null device label");
    }
-   return GetDevice(std::string(label));
+   LabelIndex::const_iterator found =
+      labelIndex_.find(label, LabelHash(), CStringEqualsLabel());
+   if (found == labelIndex_.end())
+   {
+      throw CMMError("No device with label " + ToQuotedString(label));
+   }
+   return found->second;
 }
 
 
 boost::shared_ptr<DeviceInstance>
 DeviceManager::GetDevice(const MM::Device* rawPtr) const
 {
-   typedef std::map< const MM::Device*, boost::weak_ptr<DeviceInstance> >::const_iterator Iterator;
+   typedef boost::unordered_map< const MM::Device*, boost::weak_ptr<DeviceInstance> >::const_iterator Iterator;
    Iterator it = deviceRawPtrIndex_.find(rawPtr);
    if (it == deviceRawPtrIndex_.end())
       throw CMMError("Invalid device pointer");
@@ -292,9 +290,44 @@ DeviceManager::GetParentDevice(boost::shared_ptr<DeviceInstance> device) const
 }
 
 
-DeviceModuleLockGuard::DeviceModuleLockGuard(boost::shared_ptr<DeviceInstance> device) :
-   g_(device->GetAdapterModule()->GetLock())
-{}
+DeviceModuleLockGuard::DeviceModuleLockGuard(boost::shared_ptr<DeviceInstance> device)
+{
+   // The lock to use can change while we wait for it (when a parent hub is
+   // assigned); retry until we hold the current one.
+   for (;;)
+   {
+      lock_ = device->GetLock();
+      lock_->Lock();
+      if (device->GetLock() == lock_)
+         break;
+      lock_->Unlock();
+   }
+}
+
+
+DeviceModuleLockGuard::DeviceModuleLockGuard(boost::shared_ptr<DeviceInstance> device,
+      boost::try_to_lock_t)
+{
+   for (;;)
+   {
+      lock_ = device->GetLock();
+      if (!lock_->TryLock())
+      {
+         lock_ = 0;
+         return;
+      }
+      if (device->GetLock() == lock_)
+         return;
+      lock_->Unlock();
+   }
+}
+
+
+DeviceModuleLockGuard::~DeviceModuleLockGuard()
+{
+   if (lock_)
+      lock_->Unlock();
+}
 
 
 } // namespace mm
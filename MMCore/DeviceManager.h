@@ -24,10 +24,14 @@
 #include "Error.h"
 #include "Logging/Logger.h"
 
+#include <boost/functional/hash.hpp>
 #include <boost/shared_ptr.hpp>
+#include <boost/thread/locks.hpp>
+#include <boost/unordered_map.hpp>
+#include <boost/utility.hpp>
 #include <boost/weak_ptr.hpp>
 
-#include <map>
+#include <cstring>
 #include <string>
 #include <vector>
 
@@ -41,18 +45,32 @@ namespace mm
 
 class DeviceManager /* final */
 {
-   // Store devices in an ordered container. We could use a map or hash map to
-   // retrieve by name, but the number of devices is so small that it is not
-   // known to be worth it.
+   // Store devices in an ordered container, so that they are listed and
+   // unloaded in load order.
    std::vector< std::pair<std::string, boost::shared_ptr<DeviceInstance> > > devices_;
    typedef std::vector< std::pair<std::string, boost::shared_ptr<DeviceInstance> > >::const_iterator
       DeviceConstIterator;
    typedef std::vector< std::pair<std::string, boost::shared_ptr<DeviceInstance> > >::iterator
       DeviceIterator;
 
+   // Index of devices_ by label. Nearly every Core API call looks up a
+   // device by label, so this is a hash map; lookup by const char* does not
+   // construct a std::string (see GetDevice(const char*)).
+   struct LabelHash
+   {
+      std::size_t operator()(const std::string& s) const
+      { return boost::hash_range(s.begin(), s.end()); }
+      std::size_t operator()(const char* s) const
+      { return boost::hash_range(s, s + std::strlen(s)); }
+   };
+   typedef boost::unordered_map< std::string, boost::shared_ptr<DeviceInstance>,
+           LabelHash > LabelIndex;
+   LabelIndex labelIndex_;
+
    // Map raw device pointers to DeviceInstance objects, for those few places
-   // where we need to retrieve device information from raw pointers.
-   std::map< const MM::Device*, boost::weak_ptr<DeviceInstance> > deviceRawPtrIndex_;
+   // where we need to retrieve device information from raw pointers (which
+   // include every image inserted by a camera).
+   boost::unordered_map< const MM::Device*, boost::weak_ptr<DeviceInstance> > deviceRawPtrIndex_;
 
 public:
    ~DeviceManager();
@@ -134,12 +152,19 @@ public:
 };
 
 
-// Scoped acquisition of a device's module's lock
-class DeviceModuleLockGuard
+// Scoped acquisition of a device's module's lock, or of a finer lock if the
+// module declares that its devices can be called concurrently
+class DeviceModuleLockGuard : boost::noncopyable
 {
-   MMThreadGuard g_;
+   MMThreadLock* lock_;
 public:
    explicit DeviceModuleLockGuard(boost::shared_ptr<DeviceInstance> device);
+   // Does not wait if another thread holds the lock; see OwnsLock()
+   DeviceModuleLockGuard(boost::shared_ptr<DeviceInstance> device,
+         boost::try_to_lock_t);
+   ~DeviceModuleLockGuard();
+
+   bool OwnsLock() const { return lock_ != 0; }
 };
 
 } // namespace mm
@@ -137,8 +137,38 @@ std::string CameraInstance::GetTags()
    return serializedMetadataBuf.Get();
 }
 
-void CameraInstance::AddTag(const char* key, const char* deviceLabel, const char* value) { return GetImpl()->AddTag(key, deviceLabel, value); }
-void CameraInstance::RemoveTag(const char* key) { return GetImpl()->RemoveTag(key); }
+void CameraInstance::AddTag(const char* key, const char* deviceLabel, const char* value)
+{
+   GetImpl()->AddTag(key, deviceLabel, value);
+   MMThreadGuard guard(tagCacheLock_);
+   tagCacheValid_ = false;
+}
+
+void CameraInstance::RemoveTag(const char* key)
+{
+   GetImpl()->RemoveTag(key);
+   MMThreadGuard guard(tagCacheLock_);
+   tagCacheValid_ = false;
+}
+
+/**
+ * Merges the device's tags into md. The serialized tags are fetched and
+ * parsed only when they have changed since the previous call.
+ */
+void CameraInstance::MergeTagsInto(Metadata& md)
+{
+   MMThreadGuard guard(tagCacheLock_);
+   long version = GetImpl()->GetTagsVersion();
+   if (!tagCacheValid_ || version != tagCacheVersion_)
+   {
+      Metadata tags;
+      tags.Restore(GetTags().c_str());
+      tagCache_ = tags;
+      tagCacheVersion_ = version;
+      tagCacheValid_ = true;
+   }
+   md.Merge(tagCache_);
+}
 int CameraInstance::IsExposureSequenceable(bool& isSequenceable) const { return GetImpl()->IsExposureSequenceable(isSequenceable); }
 int CameraInstance::GetExposureSequenceMaxLength(long& nrEvents) const { return GetImpl()->GetExposureSequenceMaxLength(nrEvents); }
 int CameraInstance::StartExposureSequence() { return GetImpl()->StartExposureSequence(); }
@@ -146,3 +176,5 @@ int CameraInstance::StopExposureSequence() { return GetImpl()->StopExposureSeque
 int CameraInstance::ClearExposureSequence() { return GetImpl()->ClearExposureSequence(); }
 int CameraInstance::AddToExposureSequence(double exposureTime_ms) { return GetImpl()->AddToExposureSequence(exposureTime_ms); }
 int CameraInstance::SendExposureSequence() const { return GetImpl()->SendExposureSequence(); }
+int CameraInstance::AddArrayToExposureSequence(const double* exposureTimes_ms, long count)
+{ return GetImpl()->AddArrayToExposureSequence(exposureTimes_ms, count); }
@@ -21,6 +21,9 @@
 
 #include "DeviceInstanceBase.h"
 
+#include "../../MMDevice/DeviceThreads.h"
+#include "../../MMDevice/ImageMetadata.h"
+
 
 class CameraInstance : public DeviceInstanceBase<MM::Camera>
 {
@@ -33,7 +36,9 @@ public:
          const std::string& label,
          mm::logging::Logger deviceLogger,
          mm::logging::Logger coreLogger) :
-      DeviceInstanceBase<MM::Camera>(core, adapter, name, pDevice, deleteFunction, label, deviceLogger, coreLogger)
+      DeviceInstanceBase<MM::Camera>(core, adapter, name, pDevice, deleteFunction, label, deviceLogger, coreLogger),
+      tagCacheValid_(false),
+      tagCacheVersion_(0)
    {}
 
    int SnapImage();
@@ -75,6 +80,7 @@ public:
    std::string GetTags();
    void AddTag(const char* key, const char* deviceLabel, const char* value);
    void RemoveTag(const char* key);
+   void MergeTagsInto(Metadata& md);
    int IsExposureSequenceable(bool& isSequenceable) const;
    int GetExposureSequenceMaxLength(long& nrEvents) const;
    int StartExposureSequence();
@@ -82,4 +88,13 @@ public:
    int ClearExposureSequence();
    int AddToExposureSequence(double exposureTime_ms);
    int SendExposureSequence() const;
+   int AddArrayToExposureSequence(const double* exposureTimes_ms, long count);
+
+private:
+   // Parsed copy of the device's tags, reused until the device reports a
+   // new tags version
+   MMThreadLock tagCacheLock_;
+   bool tagCacheValid_;
+   long tagCacheVersion_;
+   Metadata tagCache_;
 };
@@ -66,10 +66,18 @@ DeviceInstance::DeviceInstance(CMMCore* core,
    }
 
    pImpl_->SetLabel(label_.c_str());
+
+   if (adapter_->GetConcurrency() == MM::ConcurrencyPerHub &&
+         GetType() != MM::HubDevice)
+      adapter_->SetPeripheralParent(label_, GetParentID());
 }
 
 DeviceInstance::~DeviceInstance()
 {
+   if (adapter_->GetConcurrency() == MM::ConcurrencyPerHub &&
+         GetType() != MM::HubDevice)
+      adapter_->RemovePeripheral(label_);
+
    // TODO Should we call Shutdown here? Or check that we have done so?
    deleteFunction_(pImpl_);
 }
@@ -299,6 +307,25 @@ DeviceInstance::SendPropertySequence(const char* propertyName)
    ThrowIfError(pImpl_->SendPropertySequence(propertyName));
 }
 
+void
+DeviceInstance::AddArrayToPropertySequence(const char* propertyName,
+      const double* values, long count)
+{
+   ThrowIfError(pImpl_->AddArrayToPropertySequence(propertyName, values,
+            count));
+}
+
+bool
+DeviceInstance::GetPropertySequenceFreeSpace(const char* propertyName,
+      long& nrEvents) const
+{
+   int err = pImpl_->GetPropertySequenceFreeSpace(propertyName, nrEvents);
+   if (err == DEVICE_UNSUPPORTED_COMMAND)
+      return false;
+   ThrowIfError(err);
+   return true;
+}
+
 std::string
 DeviceInstance::GetErrorText(int code) const
 {
@@ -371,7 +398,28 @@ DeviceInstance::DetectDevice()
 
 void
 DeviceInstance::SetParentID(const char* parentId)
-{ pImpl_->SetParentID(parentId); }
+{
+   pImpl_->SetParentID(parentId);
+   if (adapter_->GetConcurrency() == MM::ConcurrencyPerHub &&
+         GetType() != MM::HubDevice)
+      adapter_->SetPeripheralParent(label_, parentId ? parentId : "");
+}
+
+MMThreadLock*
+DeviceInstance::GetLock()
+{
+   switch (adapter_->GetConcurrency())
+   {
+      case MM::ConcurrencyPerDevice:
+         return &lock_;
+      case MM::ConcurrencyPerHub:
+         // The parent is looked up from what the Core recorded, so that
+         // choosing the lock does not call into the device unlocked
+         return adapter_->GetHubLock(label_, GetType() == MM::HubDevice);
+      default:
+         return adapter_->GetLock();
+   }
+}
 
 std::string
 DeviceInstance::GetParentID() const
@@ -19,6 +19,7 @@
 
 #pragma once
 
+#include "../../MMDevice/DeviceThreads.h"
 #include "../../MMDevice/MMDeviceConstants.h"
 #include "../Error.h"
 #include "../Logging/Logger.h"
@@ -71,9 +72,14 @@ private:
    DeleteDeviceFunction deleteFunction_;
    mm::logging::Logger deviceLogger_;
    mm::logging::Logger coreLogger_;
+   MMThreadLock lock_;
 
 public:
    boost::shared_ptr<LoadedDeviceAdapter> GetAdapterModule() const /* final */ { return adapter_; }
+   // The lock to hold while calling the device, as allowed by the module's
+   // declared concurrency: the module lock, the lock of the parent hub, or
+   // the device's own lock.
+   MMThreadLock* GetLock() /* final */;
    std::string GetLabel() const /* final */ { return label_; }
    std::string GetDescription() const /* final */ { return description_; }
    void SetDescription(const std::string& description) /* final */ { description_ = description; }
@@ -194,6 +200,11 @@ public:
    void ClearPropertySequence(const char* propertyName);
    void AddToPropertySequence(const char* propertyName, const char* value);
    void SendPropertySequence(const char* propertyName);
+   void AddArrayToPropertySequence(const char* propertyName,
+         const double* values, long count);
+   // Returns false if the device cannot extend a running sequence
+   bool GetPropertySequenceFreeSpace(const char* propertyName,
+         long& nrEvents) const;
    std::string GetErrorText(int code) const;
    bool Busy();
    double GetDelayMs() const;
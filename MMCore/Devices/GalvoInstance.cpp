@@ -23,7 +23,13 @@
 
 
 int GalvoInstance::PointAndFire(double x, double y, double time_us) { return GetImpl()->PointAndFire(x, y, time_us); }
-int GalvoInstance::SetSpotInterval(double pulseInterval_us) { return GetImpl()->SetSpotInterval(pulseInterval_us); }
+int GalvoInstance::SetSpotInterval(double pulseInterval_us)
+{
+   int ret = GetImpl()->SetSpotInterval(pulseInterval_us);
+   if (ret == DEVICE_OK)
+      spotInterval_us_ = pulseInterval_us;
+   return ret;
+}
 int GalvoInstance::SetPosition(double x, double y) { return GetImpl()->SetPosition(x, y); }
 int GalvoInstance::GetPosition(double& x, double& y) { return GetImpl()->GetPosition(x, y); }
 int GalvoInstance::SetIlluminationState(bool on) { return GetImpl()->SetIlluminationState(on); }
@@ -38,6 +44,16 @@ int GalvoInstance::LoadPolygons() { return GetImpl()->LoadPolygons(); }
 int GalvoInstance::SetPolygonRepetitions(int repetitions) { return GetImpl()->SetPolygonRepetitions(repetitions); }
 int GalvoInstance::RunPolygons() { return GetImpl()->RunPolygons(); }
 int GalvoInstance::StopSequence() { return GetImpl()->StopSequence(); }
+int GalvoInstance::LoadPolygonPattern(const char* patternKey, const double* xs,
+      const double* ys, const long* vertexCounts,
+      const double* dwellTimes_us, const long* repetitions,
+      long polygonCount)
+{
+   return GetImpl()->LoadPolygonPattern(patternKey, xs, ys, vertexCounts,
+         dwellTimes_us, repetitions, polygonCount);
+}
+int GalvoInstance::SelectPolygonPattern(const char* patternKey, bool& found)
+{ return GetImpl()->SelectPolygonPattern(patternKey, found); }
 
 std::string GalvoInstance::GetChannel()
 {
@@ -33,7 +33,8 @@ public:
          const std::string& label,
          mm::logging::Logger deviceLogger,
          mm::logging::Logger coreLogger) :
-      DeviceInstanceBase<MM::Galvo>(core, adapter, name, pDevice, deleteFunction, label, deviceLogger, coreLogger)
+      DeviceInstanceBase<MM::Galvo>(core, adapter, name, pDevice, deleteFunction, label, deviceLogger, coreLogger),
+      spotInterval_us_(-1.0)
    {}
 
    int PointAndFire(double x, double y, double time_us);
@@ -53,4 +54,16 @@ public:
    int RunPolygons();
    int StopSequence();
    std::string GetChannel();
+   int LoadPolygonPattern(const char* patternKey, const double* xs,
+         const double* ys, const long* vertexCounts,
+         const double* dwellTimes_us, const long* repetitions,
+         long polygonCount);
+   int SelectPolygonPattern(const char* patternKey, bool& found);
+
+   // Last spot interval successfully set, or -1 if never set (the device
+   // default)
+   double GetLastSpotInterval() const { return spotInterval_us_; }
+
+private:
+   double spotInterval_us_;
 };
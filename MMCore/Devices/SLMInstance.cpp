@@ -45,3 +45,11 @@ int SLMInstance::AddToSLMSequence(const unsigned char * pixels)
 int SLMInstance::AddToSLMSequence(const unsigned int * pixels)
 { return GetImpl()->AddToSLMSequence(pixels); }
 int SLMInstance::SendSLMSequence() { return GetImpl()->SendSLMSequence(); }
+int SLMInstance::GetSLMPatternBankCapacity(long& capacity)
+{ return GetImpl()->GetSLMPatternBankCapacity(capacity); }
+int SLMInstance::SetSLMPattern(long index, const unsigned char* pixels)
+{ return GetImpl()->SetSLMPattern(index, pixels); }
+int SLMInstance::DisplaySLMPattern(long index)
+{ return GetImpl()->DisplaySLMPattern(index); }
+int SLMInstance::AddSLMPatternToSequence(long index)
+{ return GetImpl()->AddSLMPatternToSequence(index); }
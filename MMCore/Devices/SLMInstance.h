@@ -55,4 +55,8 @@ public:
    int AddToSLMSequence(const unsigned char * pixels);
    int AddToSLMSequence(const unsigned int * pixels);
    int SendSLMSequence();
+   int GetSLMPatternBankCapacity(long& capacity);
+   int SetSLMPattern(long index, const unsigned char* pixels);
+   int DisplaySLMPattern(long index);
+   int AddSLMPatternToSequence(long index);
 };
@@ -66,5 +66,9 @@ int StageInstance::StopStageSequence() { return GetImpl()->StopStageSequence();
 int StageInstance::ClearStageSequence() { return GetImpl()->ClearStageSequence(); }
 int StageInstance::AddToStageSequence(double position) { return GetImpl()->AddToStageSequence(position); }
 int StageInstance::SendStageSequence() { return GetImpl()->SendStageSequence(); }
+int StageInstance::AddArrayToStageSequence(const double* positions, long count)
+{ return GetImpl()->AddArrayToStageSequence(positions, count); }
+int StageInstance::GetStageSequenceFreeSpace(long& nrEvents) const
+{ return GetImpl()->GetStageSequenceFreeSpace(nrEvents); }
 int StageInstance::SetStageLinearSequence(double dZ_um, long nSlices)
 { return GetImpl()->SetStageLinearSequence(dZ_um, nSlices); }
\ No newline at end of file
@@ -61,5 +61,7 @@ public:
    int ClearStageSequence();
    int AddToStageSequence(double position);
    int SendStageSequence();
+   int AddArrayToStageSequence(const double* positions, long count);
+   int GetStageSequenceFreeSpace(long& nrEvents) const;
    int SetStageLinearSequence(double dZ_um, long nSlices);
 };
@@ -46,3 +46,6 @@ int XYStageInstance::StopXYStageSequence() { return GetImpl()->StopXYStageSequen
 int XYStageInstance::ClearXYStageSequence() { return GetImpl()->ClearXYStageSequence(); }
 int XYStageInstance::AddToXYStageSequence(double positionX, double positionY) { return GetImpl()->AddToXYStageSequence(positionX, positionY); }
 int XYStageInstance::SendXYStageSequence() { return GetImpl()->SendXYStageSequence(); }
+int XYStageInstance::AddArrayToXYStageSequence(const double* positionsX,
+      const double* positionsY, long count)
+{ return GetImpl()->AddArrayToXYStageSequence(positionsX, positionsY, count); }
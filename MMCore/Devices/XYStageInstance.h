@@ -60,4 +60,6 @@ public:
    int ClearXYStageSequence();
    int AddToXYStageSequence(double positionX, double positionY);
    int SendXYStageSequence();
+   int AddArrayToXYStageSequence(const double* positionsX,
+         const double* positionsY, long count);
 };
@@ -0,0 +1,711 @@
+///////////////////////////////////////////////////////////////////////////////
+// FILE:          DiskStreamSink.cpp
+// PROJECT:       Micro-Manager
+// SUBSYSTEM:     MMCore
+//-----------------------------------------------------------------------------
+// DESCRIPTION:   Writes the frames inserted into the circular buffer to disk
+//                on a dedicated thread
+//
+// LICENSE:       This file is distributed under the "Lesser GPL" (LGPL) license.
+//                License text is included with the source distribution.
+//
+//                This file is distributed in the hope that it will be useful,
+//                but WITHOUT ANY WARRANTY; without even the implied warranty
+//                of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+//
+//                IN NO EVENT SHALL THE COPYRIGHT OWNER OR
+//                CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+//                INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES.
+
+#include "DiskStreamSink.h"
+
+#include "ErrorCodes.h"
+
+#include "../MMDevice/DeviceUtils.h"
+
+#include <boost/bind.hpp>
+#include <boost/thread/thread.hpp>
+
+#include <algorithm>
+#include <cerrno>
+#include <cstdlib>
+#include <cstring>
+#include <iomanip>
+#include <sstream>
+
+#ifdef _WIN32
+#include <windows.h>
+#include <malloc.h>
+#include <sys/stat.h>
+#else
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+#include <unistd.h>
+#endif
+
+
+namespace mm {
+
+namespace {
+
+// Unbuffered I/O requires the buffer address, the size and the file offset of
+// every write to be a multiple of the device's logical block size; 4096 bytes
+// covers the common sector and page sizes.
+const size_t g_Alignment = 4096;
+const size_t g_HeaderBytes = g_Alignment;
+const long long g_ReportIntervalUs = 1000000;
+
+size_t RoundUp(size_t bytes)
+{
+   return (bytes + g_Alignment - 1) / g_Alignment * g_Alignment;
+}
+
+unsigned char* AllocateAligned(size_t bytes)
+{
+#ifdef _WIN32
+   return static_cast<unsigned char*>(_aligned_malloc(bytes, g_Alignment));
+#else
+   void* p = 0;
+   if (posix_memalign(&p, g_Alignment, bytes) != 0)
+      return 0;
+   return static_cast<unsigned char*>(p);
+#endif
+}
+
+void FreeAligned(unsigned char* p)
+{
+#ifdef _WIN32
+   _aligned_free(p);
+#else
+   std::free(p);
+#endif
+}
+
+bool IsDirectory(const std::string& path)
+{
+#ifdef _WIN32
+   struct _stat st;
+   return _stat(path.c_str(), &st) == 0 && (st.st_mode & _S_IFDIR);
+#else
+   struct stat st;
+   return stat(path.c_str(), &st) == 0 && S_ISDIR(st.st_mode);
+#endif
+}
+
+std::string Escape(const std::string& s, bool isKey)
+{
+   std::string result;
+   result.reserve(s.size());
+   for (std::string::const_iterator it = s.begin(), end = s.end(); it != end; ++it)
+   {
+      switch (*it)
+      {
+         case '\\': result += "\\\\"; break;
+         case '\t': result += "\\t"; break;
+         case '\n': result += "\\n"; break;
+         case '\r': result += "\\r"; break;
+         case '=':
+            result += isKey ? "\\=" : "=";
+            break;
+         default: result += *it;
+      }
+   }
+   return result;
+}
+
+// Single-valued tags by qualified name, from the Metadata::Serialize() format
+void ParseSingleTags(const std::string& serialized,
+      std::map<std::string, std::string>& tags)
+{
+   std::istringstream is(serialized);
+   std::string line;
+   std::getline(is, line);
+   const long count = std::atol(line.c_str());
+   for (long i = 0; i < count; ++i)
+   {
+      std::string id, name, device, readOnly, value;
+      if (!std::getline(is, id) || !std::getline(is, name) ||
+            !std::getline(is, device) || !std::getline(is, readOnly) ||
+            !std::getline(is, value))
+         return;
+      if (id == "s")
+      {
+         tags[device == "_" ? name : device + "-" + name] = value;
+      }
+      else if (id == "a")
+      {
+         const long size = std::atol(value.c_str());
+         for (long j = 0; j < size && std::getline(is, line); ++j)
+            ;
+      }
+      else
+      {
+         return;
+      }
+   }
+}
+
+} // anonymous namespace
+
+
+/**
+ * Write-only file opened for unbuffered I/O where supported
+ */
+class DiskStreamSink::RawFile
+{
+public:
+#ifdef _WIN32
+   RawFile() : handle_(INVALID_HANDLE_VALUE) {}
+#else
+   RawFile() : fd_(-1) {}
+#endif
+   ~RawFile() { Close(); }
+
+   // Fails if the file exists
+   bool Open(const std::string& path, bool& unbuffered)
+   {
+#ifdef _WIN32
+      handle_ = CreateFileA(path.c_str(), GENERIC_WRITE, 0, NULL, CREATE_NEW,
+            FILE_ATTRIBUTE_NORMAL | FILE_FLAG_NO_BUFFERING |
+            FILE_FLAG_SEQUENTIAL_SCAN, NULL);
+      unbuffered = true;
+      return handle_ != INVALID_HANDLE_VALUE;
+#else
+      fd_ = open(path.c_str(), O_WRONLY | O_CREAT | O_EXCL, 0644);
+      if (fd_ < 0)
+         return false;
+      unbuffered = false;
+#if defined(O_DIRECT)
+      // Set after creation, because file systems that do not support direct
+      // I/O (e.g. tmpfs) reject it with EINVAL
+      int flags = fcntl(fd_, F_GETFL);
+      unbuffered = flags != -1 && fcntl(fd_, F_SETFL, flags | O_DIRECT) == 0;
+#elif defined(F_NOCACHE)
+      unbuffered = fcntl(fd_, F_NOCACHE, 1) != -1;
+#endif
+      return true;
+#endif
+   }
+
+   bool Write(const unsigned char* data, size_t bytes)
+   {
+#ifdef _WIN32
+      while (bytes > 0)
+      {
+         DWORD chunk = bytes > 0x40000000 ? 0x40000000 : (DWORD)bytes;
+         DWORD written = 0;
+         if (!WriteFile(handle_, data, chunk, &written, NULL) || written == 0)
+            return false;
+         data += written;
+         bytes -= written;
+      }
+      return true;
+#else
+      while (bytes > 0)
+      {
+         ssize_t written = write(fd_, data, bytes);
+         if (written < 0 && errno == EINTR)
+            continue;
+         if (written <= 0)
+            return false;
+         data += written;
+         bytes -= written;
+      }
+      return true;
+#endif
+   }
+
+   bool Close()
+   {
+#ifdef _WIN32
+      if (handle_ == INVALID_HANDLE_VALUE)
+         return true;
+      bool ok = CloseHandle(handle_) != 0;
+      handle_ = INVALID_HANDLE_VALUE;
+      return ok;
+#else
+      if (fd_ < 0)
+         return true;
+      bool ok = close(fd_) == 0;
+      fd_ = -1;
+      return ok;
+#endif
+   }
+
+private:
+#ifdef _WIN32
+   HANDLE handle_;
+#else
+   int fd_;
+#endif
+};
+
+
+DiskStreamSink::DiskStreamSink(logging::Logger logger,
+      const std::string& directory, const std::string& prefix,
+      long long maxFileBytes, unsigned queueMemoryMB) :
+   logger_(logger),
+   directory_(directory),
+   prefix_(prefix),
+   maxFileBytes_(maxFileBytes),
+   queueMemoryMB_(queueMemoryMB),
+   running_(false),
+   stopRequested_(false),
+   slotBytes_(0),
+   nextSequence_(0),
+   indexFile_(0),
+   fileNumber_(0),
+   fileBytes_(0),
+   fileWidth_(0),
+   fileHeight_(0),
+   fileBytesPerPixel_(0),
+   intervalStartUs_(0),
+   intervalBytes_(0),
+   intervalFrames_(0),
+   intervalLatencySumUs_(0),
+   intervalMaxLatencyUs_(0)
+{
+}
+
+DiskStreamSink::~DiskStreamSink()
+{
+   try
+   {
+      Stop();
+   }
+   catch (const CMMError&)
+   {
+      // Already logged by the writer thread
+   }
+   FreeSlots();
+}
+
+void DiskStreamSink::Start() throw (CMMError)
+{
+   if (!IsDirectory(directory_))
+      throw CMMError("Stream directory does not exist: " + directory_,
+            MMERR_StreamToDiskFailed);
+   if (prefix_.empty())
+      throw CMMError("Stream file prefix must not be empty",
+            MMERR_StreamToDiskFailed);
+
+   boost::mutex::scoped_lock lock(mutex_);
+   if (running_)
+      return;
+   running_ = true;
+   stopRequested_ = false;
+   error_.clear();
+   nextSequence_ = 0;
+   stats_ = Statistics();
+   stats_.queueCapacity = (unsigned long)slots_.size();
+   intervalStartUs_ = CDeviceUtils::GetMonotonicTimeUs();
+   intervalBytes_ = 0;
+   intervalFrames_ = 0;
+   intervalLatencySumUs_ = 0;
+   intervalMaxLatencyUs_ = 0;
+   thread_.reset(new boost::thread(
+            boost::bind(&DiskStreamSink::WriterThread, this)));
+
+   LOG_INFO(logger_) << "Streaming to " << directory_ << " (prefix " <<
+      prefix_ << ", " << queueMemoryMB_ << " MB queue)";
+}
+
+void DiskStreamSink::Stop() throw (CMMError)
+{
+   boost::shared_ptr<boost::thread> thread;
+   {
+      boost::mutex::scoped_lock lock(mutex_);
+      if (!running_)
+         return;
+      stopRequested_ = true;
+      thread = thread_;
+   }
+   queueCond_.notify_all();
+   freeCond_.notify_all();
+   thread->join();
+
+   std::string error;
+   Statistics stats;
+   {
+      boost::mutex::scoped_lock lock(mutex_);
+      running_ = false;
+      thread_.reset();
+      error = error_;
+      stats = stats_;
+   }
+
+   LOG_INFO(logger_) << "Streaming stopped: " << stats.framesWritten <<
+      " frames (" << stats.bytesWritten / (1024 * 1024) << " MB) written to " <<
+      stats.filesWritten << " files, " << stats.framesDropped << " dropped";
+   if (!error.empty())
+      throw CMMError("Streaming to disk failed: " + error,
+            MMERR_StreamToDiskFailed);
+}
+
+bool DiskStreamSink::IsRunning() const
+{
+   boost::mutex::scoped_lock lock(mutex_);
+   return running_;
+}
+
+DiskStreamSink::Statistics DiskStreamSink::GetStatistics() const
+{
+   boost::mutex::scoped_lock lock(mutex_);
+   Statistics stats = stats_;
+   stats.queuedFrames = (unsigned long)(slots_.size() - freeSlots_.size());
+   stats.queueCapacity = (unsigned long)slots_.size();
+   return stats;
+}
+
+/**
+ * Called on the inserting (camera) thread; copies the frame and returns
+ * without waiting for the write, except when the frame is larger than the
+ * current buffers, in which case the queued frames are written first.
+ */
+bool DiskStreamSink::Submit(const unsigned char* pixels, unsigned width,
+      unsigned height, unsigned bytesPerPixel, const Metadata& md)
+{
+   const long long submitTimeUs = CDeviceUtils::GetMonotonicTimeUs();
+   const size_t frameBytes = (size_t)width * height * bytesPerPixel;
+   const size_t slotBytes = RoundUp(frameBytes);
+
+   Slot* slot;
+   {
+      boost::mutex::scoped_lock lock(mutex_);
+      const unsigned long long sequence = nextSequence_++;
+      if (!running_ || stopRequested_ || !error_.empty())
+      {
+         ++stats_.framesDropped;
+         return false;
+      }
+      if (slotBytes > slotBytes_)
+      {
+         while (freeSlots_.size() < slots_.size() && error_.empty() &&
+               !stopRequested_)
+            freeCond_.wait(lock);
+         if (stopRequested_ || !error_.empty())
+         {
+            ++stats_.framesDropped;
+            return false;
+         }
+         FreeSlots();
+         AllocateSlots(slotBytes);
+      }
+      if (freeSlots_.empty())
+      {
+         ++stats_.framesDropped;
+         return false;
+      }
+      slot = freeSlots_.back();
+      freeSlots_.pop_back();
+      slot->sequence = sequence;
+   }
+
+   memcpy(slot->data, pixels, frameBytes);
+   memset(slot->data + frameBytes, 0, slotBytes - frameBytes);
+   slot->width = width;
+   slot->height = height;
+   slot->bytesPerPixel = bytesPerPixel;
+   slot->submitTimeUs = submitTimeUs;
+   slot->serializedMetadata = md.Serialize();
+
+   {
+      boost::mutex::scoped_lock lock(mutex_);
+      queue_.push_back(slot);
+   }
+   queueCond_.notify_one();
+   return true;
+}
+
+/**
+ * Must be called with mutex_ held and no slots in use.
+ */
+void DiskStreamSink::AllocateSlots(size_t slotBytes)
+{
+   size_t count = ((size_t)queueMemoryMB_ << 20) / slotBytes;
+   if (count < 2)
+      count = 2;
+
+   slots_.resize(count);
+   size_t allocated = 0;
+   for (; allocated < count; ++allocated)
+   {
+      slots_[allocated].data = AllocateAligned(slotBytes);
+      if (!slots_[allocated].data)
+         break;
+   }
+   slots_.resize(allocated);
+   for (size_t i = 0; i < slots_.size(); ++i)
+      freeSlots_.push_back(&slots_[i]);
+   slotBytes_ = allocated > 0 ? slotBytes : 0;
+   stats_.queueCapacity = (unsigned long)slots_.size();
+
+   if (allocated == 0)
+      FailLocked("Out of memory for the stream queue");
+   else if (allocated < count)
+      LOG_WARNING(logger_) << "Stream queue limited to " << allocated <<
+         " frames by available memory";
+}
+
+/**
+ * Must be called with mutex_ held (or from the destructor) and no slots in
+ * use.
+ */
+void DiskStreamSink::FreeSlots()
+{
+   for (size_t i = 0; i < slots_.size(); ++i)
+      FreeAligned(slots_[i].data);
+   slots_.clear();
+   freeSlots_.clear();
+   slotBytes_ = 0;
+}
+
+void DiskStreamSink::WriterThread()
+{
+   boost::mutex::scoped_lock lock(mutex_);
+   for (;;)
+   {
+      while (queue_.empty() && !stopRequested_)
+      {
+         queueCond_.timed_wait(lock,
+               boost::posix_time::microseconds(g_ReportIntervalUs / 4));
+         ReportInterval(CDeviceUtils::GetMonotonicTimeUs());
+      }
+      if (queue_.empty())
+         break;
+
+      Slot* slot = queue_.front();
+      queue_.pop_front();
+      const bool failed = !error_.empty();
+      const size_t bytes = RoundUp(
+            (size_t)slot->width * slot->height * slot->bytesPerPixel);
+
+      lock.unlock();
+      const bool written = !failed && WriteSlot(slot, bytes);
+      const long long nowUs = CDeviceUtils::GetMonotonicTimeUs();
+      lock.lock();
+
+      if (written)
+      {
+         const long long latencyUs = nowUs - slot->submitTimeUs;
+         ++stats_.framesWritten;
+         stats_.bytesWritten += bytes;
+         ++intervalFrames_;
+         intervalBytes_ += bytes;
+         intervalLatencySumUs_ += latencyUs;
+         if (latencyUs > intervalMaxLatencyUs_)
+            intervalMaxLatencyUs_ = latencyUs;
+      }
+      else
+      {
+         ++stats_.framesDropped;
+      }
+      freeSlots_.push_back(slot);
+      freeCond_.notify_all();
+      ReportInterval(nowUs);
+   }
+   lock.unlock();
+
+   CloseFiles();
+}
+
+/**
+ * Must be called with mutex_ held.
+ */
+void DiskStreamSink::ReportInterval(long long nowUs)
+{
+   const long long elapsedUs = nowUs - intervalStartUs_;
+   if (elapsedUs < g_ReportIntervalUs)
+      return;
+
+   stats_.megabytesPerSecond =
+      intervalBytes_ / (1024.0 * 1024.0) / (elapsedUs / 1e6);
+   stats_.meanLatencyMs = intervalFrames_ > 0 ?
+      intervalLatencySumUs_ / 1000.0 / intervalFrames_ : 0.0;
+   stats_.maxLatencyMs = intervalMaxLatencyUs_ / 1000.0;
+
+   if (intervalFrames_ > 0)
+   {
+      LOG_INFO(logger_) << "Streaming " << std::fixed <<
+         std::setprecision(1) << stats_.megabytesPerSecond << " MB/s, " <<
+         intervalFrames_ << " frames; latency mean " <<
+         stats_.meanLatencyMs << " ms, max " << stats_.maxLatencyMs <<
+         " ms; queue " << slots_.size() - freeSlots_.size() << "/" <<
+         slots_.size() << "; " << stats_.framesDropped << " dropped";
+   }
+   if (indexFile_)
+      std::fflush(indexFile_);
+
+   intervalStartUs_ = nowUs;
+   intervalBytes_ = 0;
+   intervalFrames_ = 0;
+   intervalLatencySumUs_ = 0;
+   intervalMaxLatencyUs_ = 0;
+}
+
+/**
+ * Writer thread only, without mutex_ held.
+ */
+bool DiskStreamSink::WriteSlot(const Slot* slot, size_t bytes)
+{
+   if (dataFile_)
+   {
+      const bool geometryChanged = slot->width != fileWidth_ ||
+         slot->height != fileHeight_ ||
+         slot->bytesPerPixel != fileBytesPerPixel_;
+      const bool full = fileBytes_ > (long long)g_HeaderBytes &&
+         fileBytes_ + (long long)bytes > maxFileBytes_;
+      if (geometryChanged || full)
+         CloseFiles();
+   }
+   std::map<std::string, std::string> tags;
+   ParseSingleTags(slot->serializedMetadata, tags);
+   if (!dataFile_ && !OpenFiles(slot, bytes, tags))
+      return false;
+
+   if (!dataFile_->Write(slot->data, bytes))
+   {
+      Fail("Cannot write frame to stream file (" +
+            std::string(strerror(errno)) + ")");
+      return false;
+   }
+   WriteIndexLine(fileBytes_, slot->sequence, tags);
+   fileBytes_ += bytes;
+   return true;
+}
+
+bool DiskStreamSink::OpenFiles(const Slot* slot, size_t bytes,
+      const std::map<std::string, std::string>& tags)
+{
+   std::ostringstream base;
+   base << directory_ << "/" << prefix_ << "_" << std::setw(5) <<
+      std::setfill('0') << fileNumber_;
+   const std::string dataPath = base.str() + ".mmraw";
+   const std::string indexPath = base.str() + ".mmidx";
+
+   boost::shared_ptr<RawFile> file(new RawFile());
+   bool unbuffered = false;
+   if (!file->Open(dataPath, unbuffered))
+   {
+      Fail("Cannot create stream file " + dataPath + " (it may already exist)");
+      return false;
+   }
+
+   std::string pixelType;
+   std::map<std::string, std::string>::const_iterator found =
+      tags.find("PixelType");
+   if (found != tags.end())
+      pixelType = found->second;
+
+   std::ostringstream header;
+   header << "MMRawStream\t1\n" <<
+      "width=" << slot->width << "\n" <<
+      "height=" << slot->height << "\n" <<
+      "bytesPerPixel=" << slot->bytesPerPixel << "\n" <<
+      "pixelType=" << pixelType << "\n" <<
+      "frameBytes=" << (size_t)slot->width * slot->height * slot->bytesPerPixel << "\n" <<
+      "slotBytes=" << bytes << "\n" <<
+      "headerBytes=" << g_HeaderBytes << "\n";
+   const std::string headerText = header.str();
+
+   unsigned char* headerPage = AllocateAligned(g_HeaderBytes);
+   bool ok = headerPage != 0;
+   if (ok)
+   {
+      memset(headerPage, 0, g_HeaderBytes);
+      memcpy(headerPage, headerText.data(),
+            std::min(headerText.size(), g_HeaderBytes));
+      ok = file->Write(headerPage, g_HeaderBytes);
+      FreeAligned(headerPage);
+   }
+   if (!ok)
+   {
+      Fail("Cannot write stream file header to " + dataPath);
+      return false;
+   }
+
+   indexFile_ = std::fopen(indexPath.c_str(), "w");
+   if (!indexFile_)
+   {
+      Fail("Cannot create stream index file " + indexPath);
+      return false;
+   }
+   std::fprintf(indexFile_, "MMRawStreamIndex\t1\t%s_%05u.mmraw\n",
+         prefix_.c_str(), fileNumber_);
+
+   dataFile_ = file;
+   fileBytes_ = g_HeaderBytes;
+   fileWidth_ = slot->width;
+   fileHeight_ = slot->height;
+   fileBytesPerPixel_ = slot->bytesPerPixel;
+   previousTags_.clear();
+   ++fileNumber_;
+   {
+      boost::mutex::scoped_lock lock(mutex_);
+      ++stats_.filesWritten;
+   }
+
+   LOG_DEBUG(logger_) << "Opened stream file " << dataPath <<
+      (unbuffered ? " (unbuffered)" : " (buffered)");
+   return true;
+}
+
+void DiskStreamSink::CloseFiles()
+{
+   bool ok = true;
+   if (dataFile_)
+   {
+      ok = dataFile_->Close();
+      dataFile_.reset();
+   }
+   if (indexFile_)
+   {
+      ok = (std::fclose(indexFile_) == 0) && ok;
+      indexFile_ = 0;
+   }
+   if (!ok)
+      Fail("Cannot close stream file");
+}
+
+void DiskStreamSink::WriteIndexLine(long long offset,
+      unsigned long long sequence,
+      const std::map<std::string, std::string>& tags)
+{
+   std::ostringstream line;
+   line << offset << "\t" << sequence;
+   for (std::map<std::string, std::string>::const_iterator it = tags.begin(),
+         end = tags.end(); it != end; ++it)
+   {
+      std::map<std::string, std::string>::const_iterator previous =
+         previousTags_.find(it->first);
+      if (previous == previousTags_.end() || previous->second != it->second)
+         line << "\t" << Escape(it->first, true) << "=" <<
+            Escape(it->second, false);
+   }
+   line << "\n";
+
+   const std::string text = line.str();
+   if (std::fwrite(text.data(), 1, text.size(), indexFile_) != text.size())
+      Fail("Cannot write stream index file");
+   previousTags_ = tags;
+}
+
+/**
+ * Must be called with mutex_ held.
+ */
+void DiskStreamSink::FailLocked(const std::string& message)
+{
+   if (!error_.empty())
+      return;
+   error_ = message;
+   LOG_ERROR(logger_) << message << "; streaming to disk stopped";
+}
+
+void DiskStreamSink::Fail(const std::string& message)
+{
+   boost::mutex::scoped_lock lock(mutex_);
+   FailLocked(message);
+}
+
+} // namespace mm
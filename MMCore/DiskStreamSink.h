@@ -0,0 +1,184 @@
+///////////////////////////////////////////////////////////////////////////////
+// FILE:          DiskStreamSink.h
+// PROJECT:       Micro-Manager
+// SUBSYSTEM:     MMCore
+//-----------------------------------------------------------------------------
+// DESCRIPTION:   Writes the frames inserted into the circular buffer to disk
+//                on a dedicated thread
+//
+// LICENSE:       This file is distributed under the "Lesser GPL" (LGPL) license.
+//                License text is included with the source distribution.
+//
+//                This file is distributed in the hope that it will be useful,
+//                but WITHOUT ANY WARRANTY; without even the implied warranty
+//                of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+//
+//                IN NO EVENT SHALL THE COPYRIGHT OWNER OR
+//                CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+//                INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES.
+
+#pragma once
+
+#include "Error.h"
+#include "Logging/Logger.h"
+
+#include "../MMDevice/ImageMetadata.h"
+
+#include <boost/smart_ptr/shared_ptr.hpp>
+#include <boost/thread/condition_variable.hpp>
+#include <boost/thread/mutex.hpp>
+
+#include <cstdio>
+#include <deque>
+#include <map>
+#include <string>
+#include <vector>
+
+#ifdef _MSC_VER
+#pragma warning( disable : 4290 ) // exception declaration warning
+#endif
+
+namespace boost { class thread; }
+
+namespace mm {
+
+/**
+ * \brief Streams frames to raw files on a writer thread
+ *
+ * Frames are copied into a fixed pool of page-aligned buffers by Submit()
+ * (called by the circular buffer for every inserted frame) and written by a
+ * dedicated thread, unbuffered (O_DIRECT, F_NOCACHE or FILE_FLAG_NO_BUFFERING)
+ * where the file system allows it. When the pool is full the frame is dropped
+ * and counted; the circular buffer is not affected.
+ *
+ * Each file <prefix>_NNNNN.mmraw starts with a 4096-byte text header of
+ * "key=value" lines (width, height, bytesPerPixel, pixelType, frameBytes,
+ * slotBytes, headerBytes), followed by one slot of slotBytes per frame, in
+ * order of insertion (the pixels, zero-padded to a multiple of 4096 bytes).
+ * The companion <prefix>_NNNNN.mmidx is a text file with one tab-separated
+ * line per frame: byte offset of the frame, sequence number (counting all
+ * frames submitted since Start(), including dropped ones), and the metadata
+ * tags (single-valued only) that are new or changed since the previous frame
+ * in the file, as
+ * key=value with backslash escapes for tab, newline, backslash and '=' (in
+ * keys). A new file is started when the size limit would be exceeded or the
+ * frame geometry changes.
+ *
+ * The throughput and latency (from Submit() to the end of the write) are
+ * logged once per second while frames are being written.
+ */
+class DiskStreamSink /* final */
+{
+public:
+   struct Statistics
+   {
+      Statistics() :
+         framesWritten(0), bytesWritten(0), framesDropped(0), filesWritten(0),
+         queuedFrames(0), queueCapacity(0), megabytesPerSecond(0.0),
+         meanLatencyMs(0.0), maxLatencyMs(0.0)
+      {}
+
+      unsigned long long framesWritten;
+      unsigned long long bytesWritten;
+      unsigned long long framesDropped;
+      unsigned long filesWritten;
+      unsigned long queuedFrames;
+      unsigned long queueCapacity;
+      // Over the most recent one-second reporting interval
+      double megabytesPerSecond;
+      double meanLatencyMs;
+      double maxLatencyMs;
+   };
+
+   DiskStreamSink(logging::Logger logger, const std::string& directory,
+         const std::string& prefix, long long maxFileBytes,
+         unsigned queueMemoryMB);
+   // Stops (see Stop()) if running; errors are logged
+   ~DiskStreamSink();
+
+   // Throws CMMError if the directory does not exist
+   void Start() throw (CMMError);
+   // Writes the queued frames and closes the files. Throws CMMError if
+   // writing failed at any point.
+   void Stop() throw (CMMError);
+   bool IsRunning() const;
+
+   // Returns false if the frame was dropped (pool full or writer stopped)
+   bool Submit(const unsigned char* pixels, unsigned width, unsigned height,
+         unsigned bytesPerPixel, const Metadata& md);
+
+   Statistics GetStatistics() const;
+   std::string GetDirectory() const { return directory_; }
+   std::string GetPrefix() const { return prefix_; }
+
+private:
+   DiskStreamSink(const DiskStreamSink&);
+   DiskStreamSink& operator=(const DiskStreamSink&);
+
+   struct Slot
+   {
+      unsigned char* data;
+      unsigned width;
+      unsigned height;
+      unsigned bytesPerPixel;
+      unsigned long long sequence;
+      long long submitTimeUs;
+      std::string serializedMetadata;
+   };
+
+   class RawFile;
+
+   void AllocateSlots(size_t slotBytes);
+   void FreeSlots();
+   void WriterThread();
+   bool WriteSlot(const Slot* slot, size_t bytes);
+   bool OpenFiles(const Slot* slot, size_t bytes,
+         const std::map<std::string, std::string>& tags);
+   void CloseFiles();
+   void WriteIndexLine(long long offset,
+         unsigned long long sequence,
+         const std::map<std::string, std::string>& tags);
+   void ReportInterval(long long nowUs);
+   void FailLocked(const std::string& message);
+   void Fail(const std::string& message);
+
+   logging::Logger logger_;
+   const std::string directory_;
+   const std::string prefix_;
+   const long long maxFileBytes_;
+   const unsigned queueMemoryMB_;
+
+   mutable boost::mutex mutex_;
+   boost::condition_variable queueCond_; // Frame queued or stop requested
+   boost::condition_variable freeCond_; // Slot freed
+   boost::shared_ptr<boost::thread> thread_;
+   bool running_;
+   bool stopRequested_;
+   std::string error_;
+
+   size_t slotBytes_;
+   std::vector<Slot> slots_;
+   std::vector<Slot*> freeSlots_;
+   std::deque<Slot*> queue_;
+   unsigned long long nextSequence_;
+   Statistics stats_;
+
+   // Used only by the writer thread
+   boost::shared_ptr<RawFile> dataFile_;
+   std::FILE* indexFile_;
+   unsigned fileNumber_;
+   long long fileBytes_;
+   unsigned fileWidth_;
+   unsigned fileHeight_;
+   unsigned fileBytesPerPixel_;
+   std::map<std::string, std::string> previousTags_;
+
+   // Current reporting interval, guarded by mutex_
+   long long intervalStartUs_;
+   unsigned long long intervalBytes_;
+   unsigned long intervalFrames_;
+   long long intervalLatencySumUs_;
+   long long intervalMaxLatencyUs_;
+};
+
+} // namespace mm
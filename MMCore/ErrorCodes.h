@@ -78,4 +78,8 @@
 #define MMERR_CreatePeripheralFailed   50
 #define MMERR_PropertyNotInCache       51
 #define MMERR_BadAffineTransform       52
+#define MMERR_StreamToDiskFailed       53
+#define MMERR_ImageNotInBuffer         54
+#define MMERR_InvalidDeviceHandle      55
+#define MMERR_CircularBufferImagesPinned  56
 #endif //_ERRORCODES_H_
@@ -0,0 +1,321 @@
+///////////////////////////////////////////////////////////////////////////////
+// FILE:          EventDispatcher.cpp
+// PROJECT:       Micro-Manager
+// SUBSYSTEM:     MMCore
+//-----------------------------------------------------------------------------
+// DESCRIPTION:   Delivery of MMEventCallback notifications on a core-owned
+//                thread
+//
+// LICENSE:       This file is distributed under the "Lesser GPL" (LGPL) license.
+//                License text is included with the source distribution.
+//
+//                This file is distributed in the hope that it will be useful,
+//                but WITHOUT ANY WARRANTY; without even the implied warranty
+//                of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+//
+//                IN NO EVENT SHALL THE COPYRIGHT OWNER OR
+//                CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+//                INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES.
+
+#include "EventDispatcher.h"
+
+#include "MMEventCallback.h"
+
+#include <boost/bind.hpp>
+#include <boost/make_shared.hpp>
+
+#include <exception>
+
+namespace mm {
+
+bool EventDispatcher::Event::operator<(const Event& rhs) const
+{
+   if (kind != rhs.kind)
+      return kind < rhs.kind;
+   if (device != rhs.device)
+      return device < rhs.device;
+   return name < rhs.name;
+}
+
+
+EventDispatcher::EventDispatcher(logging::Logger logger,
+      size_t maxQueuedEvents) :
+   logger_(logger),
+   maxQueuedEvents_(maxQueuedEvents),
+   callback_(0),
+   droppedCount_(0),
+   delivering_(false),
+   inCallback_(false),
+   callbackWaiters_(0),
+   shutdown_(false)
+{
+   thread_ = boost::make_shared<boost::thread>(
+         boost::bind(&EventDispatcher::ThreadFunc, this));
+}
+
+EventDispatcher::~EventDispatcher()
+{
+   Shutdown();
+}
+
+void EventDispatcher::SetCallback(MMEventCallback* callback)
+{
+   boost::mutex::scoped_lock lock(mutex_);
+   callback_ = callback;
+
+   // The listener may replace itself; it is then still in its callback
+   if (boost::this_thread::get_id() == thread_->get_id())
+      return;
+   ++callbackWaiters_;
+   while (inCallback_)
+      deliveredCond_.wait(lock);
+   --callbackWaiters_;
+}
+
+void EventDispatcher::WaitForIdle()
+{
+   boost::mutex::scoped_lock lock(mutex_);
+   while (!shutdown_ && (!queue_.empty() || delivering_))
+      idleCond_.wait(lock);
+}
+
+void EventDispatcher::Shutdown()
+{
+   {
+      boost::mutex::scoped_lock lock(mutex_);
+      if (shutdown_)
+         return;
+      shutdown_ = true;
+      queue_.clear();
+      queuedTargets_.clear();
+   }
+   eventCond_.notify_all();
+   idleCond_.notify_all();
+   thread_->join();
+}
+
+void EventDispatcher::Post(const Event& event)
+{
+   boost::mutex::scoped_lock lock(mutex_);
+   if (shutdown_ || !callback_)
+      return;
+
+   std::map<Event, std::list<Event>::iterator>::iterator found =
+      queuedTargets_.find(event);
+   if (found != queuedTargets_.end())
+   {
+      queue_.erase(found->second);
+      found->second = queue_.insert(queue_.end(), event);
+      return;
+   }
+
+   // Each queued notification has a distinct target
+   if (queuedTargets_.size() >= maxQueuedEvents_)
+   {
+      ++droppedCount_;
+      return;
+   }
+   queuedTargets_.insert(std::make_pair(event,
+            queue_.insert(queue_.end(), event)));
+   eventCond_.notify_one();
+}
+
+void EventDispatcher::ThreadFunc()
+{
+   std::list<Event> batch;
+   boost::mutex::scoped_lock lock(mutex_);
+   for (;;)
+   {
+      while (!shutdown_ && queue_.empty() && droppedCount_ == 0)
+         eventCond_.wait(lock);
+      if (shutdown_)
+         return;
+
+      // Deliver everything queued so far as one batch, so that notifications
+      // posted meanwhile supersede each other in the (new) queue
+      batch.swap(queue_);
+      queuedTargets_.clear();
+      unsigned long dropped = droppedCount_;
+      droppedCount_ = 0;
+      delivering_ = true;
+
+      if (dropped > 0)
+      {
+         LOG_WARNING(logger_) << "Event queue full; dropped " << dropped <<
+            " notifications in favor of onPropertiesChanged()";
+         batch.push_back(Event(Event::PropertiesChanged));
+      }
+      for (std::list<Event>::iterator it = batch.begin(), end = batch.end();
+            it != end && callback_ && !shutdown_; ++it)
+      {
+         // Look up the listener for each notification, so that none reaches
+         // a listener after SetCallback() has replaced it
+         MMEventCallback* callback = callback_;
+         inCallback_ = true;
+         lock.unlock();
+         Deliver(callback, *it);
+         lock.lock();
+         inCallback_ = false;
+         if (callbackWaiters_ > 0)
+            deliveredCond_.notify_all();
+      }
+      batch.clear();
+
+      delivering_ = false;
+      if (queue_.empty())
+         idleCond_.notify_all();
+   }
+}
+
+void EventDispatcher::Deliver(MMEventCallback* callback, Event& event)
+{
+   // Some MMEventCallback functions take a non-const device label
+   std::vector<char> device(event.device.begin(), event.device.end());
+   device.push_back('\0');
+
+   try
+   {
+      switch (event.kind)
+      {
+         case Event::PropertiesChanged:
+            callback->onPropertiesChanged();
+            break;
+         case Event::PropertyChanged:
+            callback->onPropertyChanged(event.device.c_str(),
+                  event.name.c_str(), event.value.c_str());
+            break;
+         case Event::ChannelGroupChanged:
+            callback->onChannelGroupChanged(event.value.c_str());
+            break;
+         case Event::ConfigGroupChanged:
+            callback->onConfigGroupChanged(event.name.c_str(),
+                  event.value.c_str());
+            break;
+         case Event::SystemConfigurationLoaded:
+            callback->onSystemConfigurationLoaded();
+            break;
+         case Event::PixelSizeChanged:
+            callback->onPixelSizeChanged(event.numbers[0]);
+            break;
+         case Event::PixelSizeAffineChanged:
+            callback->onPixelSizeAffineChanged(event.numbers[0],
+                  event.numbers[1], event.numbers[2], event.numbers[3],
+                  event.numbers[4], event.numbers[5]);
+            break;
+         case Event::StagePositionChanged:
+            callback->onStagePositionChanged(&device[0], event.numbers[0]);
+            break;
+         case Event::XYStagePositionChanged:
+            callback->onXYStagePositionChanged(&device[0],
+                  event.numbers[0], event.numbers[1]);
+            break;
+         case Event::ExposureChanged:
+            callback->onExposureChanged(&device[0], event.numbers[0]);
+            break;
+         case Event::SLMExposureChanged:
+            callback->onSLMExposureChanged(&device[0], event.numbers[0]);
+            break;
+      }
+   }
+   catch (const std::exception& e)
+   {
+      LOG_ERROR(logger_) << "Exception thrown by event callback: " <<
+         e.what();
+   }
+   catch (...)
+   {
+      LOG_ERROR(logger_) << "Unknown exception thrown by event callback";
+   }
+}
+
+void EventDispatcher::PostPropertiesChanged()
+{
+   Post(Event(Event::PropertiesChanged));
+}
+
+void EventDispatcher::PostPropertyChanged(const std::string& device,
+      const std::string& property, const std::string& value)
+{
+   Event event(Event::PropertyChanged);
+   event.device = device;
+   event.name = property;
+   event.value = value;
+   Post(event);
+}
+
+void EventDispatcher::PostChannelGroupChanged(const std::string& group)
+{
+   Event event(Event::ChannelGroupChanged);
+   event.value = group;
+   Post(event);
+}
+
+void EventDispatcher::PostConfigGroupChanged(const std::string& group,
+      const std::string& config)
+{
+   Event event(Event::ConfigGroupChanged);
+   event.name = group;
+   event.value = config;
+   Post(event);
+}
+
+void EventDispatcher::PostSystemConfigurationLoaded()
+{
+   Post(Event(Event::SystemConfigurationLoaded));
+}
+
+void EventDispatcher::PostPixelSizeChanged(double pixelSizeUm)
+{
+   Event event(Event::PixelSizeChanged);
+   event.numbers.push_back(pixelSizeUm);
+   Post(event);
+}
+
+void EventDispatcher::PostPixelSizeAffineChanged(
+      const std::vector<double>& affine)
+{
+   if (affine.size() != 6)
+      return;
+   Event event(Event::PixelSizeAffineChanged);
+   event.numbers = affine;
+   Post(event);
+}
+
+void EventDispatcher::PostStagePositionChanged(const std::string& device,
+      double pos)
+{
+   Event event(Event::StagePositionChanged);
+   event.device = device;
+   event.numbers.push_back(pos);
+   Post(event);
+}
+
+void EventDispatcher::PostXYStagePositionChanged(const std::string& device,
+      double x, double y)
+{
+   Event event(Event::XYStagePositionChanged);
+   event.device = device;
+   event.numbers.push_back(x);
+   event.numbers.push_back(y);
+   Post(event);
+}
+
+void EventDispatcher::PostExposureChanged(const std::string& device,
+      double exposure)
+{
+   Event event(Event::ExposureChanged);
+   event.device = device;
+   event.numbers.push_back(exposure);
+   Post(event);
+}
+
+void EventDispatcher::PostSLMExposureChanged(const std::string& device,
+      double exposure)
+{
+   Event event(Event::SLMExposureChanged);
+   event.device = device;
+   event.numbers.push_back(exposure);
+   Post(event);
+}
+
+} // namespace mm
@@ -0,0 +1,146 @@
+///////////////////////////////////////////////////////////////////////////////
+// FILE:          EventDispatcher.h
+// PROJECT:       Micro-Manager
+// SUBSYSTEM:     MMCore
+//-----------------------------------------------------------------------------
+// DESCRIPTION:   Delivery of MMEventCallback notifications on a core-owned
+//                thread
+//
+// LICENSE:       This file is distributed under the "Lesser GPL" (LGPL) license.
+//                License text is included with the source distribution.
+//
+//                This file is distributed in the hope that it will be useful,
+//                but WITHOUT ANY WARRANTY; without even the implied warranty
+//                of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+//
+//                IN NO EVENT SHALL THE COPYRIGHT OWNER OR
+//                CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+//                INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES.
+
+#pragma once
+
+#include "Logging/Logger.h"
+
+#include <boost/shared_ptr.hpp>
+#include <boost/thread/condition_variable.hpp>
+#include <boost/thread/mutex.hpp>
+#include <boost/thread/thread.hpp>
+#include <boost/utility.hpp>
+
+#include <list>
+#include <map>
+#include <string>
+#include <vector>
+
+class MMEventCallback;
+
+namespace mm {
+
+/**
+ * \brief Delivers notifications to the registered MMEventCallback from a
+ * dedicated thread
+ *
+ * The Post functions only queue the notification and return, so that the
+ * (device) threads reporting changes are not held up by the listener.
+ *
+ * A notification that supersedes one that is still queued replaces it: only
+ * the latest value is delivered for each property, each stage and camera
+ * position or exposure, and each configuration group. The replacement goes
+ * to the back of the queue, so that notifications are delivered in the order
+ * in which their latest values were posted. The number
+ * of queued notifications is bounded; when the limit is reached, further
+ * notifications are dropped and a single onPropertiesChanged() is delivered
+ * instead, telling the listener to refresh everything.
+ */
+class EventDispatcher /* final */ : boost::noncopyable
+{
+public:
+   explicit EventDispatcher(logging::Logger logger,
+         size_t maxQueuedEvents = 4096);
+   // Stops the thread; queued notifications are discarded
+   ~EventDispatcher();
+
+   // Notifications not yet delivered go to the new listener. Unless called
+   // from the listener itself, waits for the notification being delivered
+   // to the previous listener, if any, so that the latter can be destroyed
+   // afterwards.
+   void SetCallback(MMEventCallback* callback);
+   // Blocks until no notification is queued or being delivered; must not be
+   // called from the listener
+   void WaitForIdle();
+   // Stops the thread, waiting for the notification being delivered, if any;
+   // later notifications are discarded
+   void Shutdown();
+
+   void PostPropertiesChanged();
+   void PostPropertyChanged(const std::string& device,
+         const std::string& property, const std::string& value);
+   void PostChannelGroupChanged(const std::string& group);
+   void PostConfigGroupChanged(const std::string& group,
+         const std::string& config);
+   void PostSystemConfigurationLoaded();
+   void PostPixelSizeChanged(double pixelSizeUm);
+   void PostPixelSizeAffineChanged(const std::vector<double>& affine);
+   void PostStagePositionChanged(const std::string& device, double pos);
+   void PostXYStagePositionChanged(const std::string& device,
+         double x, double y);
+   void PostExposureChanged(const std::string& device, double exposure);
+   void PostSLMExposureChanged(const std::string& device, double exposure);
+
+private:
+   struct Event
+   {
+      enum Kind
+      {
+         PropertiesChanged,
+         PropertyChanged,
+         ChannelGroupChanged,
+         ConfigGroupChanged,
+         SystemConfigurationLoaded,
+         PixelSizeChanged,
+         PixelSizeAffineChanged,
+         StagePositionChanged,
+         XYStagePositionChanged,
+         ExposureChanged,
+         SLMExposureChanged
+      };
+
+      explicit Event(Kind k) : kind(k) {}
+
+      Kind kind;
+      // Together with kind, identifies the notifications that supersede
+      // each other
+      std::string device;
+      std::string name;
+      std::string value;
+      std::vector<double> numbers;
+
+      bool SameTarget(const Event& rhs) const
+      { return kind == rhs.kind && device == rhs.device && name == rhs.name; }
+      bool operator<(const Event& rhs) const;
+   };
+
+   void Post(const Event& event);
+   void ThreadFunc();
+   void Deliver(MMEventCallback* callback, Event& event);
+
+   logging::Logger logger_;
+   const size_t maxQueuedEvents_;
+
+   boost::mutex mutex_;
+   boost::condition_variable eventCond_;
+   boost::condition_variable idleCond_;
+   boost::condition_variable deliveredCond_;
+   MMEventCallback* callback_;
+   std::list<Event> queue_;
+   // Position in queue_ of the queued notification for each target
+   std::map<Event, std::list<Event>::iterator> queuedTargets_;
+   unsigned long droppedCount_;
+   bool delivering_; // A batch taken from queue_ is being delivered
+   bool inCallback_; // callback_ is being called
+   unsigned callbackWaiters_;
+   bool shutdown_;
+   boost::shared_ptr<boost::thread> thread_;
+};
+
+} // namespace mm
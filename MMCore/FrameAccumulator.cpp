@@ -0,0 +1,378 @@
+///////////////////////////////////////////////////////////////////////////////
+// FILE:          FrameAccumulator.cpp
+// PROJECT:       Micro-Manager
+// SUBSYSTEM:     MMCore
+//-----------------------------------------------------------------------------
+// DESCRIPTION:   Frame summation, averaging and per-pixel statistics in the
+//                image insertion path
+//
+// LICENSE:       This file is distributed under the "Lesser GPL" (LGPL) license.
+//                License text is included with the source distribution.
+//
+//                This file is distributed in the hope that it will be useful,
+//                but WITHOUT ANY WARRANTY; without even the implied warranty
+//                of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+//
+//                IN NO EVENT SHALL THE COPYRIGHT OWNER OR
+//                CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+//                INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES.
+
+#include "FrameAccumulator.h"
+
+#include "TaskSet.h"
+
+#include <boost/foreach.hpp>
+#include <boost/make_shared.hpp>
+
+#include <algorithm>
+#include <limits>
+
+namespace mm {
+
+namespace {
+
+const char* const g_ModeNames[] = {
+   "Sum", "Mean", "RunningMean", "Minimum", "Maximum", "Variance"
+};
+const int g_NrModes = sizeof(g_ModeNames) / sizeof(g_ModeNames[0]);
+
+} // anonymous namespace
+
+/**
+ * Splits the rows of a frame among the threads of the pool. The per-element
+ * loops are kept free of branches so that the compiler can vectorize them.
+ */
+class FrameAccumulator::RowTasks : public TaskSet
+{
+private:
+   class ATask : public Task
+   {
+   public:
+      ATask(boost::shared_ptr<Semaphore> semDone, size_t taskIndex,
+            size_t totalTaskCount) :
+         Task(semDone, taskIndex, totalTaskCount),
+         owner_(0), stream_(0), src_(0), emit_(false)
+      {}
+
+      void SetUp(const FrameAccumulator* owner, Stream* stream,
+            const unsigned char* src, bool emit, size_t usedTaskCount)
+      {
+         owner_ = owner;
+         stream_ = stream;
+         src_ = src;
+         emit_ = emit;
+         usedTaskCount_ = usedTaskCount;
+      }
+
+      virtual void Execute()
+      {
+         if (taskIndex_ >= usedTaskCount_)
+            return;
+         const size_t rows = stream_->rowCount;
+         const size_t begin = rows * taskIndex_ / usedTaskCount_;
+         const size_t end = rows * (taskIndex_ + 1) / usedTaskCount_;
+         owner_->ProcessRows(*stream_, src_, begin, end, emit_);
+      }
+
+   private:
+      const FrameAccumulator* owner_;
+      Stream* stream_;
+      const unsigned char* src_;
+      bool emit_;
+   };
+
+public:
+   explicit RowTasks(boost::shared_ptr<ThreadPool> pool) :
+      TaskSet(pool)
+   {
+      CreateTasks<ATask>();
+   }
+
+   void Run(const FrameAccumulator& owner, Stream& stream,
+         const unsigned char* src, bool emit)
+   {
+      // As for memory copies, one thread per MB of pixels
+      usedTaskCount_ = std::min(1 + stream.result->size() / 1000000,
+            std::min(tasks_.size(), stream.rowCount));
+      if (usedTaskCount_ <= 1)
+      {
+         owner.ProcessRows(stream, src, 0, stream.rowCount, emit);
+         return;
+      }
+
+      BOOST_FOREACH(Task* task, tasks_)
+         static_cast<ATask*>(task)->SetUp(&owner, &stream, src, emit,
+               usedTaskCount_);
+      Execute();
+      Wait();
+   }
+};
+
+
+FrameAccumulator::FrameAccumulator(logging::Logger logger, Mode mode,
+      unsigned frameCount, boost::shared_ptr<ThreadPool> pool) :
+   logger_(logger),
+   mode_(mode),
+   frameCount_(std::max(1u, frameCount)),
+   tasks_(boost::make_shared<RowTasks>(pool))
+{
+}
+
+FrameAccumulator::~FrameAccumulator()
+{
+}
+
+const char* FrameAccumulator::GetModeName(Mode mode)
+{
+   return g_ModeNames[mode];
+}
+
+bool FrameAccumulator::ParseModeName(const std::string& name, Mode& mode)
+{
+   for (int i = 0; i < g_NrModes; ++i)
+   {
+      if (name == g_ModeNames[i])
+      {
+         mode = static_cast<Mode>(i);
+         return true;
+      }
+   }
+   return false;
+}
+
+bool FrameAccumulator::Add(const void* source, const unsigned char* pixels,
+      unsigned width, unsigned height, unsigned byteDepth,
+      unsigned nComponents, unsigned numChannels,
+      Result& result)
+{
+   result.reset();
+   if (nComponents == 0)
+      nComponents = 1;
+
+   boost::mutex::scoped_lock lock(mutex_);
+
+   boost::shared_ptr<Stream>& stream = streams_[source];
+   if (!stream || stream->width != width || stream->height != height ||
+         stream->byteDepth != byteDepth ||
+         stream->nComponents != nComponents ||
+         stream->numChannels != numChannels)
+   {
+      stream = boost::make_shared<Stream>();
+      stream->width = width;
+      stream->height = height;
+      stream->byteDepth = byteDepth;
+      stream->nComponents = nComponents;
+      stream->numChannels = numChannels;
+      stream->rowElements = (size_t) width * nComponents;
+      stream->rowCount = (size_t) height * numChannels;
+      stream->framesAdded = 0;
+      stream->started = false;
+
+      const unsigned elementBytes = byteDepth / nComponents;
+      stream->supported = byteDepth % nComponents == 0 &&
+         (elementBytes == 1 || elementBytes == 2);
+      if (!stream->supported)
+      {
+         LOG_WARNING(logger_) << "Frames with " << byteDepth <<
+            " bytes per pixel and " << nComponents <<
+            " components are not accumulated";
+      }
+      else
+      {
+         const size_t elements = stream->rowElements * stream->rowCount;
+         switch (mode_)
+         {
+            case ModeSum:
+            case ModeMean:
+            case ModeMinimum:
+            case ModeMaximum:
+               stream->sums.resize(elements);
+               break;
+            case ModeVariance:
+               stream->squares.resize(elements);
+               // Fall through
+            case ModeRunningMean:
+               stream->means.resize(elements);
+               break;
+         }
+         stream->result = boost::make_shared< std::vector<unsigned char> >(
+               elements * elementBytes);
+      }
+   }
+
+   if (!stream->supported)
+      return true;
+
+   ++stream->framesAdded;
+   const bool emit = stream->framesAdded >= frameCount_;
+   if (emit && !stream->result.unique())
+   {
+      // The previous result is still being inserted
+      stream->result = boost::make_shared< std::vector<unsigned char> >(
+            stream->result->size());
+   }
+   tasks_->Run(*this, *stream, pixels, emit);
+   stream->started = true;
+   if (!emit)
+      return false;
+
+   stream->framesAdded = 0;
+   result = stream->result;
+   return true;
+}
+
+void FrameAccumulator::Reset()
+{
+   boost::mutex::scoped_lock lock(mutex_);
+   streams_.clear();
+}
+
+void FrameAccumulator::ProcessRows(Stream& stream, const unsigned char* src,
+      size_t beginRow, size_t endRow, bool emit) const
+{
+   const size_t begin = beginRow * stream.rowElements;
+   const size_t end = endRow * stream.rowElements;
+   if (stream.byteDepth / stream.nComponents == 1)
+   {
+      AccumulateRows(stream, src, begin, end);
+      if (emit)
+         EmitRows<boost::uint8_t>(stream, begin, end);
+   }
+   else
+   {
+      AccumulateRows(stream, reinterpret_cast<const boost::uint16_t*>(src),
+            begin, end);
+      if (emit)
+         EmitRows<boost::uint16_t>(stream, begin, end);
+   }
+}
+
+template <typename T>
+void FrameAccumulator::AccumulateRows(Stream& stream, const T* src,
+      size_t begin, size_t end) const
+{
+   const bool first = stream.framesAdded == 1;
+   switch (mode_)
+   {
+      case ModeSum:
+      case ModeMean:
+      {
+         boost::uint32_t* sums = &stream.sums[0];
+         if (first)
+            std::copy(src + begin, src + end, sums + begin);
+         else
+            for (size_t i = begin; i < end; ++i)
+               sums[i] += src[i];
+         break;
+      }
+      case ModeMinimum:
+      {
+         boost::uint32_t* sums = &stream.sums[0];
+         if (first)
+            std::copy(src + begin, src + end, sums + begin);
+         else
+            for (size_t i = begin; i < end; ++i)
+               sums[i] = std::min<boost::uint32_t>(sums[i], src[i]);
+         break;
+      }
+      case ModeMaximum:
+      {
+         boost::uint32_t* sums = &stream.sums[0];
+         if (first)
+            std::copy(src + begin, src + end, sums + begin);
+         else
+            for (size_t i = begin; i < end; ++i)
+               sums[i] = std::max<boost::uint32_t>(sums[i], src[i]);
+         break;
+      }
+      case ModeRunningMean:
+      {
+         float* means = &stream.means[0];
+         if (!stream.started)
+            std::copy(src + begin, src + end, means + begin);
+         else
+         {
+            const float weight = 1.0f / frameCount_;
+            for (size_t i = begin; i < end; ++i)
+               means[i] += weight * (src[i] - means[i]);
+         }
+         break;
+      }
+      case ModeVariance:
+      {
+         // Welford's update, which does not lose precision to cancellation
+         float* means = &stream.means[0];
+         float* squares = &stream.squares[0];
+         if (first)
+         {
+            std::copy(src + begin, src + end, means + begin);
+            std::fill(squares + begin, squares + end, 0.0f);
+         }
+         else
+         {
+            const float weight = 1.0f / stream.framesAdded;
+            for (size_t i = begin; i < end; ++i)
+            {
+               const float delta = src[i] - means[i];
+               means[i] += weight * delta;
+               squares[i] += delta * (src[i] - means[i]);
+            }
+         }
+         break;
+      }
+   }
+}
+
+template <typename T>
+void FrameAccumulator::EmitRows(Stream& stream, size_t begin,
+      size_t end) const
+{
+   const boost::uint32_t maxValue = std::numeric_limits<T>::max();
+   const float maxFloat = static_cast<float>(maxValue);
+   T* dst = reinterpret_cast<T*>(&(*stream.result)[0]);
+   switch (mode_)
+   {
+      case ModeSum:
+      {
+         const boost::uint32_t* sums = &stream.sums[0];
+         for (size_t i = begin; i < end; ++i)
+            dst[i] = static_cast<T>(std::min(sums[i], maxValue));
+         break;
+      }
+      case ModeMean:
+      {
+         const boost::uint32_t* sums = &stream.sums[0];
+         const boost::uint32_t count = frameCount_;
+         const boost::uint32_t half = count / 2;
+         for (size_t i = begin; i < end; ++i)
+            dst[i] = static_cast<T>((sums[i] + half) / count);
+         break;
+      }
+      case ModeMinimum:
+      case ModeMaximum:
+      {
+         const boost::uint32_t* sums = &stream.sums[0];
+         for (size_t i = begin; i < end; ++i)
+            dst[i] = static_cast<T>(sums[i]);
+         break;
+      }
+      case ModeRunningMean:
+      {
+         const float* means = &stream.means[0];
+         for (size_t i = begin; i < end; ++i)
+            dst[i] = static_cast<T>(std::min(means[i] + 0.5f, maxFloat));
+         break;
+      }
+      case ModeVariance:
+      {
+         const float* squares = &stream.squares[0];
+         const float weight = 1.0f / frameCount_;
+         for (size_t i = begin; i < end; ++i)
+            dst[i] = static_cast<T>(
+                  std::min(squares[i] * weight + 0.5f, maxFloat));
+         break;
+      }
+   }
+}
+
+} // namespace mm
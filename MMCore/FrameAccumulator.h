@@ -0,0 +1,128 @@
+///////////////////////////////////////////////////////////////////////////////
+// FILE:          FrameAccumulator.h
+// PROJECT:       Micro-Manager
+// SUBSYSTEM:     MMCore
+//-----------------------------------------------------------------------------
+// DESCRIPTION:   Frame summation, averaging and per-pixel statistics in the
+//                image insertion path
+//
+// LICENSE:       This file is distributed under the "Lesser GPL" (LGPL) license.
+//                License text is included with the source distribution.
+//
+//                This file is distributed in the hope that it will be useful,
+//                but WITHOUT ANY WARRANTY; without even the implied warranty
+//                of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+//
+//                IN NO EVENT SHALL THE COPYRIGHT OWNER OR
+//                CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+//                INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES.
+
+#pragma once
+
+#include "Logging/Logger.h"
+
+#include <boost/cstdint.hpp>
+#include <boost/shared_ptr.hpp>
+#include <boost/thread/mutex.hpp>
+#include <boost/utility.hpp>
+
+#include <map>
+#include <string>
+#include <vector>
+
+class ThreadPool;
+
+namespace mm {
+
+/**
+ * \brief Combines every frameCount inserted frames into one
+ *
+ * Frames are accumulated separately for each source (camera). Each result
+ * has the pixel format of the frames it was computed from, with values
+ * clamped to the range of that format; in particular ModeSum yields a
+ * saturating sum, in which pixels whose sum exceeds 255 or 65535 are set to
+ * that maximum (the sum itself is kept in 32 bits). Pixels with 8 or 16 bits per
+ * component are supported; frames in other formats are passed through
+ * unchanged. Large frames are processed by the threads of the pool, each
+ * taking a range of rows.
+ */
+class FrameAccumulator /* final */ : boost::noncopyable
+{
+public:
+   enum Mode
+   {
+      ModeSum, // Sum of frameCount frames, clamped to the pixel range
+      ModeMean, // Mean of frameCount frames
+      // Exponential running mean with weight 1/frameCount for the newest
+      // frame, emitted every frameCount frames
+      ModeRunningMean,
+      ModeMinimum, // Per-pixel minimum of frameCount frames
+      ModeMaximum, // Per-pixel maximum of frameCount frames
+      ModeVariance // Per-pixel (population) variance of frameCount frames
+   };
+
+   FrameAccumulator(logging::Logger logger, Mode mode, unsigned frameCount,
+         boost::shared_ptr<ThreadPool> pool);
+   ~FrameAccumulator();
+
+   // Names as used by the core API ("Sum", "Mean", "RunningMean",
+   // "Minimum", "Maximum", "Variance")
+   static const char* GetModeName(Mode mode);
+   static bool ParseModeName(const std::string& name, Mode& mode);
+
+   Mode GetMode() const { return mode_; }
+   unsigned GetFrameCount() const { return frameCount_; }
+
+   typedef boost::shared_ptr< const std::vector<unsigned char> > Result;
+
+   // Adds a frame. Returns true when a result is due, setting result to the
+   // accumulated pixels, or to null if the frame is to be used unchanged.
+   // The result is owned by the caller: it is neither overwritten by later
+   // frames nor freed by Reset() while a reference is held.
+   bool Add(const void* source, const unsigned char* pixels,
+         unsigned width, unsigned height, unsigned byteDepth,
+         unsigned nComponents, unsigned numChannels,
+         Result& result);
+   // Discards partially accumulated frames of all sources
+   void Reset();
+
+private:
+   class RowTasks;
+
+   struct Stream
+   {
+      unsigned width;
+      unsigned height;
+      unsigned byteDepth;
+      unsigned nComponents;
+      unsigned numChannels;
+      size_t rowElements;
+      size_t rowCount;
+      bool supported;
+      unsigned framesAdded; // Since the last result
+      bool started; // Running mean has been seeded
+      std::vector<boost::uint32_t> sums; // Sum, mean, minimum, maximum
+      std::vector<float> means; // Running mean, variance
+      std::vector<float> squares; // Variance: sum of squared deviations
+      // Replaced rather than overwritten while a caller holds it
+      boost::shared_ptr< std::vector<unsigned char> > result;
+   };
+
+   template <typename T>
+   void AccumulateRows(Stream& stream, const T* src, size_t begin,
+         size_t end) const;
+   template <typename T>
+   void EmitRows(Stream& stream, size_t begin, size_t end) const;
+   void ProcessRows(Stream& stream, const unsigned char* src,
+         size_t beginRow, size_t endRow, bool emit) const;
+
+   logging::Logger logger_;
+   const Mode mode_;
+   const unsigned frameCount_;
+
+   boost::mutex mutex_;
+   boost::shared_ptr<RowTasks> tasks_;
+   std::map< const void*, boost::shared_ptr<Stream> > streams_;
+};
+
+} // namespace mm
@@ -0,0 +1,466 @@
+///////////////////////////////////////////////////////////////////////////////
+// FILE:          DeviceAdapterIndex.cpp
+// PROJECT:       Micro-Manager
+// SUBSYSTEM:     MMCore
+//-----------------------------------------------------------------------------
+// DESCRIPTION:   On-disk index of the devices provided by device adapters
+//
+// LICENSE:       This file is distributed under the "Lesser GPL" (LGPL) license.
+//                License text is included with the source distribution.
+//
+//                This file is distributed in the hope that it will be useful,
+//                but WITHOUT ANY WARRANTY; without even the implied warranty
+//                of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+//
+//                IN NO EVENT SHALL THE COPYRIGHT OWNER OR
+//                CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+//                INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES.
+
+#include "DeviceAdapterIndex.h"
+
+#include "LoadedDeviceAdapter.h"
+#include "../../MMDevice/MMDevice.h"
+#include "../../MMDevice/ModuleInterface.h"
+#include "../CoreUtils.h"
+#include "../Error.h"
+
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <sstream>
+
+#include <sys/types.h>
+#include <sys/stat.h>
+
+#ifdef _WIN32
+#  include <windows.h>
+#else
+#  include <errno.h>
+#  include <fcntl.h>
+#  include <poll.h>
+#  include <signal.h>
+#  include <spawn.h>
+#  include <sys/wait.h>
+#  include <unistd.h>
+#  ifdef __APPLE__
+#     include <crt_externs.h>
+#  else
+extern char** environ;
+#  endif
+#endif
+
+
+namespace mm {
+
+namespace {
+
+const char* const g_IndexFileMagic = "MMDeviceAdapterIndex";
+const int g_IndexFileFormatVersion = 2;
+
+// A probe that produces no output within this time is killed
+const int g_ProbeTimeoutMs = 30000;
+
+std::string Escape(const std::string& str)
+{
+   std::string out;
+   out.reserve(str.size());
+   for (std::string::const_iterator it = str.begin(), end = str.end(); it != end; ++it)
+   {
+      switch (*it)
+      {
+         case '\\': out += "\\\\"; break;
+         case '\t': out += "\\t"; break;
+         case '\n': out += "\\n"; break;
+         case '\r': out += "\\r"; break;
+         default: out += *it;
+      }
+   }
+   return out;
+}
+
+std::string Unescape(const std::string& str)
+{
+   std::string out;
+   out.reserve(str.size());
+   for (std::string::const_iterator it = str.begin(), end = str.end(); it != end; ++it)
+   {
+      if (*it != '\\' || it + 1 == end)
+      {
+         out += *it;
+         continue;
+      }
+      switch (*++it)
+      {
+         case 't': out += '\t'; break;
+         case 'n': out += '\n'; break;
+         case 'r': out += '\r'; break;
+         default: out += *it;
+      }
+   }
+   return out;
+}
+
+std::vector<std::string> SplitFields(const std::string& line)
+{
+   std::vector<std::string> fields;
+   std::string::size_type start = 0;
+   for (;;)
+   {
+      std::string::size_type tab = line.find('\t', start);
+      fields.push_back(Unescape(line.substr(start, tab - start)));
+      if (tab == std::string::npos)
+         return fields;
+      start = tab + 1;
+   }
+}
+
+std::string IndexFileHeader()
+{
+   std::ostringstream os;
+   os << g_IndexFileMagic << '\t' << g_IndexFileFormatVersion << '\t' <<
+      DEVICE_INTERFACE_VERSION << '\t' << MODULE_INTERFACE_VERSION;
+   return os.str();
+}
+
+#ifdef _WIN32
+
+bool RunProcess(const std::string& executable,
+      const std::vector<std::string>& args, std::string& output)
+{
+   std::string cmdLine = "\"" + executable + "\"";
+   for (std::vector<std::string>::const_iterator it = args.begin(), end = args.end();
+         it != end; ++it)
+      cmdLine += " \"" + *it + "\"";
+   std::vector<char> cmdLineBuf(cmdLine.begin(), cmdLine.end());
+   cmdLineBuf.push_back('\0');
+
+   SECURITY_ATTRIBUTES sa;
+   sa.nLength = sizeof(sa);
+   sa.lpSecurityDescriptor = NULL;
+   sa.bInheritHandle = TRUE;
+   HANDLE readPipe, writePipe;
+   if (!CreatePipe(&readPipe, &writePipe, &sa, 1 << 20))
+      return false;
+   SetHandleInformation(readPipe, HANDLE_FLAG_INHERIT, 0);
+
+   STARTUPINFOA si;
+   ZeroMemory(&si, sizeof(si));
+   si.cb = sizeof(si);
+   si.dwFlags = STARTF_USESTDHANDLES;
+   si.hStdInput = GetStdHandle(STD_INPUT_HANDLE);
+   si.hStdOutput = writePipe;
+   si.hStdError = GetStdHandle(STD_ERROR_HANDLE);
+
+   PROCESS_INFORMATION pi;
+   BOOL started = CreateProcessA(executable.c_str(), &cmdLineBuf[0], NULL, NULL,
+         TRUE, CREATE_NO_WINDOW, NULL, NULL, &si, &pi);
+   CloseHandle(writePipe);
+   if (!started)
+   {
+      CloseHandle(readPipe);
+      return false;
+   }
+
+   // The probe only writes its output once it is done, and the pipe is
+   // large enough to hold it, so we can wait for exit before reading
+   bool timedOut = false;
+   if (WaitForSingleObject(pi.hProcess, g_ProbeTimeoutMs) != WAIT_OBJECT_0)
+   {
+      TerminateProcess(pi.hProcess, 1);
+      timedOut = true;
+   }
+   char buf[4096];
+   DWORD nRead;
+   while (!timedOut && ReadFile(readPipe, buf, sizeof(buf), &nRead, NULL) && nRead > 0)
+      output.append(buf, nRead);
+   CloseHandle(readPipe);
+
+   DWORD exitCode = 1;
+   GetExitCodeProcess(pi.hProcess, &exitCode);
+   CloseHandle(pi.hThread);
+   CloseHandle(pi.hProcess);
+   return !timedOut && exitCode == 0;
+}
+
+#else // UNIX
+
+bool RunProcess(const std::string& executable,
+      const std::vector<std::string>& args, std::string& output)
+{
+   std::vector<char*> argv;
+   argv.push_back(const_cast<char*>(executable.c_str()));
+   for (std::vector<std::string>::const_iterator it = args.begin(), end = args.end();
+         it != end; ++it)
+      argv.push_back(const_cast<char*>(it->c_str()));
+   argv.push_back(0);
+
+   int fds[2];
+   if (pipe(fds) != 0)
+      return false;
+   // Do not leak the pipe into processes spawned concurrently by other threads
+   fcntl(fds[0], F_SETFD, FD_CLOEXEC);
+   fcntl(fds[1], F_SETFD, FD_CLOEXEC);
+
+   posix_spawn_file_actions_t actions;
+   posix_spawn_file_actions_init(&actions);
+   posix_spawn_file_actions_adddup2(&actions, fds[1], STDOUT_FILENO);
+
+#ifdef __APPLE__
+   char** env = *_NSGetEnviron();
+#else
+   char** env = environ;
+#endif
+   pid_t pid;
+   int err = posix_spawn(&pid, executable.c_str(), &actions, 0, &argv[0], env);
+   posix_spawn_file_actions_destroy(&actions);
+   close(fds[1]);
+   if (err != 0)
+   {
+      close(fds[0]);
+      return false;
+   }
+
+   bool timedOut = false;
+   char buf[4096];
+   for (;;)
+   {
+      struct pollfd pfd;
+      pfd.fd = fds[0];
+      pfd.events = POLLIN;
+      pfd.revents = 0;
+      int ready = poll(&pfd, 1, g_ProbeTimeoutMs);
+      if (ready < 0 && errno == EINTR)
+         continue;
+      if (ready <= 0)
+      {
+         kill(pid, SIGKILL);
+         timedOut = true;
+         break;
+      }
+      ssize_t nRead = read(fds[0], buf, sizeof(buf));
+      if (nRead < 0 && errno == EINTR)
+         continue;
+      if (nRead <= 0)
+         break;
+      output.append(buf, nRead);
+   }
+   close(fds[0]);
+
+   int status = 0;
+   while (waitpid(pid, &status, 0) < 0 && errno == EINTR)
+      ;
+   return !timedOut && WIFEXITED(status) && WEXITSTATUS(status) == 0;
+}
+
+#endif // UNIX
+
+} // anonymous namespace
+
+
+void
+DeviceAdapterIndex::Load(const std::string& filename)
+{
+   modules_.clear();
+   dirty_ = false;
+
+   std::ifstream is(filename.c_str());
+   std::string header;
+   if (!std::getline(is, header) || header != IndexFileHeader())
+      return;
+
+   AdapterModuleInfo info;
+   while (ReadRecord(is, info))
+      modules_[info.path] = info;
+}
+
+
+void
+DeviceAdapterIndex::Save(const std::string& filename)
+{
+   if (!dirty_)
+      return;
+
+   // Write a complete new file and then replace the old one, so that a
+   // concurrent reader never sees a partial index
+   const std::string tmpFilename = filename + ".tmp";
+   {
+      std::ofstream os(tmpFilename.c_str(), std::ios::out | std::ios::trunc);
+      os << IndexFileHeader() << '\n';
+      for (std::map<std::string, AdapterModuleInfo>::const_iterator
+            it = modules_.begin(), end = modules_.end(); it != end; ++it)
+         WriteRecord(os, it->second);
+      os.close();
+      if (os.fail())
+      {
+         std::remove(tmpFilename.c_str());
+         throw CMMError("Cannot write device adapter index file " +
+               ToQuotedString(filename));
+      }
+   }
+#ifdef _WIN32
+   std::remove(filename.c_str());
+#endif
+   if (std::rename(tmpFilename.c_str(), filename.c_str()) != 0)
+   {
+      std::remove(tmpFilename.c_str());
+      throw CMMError("Cannot write device adapter index file " +
+            ToQuotedString(filename));
+   }
+   dirty_ = false;
+}
+
+
+bool
+DeviceAdapterIndex::Lookup(const std::string& path, long long mtime,
+      long long size, AdapterModuleInfo& info) const
+{
+   std::map<std::string, AdapterModuleInfo>::const_iterator it = modules_.find(path);
+   if (it == modules_.end() || it->second.mtime != mtime || it->second.size != size)
+      return false;
+   info = it->second;
+   return true;
+}
+
+
+void
+DeviceAdapterIndex::Store(const AdapterModuleInfo& info)
+{
+   modules_[info.path] = info;
+   dirty_ = true;
+}
+
+
+void
+DeviceAdapterIndex::DescribeModule(const LoadedDeviceAdapter& adapter,
+      AdapterModuleInfo& info)
+{
+   std::vector<std::string> names = adapter.GetAvailableDeviceNames();
+   info.devices.clear();
+   info.devices.reserve(names.size());
+   for (std::vector<std::string>::const_iterator it = names.begin(), end = names.end();
+         it != end; ++it)
+   {
+      AdapterDeviceInfo device;
+      device.name = *it;
+      device.description = adapter.GetDeviceDescription(*it);
+      device.type = adapter.GetAdvertisedDeviceType(*it);
+      info.devices.push_back(device);
+   }
+}
+
+
+bool
+DeviceAdapterIndex::Probe(const std::string& probeExecutable,
+      const std::string& moduleName, const std::string& path,
+      AdapterModuleInfo& info)
+{
+   std::vector<std::string> args;
+   args.push_back(moduleName);
+   args.push_back(path);
+
+   std::string output;
+   if (!RunProcess(probeExecutable, args, output))
+      return false;
+
+   // Skip anything the adapter itself may have printed before the record
+   std::string::size_type start = 0;
+   if (output.compare(0, 7, "module\t") != 0)
+   {
+      start = output.rfind("\nmodule\t");
+      if (start == std::string::npos)
+         return false;
+      ++start;
+   }
+
+   std::istringstream is(output.substr(start));
+   AdapterModuleInfo probed;
+   if (!ReadRecord(is, probed) || probed.name != moduleName)
+      return false;
+
+   // The file stamp is recorded by the caller
+   probed.path = info.path;
+   probed.mtime = info.mtime;
+   probed.size = info.size;
+   info = probed;
+   return true;
+}
+
+
+bool
+DeviceAdapterIndex::GetFileStamp(const std::string& path,
+      long long& mtime, long long& size)
+{
+#ifdef _WIN32
+   struct _stat64 st;
+   if (_stat64(path.c_str(), &st) != 0)
+      return false;
+#else
+   struct stat st;
+   if (stat(path.c_str(), &st) != 0)
+      return false;
+#endif
+   mtime = static_cast<long long>(st.st_mtime);
+   size = static_cast<long long>(st.st_size);
+   return true;
+}
+
+
+/*
+ * Each module is written as one "module" line followed by one "device" line
+ * per device; fields are tab-separated and backslash-escaped:
+ *
+ *    module <name> <path> <mtime> <size> <device count> <error> <probe failed>
+ *    device <name> <type> <description>
+ */
+void
+DeviceAdapterIndex::WriteRecord(std::ostream& os, const AdapterModuleInfo& info)
+{
+   os << "module\t" << Escape(info.name) << '\t' << Escape(info.path) << '\t' <<
+      info.mtime << '\t' << info.size << '\t' << info.devices.size() << '\t' <<
+      Escape(info.error) << '\t' << (info.probeFailed ? 1 : 0) << '\n';
+   for (std::vector<AdapterDeviceInfo>::const_iterator it = info.devices.begin(),
+         end = info.devices.end(); it != end; ++it)
+   {
+      os << "device\t" << Escape(it->name) << '\t' <<
+         static_cast<int>(it->type) << '\t' << Escape(it->description) << '\n';
+   }
+}
+
+
+bool
+DeviceAdapterIndex::ReadRecord(std::istream& is, AdapterModuleInfo& info)
+{
+   std::string line;
+   if (!std::getline(is, line))
+      return false;
+   std::vector<std::string> fields = SplitFields(line);
+   if (fields.size() != 8 || fields[0] != "module")
+      return false;
+
+   info = AdapterModuleInfo();
+   info.name = fields[1];
+   info.path = fields[2];
+   size_t deviceCount = 0;
+   std::istringstream(fields[3]) >> info.mtime;
+   std::istringstream(fields[4]) >> info.size;
+   std::istringstream(fields[5]) >> deviceCount;
+   info.error = fields[6];
+   info.probeFailed = fields[7] == "1";
+
+   for (size_t i = 0; i < deviceCount; ++i)
+   {
+      if (!std::getline(is, line))
+         return false;
+      fields = SplitFields(line);
+      if (fields.size() != 4 || fields[0] != "device")
+         return false;
+      AdapterDeviceInfo device;
+      device.name = fields[1];
+      device.type = static_cast<MM::DeviceType>(std::atoi(fields[2].c_str()));
+      device.description = fields[3];
+      info.devices.push_back(device);
+   }
+   return true;
+}
+
+} // namespace mm
@@ -0,0 +1,104 @@
+///////////////////////////////////////////////////////////////////////////////
+// FILE:          DeviceAdapterIndex.h
+// PROJECT:       Micro-Manager
+// SUBSYSTEM:     MMCore
+//-----------------------------------------------------------------------------
+// DESCRIPTION:   On-disk index of the devices provided by device adapters
+//
+// LICENSE:       This file is distributed under the "Lesser GPL" (LGPL) license.
+//                License text is included with the source distribution.
+//
+//                This file is distributed in the hope that it will be useful,
+//                but WITHOUT ANY WARRANTY; without even the implied warranty
+//                of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+//
+//                IN NO EVENT SHALL THE COPYRIGHT OWNER OR
+//                CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+//                INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES.
+
+#pragma once
+
+#include "../../MMDevice/MMDeviceConstants.h"
+
+#include <iosfwd>
+#include <map>
+#include <string>
+#include <vector>
+
+class LoadedDeviceAdapter;
+
+namespace mm {
+
+struct AdapterDeviceInfo
+{
+   std::string name;
+   std::string description;
+   MM::DeviceType type;
+};
+
+struct AdapterModuleInfo
+{
+   AdapterModuleInfo() : mtime(0), size(0), probeFailed(false) {}
+
+   std::string name;
+   std::string path;
+   long long mtime;
+   long long size;
+   // Nonempty if the module could not be listed
+   std::string error;
+   // Set if the probe crashed or hung on the module, in which case it is not
+   // loaded into the calling process to list it
+   bool probeFailed;
+   std::vector<AdapterDeviceInfo> devices;
+};
+
+
+/**
+ * \brief Cache of the device names, types and descriptions of adapter modules
+ *
+ * Entries are keyed by the module's file path and remain valid for as long as
+ * the file's modification time and size are unchanged. The whole index is
+ * discarded when the device or module interface version changes.
+ *
+ * Modules that are not in the index (or have changed) can be listed by the
+ * probe executable (mmdeviceprobe), so that listing the available devices does
+ * not load every adapter (and vendor library) into the calling process.
+ */
+class DeviceAdapterIndex /* final */
+{
+public:
+   DeviceAdapterIndex() : dirty_(false) {}
+
+   // A missing, unreadable or outdated file yields an empty index
+   void Load(const std::string& filename);
+   // Does nothing unless entries were added since the last load or save
+   void Save(const std::string& filename);
+
+   bool Lookup(const std::string& path, long long mtime, long long size,
+         AdapterModuleInfo& info) const;
+   void Store(const AdapterModuleInfo& info);
+
+   // Fill in the devices from a loaded adapter; throws CMMError
+   static void DescribeModule(const LoadedDeviceAdapter& adapter,
+         AdapterModuleInfo& info);
+
+   // Run the probe executable for one module. Returns false if the probe
+   // could not be run or did not produce a valid record (the module
+   // reporting an error is not a probe failure).
+   static bool Probe(const std::string& probeExecutable,
+         const std::string& moduleName, const std::string& path,
+         AdapterModuleInfo& info);
+
+   static bool GetFileStamp(const std::string& path,
+         long long& mtime, long long& size);
+
+   // The record format shared by the index file and the probe output
+   static void WriteRecord(std::ostream& os, const AdapterModuleInfo& info);
+   static bool ReadRecord(std::istream& is, AdapterModuleInfo& info);
+
+private:
+   std::map<std::string, AdapterModuleInfo> modules_;
+   bool dirty_;
+};
+
+} // namespace mm
@@ -28,9 +28,14 @@
 #include <boost/bind.hpp>
 #include <boost/make_shared.hpp>
 
+#include <algorithm>
+#include <vector>
+
 
 LoadedDeviceAdapter::LoadedDeviceAdapter(const std::string& name, const std::string& filename) :
    name_(name),
+   concurrency_(MM::ConcurrencyPerModule),
+   unresolvedPeripheralCount_(0),
    InitializeModuleData_(0),
    CreateDevice_(0),
    DeleteDevice_(0),
@@ -63,6 +68,7 @@ LoadedDeviceAdapter::LoadedDeviceAdapter(const std::string& name, const std::str
    }
 
    InitializeModuleData();
+   concurrency_ = GetModuleConcurrency();
 }
 
 
@@ -73,6 +79,106 @@ LoadedDeviceAdapter::GetLock()
 }
 
 
+MMThreadLock*
+LoadedDeviceAdapter::GetHubLock(const std::string& deviceLabel, bool isHub)
+{
+   MMThreadGuard g(hubLocksLock_);
+
+   // A peripheral whose hub is not known may share state with any hub of
+   // the module, so while there is one, every device takes the module lock
+   if (unresolvedPeripheralCount_ > 0)
+      return &lock_;
+
+   std::string hubLabel = deviceLabel;
+   if (!isHub)
+   {
+      std::map<std::string, std::string>::const_iterator it =
+         peripheralParents_.find(deviceLabel);
+      if (it == peripheralParents_.end())
+         return &lock_;
+      hubLabel = it->second;
+   }
+
+   boost::shared_ptr<MMThreadLock>& lock = hubLocks_[hubLabel];
+   if (!lock)
+      lock = boost::make_shared<MMThreadLock>();
+   return lock.get();
+}
+
+
+void
+LoadedDeviceAdapter::SetPeripheralParent(const std::string& label,
+      const std::string& parentLabel)
+{
+   UpdatePeripheral(label, &parentLabel);
+}
+
+
+void
+LoadedDeviceAdapter::RemovePeripheral(const std::string& label)
+{
+   UpdatePeripheral(label, 0);
+}
+
+
+void
+LoadedDeviceAdapter::UpdatePeripheral(const std::string& label,
+      const std::string* parentLabel)
+{
+   // The change can move devices to a different lock. Hold every lock of
+   // the module while making it, so that no call made under the previous
+   // choice is still running afterwards. (Callers that picked a lock before
+   // the change recheck it once they hold it; see DeviceModuleLockGuard.)
+   lock_.Lock();
+   std::vector<MMThreadLock*> held;
+   for (;;)
+   {
+      std::vector<MMThreadLock*> pending;
+      {
+         MMThreadGuard g(hubLocksLock_);
+         for (std::map< std::string, boost::shared_ptr<MMThreadLock> >::const_iterator
+               it = hubLocks_.begin(), end = hubLocks_.end(); it != end; ++it)
+         {
+            if (std::find(held.begin(), held.end(), it->second.get()) == held.end())
+               pending.push_back(it->second.get());
+         }
+
+         if (pending.empty())
+         {
+            std::map<std::string, std::string>::iterator it =
+               peripheralParents_.find(label);
+            if (it != peripheralParents_.end())
+            {
+               if (it->second.empty())
+                  --unresolvedPeripheralCount_;
+               peripheralParents_.erase(it);
+            }
+            if (parentLabel)
+            {
+               peripheralParents_[label] = *parentLabel;
+               if (parentLabel->empty())
+                  ++unresolvedPeripheralCount_;
+            }
+            break;
+         }
+      }
+
+      // Hub locks are never removed, so these pointers stay valid
+      for (std::vector<MMThreadLock*>::iterator it = pending.begin(),
+            end = pending.end(); it != end; ++it)
+      {
+         (*it)->Lock();
+         held.push_back(*it);
+      }
+   }
+
+   for (std::vector<MMThreadLock*>::reverse_iterator it = held.rbegin(),
+         end = held.rend(); it != end; ++it)
+      (*it)->Unlock();
+   lock_.Unlock();
+}
+
+
 std::vector<std::string>
 LoadedDeviceAdapter::GetAvailableDeviceNames() const
 {
@@ -260,6 +366,33 @@ LoadedDeviceAdapter::DeleteDevice(MM::Device* device)
 }
 
 
+MM::DeviceConcurrency
+LoadedDeviceAdapter::GetModuleConcurrency() const
+{
+   // Optional: modules built against an older MMDevice do not export it
+   fnGetModuleConcurrency getModuleConcurrency;
+   try
+   {
+      getModuleConcurrency = reinterpret_cast<fnGetModuleConcurrency>
+         (module_->GetFunction("GetModuleConcurrency"));
+   }
+   catch (const CMMError&)
+   {
+      return MM::ConcurrencyPerModule;
+   }
+
+   switch (getModuleConcurrency())
+   {
+      case MM::ConcurrencyPerHub:
+         return MM::ConcurrencyPerHub;
+      case MM::ConcurrencyPerDevice:
+         return MM::ConcurrencyPerDevice;
+      default:
+         return MM::ConcurrencyPerModule;
+   }
+}
+
+
 long
 LoadedDeviceAdapter::GetModuleVersion() const
 {
@@ -31,6 +31,9 @@
 #include <boost/shared_ptr.hpp>
 #include <boost/utility.hpp>
 
+#include <map>
+#include <string>
+
 class CMMCore;
 
 
@@ -54,6 +57,18 @@ public:
    // adapter.
    MMThreadLock* GetLock();
 
+   // How finely the module allows calls into its devices to be serialized
+   // (see DeviceInstance::GetLock()).
+   MM::DeviceConcurrency GetConcurrency() const { return concurrency_; }
+   // Under per-hub concurrency, the lock shared by a hub of this module and
+   // its peripherals; the module lock while any peripheral has no parent.
+   MMThreadLock* GetHubLock(const std::string& deviceLabel, bool isHub);
+   // Record the parent of a (non-hub) device of this module, or forget the
+   // device. These wait until no device of the module is being called.
+   void SetPeripheralParent(const std::string& label,
+         const std::string& parentLabel);
+   void RemovePeripheral(const std::string& label);
+
    std::vector<std::string> GetAvailableDeviceNames() const;
    std::string GetDeviceDescription(const std::string& deviceName) const;
    MM::DeviceType GetAdvertisedDeviceType(const std::string& deviceName) const;
@@ -94,6 +109,7 @@ private:
 
    // Wrappers around raw module interface functions
    void InitializeModuleData();
+   MM::DeviceConcurrency GetModuleConcurrency() const;
    long GetModuleVersion() const;
    long GetDeviceInterfaceVersion() const;
    unsigned GetNumberOfDevices() const;
@@ -104,10 +120,20 @@ private:
    MM::Device* CreateDevice(const char* deviceName);
    void DeleteDevice(MM::Device* device);
 
+   void UpdatePeripheral(const std::string& label,
+         const std::string* parentLabel);
+
    const std::string name_;
    boost::shared_ptr<LoadedModule> module_;
 
    MMThreadLock lock_;
+   MM::DeviceConcurrency concurrency_;
+   // Guards hubLocks_, peripheralParents_ and unresolvedPeripheralCount_
+   MMThreadLock hubLocksLock_;
+   std::map< std::string, boost::shared_ptr<MMThreadLock> > hubLocks_;
+   // Parent labels of the loaded non-hub devices (per-hub concurrency only)
+   std::map<std::string, std::string> peripheralParents_;
+   unsigned unresolvedPeripheralCount_;
 
    // Cached function pointers
    mutable fnInitializeModuleData InitializeModuleData_;
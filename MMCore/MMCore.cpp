@@ -42,25 +42,40 @@
 #include "../MMDevice/DeviceUtils.h"
 #include "../MMDevice/ImageMetadata.h"
 #include "../MMDevice/ModuleInterface.h"
+#include "AcquisitionPlanRunner.h"
+#include "AcquisitionStatistics.h"
 #include "CircularBuffer.h"
 #include "ConfigGroup.h"
 #include "Configuration.h"
 #include "CoreCallback.h"
 #include "CoreProperty.h"
 #include "CoreUtils.h"
+#include "DeviceCommandExecutor.h"
 #include "DeviceManager.h"
+#include "DiskStreamSink.h"
+#include "EventDispatcher.h"
+#include "FrameAccumulator.h"
 #include "Devices/DeviceInstances.h"
 #include "Host.h"
 #include "LogManager.h"
 #include "MMCore.h"
 #include "MMEventCallback.h"
 #include "PluginManager.h"
+#include "SequenceStreamer.h"
+#include "ThreadPool.h"
 
+#include <boost/bind.hpp>
 #include <boost/date_time/posix_time/posix_time.hpp>
+#include <boost/function.hpp>
+#include <boost/make_shared.hpp>
+#include <boost/thread/thread.hpp>
+#include <boost/thread/thread_time.hpp>
 
 #include <algorithm>
 #include <assert.h>
+#include <cstdio>
 #include <fstream>
+#include <iomanip>
 #include <set>
 #include <sstream>
 #include <vector>
@@ -113,7 +128,7 @@ using namespace std;
  * (Keep the 3 numbers on one line to make it easier to look at diffs when
  * merging/rebasing.)
  */
-const int MMCore_versionMajor = 10, MMCore_versionMinor = 1, MMCore_versionPatch = 1;
+const int MMCore_versionMajor = 10, MMCore_versionMinor = 2, MMCore_versionPatch = 0;
 
 
 ///////////////////////////////////////////////////////////////////////////////
@@ -132,20 +147,31 @@ CMMCore::CMMCore() :
    everSnapped_(false),
    pollingIntervalMs_(10),
    timeoutMs_(5000),
+   busyChangeCount_(0),
+   deferPropertyCallbacks_(false),
+   deferredPropertyCallbacks_(0),
    autoShutter_(true),
+   parallelConfigLoading_(true),
    callback_(0),
    configGroups_(0),
    properties_(0),
    externalCallback_(0),
    pixelSizeGroup_(0),
    cbuf_(0),
-   pluginManager_(new CPluginManager()),
+   acqStats_(new mm::AcquisitionStatistics()),
+   pluginManager_(new CPluginManager(coreLogger_)),
    deviceManager_(new mm::DeviceManager()),
-   pPostedErrorsLock_(NULL)
+   stateCacheGeneration_(0),
+   stateCacheSnapshotGeneration_(-1),
+   pPostedErrorsLock_(NULL),
+   acquisitionPlanStopRequested_(false),
+   slmPatternBankGeneration_(0)
 {
    configGroups_ = new ConfigGroupCollection();
    pixelSizeGroup_ = new PixelSizeConfigGroup();
    pPostedErrorsLock_ = new MMThreadLock();
+   commandExecutor_.reset(new mm::DeviceCommandExecutor(coreLogger_));
+   eventDispatcher_.reset(new mm::EventDispatcher(coreLogger_));
 
    InitializeErrorMessages();
 
@@ -153,6 +179,7 @@ CMMCore::CMMCore() :
 
    const unsigned seqBufMegabytes = (sizeof(void*) > 4) ? 250 : 25;
    cbuf_ = new CircularBuffer(seqBufMegabytes);
+   cbuf_->SetStatistics(acqStats_);
 
    nullAffine_ = new std::vector<double>(6);
    for (int i = 0; i < 6; i++) {
@@ -168,6 +195,9 @@ CMMCore::CMMCore() :
  */
 CMMCore::~CMMCore()
 {
+   // The listener may call back into the core, so stop notifying it first
+   eventDispatcher_->Shutdown();
+
    try
    {
       // TODO We should attempt to continue cleanup beyond the first device
@@ -249,6 +279,30 @@ bool CMMCore::debugLogEnabled()
    return (logManager_->GetPrimaryLogLevel() < mm::logging::LogLevelInfo);
 }
 
+/**
+ * Enables or disables applying the device properties of a configuration file
+ * for different device adapter modules in parallel (enabled by default).
+ *
+ * Disable this for systems whose devices in different modules depend on one
+ * another's properties being set in file order; the lines are then applied
+ * one by one.
+ *
+ * @see loadSystemConfiguration()
+ */
+void CMMCore::enableParallelConfigLoading(bool enable)
+{
+   parallelConfigLoading_ = enable;
+}
+
+/**
+ * Indicates whether loadSystemConfiguration() applies device properties of
+ * different modules in parallel.
+ */
+bool CMMCore::parallelConfigLoadingEnabled()
+{
+   return parallelConfigLoading_;
+}
+
 /**
  * Enables or disables log message display on the standard console.
  * @param enable     if set to true, log file messages will be echoed on the stderr.
@@ -363,9 +417,16 @@ string CMMCore::getVersionInfo() const
 std::vector<std::string>
 CMMCore::getAvailableDevices(const char* moduleName) throw (CMMError)
 {
-   boost::shared_ptr<LoadedDeviceAdapter> module =
-      pluginManager_->GetDeviceAdapter(moduleName);
-   return module->GetAvailableDeviceNames();
+   std::vector<mm::AdapterDeviceInfo> devices =
+      pluginManager_->GetAvailableDevices(moduleName);
+   std::vector<std::string> names;
+   names.reserve(devices.size());
+   for (std::vector<mm::AdapterDeviceInfo>::const_iterator
+         it = devices.begin(), end = devices.end(); it != end; ++it)
+   {
+      names.push_back(it->name);
+   }
+   return names;
 }
 
 /**
@@ -376,15 +437,14 @@ CMMCore::getAvailableDeviceDescriptions(const char* moduleName) throw (CMMError)
 {
    // XXX It is a little silly that we return the list of descriptions, rather
    // than provide access to the description of each device.
-   boost::shared_ptr<LoadedDeviceAdapter> module =
-      pluginManager_->GetDeviceAdapter(moduleName);
-   std::vector<std::string> names = module->GetAvailableDeviceNames();
+   std::vector<mm::AdapterDeviceInfo> devices =
+      pluginManager_->GetAvailableDevices(moduleName);
    std::vector<std::string> descriptions;
-   descriptions.reserve(names.size());
-   for (std::vector<std::string>::const_iterator
-         it = names.begin(), end = names.end(); it != end; ++it)
+   descriptions.reserve(devices.size());
+   for (std::vector<mm::AdapterDeviceInfo>::const_iterator
+         it = devices.begin(), end = devices.end(); it != end; ++it)
    {
-      descriptions.push_back(module->GetDeviceDescription(*it));
+      descriptions.push_back(it->description);
    }
    return descriptions;
 }
@@ -397,16 +457,14 @@ CMMCore::getAvailableDeviceTypes(const char* moduleName) throw (CMMError)
 {
    // XXX It is a little silly that we return the list of types, rather than
    // provide access to the type of each device.
-   boost::shared_ptr<LoadedDeviceAdapter> module =
-      pluginManager_->GetDeviceAdapter(moduleName);
-   std::vector<std::string> names = module->GetAvailableDeviceNames();
+   std::vector<mm::AdapterDeviceInfo> devices =
+      pluginManager_->GetAvailableDevices(moduleName);
    std::vector<long> types;
-   types.reserve(names.size());
-   for (std::vector<std::string>::const_iterator
-         it = names.begin(), end = names.end(); it != end; ++it)
+   types.reserve(devices.size());
+   for (std::vector<mm::AdapterDeviceInfo>::const_iterator
+         it = devices.begin(), end = devices.end(); it != end; ++it)
    {
-      MM::DeviceType devType = module->GetAdvertisedDeviceType(*it);
-      types.push_back(static_cast<long>(devType));
+      types.push_back(static_cast<long>(it->type));
    }
    return types;
 }
@@ -641,6 +699,36 @@ std::vector<std::string> CMMCore::getDeviceAdapterNames() throw (CMMError)
    return pluginManager_->GetAvailableDeviceAdapters();
 }
 
+/**
+ * Set the file used to cache the devices available in each device adapter.
+ *
+ * With the index enabled, getAvailableDevices(),
+ * getAvailableDeviceDescriptions() and getAvailableDeviceTypes() return the
+ * cached information for device adapters whose file has not changed, and list
+ * new or changed device adapters using a helper process (mmdeviceprobe,
+ * installed alongside the device adapters), so that the device adapters are
+ * not loaded into this process. The index file is created or updated as
+ * needed.
+ *
+ * @param filename   the index file, or an empty string to disable the index
+ */
+void CMMCore::setDeviceAdapterIndexFile(const char* filename) throw (CMMError)
+{
+   if (!filename)
+      throw CMMError(getCoreErrorText(MMERR_NullPointerException),
+            MMERR_NullPointerException);
+   pluginManager_->SetDeviceAdapterIndexFile(filename);
+}
+
+/**
+ * Return the device adapter index file, or an empty string if the index is
+ * disabled.
+ */
+std::string CMMCore::getDeviceAdapterIndexFile() const
+{
+   return pluginManager_->GetDeviceAdapterIndexFile();
+}
+
 /**
  * Add a list of paths to the legacy device adapter search path list.
  *
@@ -783,6 +871,9 @@ void CMMCore::unloadDevice(const char* label///< the name of the device to unloa
 {
    boost::shared_ptr<DeviceInstance> pDevice = deviceManager_->GetDevice(label);
 
+   discardSequenceStreamers(label);
+   discardSLMPatternBanks(label);
+
    try {
       mm::DeviceModuleLockGuard guard(pDevice);
       LOG_DEBUG(coreLogger_) << "Will unload device " << label;
@@ -802,6 +893,11 @@ void CMMCore::unloadDevice(const char* label///< the name of the device to unloa
 void CMMCore::unloadAllDevices() throw (CMMError)
 {
    try {
+      // Let queued asynchronous commands finish while their devices exist
+      commandExecutor_->WaitForIdle();
+      discardSequenceStreamers("");
+      discardSLMPatternBanks("");
+
       configGroups_->Clear();
 
       //selected channel group is no longer valid
@@ -969,10 +1065,93 @@ void CMMCore::updateSystemStateCache()
    {
       MMThreadGuard scg(stateCacheLock_);
       stateCache_ = wk;
+      ++stateCacheGeneration_;
    }
    LOG_INFO(coreLogger_) << "Did update system state cache";
 }
 
+/**
+ * Returns a number that changes whenever a value in the system state cache
+ * changes. Callers that derive data from getSystemStateCache() can use it to
+ * tell when their copy is out of date.
+ */
+long CMMCore::getSystemStateCacheGeneration() const
+{
+   MMThreadGuard scg(stateCacheLock_);
+   return stateCacheGeneration_;
+}
+
+namespace {
+
+void AppendJSONString(std::string& out, const std::string& str)
+{
+   out += '"';
+   for (std::string::const_iterator it = str.begin(), end = str.end(); it != end; ++it)
+   {
+      switch (*it)
+      {
+         case '"': out += "\\\""; break;
+         case '\\': out += "\\\\"; break;
+         case '\n': out += "\\n"; break;
+         case '\r': out += "\\r"; break;
+         case '\t': out += "\\t"; break;
+         default:
+            if (static_cast<unsigned char>(*it) < 0x20)
+            {
+               char esc[8];
+               sprintf(esc, "\\u%04x", static_cast<unsigned>(static_cast<unsigned char>(*it)));
+               out += esc;
+            }
+            else
+               out += *it;
+      }
+   }
+   out += '"';
+}
+
+} // anonymous namespace
+
+/**
+ * Returns the system state cache serialized as a JSON object, mapping
+ * "Device-Property" keys to values (the keys used in image metadata).
+ *
+ * The string is rebuilt only when the cache has changed since the last call
+ * (see getSystemStateCacheGeneration()), so it is cheap to call per image.
+ */
+std::string CMMCore::getSystemStateCacheSnapshot() const
+{
+   MMThreadGuard scg(stateCacheLock_);
+   if (stateCacheSnapshotGeneration_ != stateCacheGeneration_)
+   {
+      std::string json = "{";
+      for (size_t i = 0; i < stateCache_.size(); ++i)
+      {
+         PropertySetting setting = stateCache_.getSetting(i);
+         if (i > 0)
+            json += ',';
+         AppendJSONString(json, setting.getDeviceLabel() + "-" + setting.getPropertyName());
+         json += ':';
+         AppendJSONString(json, setting.getPropertyValue());
+      }
+      json += '}';
+      stateCacheSnapshot_ = json;
+      stateCacheSnapshotGeneration_ = stateCacheGeneration_;
+   }
+   return stateCacheSnapshot_;
+}
+
+/**
+ * Updates one value in the system state cache.
+ * Must be called with stateCacheLock_ held.
+ */
+void CMMCore::addStateCacheSetting(const PropertySetting& setting) const
+{
+   if (stateCache_.isSettingIncluded(setting))
+      return;
+   stateCache_.addSetting(setting);
+   ++stateCacheGeneration_;
+}
+
 /**
  * Returns device type.
  */
@@ -1097,6 +1276,30 @@ std::string CMMCore::getDeviceDescription(const char* label) throw (CMMError)
    return pDevice->GetDescription();
 }
 
+/**
+ * Returns a handle to a loaded device, to pass to the overloads of frequently
+ * used methods (such as getProperty(), setPosition() and waitForDevice())
+ * that take a handle in place of the device label.
+ *
+ * @param label   the device label
+ */
+DeviceHandle CMMCore::getDeviceHandle(const char* label) throw (CMMError)
+{
+   boost::shared_ptr<DeviceInstance> pDevice = deviceManager_->GetDevice(label);
+   return DeviceHandle(pDevice->GetLabel(), pDevice);
+}
+
+boost::shared_ptr<DeviceInstance>
+CMMCore::resolveDeviceHandle(const DeviceHandle& device) const throw (CMMError)
+{
+   boost::shared_ptr<DeviceInstance> pDevice = device.device_.lock();
+   if (!pDevice)
+      throw CMMError("Device " + ToQuotedString(device.label_) + ": " +
+            getCoreErrorText(MMERR_InvalidDeviceHandle),
+            MMERR_InvalidDeviceHandle);
+   return pDevice;
+}
+
 
 /**
  * Reports action delay in milliseconds for the specific device.
@@ -1162,8 +1365,21 @@ bool CMMCore::deviceBusy(const char* label) throw (CMMError)
 {
    if (IsCoreDeviceLabel(label))
       return false;
-   boost::shared_ptr<DeviceInstance> pDevice = deviceManager_->GetDevice(label);
+   return deviceBusy(deviceManager_->GetDevice(label));
+}
+
+/**
+ * Checks the busy status of the specific device.
+ * @param device the device handle
+ * @return true if the device is busy
+ */
+bool CMMCore::deviceBusy(const DeviceHandle& device) throw (CMMError)
+{
+   return deviceBusy(resolveDeviceHandle(device));
+}
 
+bool CMMCore::deviceBusy(boost::shared_ptr<DeviceInstance> pDevice) throw (CMMError)
+{
    mm::DeviceModuleLockGuard guard(pDevice);
    return pDevice->Busy();
 }
@@ -1193,6 +1409,16 @@ void CMMCore::waitForDevice(const char* label) throw (CMMError)
    waitForDevice(pDevice);
 }
 
+/**
+ * Waits (blocks the calling thread) until the specified device becomes
+ * non-busy.
+ * @param device   the device handle
+ */
+void CMMCore::waitForDevice(const DeviceHandle& device) throw (CMMError)
+{
+   waitForDevice(resolveDeviceHandle(device));
+}
+
 
 /**
  * Waits (blocks the calling thread) until the specified device becomes
@@ -1200,23 +1426,63 @@ void CMMCore::waitForDevice(const char* label) throw (CMMError)
  */
 void CMMCore::waitForDevice(boost::shared_ptr<DeviceInstance> pDev) throw (CMMError)
 {
-   LOG_DEBUG(coreLogger_) << "Waiting for device " << pDev->GetLabel() << "...";
+   waitForDevices(std::vector< boost::shared_ptr<DeviceInstance> >(1, pDev));
+}
+
+/**
+ * Waits until none of the given devices is busy. All devices are polled in
+ * the same loop, so the wait lasts as long as the slowest device rather than
+ * the sum of all devices. A device whose lock is held by another thread (for
+ * example during a long command) is not waited for in the loop; it counts as
+ * busy until a later poll, so that the others are still polled on time.
+ *
+ * Polling starts at a short interval and backs off to pollingIntervalMs_, so
+ * that fast devices are not penalized by a full polling interval. Devices
+ * that call MM::Core::OnBusyChanged() wake up the wait immediately.
+ */
+void CMMCore::waitForDevices(std::vector< boost::shared_ptr<DeviceInstance> > devices) throw (CMMError)
+{
+   for (std::vector< boost::shared_ptr<DeviceInstance> >::const_iterator
+         it = devices.begin(), end = devices.end(); it != end; ++it)
+   {
+      LOG_DEBUG(coreLogger_) << "Waiting for device " << (*it)->GetLabel() << "...";
+   }
 
    MM::TimeoutMs timeout(GetMMTimeNow(),timeoutMs_);
+   const long maxIntervalMs = std::max(1L, pollingIntervalMs_);
+   long intervalMs = 1;
 
    while (true)
    {
+      unsigned long changeCount;
       {
-         mm::DeviceModuleLockGuard guard(pDev);
-         if (!pDev->Busy())
+         boost::mutex::scoped_lock lock(busyChangeMutex_);
+         changeCount = busyChangeCount_;
+      }
+
+      for (std::vector< boost::shared_ptr<DeviceInstance> >::iterator
+            it = devices.begin(); it != devices.end(); )
+      {
+         bool busy = true;
+         {
+            mm::DeviceModuleLockGuard guard(*it, boost::try_to_lock);
+            if (guard.OwnsLock())
+               busy = (*it)->Busy();
+         }
+         if (busy)
          {
-            break;
+            ++it;
+            continue;
          }
+         LOG_DEBUG(coreLogger_) << "Finished waiting for device " << (*it)->GetLabel();
+         it = devices.erase(it);
       }
+      if (devices.empty())
+         break;
 
       if (timeout.expired(GetMMTimeNow()))
       {
-         string label = pDev->GetLabel();
+         string label = devices.front()->GetLabel();
          std::ostringstream mez;
          mez << "wait timed out after " << timeoutMs_ << " ms. ";
          logError(label.c_str(), mez.str().c_str());
@@ -1225,9 +1491,28 @@ void CMMCore::waitForDevice(boost::shared_ptr<DeviceInstance> pDev) throw (CMMEr
                MMERR_DevicePollingTimeout);
       }
 
-     sleep(pollingIntervalMs_);
+      {
+         boost::mutex::scoped_lock lock(busyChangeMutex_);
+         if (busyChangeCount_ == changeCount)
+         {
+            busyChangeCond_.timed_wait(lock, boost::get_system_time() +
+                  boost::posix_time::milliseconds(intervalMs));
+         }
+      }
+      intervalMs = std::min(2 * intervalMs, maxIntervalMs);
+   }
+}
+
+/**
+ * Called (from any thread) when a device reports a busy state change.
+ */
+void CMMCore::notifyBusyChanged()
+{
+   {
+      boost::mutex::scoped_lock lock(busyChangeMutex_);
+      ++busyChangeCount_;
    }
-   LOG_DEBUG(coreLogger_) << "Finished waiting for device " << pDev->GetLabel();
+   busyChangeCond_.notify_all();
 }
 
 /**
@@ -1284,9 +1569,11 @@ bool CMMCore::deviceTypeBusy(MM::DeviceType devType) throw (CMMError)
  */
 void CMMCore::waitForDeviceType(MM::DeviceType devType) throw (CMMError)
 {
-   vector<string> devices = deviceManager_->GetDeviceList(devType);
-   for (size_t i=0; i<devices.size(); i++)
-      waitForDevice(devices[i].c_str());
+   vector<string> labels = deviceManager_->GetDeviceList(devType);
+   std::vector< boost::shared_ptr<DeviceInstance> > devices;
+   for (size_t i=0; i<labels.size(); i++)
+      devices.push_back(deviceManager_->GetDevice(labels[i]));
+   waitForDevices(devices);
 }
 
 /**
@@ -1301,8 +1588,16 @@ void CMMCore::waitForConfig(const char* group, const char* configName) throw (CM
 
    Configuration cfg = getConfigData(group, configName);
    try {
+      std::set<std::string> labels;
+      std::vector< boost::shared_ptr<DeviceInstance> > devices;
       for(size_t i=0; i<cfg.size(); i++)
-         waitForDevice(cfg.getSetting(i).getDeviceLabel().c_str());
+      {
+         std::string label = cfg.getSetting(i).getDeviceLabel();
+         if (IsCoreDeviceLabel(label.c_str()) || !labels.insert(label).second)
+            continue;
+         devices.push_back(deviceManager_->GetDevice(label));
+      }
+      waitForDevices(devices);
    } catch (CMMError& err) {
       // trap MM exceptions and keep quiet - this is not a good time to blow up
       logError("waitForConfig", err.getMsg().c_str());
@@ -1314,6 +1609,7 @@ void CMMCore::waitForConfig(const char* group, const char* configName) throw (CM
  */
 void CMMCore::waitForImageSynchro() throw (CMMError)
 {
+   std::vector< boost::shared_ptr<DeviceInstance> > devices;
    for (std::vector< boost::weak_ptr<DeviceInstance> >::iterator
          it = imageSynchroDevices_.begin(), end = imageSynchroDevices_.end();
          it != end; ++it)
@@ -1321,9 +1617,10 @@ void CMMCore::waitForImageSynchro() throw (CMMError)
       boost::shared_ptr<DeviceInstance> device = it->lock();
       if (device)
       {
-         waitForDevice(device);
+         devices.push_back(device);
       }
    }
+   waitForDevices(devices);
 }
 
 /**
@@ -1333,10 +1630,24 @@ void CMMCore::waitForImageSynchro() throw (CMMError)
  */
 void CMMCore::setPosition(const char* label, double position) throw (CMMError)
 {
-   boost::shared_ptr<StageInstance> pStage =
-      deviceManager_->GetDeviceOfType<StageInstance>(label);
+   setPosition(deviceManager_->GetDeviceOfType<StageInstance>(label), position);
+}
+
+/**
+ * Sets the position of the stage in microns.
+ * @param stage     the stage device handle
+ * @param position  the desired stage position, in microns
+ */
+void CMMCore::setPosition(const DeviceHandle& stage, double position) throw (CMMError)
+{
+   setPosition(deviceManager_->GetDeviceOfType<StageInstance>(
+            resolveDeviceHandle(stage)), position);
+}
 
-   LOG_DEBUG(coreLogger_) << "Will start absolute move of " << label <<
+void CMMCore::setPosition(boost::shared_ptr<StageInstance> pStage,
+      double position) throw (CMMError)
+{
+   LOG_DEBUG(coreLogger_) << "Will start absolute move of " << pStage->GetLabel() <<
       " to position " << std::fixed << std::setprecision(5) << position <<
       " um";
 
@@ -1398,9 +1709,22 @@ void CMMCore::setRelativePosition(double d) throw (CMMError)
  */
 double CMMCore::getPosition(const char* label) throw (CMMError)
 {
-   boost::shared_ptr<StageInstance> pStage =
-      deviceManager_->GetDeviceOfType<StageInstance>(label);
+   return getPosition(deviceManager_->GetDeviceOfType<StageInstance>(label));
+}
+
+/**
+ * Returns the current position of the stage in microns.
+ * @return the position in microns
+ * @param stage     the single-axis drive device handle
+ */
+double CMMCore::getPosition(const DeviceHandle& stage) throw (CMMError)
+{
+   return getPosition(deviceManager_->GetDeviceOfType<StageInstance>(
+            resolveDeviceHandle(stage)));
+}
 
+double CMMCore::getPosition(boost::shared_ptr<StageInstance> pStage) throw (CMMError)
+{
    mm::DeviceModuleLockGuard guard(pStage);
    double pos;
    int ret = pStage->GetPositionUm(pos);
@@ -1430,10 +1754,25 @@ double CMMCore::getPosition() throw (CMMError)
  */
 void CMMCore::setXYPosition(const char* label, double x, double y) throw (CMMError)
 {
-   boost::shared_ptr<XYStageInstance> pXYStage =
-      deviceManager_->GetDeviceOfType<XYStageInstance>(label);
+   setXYPosition(deviceManager_->GetDeviceOfType<XYStageInstance>(label), x, y);
+}
+
+/**
+ * Sets the position of the XY stage in microns.
+ * @param xyStage  the XY stage device handle
+ * @param x        the X axis position in microns
+ * @param y        the Y axis position in microns
+ */
+void CMMCore::setXYPosition(const DeviceHandle& xyStage, double x, double y) throw (CMMError)
+{
+   setXYPosition(deviceManager_->GetDeviceOfType<XYStageInstance>(
+            resolveDeviceHandle(xyStage)), x, y);
+}
 
-   LOG_DEBUG(coreLogger_) << "Will start absolute move of " << label <<
+void CMMCore::setXYPosition(boost::shared_ptr<XYStageInstance> pXYStage,
+      double x, double y) throw (CMMError)
+{
+   LOG_DEBUG(coreLogger_) << "Will start absolute move of " << pXYStage->GetLabel() <<
       " to position (" << std::fixed << std::setprecision(3) << x << ", " <<
       y << ") um";
 
@@ -1499,9 +1838,24 @@ void CMMCore::setRelativeXYPosition(double dx, double dy) throw (CMMError) {
  */
 void CMMCore::getXYPosition(const char* label, double& x, double& y) throw (CMMError)
 {
-   boost::shared_ptr<XYStageInstance> pXYStage =
-      deviceManager_->GetDeviceOfType<XYStageInstance>(label);
+   getXYPosition(deviceManager_->GetDeviceOfType<XYStageInstance>(label), x, y);
+}
+
+/**
+ * Obtains the current position of the XY stage in microns.
+ * @param xyStage the XY stage device handle
+ * @param x       a return parameter yielding the X position in microns
+ * @param y       a return parameter yielding the Y position in microns
+ */
+void CMMCore::getXYPosition(const DeviceHandle& xyStage, double& x, double& y) throw (CMMError)
+{
+   getXYPosition(deviceManager_->GetDeviceOfType<XYStageInstance>(
+            resolveDeviceHandle(xyStage)), x, y);
+}
 
+void CMMCore::getXYPosition(boost::shared_ptr<XYStageInstance> pXYStage,
+      double& x, double& y) throw (CMMError)
+{
    mm::DeviceModuleLockGuard guard(pXYStage);
    int ret = pXYStage->GetPositionUm(x, y);
    if (ret != DEVICE_OK)
@@ -2052,7 +2406,7 @@ long CMMCore::getExposureSequenceMaxLength(const char* cameraLabel) throw (CMMEr
  * @param cameraLabel      the camera device label
  * @param exposureTime_ms  sequence of exposure times the camera will use during a sequence acquisition
  */
-void CMMCore::loadExposureSequence(const char* cameraLabel, std::vector<double> exposureTime_ms) throw (CMMError)
+void CMMCore::loadExposureSequence(const char* cameraLabel, const std::vector<double>& exposureTime_ms) throw (CMMError)
 {
    boost::shared_ptr<CameraInstance> pCamera =
       deviceManager_->GetDeviceOfType<CameraInstance>(cameraLabel);
@@ -2071,10 +2425,10 @@ void CMMCore::loadExposureSequence(const char* cameraLabel, std::vector<double>
    if (ret != DEVICE_OK)
       throw CMMError(getDeviceErrorText(ret, pCamera));
 
-   std::vector<double>::iterator it;
-   for ( it=exposureTime_ms.begin() ; it < exposureTime_ms.end(); it++ )
+   if (!exposureTime_ms.empty())
    {
-      ret = pCamera->AddToExposureSequence(*it);
+      ret = pCamera->AddArrayToExposureSequence(&exposureTime_ms[0],
+            static_cast<long>(exposureTime_ms.size()));
       if (ret != DEVICE_OK)
          throw CMMError(getDeviceErrorText(ret, pCamera));
    }
@@ -2136,16 +2490,28 @@ void CMMCore::startStageSequence(const char* label) throw (CMMError)
    boost::shared_ptr<StageInstance> pStage =
       deviceManager_->GetDeviceOfType<StageInstance>(label);
 
-   mm::DeviceModuleLockGuard guard(pStage);
+   {
+      mm::DeviceModuleLockGuard guard(pStage);
 
-   int ret = pStage->StartStageSequence();
-   if (ret != DEVICE_OK)
-      throw CMMError(getDeviceErrorText(ret, pStage));
+      int ret = pStage->StartStageSequence();
+      if (ret != DEVICE_OK)
+         throw CMMError(getDeviceErrorText(ret, pStage));
+   }
+
+   boost::shared_ptr<mm::SequenceStreamer> streamer =
+      getSequenceStreamer(SequenceStreamerKey(label, ""));
+   if (streamer)
+      streamer->Start();
 }
 
 /**
  * Stops an ongoing sequence of triggered events in a stage
  * This should only be called for stages that are sequenceable
+ *
+ * If the sequence was being streamed (see loadStageSequence()), streaming
+ * ends, and the sequence must be loaded again before it is restarted. An
+ * error that interrupted streaming is thrown here.
+ *
  * @param label    the stage device label
  */
 void CMMCore::stopStageSequence(const char* label) throw (CMMError)
@@ -2153,11 +2519,19 @@ void CMMCore::stopStageSequence(const char* label) throw (CMMError)
    boost::shared_ptr<StageInstance> pStage =
       deviceManager_->GetDeviceOfType<StageInstance>(label);
 
-   mm::DeviceModuleLockGuard guard(pStage);
+   boost::shared_ptr<CMMError> streamingError;
+   stopSequenceStreamer(SequenceStreamerKey(label, ""), streamingError);
 
-   int ret = pStage->StopStageSequence();
-   if (ret != DEVICE_OK)
-      throw CMMError(getDeviceErrorText(ret, pStage));
+   {
+      mm::DeviceModuleLockGuard guard(pStage);
+
+      int ret = pStage->StopStageSequence();
+      if (ret != DEVICE_OK)
+         throw CMMError(getDeviceErrorText(ret, pStage));
+   }
+
+   if (streamingError)
+      throw *streamingError;
 }
 
 /**
@@ -2183,32 +2557,87 @@ long CMMCore::getStageSequenceMaxLength(const char* label) throw (CMMError)
 /**
  * Transfer a sequence of events/states/whatever to the device
  * This should only be called for device-properties that are sequenceable
+ *
+ * The positions are passed to the stage in a single call. A sequence longer
+ * than getStageSequenceMaxLength() can be loaded if the stage is streamable
+ * (see isStageSequenceStreamable()): the stage is loaded with as many
+ * positions as fit, and the rest are added in chunks while the sequence runs
+ * (from startStageSequence() until stopStageSequence()).
+ *
  * @param label              the device label
  * @param positionSequence   a sequence of positions that the stage will execute in response to external triggers
  */
-void CMMCore::loadStageSequence(const char* label, std::vector<double> positionSequence) throw (CMMError)
+void CMMCore::loadStageSequence(const char* label, const std::vector<double>& positionSequence) throw (CMMError)
 {
    boost::shared_ptr<StageInstance> pStage =
       deviceManager_->GetDeviceOfType<StageInstance>(label);
 
-   mm::DeviceModuleLockGuard guard(pStage);
+   // Any previous sequence is replaced
+   boost::shared_ptr<CMMError> ignoredError;
+   stopSequenceStreamer(SequenceStreamerKey(label, ""), ignoredError);
 
-   int ret;
-   ret = pStage->ClearStageSequence();
-   if (ret != DEVICE_OK)
-      throw CMMError(getDeviceErrorText(ret, pStage));
+   long length = static_cast<long>(positionSequence.size());
+   long maxLength = getStageSequenceMaxLength(label);
+   bool streaming = length > maxLength;
+   if (streaming && !isStageSequenceStreamable(label))
+   {
+      throw CMMError("The length of the requested stage sequence (" + ToString(length) +
+            ") exceeds the maximum allowed (" + ToString(maxLength) +
+            ") by the stage " + ToQuotedString(label));
+   }
+   long loadLength = streaming ? maxLength : length;
 
-   std::vector<double>::iterator it;
-   for ( it=positionSequence.begin() ; it < positionSequence.end(); it++ )
    {
-      ret = pStage->AddToStageSequence(*it);
+      mm::DeviceModuleLockGuard guard(pStage);
+
+      int ret;
+      ret = pStage->ClearStageSequence();
+      if (ret != DEVICE_OK)
+         throw CMMError(getDeviceErrorText(ret, pStage));
+
+      if (loadLength > 0)
+      {
+         ret = pStage->AddArrayToStageSequence(&positionSequence[0], loadLength);
+         if (ret != DEVICE_OK)
+            throw CMMError(getDeviceErrorText(ret, pStage));
+      }
+
+      ret = pStage->SendStageSequence();
       if (ret != DEVICE_OK)
          throw CMMError(getDeviceErrorText(ret, pStage));
    }
 
-   ret = pStage->SendStageSequence();
-   if (ret != DEVICE_OK)
-      throw CMMError(getDeviceErrorText(ret, pStage));
+   if (streaming)
+   {
+      std::vector<double> rest(positionSequence.begin() + loadLength,
+            positionSequence.end());
+      LOG_INFO(coreLogger_) << "Stage sequence of " << label << ": " <<
+         loadLength << " positions loaded, " << rest.size() <<
+         " to be streamed";
+      setSequenceStreamer(SequenceStreamerKey(label, ""),
+            boost::make_shared<mm::SequenceStreamer>(coreLogger_,
+               "stage sequence of " + ToQuotedString(label), rest,
+               maxLength / 4,
+               boost::bind(&CMMCore::getStageSequenceFreeSpace, this, pStage),
+               boost::bind(&CMMCore::addArrayToStageSequence, this, pStage,
+                  _1, _2)));
+   }
+}
+
+/**
+ * Queries whether positions can be added to a running sequence of the
+ * stage, so that sequences longer than getStageSequenceMaxLength() can be
+ * loaded with loadStageSequence().
+ * @param label   the stage device label
+ */
+bool CMMCore::isStageSequenceStreamable(const char* label) throw (CMMError)
+{
+   boost::shared_ptr<StageInstance> pStage =
+      deviceManager_->GetDeviceOfType<StageInstance>(label);
+
+   mm::DeviceModuleLockGuard guard(pStage);
+   long freeSpace;
+   return pStage->GetStageSequenceFreeSpace(freeSpace) == DEVICE_OK;
 }
 
 /**
@@ -2320,12 +2749,20 @@ long CMMCore::getXYStageSequenceMaxLength(const char* label) throw (CMMError)
  * @param ySequence    the sequence of y positions that the stage will execute in response to external triggers
  */
 void CMMCore::loadXYStageSequence(const char* label,
-                                  std::vector<double> xSequence,
-                                  std::vector<double> ySequence) throw (CMMError)
+                                  const std::vector<double>& xSequence,
+                                  const std::vector<double>& ySequence) throw (CMMError)
 {
    boost::shared_ptr<XYStageInstance> pStage =
       deviceManager_->GetDeviceOfType<XYStageInstance>(label);
 
+   if (xSequence.size() != ySequence.size())
+   {
+      throw CMMError("The x and y sequences for the XY stage " +
+            ToQuotedString(label) + " differ in length (" +
+            ToString(xSequence.size()) + " and " +
+            ToString(ySequence.size()) + ")");
+   }
+
    mm::DeviceModuleLockGuard guard(pStage);
 
    int ret;
@@ -2333,11 +2770,10 @@ void CMMCore::loadXYStageSequence(const char* label,
    if (ret != DEVICE_OK)
       throw CMMError(getDeviceErrorText(ret, pStage));
 
-   std::vector<double>::iterator itx, ity;
-   for ( itx=xSequence.begin(), ity=ySequence.begin() ;
-         (itx < xSequence.end()) && (ity < ySequence.end()); itx++, ity++)
+   if (!xSequence.empty())
    {
-      ret = pStage->AddToXYStageSequence(*itx, *ity);
+      ret = pStage->AddArrayToXYStageSequence(&xSequence[0], &ySequence[0],
+            static_cast<long>(xSequence.size()));
       if (ret != DEVICE_OK)
          throw CMMError(getDeviceErrorText(ret, pStage));
    }
@@ -2501,7 +2937,7 @@ void CMMCore::setAutoShutter(bool state)
    autoShutter_ = state;
    {
       MMThreadGuard scg(stateCacheLock_);
-      stateCache_.addSetting(PropertySetting(MM::g_Keyword_CoreDevice, MM::g_Keyword_CoreAutoShutter, state ? "1" : "0"));
+      addStateCacheSetting(PropertySetting(MM::g_Keyword_CoreDevice, MM::g_Keyword_CoreAutoShutter, state ? "1" : "0"));
    }
    LOG_DEBUG(coreLogger_) << "Autoshutter turned " << (state ? "on" : "off");
 }
@@ -2536,7 +2972,7 @@ void CMMCore::setShutterOpen(const char* shutterLabel, bool state) throw (CMMErr
       {
          {
             MMThreadGuard scg(stateCacheLock_);
-            stateCache_.addSetting(PropertySetting(shutterLabel, MM::g_Keyword_State, CDeviceUtils::ConvertToString(state)));
+            addStateCacheSetting(PropertySetting(shutterLabel, MM::g_Keyword_State, CDeviceUtils::ConvertToString(state)));
          }
       }
    }
@@ -2755,10 +3191,11 @@ void CMMCore::startSequenceAcquisition(long numImages, double intervalMs, bool s
 		{
 			if (!cbuf_->Initialize(camera->GetNumberOfChannels(), camera->GetImageWidth(), camera->GetImageHeight(), camera->GetImageBytesPerPixel()))
 			{
-				logError(getDeviceName(camera).c_str(), getCoreErrorText(MMERR_CircularBufferFailedToInitialize).c_str());
-				throw CMMError(getCoreErrorText(MMERR_CircularBufferFailedToInitialize).c_str(), MMERR_CircularBufferFailedToInitialize);
+				logError(getDeviceName(camera).c_str(), getCoreErrorText(getCircularBufferInitializeError()).c_str());
+				throw CMMError(getCoreErrorText(getCircularBufferInitializeError()).c_str(), getCircularBufferInitializeError());
 			}
 			cbuf_->Clear();
+         resetFrameAccumulator();
          mm::DeviceModuleLockGuard guard(camera);
 
          LOG_DEBUG(coreLogger_) << "Will start sequence acquisition from default camera";
@@ -2843,10 +3280,11 @@ void CMMCore::initializeCircularBuffer() throw (CMMError)
       mm::DeviceModuleLockGuard guard(camera);
       if (!cbuf_->Initialize(camera->GetNumberOfChannels(), camera->GetImageWidth(), camera->GetImageHeight(), camera->GetImageBytesPerPixel()))
       {
-         logError(getDeviceName(camera).c_str(), getCoreErrorText(MMERR_CircularBufferFailedToInitialize).c_str());
-         throw CMMError(getCoreErrorText(MMERR_CircularBufferFailedToInitialize).c_str(), MMERR_CircularBufferFailedToInitialize);
+         logError(getDeviceName(camera).c_str(), getCoreErrorText(getCircularBufferInitializeError()).c_str());
+         throw CMMError(getCoreErrorText(getCircularBufferInitializeError()).c_str(), getCircularBufferInitializeError());
       }
       cbuf_->Clear();
+      resetFrameAccumulator();
    }
    else
    {
@@ -2895,10 +3333,11 @@ void CMMCore::startContinuousSequenceAcquisition(double intervalMs) throw (CMMEr
 
       if (!cbuf_->Initialize(camera->GetNumberOfChannels(), camera->GetImageWidth(), camera->GetImageHeight(), camera->GetImageBytesPerPixel()))
       {
-         logError(getDeviceName(camera).c_str(), getCoreErrorText(MMERR_CircularBufferFailedToInitialize).c_str());
-         throw CMMError(getCoreErrorText(MMERR_CircularBufferFailedToInitialize).c_str(), MMERR_CircularBufferFailedToInitialize);
+         logError(getDeviceName(camera).c_str(), getCoreErrorText(getCircularBufferInitializeError()).c_str());
+         throw CMMError(getCoreErrorText(getCircularBufferInitializeError()).c_str(), getCircularBufferInitializeError());
       }
       cbuf_->Clear();
+      resetFrameAccumulator();
       LOG_DEBUG(coreLogger_) << "Will start continuous sequence acquisition from current camera";
       int nRet = camera->StartSequenceAcquisition(intervalMs);
       if (nRet != DEVICE_OK)
@@ -3108,40 +3547,279 @@ void* CMMCore::popNextImageMD(Metadata& md) throw (CMMError)
 }
 
 /**
- * Removes all images from the circular buffer.
- *
- * It is rarely necessary to call this directly since starting a sequence
- * acquisition or changing the ROI will always clear the buffer.
+ * Gets and removes the next image from the circular buffer without copying
+ * it. The returned pixels stay valid, and their slot is not reused, until
+ * they are passed to releasePinnedImage(). Every pinned image holds a slot,
+ * so the caller must release images promptly or the buffer will fill up.
+ * Pins are dropped (and the pixels may be overwritten) when the buffer is
+ * cleared or reinitialized.
  */
-void CMMCore::clearCircularBuffer() throw (CMMError)
+void* CMMCore::popNextImagePinned(unsigned channel, Metadata& md) throw (CMMError)
 {
-   cbuf_->Clear();
+   const mm::ImgBuffer* pBuf = cbuf_->GetNextImageBufferPinned(channel);
+   if (pBuf != 0)
+   {
+      md = pBuf->GetMetadata();
+      return const_cast<unsigned char*>(pBuf->GetPixels());
+   }
+   else
+      throw CMMError(getCoreErrorText(MMERR_CircularBufferEmpty).c_str(), MMERR_CircularBufferEmpty);
 }
 
 /**
- * Reserve memory for the circular buffer.
+ * Returns the last image inserted into the circular buffer without copying
+ * it, pinned until released with releasePinnedImage(). The image is not
+ * removed from the buffer.
  */
-void CMMCore::setCircularBufferMemoryFootprint(unsigned sizeMB ///< n megabytes
-                                               ) throw (CMMError)
+void* CMMCore::getLastImagePinned(unsigned channel, Metadata& md) throw (CMMError)
 {
-   delete cbuf_; // discard old buffer
-   LOG_DEBUG(coreLogger_) << "Will set circular buffer size to " <<
-      sizeMB << " MB";
-	try
-	{
-		cbuf_ = new CircularBuffer(sizeMB);
-	}
-	catch(bad_alloc& ex)
-	{
-      // This is an out-of-memory error before even allocating the buffers.
-		ostringstream messs;
-		messs << getCoreErrorText(MMERR_OutOfMemory).c_str() << " " << ex.what() << endl;
-		throw CMMError(messs.str().c_str() , MMERR_OutOfMemory);
-	}
-	if (NULL == cbuf_) throw CMMError(getCoreErrorText(MMERR_OutOfMemory).c_str(), MMERR_OutOfMemory);
-
-
-	try
+   const mm::ImgBuffer* pBuf = cbuf_->GetTopImageBufferPinned(channel);
+   if (pBuf != 0)
+   {
+      md = pBuf->GetMetadata();
+      return const_cast<unsigned char*>(pBuf->GetPixels());
+   }
+   else
+      throw CMMError(getCoreErrorText(MMERR_CircularBufferEmpty).c_str(), MMERR_CircularBufferEmpty);
+}
+
+/**
+ * Returns the size in bytes of an image returned by popNextImagePinned(),
+ * getLastImagePinned() or getImageAtCoordinatesPinned() and not yet
+ * released. This is the size of the image as inserted, which can differ
+ * from that of the current camera.
+ */
+long CMMCore::getPinnedImageByteCount(const void* pixels) const throw (CMMError)
+{
+   unsigned long size = cbuf_->GetPinnedImageByteCount(
+         static_cast<const unsigned char*>(pixels));
+   if (size == 0)
+      throw CMMError("Image is not pinned in the circular buffer",
+            MMERR_InvalidCoreValue);
+   return static_cast<long>(size);
+}
+
+/**
+ * Releases an image returned by popNextImagePinned() or
+ * getLastImagePinned(), allowing its slot to be reused.
+ */
+void CMMCore::releasePinnedImage(const void* pixels) throw (CMMError)
+{
+   if (!cbuf_->ReleasePinnedImage(static_cast<const unsigned char*>(pixels)))
+      throw CMMError("Image is not pinned in the circular buffer",
+            MMERR_InvalidCoreValue);
+}
+
+/**
+ * Enables or disables looking up images in the circular buffer by their
+ * acquisition coordinates.
+ *
+ * While enabled, every image inserted with at least one of the metadata tags
+ * PositionIndex, ChannelIndex, SliceIndex and FrameIndex (missing ones count
+ * as 0) can be retrieved by its camera and coordinates with
+ * getImageAtCoordinatesMD() until its slot is overwritten, whether or not it
+ * has been popped. If several images have the same coordinates, the most
+ * recent one is returned.
+ *
+ * The channels of a multi-channel camera are numbered from the ChannelIndex
+ * tag of the image (or 0).
+ */
+void CMMCore::enableCircularBufferCoordinateIndex(bool enable)
+{
+   cbuf_->SetCoordinateIndexEnabled(enable);
+   LOG_DEBUG(coreLogger_) << "Circular buffer coordinate index " <<
+      (enable ? "enabled" : "disabled");
+}
+
+/**
+ * Returns true if images are indexed by their acquisition coordinates.
+ */
+bool CMMCore::isCircularBufferCoordinateIndexEnabled() const
+{
+   return cbuf_->IsCoordinateIndexEnabled();
+}
+
+/**
+ * Returns true if an image from the current camera with the given
+ * coordinates is in the circular buffer (see
+ * enableCircularBufferCoordinateIndex()).
+ */
+bool CMMCore::hasImageAtCoordinates(long position, long channel, long slice,
+      long frame) const
+{
+   return hasImageAtCoordinates(getCurrentCameraLabel().c_str(), position,
+         channel, slice, frame);
+}
+
+/**
+ * Returns true if an image from the given camera with the given coordinates
+ * is in the circular buffer.
+ */
+bool CMMCore::hasImageAtCoordinates(const char* cameraLabel, long position,
+      long channel, long slice, long frame) const
+{
+   CircularBuffer::Coordinates coords =
+      { cameraLabel ? cameraLabel : "", position, channel, slice, frame };
+   return cbuf_->GetImageBufferAt(coords) != 0;
+}
+
+/**
+ * Returns a pointer to the pixels of the most recent image from the current
+ * camera with the given coordinates, without removing it from the circular
+ * buffer. Like getLastImageMD(), the pixels are overwritten when the slot is
+ * reused; use getImageAtCoordinatesPinned() to prevent that.
+ *
+ * @see enableCircularBufferCoordinateIndex()
+ */
+void* CMMCore::getImageAtCoordinatesMD(long position, long channel,
+      long slice, long frame, Metadata& md) const throw (CMMError)
+{
+   return getImageAtCoordinatesMD(getCurrentCameraLabel().c_str(), position,
+         channel, slice, frame, md);
+}
+
+/**
+ * Like getImageAtCoordinatesMD(), for an image from the given camera.
+ */
+void* CMMCore::getImageAtCoordinatesMD(const char* cameraLabel, long position,
+      long channel, long slice, long frame, Metadata& md) const
+   throw (CMMError)
+{
+   CircularBuffer::Coordinates coords =
+      { cameraLabel ? cameraLabel : "", position, channel, slice, frame };
+   const mm::ImgBuffer* pBuf = cbuf_->GetImageBufferAt(coords);
+   if (!pBuf)
+      throw CMMError(getCoreErrorText(MMERR_ImageNotInBuffer).c_str(),
+            MMERR_ImageNotInBuffer);
+   md = pBuf->GetMetadata();
+   return const_cast<unsigned char*>(pBuf->GetPixels());
+}
+
+/**
+ * Like getImageAtCoordinatesMD(), but the image's slot is not reused until
+ * the pixels are passed to releasePinnedImage().
+ */
+void* CMMCore::getImageAtCoordinatesPinned(long position, long channel,
+      long slice, long frame, Metadata& md) throw (CMMError)
+{
+   return getImageAtCoordinatesPinned(getCurrentCameraLabel().c_str(),
+         position, channel, slice, frame, md);
+}
+
+/**
+ * Like getImageAtCoordinatesPinned(), for an image from the given camera.
+ */
+void* CMMCore::getImageAtCoordinatesPinned(const char* cameraLabel,
+      long position, long channel, long slice, long frame, Metadata& md)
+   throw (CMMError)
+{
+   CircularBuffer::Coordinates coords =
+      { cameraLabel ? cameraLabel : "", position, channel, slice, frame };
+   const mm::ImgBuffer* pBuf = cbuf_->GetImageBufferAtPinned(coords);
+   if (!pBuf)
+      throw CMMError(getCoreErrorText(MMERR_ImageNotInBuffer).c_str(),
+            MMERR_ImageNotInBuffer);
+   md = pBuf->GetMetadata();
+   return const_cast<unsigned char*>(pBuf->GetPixels());
+}
+
+/**
+ * Returns the number of pinned images that have not been released.
+ */
+long CMMCore::getPinnedImageCount() const
+{
+   return cbuf_->GetPinnedImageCount();
+}
+
+/**
+ * Gets and removes the next image from the circular buffer, copying its
+ * pixels into a buffer supplied by the caller. The buffer must hold at least
+ * width * height * bytes per pixel bytes; if it is too small, no image is
+ * removed.
+ */
+void CMMCore::popNextImageIntoBuffer(void* pixelBuffer, long pixelBufferSize,
+      unsigned channel, Metadata& md) throw (CMMError)
+{
+   if (!pixelBuffer)
+      throw CMMError(getCoreErrorText(MMERR_NullPointerException).c_str(),
+            MMERR_NullPointerException);
+
+   long imageSize = (long)cbuf_->Width() * cbuf_->Height() * cbuf_->Depth();
+   if (pixelBufferSize < imageSize)
+      throw CMMError("Buffer of " + ToString(pixelBufferSize) +
+            " bytes is too small for an image of " + ToString(imageSize) +
+            " bytes", MMERR_InvalidCoreValue);
+
+   // Pin while copying so that the slot is not overwritten under us
+   const unsigned char* pixels =
+      static_cast<const unsigned char*>(popNextImagePinned(channel, md));
+   memcpy(pixelBuffer, pixels, imageSize);
+   cbuf_->ReleasePinnedImage(pixels);
+}
+
+/**
+ * Removes all images from the circular buffer.
+ *
+ * It is rarely necessary to call this directly since starting a sequence
+ * acquisition or changing the ROI will always clear the buffer. Pinned
+ * images stay valid (and their slots stay reserved) until released.
+ */
+void CMMCore::clearCircularBuffer() throw (CMMError)
+{
+   cbuf_->Clear();
+}
+
+/**
+ * Reserve memory for the circular buffer.
+ */
+void CMMCore::setCircularBufferMemoryFootprint(unsigned sizeMB ///< n megabytes
+                                               ) throw (CMMError)
+{
+   // the pixels of pinned images must stay valid until they are released
+   if (cbuf_ && cbuf_->GetPinnedImageCount() > 0)
+      throw CMMError(getCoreErrorText(MMERR_CircularBufferImagesPinned).c_str(),
+            MMERR_CircularBufferImagesPinned);
+
+   // the overflow settings survive the reallocation
+   CircularBuffer::OverflowPolicy policy = CircularBuffer::OverflowError;
+   long blockTimeoutMs = 1000;
+   std::string spillDirectory;
+   bool coordinateIndex = false;
+   if (cbuf_)
+   {
+      policy = cbuf_->GetOverflowPolicy();
+      blockTimeoutMs = cbuf_->GetOverflowBlockTimeoutMs();
+      spillDirectory = cbuf_->GetSpillDirectory();
+      coordinateIndex = cbuf_->IsCoordinateIndexEnabled();
+   }
+
+   delete cbuf_; // discard old buffer
+   LOG_DEBUG(coreLogger_) << "Will set circular buffer size to " <<
+      sizeMB << " MB";
+	try
+	{
+		cbuf_ = new CircularBuffer(sizeMB);
+	}
+	catch(bad_alloc& ex)
+	{
+      // This is an out-of-memory error before even allocating the buffers.
+		ostringstream messs;
+		messs << getCoreErrorText(MMERR_OutOfMemory).c_str() << " " << ex.what() << endl;
+		throw CMMError(messs.str().c_str() , MMERR_OutOfMemory);
+	}
+	if (NULL == cbuf_) throw CMMError(getCoreErrorText(MMERR_OutOfMemory).c_str(), MMERR_OutOfMemory);
+
+   cbuf_->SetOverflowPolicy(policy);
+   cbuf_->SetOverflowBlockTimeoutMs(blockTimeoutMs);
+   cbuf_->SetSpillDirectory(spillDirectory);
+   {
+      boost::mutex::scoped_lock lock(streamSinkMutex_);
+      cbuf_->SetStreamSink(streamSink_);
+   }
+   cbuf_->SetStatistics(acqStats_);
+   cbuf_->SetCoordinateIndexEnabled(coordinateIndex);
+
+	try
 	{
 
 		// attempt to initialize based on the current camera settings
@@ -3150,7 +3828,7 @@ void CMMCore::setCircularBufferMemoryFootprint(unsigned sizeMB ///< n megabytes
 		{
          mm::DeviceModuleLockGuard guard(camera);
          if (!cbuf_->Initialize(camera->GetNumberOfChannels(), camera->GetImageWidth(), camera->GetImageHeight(), camera->GetImageBytesPerPixel()))
-				throw CMMError(getCoreErrorText(MMERR_CircularBufferFailedToInitialize).c_str(), MMERR_CircularBufferFailedToInitialize);
+				throw CMMError(getCoreErrorText(getCircularBufferInitializeError()).c_str(), getCircularBufferInitializeError());
 		}
 
       LOG_DEBUG(coreLogger_) << "Did set circular buffer size to " <<
@@ -3178,6 +3856,487 @@ unsigned CMMCore::getCircularBufferMemoryFootprint()
    return 0;
 }
 
+namespace {
+
+const char* const g_OverflowPolicyNames[] = {
+   "Error", "DropNewest", "DropOldest", "Block", "SpillToDisk"
+};
+const int g_NrOverflowPolicies =
+   sizeof(g_OverflowPolicyNames) / sizeof(g_OverflowPolicyNames[0]);
+
+} // anonymous namespace
+
+/**
+ * Selects what happens to frames arriving while the Circular Buffer is full.
+ *
+ * - "Error" (default): the frame is refused and the camera is told that the
+ *   buffer overflowed; cameras either stop the sequence or, when set not to
+ *   stop on overflow, clear the buffer and insert the frame again.
+ * - "DropNewest": the arriving frame is discarded.
+ * - "DropOldest": the oldest unread frame is overwritten.
+ * - "Block": the inserting thread waits for the application to pop a frame,
+ *   up to the block timeout; the frame is discarded on timeout.
+ * - "SpillToDisk": frames are queued in a file (see
+ *   setCircularBufferSpillDirectory()) and moved back into the buffer in order
+ *   as room becomes available.
+ *
+ * Except under "Error", the sequence keeps running; discarded frames are
+ * counted by getCircularBufferDroppedImageCount().
+ */
+void CMMCore::setCircularBufferOverflowPolicy(const char* policy) throw (CMMError)
+{
+   CheckPropertyValue(policy);
+   for (int i = 0; i < g_NrOverflowPolicies; ++i)
+   {
+      if (strcmp(policy, g_OverflowPolicyNames[i]) == 0)
+      {
+         cbuf_->SetOverflowPolicy(static_cast<CircularBuffer::OverflowPolicy>(i));
+         LOG_DEBUG(coreLogger_) << "Circular buffer overflow policy set to " <<
+            policy;
+         return;
+      }
+   }
+   throw CMMError("Unknown circular buffer overflow policy: " +
+         ToQuotedString(policy), MMERR_InvalidCoreValue);
+}
+
+/**
+ * Returns the current Circular Buffer overflow policy.
+ */
+std::string CMMCore::getCircularBufferOverflowPolicy() const
+{
+   return g_OverflowPolicyNames[cbuf_->GetOverflowPolicy()];
+}
+
+/**
+ * Sets how long the "Block" overflow policy waits for free space before the
+ * frame is dropped.
+ */
+void CMMCore::setCircularBufferOverflowBlockTimeoutMs(long timeoutMs) throw (CMMError)
+{
+   if (timeoutMs < 0)
+      throw CMMError("Circular buffer block timeout must not be negative",
+            MMERR_InvalidCoreValue);
+   cbuf_->SetOverflowBlockTimeoutMs(timeoutMs);
+}
+
+/**
+ * Returns the block timeout used by the "Block" overflow policy.
+ */
+long CMMCore::getCircularBufferOverflowBlockTimeoutMs() const
+{
+   return cbuf_->GetOverflowBlockTimeoutMs();
+}
+
+/**
+ * Sets the directory for the spill file of the "SpillToDisk" overflow policy.
+ * An empty string (default) uses an anonymous temporary file. Takes effect
+ * when the spill file is next created.
+ */
+void CMMCore::setCircularBufferSpillDirectory(const char* directory)
+{
+   cbuf_->SetSpillDirectory(directory ? directory : "");
+}
+
+/**
+ * Returns the directory used for the "SpillToDisk" overflow policy.
+ */
+std::string CMMCore::getCircularBufferSpillDirectory() const
+{
+   return cbuf_->GetSpillDirectory();
+}
+
+/**
+ * Returns the number of frames discarded or refused because the Circular
+ * Buffer was full, since the buffer was last cleared.
+ */
+long CMMCore::getCircularBufferDroppedImageCount() const
+{
+   return cbuf_->GetDroppedImageCount();
+}
+
+/**
+ * Returns the number of frames queued to disk by the "SpillToDisk" overflow
+ * policy, since the buffer was last cleared.
+ */
+long CMMCore::getCircularBufferSpilledImageCount() const
+{
+   return cbuf_->GetSpilledImageCount();
+}
+
+/**
+ * Starts writing every frame inserted into the Circular Buffer to disk, with
+ * a 4 GB file size limit and a 256 MB write queue.
+ *
+ * @see startStreamToDisk(const char*, const char*, long, unsigned)
+ */
+void CMMCore::startStreamToDisk(const char* directory, const char* prefix)
+   throw (CMMError)
+{
+   startStreamToDisk(directory, prefix, 4096, 256);
+}
+
+/**
+ * Starts writing every frame inserted into the Circular Buffer to disk.
+ *
+ * Frames are written by a dedicated thread to raw files
+ * <directory>/<prefix>_NNNNN.mmraw, each with a text index
+ * <prefix>_NNNNN.mmidx of the frame offsets and per-frame metadata. A new
+ * file is started when maxFileSizeMB would be exceeded. The files must not
+ * already exist.
+ *
+ * Streaming is independent of the application reading the Circular Buffer:
+ * frames are written even if the buffer overflows. When nobody reads the
+ * buffer, set the overflow policy to "DropOldest" so that the sequence keeps
+ * running. If the disk cannot keep up and the write queue (queueSizeMB) is
+ * full, frames are dropped from the stream (see
+ * getStreamToDiskDroppedImageCount()).
+ *
+ * Throughput and latency are written to the Core log once per second.
+ */
+void CMMCore::startStreamToDisk(const char* directory, const char* prefix,
+      long maxFileSizeMB, unsigned queueSizeMB) throw (CMMError)
+{
+   CheckPropertyValue(directory);
+   CheckPropertyValue(prefix);
+   if (maxFileSizeMB <= 0 || queueSizeMB == 0)
+      throw CMMError("Stream file size and queue size must be positive",
+            MMERR_InvalidCoreValue);
+
+   // Held throughout, so that concurrent starts and stops take turns
+   boost::mutex::scoped_lock lock(streamSinkMutex_);
+   if (streamSink_)
+      throw CMMError("Already streaming to disk", MMERR_StreamToDiskFailed);
+
+   boost::shared_ptr<mm::DiskStreamSink> sink(
+         new mm::DiskStreamSink(coreLogger_, directory, prefix,
+            (long long)maxFileSizeMB << 20, queueSizeMB));
+   sink->Start();
+   streamSink_ = sink;
+   cbuf_->SetStreamSink(sink);
+}
+
+/**
+ * Stops streaming to disk after the queued frames have been written.
+ * Throws if any write failed since streaming was started.
+ */
+void CMMCore::stopStreamToDisk() throw (CMMError)
+{
+   boost::shared_ptr<mm::DiskStreamSink> sink;
+   {
+      boost::mutex::scoped_lock lock(streamSinkMutex_);
+      sink.swap(streamSink_);
+      if (!sink)
+         return;
+      cbuf_->SetStreamSink(boost::shared_ptr<mm::DiskStreamSink>());
+   }
+   // Waits for the queued frames to be written
+   sink->Stop();
+}
+
+/**
+ * Returns true between startStreamToDisk() and stopStreamToDisk().
+ */
+bool CMMCore::isStreamingToDisk() const
+{
+   return getStreamSink().get() != 0;
+}
+
+/**
+ * Returns the number of frames written to disk since streaming was started.
+ */
+long CMMCore::getStreamToDiskImageCount() const
+{
+   boost::shared_ptr<mm::DiskStreamSink> sink = getStreamSink();
+   if (!sink)
+      return 0;
+   return (long)sink->GetStatistics().framesWritten;
+}
+
+/**
+ * Returns the number of frames that could not be written to disk (because
+ * the write queue was full or a write failed) since streaming was started.
+ */
+long CMMCore::getStreamToDiskDroppedImageCount() const
+{
+   boost::shared_ptr<mm::DiskStreamSink> sink = getStreamSink();
+   if (!sink)
+      return 0;
+   return (long)sink->GetStatistics().framesDropped;
+}
+
+/**
+ * Returns the write throughput over the last second of streaming.
+ */
+double CMMCore::getStreamToDiskThroughputMBPerSecond() const
+{
+   boost::shared_ptr<mm::DiskStreamSink> sink = getStreamSink();
+   if (!sink)
+      return 0.0;
+   return sink->GetStatistics().megabytesPerSecond;
+}
+
+/**
+ * Returns the mean time from insertion into the Circular Buffer to the end of
+ * the write, over the last second of streaming.
+ */
+double CMMCore::getStreamToDiskMeanLatencyMs() const
+{
+   boost::shared_ptr<mm::DiskStreamSink> sink = getStreamSink();
+   if (!sink)
+      return 0.0;
+   return sink->GetStatistics().meanLatencyMs;
+}
+
+/**
+ * Returns the longest time from insertion into the Circular Buffer to the end
+ * of the write, over the last second of streaming.
+ */
+double CMMCore::getStreamToDiskMaxLatencyMs() const
+{
+   boost::shared_ptr<mm::DiskStreamSink> sink = getStreamSink();
+   if (!sink)
+      return 0.0;
+   return sink->GetStatistics().maxLatencyMs;
+}
+
+/**
+ * Combines every frameCount frames inserted by a camera into one before it
+ * enters the Circular Buffer, so that the application receives only every
+ * Nth (combined) frame.
+ *
+ * The modes are:
+ * - "None": frames are inserted unchanged (frameCount is ignored);
+ * - "Sum": the sum of frameCount frames, saturating: pixels whose sum
+ *   exceeds the maximum of the pixel format (255 or 65535) are set to that
+ *   maximum, so use "Mean" when the sum may overflow;
+ * - "Mean": the mean of frameCount frames;
+ * - "RunningMean": an exponential running mean in which the newest frame has
+ *   weight 1/frameCount, inserted every frameCount frames;
+ * - "Minimum", "Maximum": the per-pixel minimum or maximum of frameCount
+ *   frames;
+ * - "Variance": the per-pixel population variance of frameCount frames.
+ *
+ * Results keep the pixel format of the camera, with values clamped to its
+ * range. Frames from each camera are accumulated separately; partial
+ * accumulations are discarded when the setting changes and when the
+ * Circular Buffer is initialized for a new sequence. Frames with other than
+ * 8 or 16 bits per pixel component are inserted unchanged. Accumulated
+ * frames carry the tags FrameAccumulationMode and AccumulatedFrames.
+ *
+ * @param mode one of the modes above
+ * @param frameCount number of frames per result, from 1 to 65536
+ */
+void CMMCore::setFrameAccumulation(const char* mode, long frameCount)
+   throw (CMMError)
+{
+   CheckPropertyValue(mode);
+
+   const bool enable = strcmp(mode, "None") != 0;
+   mm::FrameAccumulator::Mode accumulatorMode = mm::FrameAccumulator::ModeSum;
+   if (enable && !mm::FrameAccumulator::ParseModeName(mode, accumulatorMode))
+      throw CMMError("Unknown frame accumulation mode: " +
+            ToQuotedString(mode), MMERR_InvalidCoreValue);
+
+   boost::shared_ptr<mm::FrameAccumulator> accumulator;
+   if (enable)
+   {
+      if (frameCount < 1 || frameCount > 65536)
+         throw CMMError("Frame accumulation count must be between 1 and 65536",
+               MMERR_InvalidCoreValue);
+      if (!frameAccumulatorPool_)
+         frameAccumulatorPool_ = boost::make_shared<ThreadPool>();
+      accumulator = boost::make_shared<mm::FrameAccumulator>(coreLogger_,
+            accumulatorMode, (unsigned) frameCount, frameAccumulatorPool_);
+   }
+
+   {
+      boost::mutex::scoped_lock lock(frameAccumulatorMutex_);
+      frameAccumulator_ = accumulator;
+   }
+   LOG_DEBUG(coreLogger_) << "Frame accumulation set to " << mode <<
+      (accumulator ? " of " + ToString(frameCount) + " frames" : "");
+}
+
+/**
+ * Returns the mode set by setFrameAccumulation().
+ */
+std::string CMMCore::getFrameAccumulationMode() const
+{
+   boost::shared_ptr<mm::FrameAccumulator> accumulator = getFrameAccumulator();
+   if (!accumulator)
+      return "None";
+   return mm::FrameAccumulator::GetModeName(accumulator->GetMode());
+}
+
+/**
+ * Returns the number of frames per result set by setFrameAccumulation(), or
+ * 1 if accumulation is off.
+ */
+long CMMCore::getFrameAccumulationCount() const
+{
+   boost::shared_ptr<mm::FrameAccumulator> accumulator = getFrameAccumulator();
+   if (!accumulator)
+      return 1;
+   return accumulator->GetFrameCount();
+}
+
+boost::shared_ptr<mm::FrameAccumulator> CMMCore::getFrameAccumulator() const
+{
+   boost::mutex::scoped_lock lock(frameAccumulatorMutex_);
+   return frameAccumulator_;
+}
+
+boost::shared_ptr<mm::DiskStreamSink> CMMCore::getStreamSink() const
+{
+   boost::mutex::scoped_lock lock(streamSinkMutex_);
+   return streamSink_;
+}
+
+/**
+ * Error code for a failed CircularBuffer::Initialize().
+ */
+int CMMCore::getCircularBufferInitializeError() const
+{
+   return cbuf_->GetPinnedImageCount() > 0 ?
+      MMERR_CircularBufferImagesPinned : MMERR_CircularBufferFailedToInitialize;
+}
+
+void CMMCore::resetFrameAccumulator()
+{
+   boost::shared_ptr<mm::FrameAccumulator> accumulator = getFrameAccumulator();
+   if (accumulator)
+      accumulator->Reset();
+}
+
+/**
+ * Returns timing statistics of the image insertion path since the core was
+ * created or resetAcquisitionStatistics() was last called.
+ *
+ * The first line gives the number of frames inserted into the Circular
+ * Buffer, refused (reported to the camera as an overflow), dropped by the
+ * overflow policy, and popped by the application. It is followed by a header
+ * and one tab-separated line per stage: the number of samples, the mean,
+ * the 50th, 90th and 99th percentiles and the maximum in microseconds, and
+ * the sample counts of the histogram buckets (<1 us, <2 us, <4 us, and so
+ * on, doubling). The percentiles are the upper bounds of their buckets.
+ *
+ * The stages are:
+ * Interval - between successive frames from any camera;
+ * Metadata - adding the camera's tags to the frame metadata;
+ * Process - the image processor and frame accumulation, if any;
+ * BufferWait - waiting for other inserts and, with the Block overflow
+ * policy, for free space;
+ * BufferMetadata - adding the buffer's tags to the frame metadata;
+ * Copy - copying the pixels into the buffer;
+ * Insert - the whole insert call, as seen by the camera;
+ * Queue - from insertion into the buffer to being popped.
+ */
+std::string CMMCore::getAcquisitionStatistics() const
+{
+   return acqStats_->Format(cbuf_->GetDroppedImageCount());
+}
+
+/**
+ * Clears the counters and histograms reported by getAcquisitionStatistics().
+ */
+void CMMCore::resetAcquisitionStatistics()
+{
+   acqStats_->Reset();
+}
+
+/**
+ * Starts recording every timed stage of the image insertion path (see
+ * getAcquisitionStatistics()) as a trace event, up to the given number of
+ * events. Recording stops when the limit is reached, so a trace covers the
+ * beginning of an acquisition.
+ *
+ * @param maxEvents the maximum number of events to keep; each frame
+ *                  produces about 7 events
+ */
+void CMMCore::startAcquisitionTrace(long maxEvents) throw (CMMError)
+{
+   if (maxEvents <= 0)
+      throw CMMError("Number of trace events must be positive",
+            MMERR_InvalidCoreValue);
+   acqStats_->StartTrace((size_t)maxEvents);
+   LOG_INFO(coreLogger_) << "Acquisition trace started (up to " <<
+      maxEvents << " events)";
+}
+
+/**
+ * Stops recording the trace started with startAcquisitionTrace() and writes
+ * it to a file in the Chrome trace event format, which can be viewed with
+ * chrome://tracing or Perfetto. Each frame's time in the Circular Buffer
+ * appears as an asynchronous span identified by the frame's buffer index.
+ *
+ * @param filename the file to write (overwritten if it exists)
+ */
+void CMMCore::saveAcquisitionTrace(const char* filename) throw (CMMError)
+{
+   CheckPropertyValue(filename);
+   if (!acqStats_->SaveTrace(filename))
+   {
+      logError(filename, getCoreErrorText(MMERR_FileOpenFailed).c_str());
+      throw CMMError(ToQuotedString(filename) + ": " +
+            getCoreErrorText(MMERR_FileOpenFailed), MMERR_FileOpenFailed);
+   }
+   LOG_INFO(coreLogger_) << "Acquisition trace saved to " << filename;
+}
+
+/**
+ * Splits an acquisition plan into runs that can each be executed as a single
+ * hardware-triggered camera sequence.
+ *
+ * Configuration presets are expanded into their property settings, and the
+ * sequenceability of every focus, XY stage, exposure and property value that
+ * changes within a run is checked, as is the maximum sequence length of the
+ * device. The current focus device, XY stage and camera are used. The result
+ * can be inspected with AcquisitionPlan::getNumberOfRuns() and related
+ * methods.
+ *
+ * @param plan the plan to compile
+ */
+void CMMCore::compileAcquisitionPlan(AcquisitionPlan& plan) throw (CMMError)
+{
+   mm::AcquisitionPlanRunner runner(*this, coreLogger_);
+   runner.Compile(plan);
+}
+
+/**
+ * Acquires the frames of an acquisition plan into the Circular Buffer, from
+ * which they can be retrieved with popNextImage() and related methods.
+ *
+ * The plan is compiled first if it has not been (see
+ * compileAcquisitionPlan()). For each run, the state of its first event is
+ * applied in software (only what differs from the end of the previous run),
+ * the sequences of the remaining events are loaded into the devices, and a
+ * sequence acquisition of the run's length is started on the current
+ * camera. The devices then step through their sequences on the camera's
+ * trigger. The buffer is cleared once at the start, not between runs.
+ *
+ * This method blocks until all frames have been acquired. To consume the
+ * frames while the plan is running, or to stop it with
+ * stopAcquisitionPlan(), call it from a separate thread.
+ *
+ * @param plan the plan to run
+ */
+void CMMCore::runAcquisitionPlan(AcquisitionPlan& plan) throw (CMMError)
+{
+   acquisitionPlanStopRequested_ = false;
+   mm::AcquisitionPlanRunner runner(*this, coreLogger_);
+   runner.Run(plan, acquisitionPlanStopRequested_);
+}
+
+/**
+ * Stops an acquisition plan running in another thread after the current
+ * camera sequence has been stopped.
+ */
+void CMMCore::stopAcquisitionPlan()
+{
+   acquisitionPlanStopRequested_ = true;
+}
+
 /**
  * Returns number ofimages available in the Circular Buffer
  */
@@ -3238,6 +4397,17 @@ string CMMCore::getCameraDevice()
    return std::string();
 }
 
+/**
+ * Like getCameraDevice(), for use in const member functions.
+ */
+std::string CMMCore::getCurrentCameraLabel() const
+{
+   boost::shared_ptr<CameraInstance> camera = currentCameraDevice_.lock();
+   if (camera)
+      return camera->GetLabel();
+   return std::string();
+}
+
 /**
  * Returns the label of the currently selected shutter device.
  * @return shutter name
@@ -3313,7 +4483,7 @@ void CMMCore::setAutoFocusDevice(const char* autofocusLabel) throw (CMMError)
    std::string newAutofocusLabel = getAutoFocusDevice();
    {
       MMThreadGuard scg(stateCacheLock_);
-      stateCache_.addSetting(PropertySetting(MM::g_Keyword_CoreDevice, MM::g_Keyword_CoreAutoFocus, newAutofocusLabel.c_str()));
+      addStateCacheSetting(PropertySetting(MM::g_Keyword_CoreDevice, MM::g_Keyword_CoreAutoFocus, newAutofocusLabel.c_str()));
    }
 }
 
@@ -3380,7 +4550,7 @@ void CMMCore::setImageProcessorDevice(const char* procLabel) throw (CMMError)
    std::string newProcLabel = getImageProcessorDevice();
    {
       MMThreadGuard scg(stateCacheLock_);
-      stateCache_.addSetting(PropertySetting(MM::g_Keyword_CoreDevice, MM::g_Keyword_CoreImageProcessor, newProcLabel.c_str()));
+      addStateCacheSetting(PropertySetting(MM::g_Keyword_CoreDevice, MM::g_Keyword_CoreImageProcessor, newProcLabel.c_str()));
    }
 }
 
@@ -3404,7 +4574,7 @@ void CMMCore::setSLMDevice(const char* slmLabel) throw (CMMError)
    std::string newSLMLabel = getSLMDevice();
    {
       MMThreadGuard scg(stateCacheLock_);
-      stateCache_.addSetting(PropertySetting(MM::g_Keyword_CoreDevice, MM::g_Keyword_CoreSLM, newSLMLabel.c_str()));
+      addStateCacheSetting(PropertySetting(MM::g_Keyword_CoreDevice, MM::g_Keyword_CoreSLM, newSLMLabel.c_str()));
    }
 }
 
@@ -3429,7 +4599,7 @@ void CMMCore::setGalvoDevice(const char* galvoLabel) throw (CMMError)
    std::string newGalvoLabel = getGalvoDevice();
    {
       MMThreadGuard scg(stateCacheLock_);
-      stateCache_.addSetting(PropertySetting(MM::g_Keyword_CoreDevice, MM::g_Keyword_CoreGalvo, newGalvoLabel.c_str()));
+      addStateCacheSetting(PropertySetting(MM::g_Keyword_CoreDevice, MM::g_Keyword_CoreGalvo, newGalvoLabel.c_str()));
    }
 }
 
@@ -3456,11 +4626,11 @@ void CMMCore::setChannelGroup(const char* chGroup) throw (CMMError)
 
    {
       MMThreadGuard scg(stateCacheLock_);
-      stateCache_.addSetting(PropertySetting(MM::g_Keyword_CoreDevice, MM::g_Keyword_CoreChannelGroup, channelGroup_.c_str()));
+      addStateCacheSetting(PropertySetting(MM::g_Keyword_CoreDevice, MM::g_Keyword_CoreChannelGroup, channelGroup_.c_str()));
    }
    if (externalCallback_ != 0) 
    {
-      externalCallback_->onChannelGroupChanged(channelGroup_.c_str());
+      eventDispatcher_->PostChannelGroupChanged(channelGroup_);
    }
 }
 
@@ -3518,7 +4688,7 @@ void CMMCore::setShutterDevice(const char* shutterLabel) throw (CMMError)
    std::string newShutterLabel = getShutterDevice();
    {
       MMThreadGuard scg(stateCacheLock_);
-      stateCache_.addSetting(PropertySetting(MM::g_Keyword_CoreDevice, MM::g_Keyword_CoreShutter, newShutterLabel.c_str()));
+      addStateCacheSetting(PropertySetting(MM::g_Keyword_CoreDevice, MM::g_Keyword_CoreShutter, newShutterLabel.c_str()));
    }
 }
 
@@ -3543,7 +4713,7 @@ void CMMCore::setFocusDevice(const char* focusLabel) throw (CMMError)
    std::string newFocusLabel = getFocusDevice();
    {
       MMThreadGuard scg(stateCacheLock_);
-      stateCache_.addSetting(PropertySetting(MM::g_Keyword_CoreDevice, MM::g_Keyword_CoreFocus, newFocusLabel.c_str()));
+      addStateCacheSetting(PropertySetting(MM::g_Keyword_CoreDevice, MM::g_Keyword_CoreFocus, newFocusLabel.c_str()));
    }
 }
 
@@ -3566,7 +4736,7 @@ void CMMCore::setXYStageDevice(const char* xyDeviceLabel) throw (CMMError)
    std::string newXYStageLabel = getXYStageDevice();
    {
       MMThreadGuard scg(stateCacheLock_);
-      stateCache_.addSetting(PropertySetting(MM::g_Keyword_CoreDevice, MM::g_Keyword_CoreXYStage, newXYStageLabel.c_str()));
+      addStateCacheSetting(PropertySetting(MM::g_Keyword_CoreDevice, MM::g_Keyword_CoreXYStage, newXYStageLabel.c_str()));
    }
 }
 
@@ -3605,7 +4775,7 @@ void CMMCore::setCameraDevice(const char* cameraLabel) throw (CMMError)
    std::string newCameraLabel = getCameraDevice();
    {
       MMThreadGuard scg(stateCacheLock_);
-      stateCache_.addSetting(PropertySetting(MM::g_Keyword_CoreDevice, MM::g_Keyword_CoreCamera, newCameraLabel.c_str()));
+      addStateCacheSetting(PropertySetting(MM::g_Keyword_CoreDevice, MM::g_Keyword_CoreCamera, newCameraLabel.c_str()));
    }
 }
 
@@ -3698,7 +4868,24 @@ string CMMCore::getProperty(const char* label, const char* propName) throw (CMME
 {
    if (IsCoreDeviceLabel(label))
       return properties_->Get(propName);
-   boost::shared_ptr<DeviceInstance> pDevice = deviceManager_->GetDevice(label);
+   return getProperty(deviceManager_->GetDevice(label), propName);
+}
+
+/**
+ * Returns the property value for the specified device.
+
+ * @return the property value
+ * @param device     the device handle
+ * @param propName   the property name
+ */
+string CMMCore::getProperty(const DeviceHandle& device, const char* propName) throw (CMMError)
+{
+   return getProperty(resolveDeviceHandle(device), propName);
+}
+
+string CMMCore::getProperty(boost::shared_ptr<DeviceInstance> pDevice,
+      const char* propName) throw (CMMError)
+{
    CheckPropertyName(propName);
 
    mm::DeviceModuleLockGuard guard(pDevice);
@@ -3706,10 +4893,10 @@ string CMMCore::getProperty(const char* label, const char* propName) throw (CMME
 
    // use the opportunity to update the cache
    // Note, stateCache is mutable so that we can update it from this const function
-   PropertySetting s(label, propName, value.c_str());
+   PropertySetting s(pDevice->GetLabel().c_str(), propName, value.c_str());
    {
       MMThreadGuard scg(stateCacheLock_);
-      stateCache_.addSetting(s);
+      addStateCacheSetting(s);
    }
 
    return value;
@@ -3762,7 +4949,7 @@ void CMMCore::setProperty(const char* label, const char* propName,
       properties_->Execute(propName, propValue);
       {
          MMThreadGuard scg(stateCacheLock_);
-         stateCache_.addSetting(PropertySetting(MM::g_Keyword_CoreDevice, propName, propValue));
+         addStateCacheSetting(PropertySetting(MM::g_Keyword_CoreDevice, propName, propValue));
       }
 
       LOG_DEBUG(coreLogger_) << "Did set Core property: " <<
@@ -3770,19 +4957,51 @@ void CMMCore::setProperty(const char* label, const char* propName,
    }
    else
    {
-      boost::shared_ptr<DeviceInstance> pDevice = deviceManager_->GetDevice(label);
+      setProperty(deviceManager_->GetDevice(label), propName, propValue);
+   }
+}
+
+/**
+ * Changes the value of the device property.
+ *
+ * @param device      the device handle
+ * @param propName    the property name
+ * @param propValue   the new property value
+ */
+void CMMCore::setProperty(const DeviceHandle& device, const char* propName,
+                          const char* propValue) throw (CMMError)
+{
+   CheckPropertyName(propName);
+   CheckPropertyValue(propValue);
+   setProperty(resolveDeviceHandle(device), propName, propValue);
+}
 
-      mm::DeviceModuleLockGuard guard(pDevice);
+void CMMCore::setProperty(boost::shared_ptr<DeviceInstance> pDevice,
+      const char* propName, const char* propValue) throw (CMMError)
+{
+   mm::DeviceModuleLockGuard guard(pDevice);
 
-      pDevice->SetProperty(propName, propValue);
+   pDevice->SetProperty(propName, propValue);
 
-      {
-         MMThreadGuard scg(stateCacheLock_);
-         stateCache_.addSetting(PropertySetting(label, propName, propValue));
-      }
+   {
+      MMThreadGuard scg(stateCacheLock_);
+      addStateCacheSetting(PropertySetting(pDevice->GetLabel().c_str(),
+               propName, propValue));
    }
 }
 
+/*
+ * Sets a device property from a configuration file line, with the same
+ * checks as setProperty(). May be called from several threads at once.
+ */
+void CMMCore::setConfigFileProperty(boost::shared_ptr<DeviceInstance> pDevice,
+      const std::string& propName, const std::string& propValue) throw (CMMError)
+{
+   CheckPropertyName(propName.c_str());
+   CheckPropertyValue(propValue.c_str());
+   setProperty(pDevice, propName.c_str(), propValue.c_str());
+}
+
 /**
  * Changes the value of the device property.
  *
@@ -3979,13 +5198,24 @@ void CMMCore::startPropertySequence(const char* label, const char* propName) thr
    boost::shared_ptr<DeviceInstance> pDevice = deviceManager_->GetDevice(label);
    CheckPropertyName(propName);
 
-   mm::DeviceModuleLockGuard guard(pDevice);
-   pDevice->StartPropertySequence(propName);
+   {
+      mm::DeviceModuleLockGuard guard(pDevice);
+      pDevice->StartPropertySequence(propName);
+   }
+
+   boost::shared_ptr<mm::SequenceStreamer> streamer =
+      getSequenceStreamer(SequenceStreamerKey(label, propName));
+   if (streamer)
+      streamer->Start();
 }
 
 /**
  * Stops an ongoing sequence of triggered events in a property of a device
  * This should only be called for device-properties that are sequenceable
+ *
+ * As with stopStageSequence(), a streamed sequence must be loaded again
+ * before it is restarted.
+ *
  * @param label     the device label
  * @param propName  the property name
  */
@@ -3997,8 +5227,16 @@ void CMMCore::stopPropertySequence(const char* label, const char* propName) thro
    boost::shared_ptr<DeviceInstance> pDevice = deviceManager_->GetDevice(label);
    CheckPropertyName(propName);
 
-   mm::DeviceModuleLockGuard guard(pDevice);
-   pDevice->StopPropertySequence(propName);
+   boost::shared_ptr<CMMError> streamingError;
+   stopSequenceStreamer(SequenceStreamerKey(label, propName), streamingError);
+
+   {
+      mm::DeviceModuleLockGuard guard(pDevice);
+      pDevice->StopPropertySequence(propName);
+   }
+
+   if (streamingError)
+      throw *streamingError;
 }
 
 /**
@@ -4008,7 +5246,7 @@ void CMMCore::stopPropertySequence(const char* label, const char* propName) thro
  * @param propName        the property label
  * @param eventSequence   the sequence of events/states that the device will execute in response to external triggers
  */
-void CMMCore::loadPropertySequence(const char* label, const char* propName, std::vector<std::string> eventSequence) throw (CMMError)
+void CMMCore::loadPropertySequence(const char* label, const char* propName, const std::vector<std::string>& eventSequence) throw (CMMError)
 {
    if (IsCoreDeviceLabel(label))
       // XXX Should be a throw
@@ -4016,6 +5254,9 @@ void CMMCore::loadPropertySequence(const char* label, const char* propName, std:
    boost::shared_ptr<DeviceInstance> pDevice = deviceManager_->GetDevice(label);
    CheckPropertyName(propName);
 
+   boost::shared_ptr<CMMError> ignoredError;
+   stopSequenceStreamer(SequenceStreamerKey(label, propName), ignoredError);
+
    mm::DeviceModuleLockGuard guard(pDevice);
    pDevice->ClearPropertySequence(propName);
 
@@ -4031,6 +5272,224 @@ void CMMCore::loadPropertySequence(const char* label, const char* propName, std:
    pDevice->SendPropertySequence(propName);
 }
 
+/**
+ * Transfer a sequence of values of a numeric (Integer or Float) property to
+ * the device, in a single call.
+ *
+ * A sequence longer than getPropertySequenceMaxLength() can be loaded if the
+ * property is streamable (see isPropertySequenceStreamable()); the values
+ * that do not fit are added while the sequence runs, as with
+ * loadStageSequence().
+ *
+ * @param label           the device name
+ * @param propName        the property label
+ * @param valueSequence   the sequence of values that the device will execute in response to external triggers
+ */
+void CMMCore::loadPropertySequence(const char* label, const char* propName, const std::vector<double>& valueSequence) throw (CMMError)
+{
+   if (IsCoreDeviceLabel(label))
+      // XXX Should be a throw
+      return;
+   boost::shared_ptr<DeviceInstance> pDevice = deviceManager_->GetDevice(label);
+   CheckPropertyName(propName);
+
+   SequenceStreamerKey key(label, propName);
+   boost::shared_ptr<CMMError> ignoredError;
+   stopSequenceStreamer(key, ignoredError);
+
+   long length = static_cast<long>(valueSequence.size());
+   long maxLength;
+   bool streaming;
+   {
+      mm::DeviceModuleLockGuard guard(pDevice);
+      MM::PropertyType type = pDevice->GetPropertyType(propName);
+      if (type != MM::Integer && type != MM::Float)
+      {
+         throw CMMError("Property " + ToQuotedString(propName) + " of " +
+               ToQuotedString(label) + " is not numeric");
+      }
+
+      maxLength = pDevice->GetPropertySequenceMaxLength(propName);
+      long freeSpace;
+      streaming = length > maxLength;
+      if (streaming &&
+            !pDevice->GetPropertySequenceFreeSpace(propName, freeSpace))
+      {
+         throw CMMError("The length of the requested sequence (" + ToString(length) +
+               ") exceeds the maximum allowed (" + ToString(maxLength) +
+               ") by the property " + ToQuotedString(propName) + " of " +
+               ToQuotedString(label));
+      }
+
+      pDevice->ClearPropertySequence(propName);
+      long loadLength = streaming ? maxLength : length;
+      if (loadLength > 0)
+         pDevice->AddArrayToPropertySequence(propName, &valueSequence[0],
+               loadLength);
+      pDevice->SendPropertySequence(propName);
+   }
+
+   if (streaming)
+   {
+      std::vector<double> rest(valueSequence.begin() + maxLength,
+            valueSequence.end());
+      LOG_INFO(coreLogger_) << "Sequence of " << label << "-" << propName <<
+         ": " << maxLength << " values loaded, " << rest.size() <<
+         " to be streamed";
+      setSequenceStreamer(key,
+            boost::make_shared<mm::SequenceStreamer>(coreLogger_,
+               "sequence of " + ToQuotedString(label) + "-" +
+               ToQuotedString(propName), rest, maxLength / 4,
+               boost::bind(&CMMCore::getPropertySequenceFreeSpace, this,
+                  pDevice, std::string(propName)),
+               boost::bind(&CMMCore::addArrayToPropertySequence, this,
+                  pDevice, std::string(propName), _1, _2)));
+   }
+}
+
+/**
+ * Transfer a sequence of values of an Integer property to the device.
+ * Same as the overload taking doubles.
+ *
+ * @param label           the device name
+ * @param propName        the property label
+ * @param valueSequence   the sequence of values that the device will execute in response to external triggers
+ */
+void CMMCore::loadPropertySequence(const char* label, const char* propName, const std::vector<long>& valueSequence) throw (CMMError)
+{
+   loadPropertySequence(label, propName,
+         std::vector<double>(valueSequence.begin(), valueSequence.end()));
+}
+
+/**
+ * Queries whether values can be added to a running sequence of the
+ * property, so that sequences longer than getPropertySequenceMaxLength()
+ * can be loaded with loadPropertySequence().
+ * @param label      the device name
+ * @param propName   the property label
+ */
+bool CMMCore::isPropertySequenceStreamable(const char* label, const char* propName) throw (CMMError)
+{
+   if (IsCoreDeviceLabel(label))
+      return false;
+   boost::shared_ptr<DeviceInstance> pDevice = deviceManager_->GetDevice(label);
+   CheckPropertyName(propName);
+
+   mm::DeviceModuleLockGuard guard(pDevice);
+   long freeSpace;
+   return pDevice->GetPropertySequenceFreeSpace(propName, freeSpace);
+}
+
+void CMMCore::setSequenceStreamer(const SequenceStreamerKey& key,
+      boost::shared_ptr<mm::SequenceStreamer> streamer)
+{
+   boost::mutex::scoped_lock lock(sequenceStreamersMutex_);
+   sequenceStreamers_[key] = streamer;
+}
+
+boost::shared_ptr<mm::SequenceStreamer>
+CMMCore::getSequenceStreamer(const SequenceStreamerKey& key)
+{
+   boost::mutex::scoped_lock lock(sequenceStreamersMutex_);
+   std::map< SequenceStreamerKey, boost::shared_ptr<mm::SequenceStreamer> >::iterator
+      found = sequenceStreamers_.find(key);
+   if (found == sequenceStreamers_.end())
+      return boost::shared_ptr<mm::SequenceStreamer>();
+   return found->second;
+}
+
+/**
+ * Stops and discards the streamer for the key, if any, and sets error to the
+ * error that interrupted its streaming, if any.
+ */
+void CMMCore::stopSequenceStreamer(const SequenceStreamerKey& key,
+      boost::shared_ptr<CMMError>& error)
+{
+   boost::shared_ptr<mm::SequenceStreamer> streamer;
+   {
+      boost::mutex::scoped_lock lock(sequenceStreamersMutex_);
+      std::map< SequenceStreamerKey, boost::shared_ptr<mm::SequenceStreamer> >::iterator
+         found = sequenceStreamers_.find(key);
+      if (found == sequenceStreamers_.end())
+         return;
+      streamer = found->second;
+      sequenceStreamers_.erase(found);
+   }
+
+   try
+   {
+      streamer->Stop();
+   }
+   catch (const CMMError& e)
+   {
+      error = boost::make_shared<CMMError>(e);
+   }
+}
+
+/**
+ * Stops and discards the streamers of a device (of all devices if label is
+ * empty), ignoring their errors.
+ */
+void CMMCore::discardSequenceStreamers(const std::string& label)
+{
+   std::vector<SequenceStreamerKey> keys;
+   {
+      boost::mutex::scoped_lock lock(sequenceStreamersMutex_);
+      for (std::map< SequenceStreamerKey, boost::shared_ptr<mm::SequenceStreamer> >::iterator
+            it = sequenceStreamers_.begin(), end = sequenceStreamers_.end();
+            it != end; ++it)
+      {
+         if (label.empty() || it->first.first == label)
+            keys.push_back(it->first);
+      }
+   }
+
+   for (std::vector<SequenceStreamerKey>::iterator it = keys.begin(),
+         end = keys.end(); it != end; ++it)
+   {
+      boost::shared_ptr<CMMError> ignoredError;
+      stopSequenceStreamer(*it, ignoredError);
+   }
+}
+
+long CMMCore::getStageSequenceFreeSpace(boost::shared_ptr<StageInstance> pStage) throw (CMMError)
+{
+   mm::DeviceModuleLockGuard guard(pStage);
+   long freeSpace;
+   int ret = pStage->GetStageSequenceFreeSpace(freeSpace);
+   if (ret != DEVICE_OK)
+      throw CMMError(getDeviceErrorText(ret, pStage));
+   return freeSpace;
+}
+
+void CMMCore::addArrayToStageSequence(boost::shared_ptr<StageInstance> pStage,
+      const double* positions, long count) throw (CMMError)
+{
+   mm::DeviceModuleLockGuard guard(pStage);
+   int ret = pStage->AddArrayToStageSequence(positions, count);
+   if (ret != DEVICE_OK)
+      throw CMMError(getDeviceErrorText(ret, pStage));
+}
+
+long CMMCore::getPropertySequenceFreeSpace(boost::shared_ptr<DeviceInstance> pDevice,
+      std::string propName) throw (CMMError)
+{
+   mm::DeviceModuleLockGuard guard(pDevice);
+   long freeSpace;
+   if (!pDevice->GetPropertySequenceFreeSpace(propName.c_str(), freeSpace))
+      throw CMMError("Device " + ToQuotedString(pDevice->GetLabel()) +
+            " no longer supports streaming of property " +
+            ToQuotedString(propName));
+   return freeSpace;
+}
+
+void CMMCore::addArrayToPropertySequence(boost::shared_ptr<DeviceInstance> pDevice,
+      std::string propName, const double* values, long count) throw (CMMError)
+{
+   mm::DeviceModuleLockGuard guard(pDevice);
+   pDevice->AddArrayToPropertySequence(propName.c_str(), values, count);
+}
+
 /**
  * Returns the intrinsic property type.
  */
@@ -4203,7 +5662,7 @@ void CMMCore::setExposure(const char* label, double dExp) throw (CMMError)
       {
          {
             MMThreadGuard scg(stateCacheLock_);
-            stateCache_.addSetting(PropertySetting(label, MM::g_Keyword_Exposure, CDeviceUtils::ConvertToString(dExp)));
+            addStateCacheSetting(PropertySetting(label, MM::g_Keyword_Exposure, CDeviceUtils::ConvertToString(dExp)));
          }
       }
    }
@@ -4586,7 +6045,7 @@ void CMMCore::setState(const char* deviceLabel, long state) throw (CMMError)
    {
       {
          MMThreadGuard scg(stateCacheLock_);
-         stateCache_.addSetting(PropertySetting(deviceLabel, MM::g_Keyword_State, CDeviceUtils::ConvertToString(state)));
+         addStateCacheSetting(PropertySetting(deviceLabel, MM::g_Keyword_State, CDeviceUtils::ConvertToString(state)));
       }
    }
    if (pStateDev->HasProperty(MM::g_Keyword_Label))
@@ -4595,7 +6054,7 @@ void CMMCore::setState(const char* deviceLabel, long state) throw (CMMError)
 
       {
          MMThreadGuard scg(stateCacheLock_);
-         stateCache_.addSetting(PropertySetting(deviceLabel, MM::g_Keyword_Label, posLbl.c_str()));
+         addStateCacheSetting(PropertySetting(deviceLabel, MM::g_Keyword_Label, posLbl.c_str()));
       }
    }
 
@@ -4657,7 +6116,7 @@ void CMMCore::setStateLabel(const char* deviceLabel, const char* stateLabel) thr
    {
       {
          MMThreadGuard scg(stateCacheLock_);
-         stateCache_.addSetting(PropertySetting(deviceLabel, MM::g_Keyword_Label, stateLabel));
+         addStateCacheSetting(PropertySetting(deviceLabel, MM::g_Keyword_Label, stateLabel));
       }
    }
    if (pStateDev->HasProperty(MM::g_Keyword_State))
@@ -4665,7 +6124,7 @@ void CMMCore::setStateLabel(const char* deviceLabel, const char* stateLabel) thr
       long state = getStateFromLabel(deviceLabel, stateLabel);
       {
          MMThreadGuard scg(stateCacheLock_);
-         stateCache_.addSetting(PropertySetting(deviceLabel, MM::g_Keyword_State,
+         addStateCacheSetting(PropertySetting(deviceLabel, MM::g_Keyword_State,
                   CDeviceUtils::ConvertToString(state)));
       }
    }
@@ -5988,74 +7447,296 @@ unsigned CMMCore::getSLMBytesPerPixel(const char* deviceLabel) throw (CMMError)
  *
  * @param deviceLabel name of the SLM
  */
-long CMMCore::getSLMSequenceMaxLength(const char* deviceLabel) throw (CMMError)
+long CMMCore::getSLMSequenceMaxLength(const char* deviceLabel) throw (CMMError)
+{
+   boost::shared_ptr<SLMInstance> pSLM =
+      deviceManager_->GetDeviceOfType<SLMInstance>(deviceLabel);
+
+   mm::DeviceModuleLockGuard guard(pSLM);
+   long numEvents;
+   int ret = pSLM->GetSLMSequenceMaxLength(numEvents);
+   if (ret != DEVICE_OK)
+      throw CMMError(getDeviceErrorText(ret, pSLM));
+   return numEvents;
+}
+
+/**
+ * Starts the sequence previously uploaded to the SLM
+ *
+ * @param deviceLabel name of the SLM
+ */
+void CMMCore::startSLMSequence(const char* deviceLabel) throw (CMMError)
+{
+   boost::shared_ptr<SLMInstance> pSLM =
+      deviceManager_->GetDeviceOfType<SLMInstance>(deviceLabel);
+
+   mm::DeviceModuleLockGuard guard(pSLM);
+   int ret = pSLM->StartSLMSequence();
+   if (ret != DEVICE_OK)
+      throw CMMError(getDeviceErrorText(ret, pSLM));
+}
+
+/**
+ * Stops the SLM sequence if previously started
+ *
+ * @param deviceLabel name of the SLM
+ */
+void CMMCore::stopSLMSequence(const char* deviceLabel) throw (CMMError)
+{
+   boost::shared_ptr<SLMInstance> pSLM =
+      deviceManager_->GetDeviceOfType<SLMInstance>(deviceLabel);
+
+   mm::DeviceModuleLockGuard guard(pSLM);
+   int ret = pSLM->StopSLMSequence();
+   if (ret != DEVICE_OK)
+      throw CMMError(getDeviceErrorText(ret, pSLM));
+}
+
+/**
+ * Load a sequence of images into the SLM
+ *
+ * @param deviceLabel name of the SLM
+ * @param imagesequence pointers to the images to be used in the sequence
+ */
+void CMMCore::loadSLMSequence(const char* deviceLabel, std::vector<unsigned char *> imageSequence) throw (CMMError)
+{
+   boost::shared_ptr<SLMInstance> pSLM =
+      deviceManager_->GetDeviceOfType<SLMInstance>(deviceLabel);
+
+
+   mm::DeviceModuleLockGuard guard(pSLM);
+   int ret = pSLM->ClearSLMSequence();
+   if (ret != DEVICE_OK)
+      throw CMMError(getDeviceErrorText(ret, pSLM));
+
+   std::vector<unsigned char *>::iterator it;
+   for (std::vector<unsigned char *>::const_iterator it = imageSequence.begin(),
+         end = imageSequence.end();
+         it < end; ++it)
+   {
+      ret = pSLM->AddToSLMSequence(*it);
+      if (ret != DEVICE_OK)
+         throw CMMError(getDeviceErrorText(ret, pSLM));
+   }
+
+   ret = pSLM->SendSLMSequence();
+   if (ret != DEVICE_OK)
+      throw CMMError(getDeviceErrorText(ret, pSLM));
+}
+
+/**
+ * Uploads a set of patterns to the SLM once, so that they can then be
+ * displayed or sequenced by index without transferring the pixels again.
+ *
+ * If the SLM has pattern memory for all of them, the patterns are stored in
+ * the device. Otherwise the core keeps a copy and passes it to the device
+ * when a pattern is displayed or sequenced. Replaces any previously loaded
+ * pattern bank of the SLM.
+ *
+ * The bank is replaced only after the patterns already queued with
+ * displaySLMPatternAsync() have been displayed; this function waits for
+ * them.
+ *
+ * @param deviceLabel name of the SLM
+ * @param patterns images of getSLMWidth() x getSLMHeight() x
+ *        getSLMBytesPerPixel() bytes
+ * @see displaySLMPattern()
+ * @see loadSLMPatternSequence()
+ */
+void CMMCore::loadSLMPatternBank(const char* deviceLabel,
+      std::vector<unsigned char*> patterns) throw (CMMError)
+{
+   deviceManager_->GetDeviceOfType<SLMInstance>(deviceLabel);
+
+   // Go through the SLM's command queue, so that the bank is replaced
+   // between the displays queued before and after this call
+   std::ostringstream description;
+   description << "loadSLMPatternBank(" << deviceLabel << ")";
+   commandExecutor_->Submit(description.str(),
+         std::vector<std::string>(1, deviceLabel),
+         boost::bind(&CMMCore::loadSLMPatternBankNow, this,
+            std::string(deviceLabel), boost::cref(patterns))).
+      waitForCompletion();
+}
+
+// Executed by commandExecutor_
+void CMMCore::loadSLMPatternBankNow(std::string label,
+      const std::vector<unsigned char*>& patterns) throw (CMMError)
+{
+   const char* deviceLabel = label.c_str();
+   boost::shared_ptr<SLMInstance> pSLM =
+      deviceManager_->GetDeviceOfType<SLMInstance>(label);
+
+   boost::shared_ptr<SLMPatternBank> bank = boost::make_shared<SLMPatternBank>();
+   bank->size = (long) patterns.size();
+
+   // Drop the old bank first (under the device lock, like the check in
+   // displaySLMPatternInBank()); its patterns are overwritten below
+   mm::DeviceModuleLockGuard guard(pSLM);
+   discardSLMPatternBanks(label);
+
+   long capacity = 0;
+   bank->inDevice = pSLM->GetSLMPatternBankCapacity(capacity) == DEVICE_OK &&
+      capacity >= bank->size;
+   if (bank->inDevice)
+   {
+      for (long i = 0; i < bank->size; ++i)
+      {
+         int ret = pSLM->SetSLMPattern(i, patterns[i]);
+         if (ret != DEVICE_OK)
+         {
+            logError(deviceLabel, getDeviceErrorText(ret, pSLM).c_str());
+            throw CMMError(getDeviceErrorText(ret, pSLM));
+         }
+      }
+   }
+   else
+   {
+      const size_t patternBytes = (size_t) pSLM->GetWidth() *
+         pSLM->GetHeight() * pSLM->GetBytesPerPixel();
+      bank->patterns.resize(patterns.size());
+      for (size_t i = 0; i < patterns.size(); ++i)
+         bank->patterns[i].assign(patterns[i], patterns[i] + patternBytes);
+   }
+
+   LOG_DEBUG(coreLogger_) << "Loaded " << bank->size << " patterns for SLM " <<
+      deviceLabel << (bank->inDevice ? " into device memory" :
+            " (kept by the core)");
+
+   boost::mutex::scoped_lock lock(slmPatternBanksMutex_);
+   bank->generation = ++slmPatternBankGeneration_;
+   slmPatternBanks_[label] = bank;
+}
+
+/**
+ * Returns the number of patterns loaded by loadSLMPatternBank(), or 0 if
+ * there is none.
+ *
+ * @param deviceLabel name of the SLM
+ */
+long CMMCore::getSLMPatternBankSize(const char* deviceLabel) throw (CMMError)
+{
+   deviceManager_->GetDeviceOfType<SLMInstance>(deviceLabel);
+
+   boost::mutex::scoped_lock lock(slmPatternBanksMutex_);
+   std::map< std::string, boost::shared_ptr<const SLMPatternBank> >::const_iterator
+      found = slmPatternBanks_.find(deviceLabel);
+   if (found == slmPatternBanks_.end())
+      return 0;
+   return found->second->size;
+}
+
+/**
+ * Forgets the patterns loaded by loadSLMPatternBank().
+ *
+ * Patterns stored in the device are not erased but can no longer be
+ * addressed. Patterns already queued with displaySLMPatternAsync() are
+ * displayed first; this function waits for them.
+ *
+ * @param deviceLabel name of the SLM
+ */
+void CMMCore::clearSLMPatternBank(const char* deviceLabel) throw (CMMError)
 {
-   boost::shared_ptr<SLMInstance> pSLM =
-      deviceManager_->GetDeviceOfType<SLMInstance>(deviceLabel);
+   deviceManager_->GetDeviceOfType<SLMInstance>(deviceLabel);
 
+   std::ostringstream description;
+   description << "clearSLMPatternBank(" << deviceLabel << ")";
+   commandExecutor_->Submit(description.str(),
+         std::vector<std::string>(1, deviceLabel),
+         boost::bind(&CMMCore::clearSLMPatternBankNow, this,
+            std::string(deviceLabel))).
+      waitForCompletion();
+}
+
+// Executed by commandExecutor_
+void CMMCore::clearSLMPatternBankNow(std::string label) throw (CMMError)
+{
+   boost::shared_ptr<SLMInstance> pSLM =
+      deviceManager_->GetDeviceOfType<SLMInstance>(label);
    mm::DeviceModuleLockGuard guard(pSLM);
-   long numEvents;
-   int ret = pSLM->GetSLMSequenceMaxLength(numEvents);
-   if (ret != DEVICE_OK)
-      throw CMMError(getDeviceErrorText(ret, pSLM));
-   return numEvents;
+   discardSLMPatternBanks(label);
 }
 
 /**
- * Starts the sequence previously uploaded to the SLM
+ * Displays a pattern loaded by loadSLMPatternBank().
+ *
+ * For SLMs without pattern memory this is equivalent to setSLMImage()
+ * followed by displaySLMImage(), but without copying the pattern.
  *
  * @param deviceLabel name of the SLM
+ * @param patternIndex index into the patterns passed to loadSLMPatternBank()
  */
-void CMMCore::startSLMSequence(const char* deviceLabel) throw (CMMError)
+void CMMCore::displaySLMPattern(const char* deviceLabel, long patternIndex)
+   throw (CMMError)
 {
-   boost::shared_ptr<SLMInstance> pSLM =
-      deviceManager_->GetDeviceOfType<SLMInstance>(deviceLabel);
-
-   mm::DeviceModuleLockGuard guard(pSLM);
-   int ret = pSLM->StartSLMSequence();
-   if (ret != DEVICE_OK)
-      throw CMMError(getDeviceErrorText(ret, pSLM));
+   displaySLMPatternInBank(deviceLabel,
+         getSLMPatternBank(deviceLabel, patternIndex), patternIndex);
 }
 
 /**
- * Stops the SLM sequence if previously started
+ * Queues displaying a pattern loaded by loadSLMPatternBank(), and returns
+ * without waiting.
  *
- * @param deviceLabel name of the SLM
+ * Patterns queued for the same SLM are displayed in order. The SLM adapter
+ * stages each pattern while the previous one is still displayed (see
+ * MM::SLM::SetImage() and MM::SLM::DisplaySLMPattern()), so that a caller
+ * keeping the next pattern queued is not held up by the transfer or by the
+ * display. Loading or clearing the pattern bank takes its turn in the same
+ * queue; a display whose bank has nonetheless been replaced by the time it
+ * runs (for example by unloading the device) fails.
+ *
+ * @see setPositionAsync()
  */
-void CMMCore::stopSLMSequence(const char* deviceLabel) throw (CMMError)
+AsyncCommand CMMCore::displaySLMPatternAsync(const char* deviceLabel,
+      long patternIndex) throw (CMMError)
 {
-   boost::shared_ptr<SLMInstance> pSLM =
-      deviceManager_->GetDeviceOfType<SLMInstance>(deviceLabel);
+   boost::shared_ptr<const SLMPatternBank> bank =
+      getSLMPatternBank(deviceLabel, patternIndex);
 
-   mm::DeviceModuleLockGuard guard(pSLM);
-   int ret = pSLM->StopSLMSequence();
-   if (ret != DEVICE_OK)
-      throw CMMError(getDeviceErrorText(ret, pSLM));
+   std::ostringstream description;
+   description << "displaySLMPattern(" << deviceLabel << ", " <<
+      patternIndex << ")";
+   return commandExecutor_->Submit(description.str(),
+         std::vector<std::string>(1, deviceLabel),
+         boost::bind(&CMMCore::displaySLMPatternInBank, this,
+            std::string(deviceLabel), bank, patternIndex));
 }
 
 /**
- * Load a sequence of images into the SLM
+ * Loads a sequence of patterns, given by their indices into the patterns
+ * passed to loadSLMPatternBank(), into the SLM.
+ *
+ * Unlike loadSLMSequence(), the pixels are not transferred again if the
+ * patterns are stored in the device, and are not copied otherwise.
  *
  * @param deviceLabel name of the SLM
- * @param imagesequence pointers to the images to be used in the sequence
+ * @param patternIndices the patterns to be used in the sequence
  */
-void CMMCore::loadSLMSequence(const char* deviceLabel, std::vector<unsigned char *> imageSequence) throw (CMMError)
+void CMMCore::loadSLMPatternSequence(const char* deviceLabel,
+      const std::vector<long>& patternIndices) throw (CMMError)
 {
    boost::shared_ptr<SLMInstance> pSLM =
       deviceManager_->GetDeviceOfType<SLMInstance>(deviceLabel);
 
-
+   // Banks are replaced under the device lock
    mm::DeviceModuleLockGuard guard(pSLM);
+   boost::shared_ptr<const SLMPatternBank> bank;
+   for (std::vector<long>::const_iterator it = patternIndices.begin(),
+         end = patternIndices.end(); it != end; ++it)
+   {
+      bank = getSLMPatternBank(deviceLabel, *it);
+   }
    int ret = pSLM->ClearSLMSequence();
    if (ret != DEVICE_OK)
       throw CMMError(getDeviceErrorText(ret, pSLM));
 
-   std::vector<unsigned char *>::iterator it;
-   for (std::vector<unsigned char *>::const_iterator it = imageSequence.begin(),
-         end = imageSequence.end();
-         it < end; ++it)
+   for (std::vector<long>::const_iterator it = patternIndices.begin(),
+         end = patternIndices.end(); it != end; ++it)
    {
-      ret = pSLM->AddToSLMSequence(*it);
+      if (bank->inDevice)
+         ret = pSLM->AddSLMPatternToSequence(*it);
+      else
+         ret = pSLM->AddToSLMSequence(&bank->patterns[*it][0]);
       if (ret != DEVICE_OK)
          throw CMMError(getDeviceErrorText(ret, pSLM));
    }
@@ -6065,6 +7746,40 @@ void CMMCore::loadSLMSequence(const char* deviceLabel, std::vector<unsigned char
       throw CMMError(getDeviceErrorText(ret, pSLM));
 }
 
+/**
+ * Returns the pattern bank of an SLM, checking that it contains the pattern.
+ */
+boost::shared_ptr<const CMMCore::SLMPatternBank>
+CMMCore::getSLMPatternBank(const std::string& label, long patternIndex)
+   throw (CMMError)
+{
+   deviceManager_->GetDeviceOfType<SLMInstance>(label);
+
+   boost::mutex::scoped_lock lock(slmPatternBanksMutex_);
+   std::map< std::string, boost::shared_ptr<const SLMPatternBank> >::const_iterator
+      found = slmPatternBanks_.find(label);
+   if (found == slmPatternBanks_.end())
+      throw CMMError("No patterns have been loaded for SLM " +
+            ToQuotedString(label));
+   if (patternIndex < 0 || patternIndex >= found->second->size)
+      throw CMMError("Pattern index " + ToString(patternIndex) +
+            " is out of range for the " + ToString(found->second->size) +
+            " patterns loaded for SLM " + ToQuotedString(label));
+   return found->second;
+}
+
+/**
+ * Discards the pattern bank of an SLM (of all SLMs if label is empty).
+ */
+void CMMCore::discardSLMPatternBanks(const std::string& label)
+{
+   boost::mutex::scoped_lock lock(slmPatternBanksMutex_);
+   if (label.empty())
+      slmPatternBanks_.clear();
+   else
+      slmPatternBanks_.erase(label);
+}
+
 /* GALVO CODE */
 
 /**
@@ -6268,6 +7983,128 @@ void CMMCore::loadGalvoPolygons(const char* deviceLabel) throw (CMMError)
    }
 }
 
+namespace {
+
+// 64-bit FNV-1a, continued from hash
+template <typename T>
+unsigned long long HashArray(unsigned long long hash, const std::vector<T>& values)
+{
+   const unsigned char* bytes =
+      reinterpret_cast<const unsigned char*>(values.empty() ? 0 : &values[0]);
+   for (size_t i = 0; i < values.size() * sizeof(T); ++i)
+   {
+      hash ^= bytes[i];
+      hash *= 1099511628211ULL;
+   }
+   // Separates the arrays, so that moving values between them changes the hash
+   hash ^= values.size();
+   hash *= 1099511628211ULL;
+   return hash;
+}
+
+unsigned long long HashValue(unsigned long long hash, double value)
+{
+   return HashArray(hash, std::vector<double>(1, value));
+}
+
+} // anonymous namespace
+
+/**
+ * Replace the galvo polygons and load them to the device, in one call.
+ *
+ * Polygon i consists of the next vertexCounts[i] points of xs and ys; the
+ * beam dwells dwellTimes_us[i] at each of its points (0 to use the current
+ * spot interval), and the polygon is repeated repetitions[i] times. Run the
+ * polygons with runGalvoPolygons().
+ *
+ * The pattern is identified by a hash of its content and of the spot
+ * interval last set with setGalvoSpotInterval(). Galvos that keep the
+ * patterns they were loaded with (such as the demo galvo) are not sent a
+ * pattern again when it is reloaded.
+ *
+ * @param galvoLabel     the galvo device label
+ * @param xs             x coordinates of the vertices of all polygons
+ * @param ys             y coordinates of the vertices of all polygons
+ * @param vertexCounts   number of vertices of each polygon
+ * @param dwellTimes_us  dwell time of each polygon
+ * @param repetitions    number of repetitions of each polygon
+ */
+void CMMCore::loadGalvoPolygons(const char* galvoLabel,
+      const std::vector<double>& xs, const std::vector<double>& ys,
+      const std::vector<long>& vertexCounts,
+      const std::vector<double>& dwellTimes_us,
+      const std::vector<long>& repetitions) throw (CMMError)
+{
+   boost::shared_ptr<GalvoInstance> pGalvo =
+      deviceManager_->GetDeviceOfType<GalvoInstance>(galvoLabel);
+
+   size_t vertexCount = 0;
+   for (std::vector<long>::const_iterator it = vertexCounts.begin(),
+         end = vertexCounts.end(); it != end; ++it)
+   {
+      if (*it < 0)
+         throw CMMError("Negative vertex count in galvo polygons");
+      vertexCount += *it;
+   }
+   if (xs.size() != vertexCount || ys.size() != vertexCount)
+   {
+      throw CMMError("Galvo polygons have " + ToString(vertexCount) +
+            " vertices, but " + ToString(xs.size()) + " x and " +
+            ToString(ys.size()) + " y coordinates were given");
+   }
+   if (dwellTimes_us.size() != vertexCounts.size() ||
+         repetitions.size() != vertexCounts.size())
+   {
+      throw CMMError("Galvo polygon dwell times and repetitions must be "
+            "given for each of the " + ToString(vertexCounts.size()) +
+            " polygons");
+   }
+
+   mm::DeviceModuleLockGuard guard(pGalvo);
+
+   // Covers everything the loaded pattern depends on, including the spot
+   // interval that zero dwell times stand for
+   unsigned long long hash = 14695981039346656037ULL;
+   hash = HashArray(hash, xs);
+   hash = HashArray(hash, ys);
+   hash = HashArray(hash, vertexCounts);
+   hash = HashArray(hash, dwellTimes_us);
+   hash = HashArray(hash, repetitions);
+   hash = HashValue(hash, pGalvo->GetLastSpotInterval());
+   std::ostringstream keyStream;
+   keyStream << std::hex << std::setw(16) << std::setfill('0') << hash;
+   const std::string key = keyStream.str();
+
+   bool found;
+   int ret = pGalvo->SelectPolygonPattern(key.c_str(), found);
+   if (ret == DEVICE_OK && found)
+   {
+      LOG_DEBUG(coreLogger_) << "Galvo " << galvoLabel <<
+         " reloaded polygon pattern " << key;
+      return;
+   }
+
+   const double empty = 0.0;
+   const long emptyLong = 0;
+   if (ret == DEVICE_OK)
+   {
+      ret = pGalvo->LoadPolygonPattern(key.c_str(),
+            xs.empty() ? &empty : &xs[0], ys.empty() ? &empty : &ys[0],
+            vertexCounts.empty() ? &emptyLong : &vertexCounts[0],
+            dwellTimes_us.empty() ? &empty : &dwellTimes_us[0],
+            repetitions.empty() ? &emptyLong : &repetitions[0],
+            static_cast<long>(vertexCounts.size()));
+   }
+   if (ret != DEVICE_OK)
+   {
+      logError(galvoLabel, getDeviceErrorText(ret, pGalvo).c_str());
+      throw CMMError(getDeviceErrorText(ret, pGalvo));
+   }
+   LOG_DEBUG(coreLogger_) << "Galvo " << galvoLabel << " loaded " <<
+      vertexCounts.size() << " polygons (" << vertexCount <<
+      " vertices) as pattern " << key;
+}
+
 /**
  * Set the number of times to loop galvo polygons
  */
@@ -6282,62 +8119,395 @@ void CMMCore::setGalvoPolygonRepetitions(const char* deviceLabel, int repetition
 
    if (ret != DEVICE_OK)
    {
-      logError(deviceLabel, getDeviceErrorText(ret, pGalvo).c_str());
-      throw CMMError(getDeviceErrorText(ret, pGalvo));
+      logError(deviceLabel, getDeviceErrorText(ret, pGalvo).c_str());
+      throw CMMError(getDeviceErrorText(ret, pGalvo));
+   }
+}
+
+
+/**
+ * Run a loop of galvo polygons
+ */
+void CMMCore::runGalvoPolygons(const char* deviceLabel) throw (CMMError)
+{
+   boost::shared_ptr<GalvoInstance> pGalvo =
+      deviceManager_->GetDeviceOfType<GalvoInstance>(deviceLabel);
+
+   mm::DeviceModuleLockGuard guard(pGalvo);
+
+   int ret =  pGalvo->RunPolygons();
+
+   if (ret != DEVICE_OK)
+   {
+      logError(deviceLabel, getDeviceErrorText(ret, pGalvo).c_str());
+      throw CMMError(getDeviceErrorText(ret, pGalvo));
+   }
+}
+
+/**
+ * Run a sequence of galvo positions
+ */
+void CMMCore::runGalvoSequence(const char* deviceLabel) throw (CMMError)
+{
+   boost::shared_ptr<GalvoInstance> pGalvo =
+      deviceManager_->GetDeviceOfType<GalvoInstance>(deviceLabel);
+
+   mm::DeviceModuleLockGuard guard(pGalvo);
+
+   int ret =  pGalvo->RunSequence();
+
+   if (ret != DEVICE_OK)
+   {
+      logError(deviceLabel, getDeviceErrorText(ret, pGalvo).c_str());
+      throw CMMError(getDeviceErrorText(ret, pGalvo));
+   }
+}
+
+/**
+ * Get the name of the active galvo channel (for a multi-laser galvo device).
+ */
+string CMMCore::getGalvoChannel(const char* deviceLabel) throw (CMMError)
+{
+   boost::shared_ptr<GalvoInstance> pGalvo =
+      deviceManager_->GetDeviceOfType<GalvoInstance>(deviceLabel);
+
+   mm::DeviceModuleLockGuard guard(pGalvo);
+   return pGalvo->GetChannel();
+}
+
+/* ASYNCHRONOUS DEVICE COMMANDS */
+
+/**
+ * Queues setting the position of a stage, and returns without waiting.
+ *
+ * The returned command is done when the stage has stopped moving.
+ * Commands to the same device are executed in the order in which they are
+ * queued; commands to other devices can overlap with this one.
+ *
+ * @param stageLabel    the stage device label
+ * @param position      the position in microns
+ */
+AsyncCommand CMMCore::setPositionAsync(const char* stageLabel, double position)
+   throw (CMMError)
+{
+   deviceManager_->GetDeviceOfType<StageInstance>(stageLabel);
+
+   std::ostringstream description;
+   description << "setPosition(" << stageLabel << ", " << position << ")";
+   return commandExecutor_->Submit(description.str(),
+         std::vector<std::string>(1, stageLabel),
+         boost::bind(&CMMCore::setPositionAndWait, this,
+            std::string(stageLabel), position));
+}
+
+/**
+ * Queues setting the position of an XY stage, and returns without waiting.
+ *
+ * @see setPositionAsync()
+ */
+AsyncCommand CMMCore::setXYPositionAsync(const char* xyStageLabel,
+      double x, double y) throw (CMMError)
+{
+   deviceManager_->GetDeviceOfType<XYStageInstance>(xyStageLabel);
+
+   std::ostringstream description;
+   description << "setXYPosition(" << xyStageLabel << ", " << x << ", " <<
+      y << ")";
+   return commandExecutor_->Submit(description.str(),
+         std::vector<std::string>(1, xyStageLabel),
+         boost::bind(&CMMCore::setXYPositionAndWait, this,
+            std::string(xyStageLabel), x, y));
+}
+
+/**
+ * Queues setting the state of a state device, and returns without waiting.
+ *
+ * @see setPositionAsync()
+ */
+AsyncCommand CMMCore::setStateAsync(const char* stateDeviceLabel, long state)
+   throw (CMMError)
+{
+   deviceManager_->GetDeviceOfType<StateInstance>(stateDeviceLabel);
+
+   std::ostringstream description;
+   description << "setState(" << stateDeviceLabel << ", " << state << ")";
+   return commandExecutor_->Submit(description.str(),
+         std::vector<std::string>(1, stateDeviceLabel),
+         boost::bind(&CMMCore::setStateAndWait, this,
+            std::string(stateDeviceLabel), state));
+}
+
+/**
+ * Queues opening or closing a shutter, and returns without waiting.
+ *
+ * @see setPositionAsync()
+ */
+AsyncCommand CMMCore::setShutterOpenAsync(const char* shutterLabel,
+      bool state) throw (CMMError)
+{
+   deviceManager_->GetDeviceOfType<ShutterInstance>(shutterLabel);
+
+   std::ostringstream description;
+   description << "setShutterOpen(" << shutterLabel << ", " <<
+      (state ? "true" : "false") << ")";
+   return commandExecutor_->Submit(description.str(),
+         std::vector<std::string>(1, shutterLabel),
+         boost::bind(&CMMCore::setShutterOpenAndWait, this,
+            std::string(shutterLabel), state));
+}
+
+/**
+ * Queues setting a device property, and returns without waiting.
+ *
+ * @see setPositionAsync()
+ */
+AsyncCommand CMMCore::setPropertyAsync(const char* label,
+      const char* propName, const char* propValue) throw (CMMError)
+{
+   CheckDeviceLabel(label);
+   CheckPropertyName(propName);
+   CheckPropertyValue(propValue);
+   if (!IsCoreDeviceLabel(label))
+      deviceManager_->GetDevice(label);
+
+   std::ostringstream description;
+   description << "setProperty(" << label << ", " << propName << ", " <<
+      propValue << ")";
+   return commandExecutor_->Submit(description.str(),
+         std::vector<std::string>(1, label),
+         boost::bind(&CMMCore::setPropertyAndWait, this,
+            std::string(label), std::string(propName),
+            std::string(propValue)));
+}
+
+/**
+ * Queues applying a configuration preset, and returns without waiting.
+ *
+ * The command is ordered with the commands to every device that the preset
+ * sets, and is done when all of them are no longer busy.
+ *
+ * @see setPositionAsync()
+ */
+AsyncCommand CMMCore::setConfigAsync(const char* groupName,
+      const char* configName) throw (CMMError)
+{
+   CheckConfigGroupName(groupName);
+   CheckConfigPresetName(configName);
+
+   Configuration* pCfg = configGroups_->Find(groupName, configName);
+   if (!pCfg)
+   {
+      throw CMMError("Preset " + ToQuotedString(configName) +
+            " of configuration group " + ToQuotedString(groupName) +
+            " does not exist",
+            MMERR_NoConfiguration);
+   }
+
+   std::set<std::string> devices;
+   for (size_t i = 0; i < pCfg->size(); ++i)
+      devices.insert(pCfg->getSetting(i).getDeviceLabel());
+
+   std::ostringstream description;
+   description << "setConfig(" << groupName << ", " << configName << ")";
+   return commandExecutor_->Submit(description.str(),
+         std::vector<std::string>(devices.begin(), devices.end()),
+         boost::bind(&CMMCore::setConfigAndWait, this,
+            std::string(groupName), std::string(configName)));
+}
+
+/**
+ * Moves several stages at once and waits until all of them have stopped.
+ *
+ * All moves are started before waiting for any of them, so that the time
+ * taken is that of the slowest stage rather than the sum over all stages.
+ * Stages in different device adapter modules are commanded concurrently;
+ * stages sharing a module are commanded in turn but still move together.
+ * To move a MultiStage (Utilities) together with other stages, its
+ * physical stages can be listed here directly. If any move fails, the
+ * first error is thrown after all moves have finished.
+ *
+ * @param stageLabels   the stage device labels
+ * @param positions     the positions in microns, one for each stage
+ */
+void CMMCore::setStagePositions(const std::vector<std::string>& stageLabels,
+      const std::vector<double>& positions) throw (CMMError)
+{
+   setStagePositions("", 0.0, 0.0, stageLabels, positions);
+}
+
+/**
+ * Moves an XY stage and several stages at once and waits until all of them
+ * have stopped.
+ *
+ * @param xyStageLabel  the XY stage device label; empty to move only the
+ *                      stages
+ * @param x             the X position in microns
+ * @param y             the Y position in microns
+ * @param stageLabels   the stage device labels
+ * @param positions     the positions in microns, one for each stage
+ * @see setStagePositions(const std::vector<std::string>&, const std::vector<double>&)
+ */
+void CMMCore::setStagePositions(const char* xyStageLabel, double x, double y,
+      const std::vector<std::string>& stageLabels,
+      const std::vector<double>& positions) throw (CMMError)
+{
+   if (positions.size() != stageLabels.size())
+   {
+      throw CMMError(ToString(stageLabels.size()) + " stages but " +
+            ToString(positions.size()) + " positions were given");
+   }
+   const bool moveXY = xyStageLabel && strlen(xyStageLabel) > 0;
+
+   // Check all devices before moving any
+   if (moveXY)
+      deviceManager_->GetDeviceOfType<XYStageInstance>(xyStageLabel);
+   for (size_t i = 0; i < stageLabels.size(); ++i)
+      deviceManager_->GetDeviceOfType<StageInstance>(stageLabels[i].c_str());
+
+   std::vector<AsyncCommand> moves;
+   if (moveXY)
+      moves.push_back(setXYPositionAsync(xyStageLabel, x, y));
+   for (size_t i = 0; i < stageLabels.size(); ++i)
+      moves.push_back(setPositionAsync(stageLabels[i].c_str(), positions[i]));
+
+   LOG_DEBUG(coreLogger_) << "Moving " << moves.size() <<
+      " stages concurrently";
+   waitForAsyncCommands(moves);
+}
+
+/**
+ * Waits for all of the given asynchronous commands to finish.
+ *
+ * If any of them failed, the error of the first failed command (in the
+ * order given) is thrown after all of them have finished.
+ */
+void CMMCore::waitForAsyncCommands(const std::vector<AsyncCommand>& commands)
+   throw (CMMError)
+{
+   for (size_t i = 0; i < commands.size(); ++i)
+   {
+      try
+      {
+         commands[i].waitForCompletion();
+      }
+      catch (const CMMError&)
+      {
+         for (size_t j = i + 1; j < commands.size(); ++j)
+         {
+            try
+            {
+               commands[j].waitForCompletion();
+            }
+            catch (const CMMError&)
+            {
+            }
+         }
+         throw;
+      }
+   }
+}
+
+/**
+ * Like waitForAsyncCommands(commands), but returns false if the commands
+ * have not all finished within timeoutMs.
+ */
+bool CMMCore::waitForAsyncCommands(const std::vector<AsyncCommand>& commands,
+      long timeoutMs) throw (CMMError)
+{
+   MM::MMTime deadline = GetMMTimeNow() + MM::MMTime(timeoutMs * 1000.0);
+   for (size_t i = 0; i < commands.size(); ++i)
+   {
+      long remainingMs =
+         (long)((deadline - GetMMTimeNow()).getMsec() + 0.5);
+      if (!commands[i].waitForCompletion(remainingMs > 0 ? remainingMs : 0))
+         return false;
    }
+   return true;
 }
 
+void CMMCore::setPositionAndWait(std::string label, double position)
+   throw (CMMError)
+{
+   setPosition(label.c_str(), position);
+   waitForDevice(label.c_str());
+}
 
-/**
- * Run a loop of galvo polygons
- */
-void CMMCore::runGalvoPolygons(const char* deviceLabel) throw (CMMError)
+void CMMCore::setXYPositionAndWait(std::string label, double x, double y)
+   throw (CMMError)
 {
-   boost::shared_ptr<GalvoInstance> pGalvo =
-      deviceManager_->GetDeviceOfType<GalvoInstance>(deviceLabel);
+   setXYPosition(label.c_str(), x, y);
+   waitForDevice(label.c_str());
+}
 
-   mm::DeviceModuleLockGuard guard(pGalvo);
+void CMMCore::setStateAndWait(std::string label, long state) throw (CMMError)
+{
+   setState(label.c_str(), state);
+   waitForDevice(label.c_str());
+}
 
-   int ret =  pGalvo->RunPolygons();
+void CMMCore::setShutterOpenAndWait(std::string label, bool state)
+   throw (CMMError)
+{
+   setShutterOpen(label.c_str(), state);
+   waitForDevice(label.c_str());
+}
 
-   if (ret != DEVICE_OK)
-   {
-      logError(deviceLabel, getDeviceErrorText(ret, pGalvo).c_str());
-      throw CMMError(getDeviceErrorText(ret, pGalvo));
-   }
+void CMMCore::setPropertyAndWait(std::string label, std::string propName,
+      std::string propValue) throw (CMMError)
+{
+   setProperty(label.c_str(), propName.c_str(), propValue.c_str());
+   if (!IsCoreDeviceLabel(label.c_str()))
+      waitForDevice(label.c_str());
 }
 
-/**
- * Run a sequence of galvo positions
- */
-void CMMCore::runGalvoSequence(const char* deviceLabel) throw (CMMError)
+void CMMCore::setConfigAndWait(std::string groupName, std::string configName)
+   throw (CMMError)
 {
-   boost::shared_ptr<GalvoInstance> pGalvo =
-      deviceManager_->GetDeviceOfType<GalvoInstance>(deviceLabel);
+   setConfig(groupName.c_str(), configName.c_str());
+   waitForConfig(groupName.c_str(), configName.c_str());
+}
 
-   mm::DeviceModuleLockGuard guard(pGalvo);
+void CMMCore::displaySLMPatternInBank(std::string label,
+      boost::shared_ptr<const SLMPatternBank> bank, long patternIndex)
+   throw (CMMError)
+{
+   boost::shared_ptr<SLMInstance> pSLM =
+      deviceManager_->GetDeviceOfType<SLMInstance>(label);
 
-   int ret =  pGalvo->RunSequence();
+   mm::DeviceModuleLockGuard guard(pSLM);
+   {
+      // Banks are replaced under the device lock, so the check holds while
+      // the pattern is displayed
+      boost::mutex::scoped_lock lock(slmPatternBanksMutex_);
+      std::map< std::string, boost::shared_ptr<const SLMPatternBank> >::const_iterator
+         found = slmPatternBanks_.find(label);
+      if (found == slmPatternBanks_.end() ||
+            found->second->generation != bank->generation)
+         throw CMMError("The patterns of SLM " + ToQuotedString(label) +
+               " were replaced or cleared before pattern " +
+               ToString(patternIndex) + " could be displayed");
+   }
 
+   int ret;
+   if (bank->inDevice)
+   {
+      ret = pSLM->DisplaySLMPattern(patternIndex);
+   }
+   else
+   {
+      // The device copies the pixels; SetImage() merely lacks const
+      ret = pSLM->SetImage(const_cast<unsigned char*>(
+               &bank->patterns[patternIndex][0]));
+      if (ret == DEVICE_OK)
+         ret = pSLM->DisplayImage();
+   }
    if (ret != DEVICE_OK)
    {
-      logError(deviceLabel, getDeviceErrorText(ret, pGalvo).c_str());
-      throw CMMError(getDeviceErrorText(ret, pGalvo));
+      logError(label.c_str(), getDeviceErrorText(ret, pSLM).c_str());
+      throw CMMError(getDeviceErrorText(ret, pSLM));
    }
 }
 
-/**
- * Get the name of the active galvo channel (for a multi-laser galvo device).
- */
-string CMMCore::getGalvoChannel(const char* deviceLabel) throw (CMMError)
-{
-   boost::shared_ptr<GalvoInstance> pGalvo =
-      deviceManager_->GetDeviceOfType<GalvoInstance>(deviceLabel);
-
-   mm::DeviceModuleLockGuard guard(pGalvo);
-   return pGalvo->GetChannel();
-}
-
 /* SYSTEM STATE */
 
 
@@ -6652,6 +8822,13 @@ void CMMCore::saveSystemConfiguration(const char* fileName) throw (CMMError)
  * The remaining fields in the line will be used for corresponding command parameters.
  * The number of parameters depends on the actual command used.
  *
+ * Consecutive "Property" lines for devices are applied together: the lines
+ * for the devices of each device adapter module are applied in file order,
+ * but different modules are applied in parallel (see
+ * enableParallelConfigLoading()). If a line fails, the lines before it have
+ * been applied and those after it have not, as when applying them one by one,
+ * and the error refers to the earliest failing line.
+ *
  */
 void CMMCore::loadSystemConfiguration(const char* fileName) throw (CMMError)
 {
@@ -6686,6 +8863,245 @@ void CMMCore::loadSystemConfiguration(const char* fileName) throw (CMMError)
 }
 
 
+namespace {
+
+struct ConfigFileCommand
+{
+   int lineNumber;
+   std::string line;
+   std::vector<std::string> tokens;
+};
+
+// True for a "Property" command addressed to a device other than the Core
+bool IsDevicePropertyCommand(const ConfigFileCommand& cmd)
+{
+   return (cmd.tokens.size() == 3 || cmd.tokens.size() == 4) &&
+      cmd.tokens[0] == MM::g_CFGCommand_Property &&
+      cmd.tokens[1] != MM::g_Keyword_CoreDevice;
+}
+
+typedef std::vector< std::pair<boost::shared_ptr<DeviceInstance>,
+        const ConfigFileCommand*> > PropertyGroup;
+
+// Sets a property (name, value) of a device as CMMCore::setProperty() would
+typedef boost::function<void (boost::shared_ptr<DeviceInstance>,
+      const std::string&, const std::string&)> PropertySetter;
+
+// At most this many modules are applied at the same time
+const size_t g_MaxConfigLoadThreads = 8;
+
+// Hands out the per-module groups to the threads applying them, and keeps
+// the earliest failure. Once a line has failed, only earlier lines are still
+// applied, so that the outcome is that of applying the lines one by one.
+class PropertyGroupScheduler
+{
+   const std::vector<const PropertyGroup*>& groups_;
+   const PropertySetter& setProperty_;
+   boost::mutex mutex_;
+   size_t nextGroup_;
+   const ConfigFileCommand* failedCommand_;
+   boost::shared_ptr<CMMError> error_;
+
+public:
+   PropertyGroupScheduler(const std::vector<const PropertyGroup*>& groups,
+         const PropertySetter& setProperty) :
+      groups_(groups), setProperty_(setProperty), nextGroup_(0),
+      failedCommand_(0)
+   {}
+
+   const ConfigFileCommand* GetFailedCommand() const { return failedCommand_; }
+   const CMMError& GetError() const { return *error_; }
+
+   void Run()
+   {
+      for (;;)
+      {
+         const PropertyGroup* group;
+         {
+            boost::mutex::scoped_lock lock(mutex_);
+            if (nextGroup_ == groups_.size())
+               return;
+            group = groups_[nextGroup_++];
+         }
+         ApplyGroup(*group);
+      }
+   }
+
+private:
+   bool ShouldApply(const ConfigFileCommand* cmd)
+   {
+      boost::mutex::scoped_lock lock(mutex_);
+      return !failedCommand_ || cmd->lineNumber < failedCommand_->lineNumber;
+   }
+
+   void ApplyGroup(const PropertyGroup& group)
+   {
+      for (PropertyGroup::const_iterator it = group.begin(); it != group.end(); ++it)
+      {
+         if (!ShouldApply(it->second))
+            return;
+         const std::vector<std::string>& tokens = it->second->tokens;
+         try
+         {
+            setProperty_(it->first, tokens[2], tokens.size() == 4 ? tokens[3] : "");
+         }
+         catch (const CMMError& e)
+         {
+            boost::mutex::scoped_lock lock(mutex_);
+            if (!failedCommand_ || it->second->lineNumber < failedCommand_->lineNumber)
+            {
+               failedCommand_ = it->second;
+               error_.reset(new CMMError(e));
+            }
+            return;
+         }
+      }
+   }
+};
+
+/*
+ * Applies a run of device "Property" commands from a configuration file.
+ *
+ * Devices in one adapter module share a lock and may depend on each other, so
+ * the commands for each module are applied in file order, but (if parallel is
+ * true) different modules are handled in parallel. Each property is set with
+ * setProperty, which is expected to check the line and update the system
+ * state cache as CMMCore::setProperty() does.
+ *
+ * On error, failed is set to the offending command and the error is
+ * rethrown. As when the commands are applied one by one, the lines before it
+ * have been applied and those after it have not (except for lines already
+ * being applied at the time).
+ */
+void ApplyConfigFileProperties(mm::DeviceManager& deviceManager,
+      const ConfigFileCommand* begin, const ConfigFileCommand* end,
+      const PropertySetter& setProperty, bool parallel,
+      const ConfigFileCommand*& failed)
+{
+   typedef std::map< boost::shared_ptr<LoadedDeviceAdapter>, PropertyGroup > GroupMap;
+   GroupMap groupMap;
+   // Groups in order of their first line, so that earlier lines start first
+   std::vector<const PropertyGroup*> groups;
+   for (const ConfigFileCommand* cmd = begin; cmd != end; ++cmd)
+   {
+      failed = cmd;
+      boost::shared_ptr<DeviceInstance> device =
+         deviceManager.GetDevice(cmd->tokens[1]);
+      PropertyGroup& group = groupMap[device->GetAdapterModule()];
+      if (group.empty())
+         groups.push_back(&group);
+      group.push_back(std::make_pair(device, cmd));
+   }
+
+   PropertyGroupScheduler scheduler(groups, setProperty);
+   size_t threadCount = parallel ?
+      std::min(groups.size(), g_MaxConfigLoadThreads) : 1;
+   if (threadCount <= 1)
+   {
+      scheduler.Run();
+   }
+   else
+   {
+      boost::thread_group threads;
+      for (size_t n = 0; n < threadCount; ++n)
+         threads.create_thread(boost::bind(&PropertyGroupScheduler::Run, &scheduler));
+      threads.join_all();
+   }
+
+   if (scheduler.GetFailedCommand())
+   {
+      failed = scheduler.GetFailedCommand();
+      throw scheduler.GetError();
+   }
+}
+
+// Accumulates the time spent in each phase of configuration loading
+class ConfigLoadTimer
+{
+   long long phaseStartUs_;
+   std::vector<std::string> phases_;
+   std::map<std::string, double> phaseMs_;
+
+public:
+   ConfigLoadTimer() : phaseStartUs_(CDeviceUtils::GetMonotonicTimeUs()) {}
+
+   void EndPhase(const std::string& phase)
+   {
+      long long now = CDeviceUtils::GetMonotonicTimeUs();
+      if (phaseMs_.find(phase) == phaseMs_.end())
+         phases_.push_back(phase);
+      phaseMs_[phase] += (now - phaseStartUs_) / 1000.0;
+      phaseStartUs_ = now;
+   }
+
+   std::string Report() const
+   {
+      std::ostringstream os;
+      os << std::fixed << std::setprecision(1);
+      double total = 0.0;
+      for (std::vector<std::string>::const_iterator it = phases_.begin();
+            it != phases_.end(); ++it)
+      {
+         double ms = phaseMs_.find(*it)->second;
+         os << *it << " " << ms << " ms; ";
+         total += ms;
+      }
+      os << "total " << total << " ms";
+      return os.str();
+   }
+};
+
+} // anonymous namespace
+
+/**
+ * Scoped suppression of device property change notifications. Notifications
+ * arriving meanwhile are only counted; if there were any, a single
+ * onPropertiesChanged() is sent when the deferral ends.
+ */
+class CMMCore::PropertyCallbackDeferral
+{
+   CMMCore* core_;
+   bool active_;
+
+public:
+   explicit PropertyCallbackDeferral(CMMCore* core) : core_(core), active_(true)
+   {
+      boost::mutex::scoped_lock lock(core_->deferredCallbacksMutex_);
+      core_->deferPropertyCallbacks_ = true;
+      core_->deferredPropertyCallbacks_ = 0;
+   }
+
+   ~PropertyCallbackDeferral() { End(); }
+
+   void End()
+   {
+      if (!active_)
+         return;
+      active_ = false;
+      unsigned long deferred;
+      {
+         boost::mutex::scoped_lock lock(core_->deferredCallbacksMutex_);
+         core_->deferPropertyCallbacks_ = false;
+         deferred = core_->deferredPropertyCallbacks_;
+      }
+      if (deferred > 0 && core_->externalCallback_)
+         core_->eventDispatcher_->PostPropertiesChanged();
+   }
+};
+
+/**
+ * Called by CoreCallback on a property change notification from a device.
+ * Returns true if processing of the notification should be skipped.
+ */
+bool CMMCore::deferPropertyCallback()
+{
+   boost::mutex::scoped_lock lock(deferredCallbacksMutex_);
+   if (!deferPropertyCallbacks_)
+      return false;
+   ++deferredPropertyCallbacks_;
+   return true;
+}
+
 void CMMCore::loadSystemConfigurationImpl(const char* fileName) throw (CMMError)
 {
    if (!fileName)
@@ -6700,10 +9116,13 @@ void CMMCore::loadSystemConfigurationImpl(const char* fileName) throw (CMMError)
             MMERR_FileOpenFailed);
    }
 
-   // Process commands
+   ConfigLoadTimer timer;
+
+   // Read the whole file first, so that a truncated or unreadable file is
+   // noticed before any device is touched
+   std::vector<ConfigFileCommand> commands;
    const int maxLineLength = 4 * MM::MaxStrLength + 4; // accommodate up to 4 strings and delimiters
    char line[maxLineLength+1];
-   vector<string> tokens;
 
    int lineCount = 0;
 
@@ -6722,190 +9141,223 @@ void CMMCore::loadSystemConfigurationImpl(const char* fileName) throw (CMMError)
             continue;
          }
 
-         // parse tokens
-         tokens.clear();
-         CDeviceUtils::Tokenize(line, tokens, MM::g_FieldDelimiters);
+         ConfigFileCommand cmd;
+         cmd.lineNumber = lineCount;
+         cmd.line = line;
+         CDeviceUtils::Tokenize(line, cmd.tokens, MM::g_FieldDelimiters);
+         commands.push_back(cmd);
+      }
+   }
+   timer.EndPhase("Parse");
 
-         try
+   // Property change notifications from devices are not processed while
+   // loading; the state cache is refreshed once at the end instead
+   PropertyCallbackDeferral deferral(this);
+
+   for (size_t i = 0; i < commands.size(); )
+   {
+      const ConfigFileCommand* failed = &commands[i];
+      try
+      {
+         if (IsDevicePropertyCommand(commands[i]))
          {
+            // Apply the whole run of device properties at once
+            size_t runEnd = i;
+            while (runEnd < commands.size() && IsDevicePropertyCommand(commands[runEnd]))
+               ++runEnd;
+            ApplyConfigFileProperties(*deviceManager_, &commands[i],
+                  &commands[0] + runEnd,
+                  boost::bind(&CMMCore::setConfigFileProperty, this, _1, _2, _3),
+                  parallelConfigLoading_, failed);
+            i = runEnd;
+            timer.EndPhase("Device properties");
+            continue;
+         }
 
-            // non-empty and non-comment lines mush have at least one token
-            if (tokens.size() < 1)
+         const ConfigFileCommand& cmd = commands[i];
+         ++i;
+
+         // non-empty and non-comment lines mush have at least one token
+         if (cmd.tokens.size() < 1)
+            throw CMMError(getCoreErrorText(MMERR_InvalidCFGEntry) + " (" +
+                  ToQuotedString(cmd.line) + ")",
+                  MMERR_InvalidCFGEntry);
+
+         if(cmd.tokens[0].compare(MM::g_CFGCommand_Device) == 0)
+         {
+            // load device command
+            // -------------------
+            if (cmd.tokens.size() != 4)
                throw CMMError(getCoreErrorText(MMERR_InvalidCFGEntry) + " (" +
-                     ToQuotedString(line) + ")",
+                     ToQuotedString(cmd.line) + ")",
                      MMERR_InvalidCFGEntry);
-
-            if(tokens[0].compare(MM::g_CFGCommand_Device) == 0)
-            {
-               // load device command
-               // -------------------
-               if (tokens.size() != 4)
-                  throw CMMError(getCoreErrorText(MMERR_InvalidCFGEntry) + " (" +
-                        ToQuotedString(line) + ")",
-                        MMERR_InvalidCFGEntry);
-               loadDevice(tokens[1].c_str(), tokens[2].c_str(), tokens[3].c_str());
-            }
-            else if(tokens[0].compare(MM::g_CFGCommand_Property) == 0)
-            {
-               // set property command
-               // --------------------
-               if (tokens.size() == 4)
-                  setProperty(tokens[1].c_str(), tokens[2].c_str(), tokens[3].c_str());
-               else if (tokens.size() == 3)
-                  // ...assuming here that the last missing toke represents an empty string
-                  setProperty(tokens[1].c_str(), tokens[2].c_str(), "");
-               else
-                  throw CMMError(getCoreErrorText(MMERR_InvalidCFGEntry) + " (" +
-                        ToQuotedString(line) + ")",
-                        MMERR_InvalidCFGEntry);
-            }
-            else if(tokens[0].compare(MM::g_CFGCommand_Delay) == 0)
-            {
-               // set delay command
-               // -----------------
-               if (tokens.size() != 3)
-                  throw CMMError(getCoreErrorText(MMERR_InvalidCFGEntry) + " (" +
-                        ToQuotedString(line) + ")",
-                        MMERR_InvalidCFGEntry);
-               setDeviceDelayMs(tokens[1].c_str(), atof(tokens[2].c_str()));
-            }
-            else if(tokens[0].compare(MM::g_CFGCommand_FocusDirection) == 0)
-            {
-               // set focus direction command
-               // ---------------------------
-               if (tokens.size() != 3)
-                  throw CMMError(getCoreErrorText(MMERR_InvalidCFGEntry) + " (" +
-                        ToQuotedString(line) + ")",
-                        MMERR_InvalidCFGEntry);
-               setFocusDirection(tokens[1].c_str(), atol(tokens[2].c_str()));
-            }
-            else if(tokens[0].compare(MM::g_CFGCommand_Label) == 0)
-            {
-               // define label command
-               // --------------------
-               if (tokens.size() != 4)
-                  throw CMMError(getCoreErrorText(MMERR_InvalidCFGEntry) + " (" +
-                        ToQuotedString(line) + ")",
-                        MMERR_InvalidCFGEntry);
-               defineStateLabel(tokens[1].c_str(), atol(tokens[2].c_str()), tokens[3].c_str());
-            }
-            else if(tokens[0].compare(MM::g_CFGCommand_Configuration) == 0)
-            {
-               // define configuration command
-               // ----------------------------
-               if (tokens.size() != 5)
-                  throw CMMError(getCoreErrorText(MMERR_InvalidCFGEntry) + " (" +
-                        ToQuotedString(line) + ")",
-                        MMERR_InvalidCFGEntry);
-               LOG_WARNING(coreLogger_) << "Obsolete command " << tokens[0] <<
-                  " ignored in configuration file";
-            }
-            else if(tokens[0].compare(MM::g_CFGCommand_ConfigGroup) == 0)
-            {
-               // define grouped configuration command
-               // ------------------------------------
-               if (tokens.size() == 6)
-                  defineConfig(tokens[1].c_str(), tokens[2].c_str(), tokens[3].c_str(), tokens[4].c_str(), tokens[5].c_str());
-               else if (tokens.size() == 5)
-               {
-                  // we will assume here that the last (missing) token is representing an empty string
-                  defineConfig(tokens[1].c_str(), tokens[2].c_str(), tokens[3].c_str(), tokens[4].c_str(), "");
-               }
-               else if (tokens.size() == 2)
-                  defineConfigGroup(tokens[1].c_str());
-               else
-                  throw CMMError(getCoreErrorText(MMERR_InvalidCFGEntry) + " (" +
-                        ToQuotedString(line) + ")",
-                        MMERR_InvalidCFGEntry);
-            }
-            else if(tokens[0].compare(MM::g_CFGCommand_ConfigPixelSize) == 0)
-            {
-               // define pixel size configuration command
-               // ---------------------------------------
-               if (tokens.size() == 5)
-                  definePixelSizeConfig(tokens[1].c_str(), tokens[2].c_str(), tokens[3].c_str(), tokens[4].c_str());
-               else
-                  throw CMMError(getCoreErrorText(MMERR_InvalidCFGEntry) + " (" +
-                        ToQuotedString(line) + ")",
-                        MMERR_InvalidCFGEntry);
-            }
-            else if(tokens[0].compare(MM::g_CFGCommand_PixelSize_um) == 0)
+            loadDevice(cmd.tokens[1].c_str(), cmd.tokens[2].c_str(), cmd.tokens[3].c_str());
+         }
+         else if(cmd.tokens[0].compare(MM::g_CFGCommand_Property) == 0)
+         {
+            // set property command
+            // --------------------
+            if (cmd.tokens.size() == 4)
+               setProperty(cmd.tokens[1].c_str(), cmd.tokens[2].c_str(), cmd.tokens[3].c_str());
+            else if (cmd.tokens.size() == 3)
+               // ...assuming here that the last missing toke represents an empty string
+               setProperty(cmd.tokens[1].c_str(), cmd.tokens[2].c_str(), "");
+            else
+               throw CMMError(getCoreErrorText(MMERR_InvalidCFGEntry) + " (" +
+                     ToQuotedString(cmd.line) + ")",
+                     MMERR_InvalidCFGEntry);
+         }
+         else if(cmd.tokens[0].compare(MM::g_CFGCommand_Delay) == 0)
+         {
+            // set delay command
+            // -----------------
+            if (cmd.tokens.size() != 3)
+               throw CMMError(getCoreErrorText(MMERR_InvalidCFGEntry) + " (" +
+                     ToQuotedString(cmd.line) + ")",
+                     MMERR_InvalidCFGEntry);
+            setDeviceDelayMs(cmd.tokens[1].c_str(), atof(cmd.tokens[2].c_str()));
+         }
+         else if(cmd.tokens[0].compare(MM::g_CFGCommand_FocusDirection) == 0)
+         {
+            // set focus direction command
+            // ---------------------------
+            if (cmd.tokens.size() != 3)
+               throw CMMError(getCoreErrorText(MMERR_InvalidCFGEntry) + " (" +
+                     ToQuotedString(cmd.line) + ")",
+                     MMERR_InvalidCFGEntry);
+            setFocusDirection(cmd.tokens[1].c_str(), atol(cmd.tokens[2].c_str()));
+         }
+         else if(cmd.tokens[0].compare(MM::g_CFGCommand_Label) == 0)
+         {
+            // define label command
+            // --------------------
+            if (cmd.tokens.size() != 4)
+               throw CMMError(getCoreErrorText(MMERR_InvalidCFGEntry) + " (" +
+                     ToQuotedString(cmd.line) + ")",
+                     MMERR_InvalidCFGEntry);
+            defineStateLabel(cmd.tokens[1].c_str(), atol(cmd.tokens[2].c_str()), cmd.tokens[3].c_str());
+         }
+         else if(cmd.tokens[0].compare(MM::g_CFGCommand_Configuration) == 0)
+         {
+            // define configuration command
+            // ----------------------------
+            if (cmd.tokens.size() != 5)
+               throw CMMError(getCoreErrorText(MMERR_InvalidCFGEntry) + " (" +
+                     ToQuotedString(cmd.line) + ")",
+                     MMERR_InvalidCFGEntry);
+            LOG_WARNING(coreLogger_) << "Obsolete command " << cmd.tokens[0] <<
+               " ignored in configuration file";
+         }
+         else if(cmd.tokens[0].compare(MM::g_CFGCommand_ConfigGroup) == 0)
+         {
+            // define grouped configuration command
+            // ------------------------------------
+            if (cmd.tokens.size() == 6)
+               defineConfig(cmd.tokens[1].c_str(), cmd.tokens[2].c_str(), cmd.tokens[3].c_str(), cmd.tokens[4].c_str(), cmd.tokens[5].c_str());
+            else if (cmd.tokens.size() == 5)
             {
-               // set pixel size
-               // --------------
-               if (tokens.size() == 3)
-                  setPixelSizeUm(tokens[1].c_str(), atof(tokens[2].c_str()));
-               else
-                  throw CMMError(getCoreErrorText(MMERR_InvalidCFGEntry) + " (" +
-                        ToQuotedString(line) + ")",
-                        MMERR_InvalidCFGEntry);
+               // we will assume here that the last (missing) token is representing an empty string
+               defineConfig(cmd.tokens[1].c_str(), cmd.tokens[2].c_str(), cmd.tokens[3].c_str(), cmd.tokens[4].c_str(), "");
             }
-            else if(tokens[0].compare(MM::g_CFGCommand_PixelSizeAffine) == 0)
+            else if (cmd.tokens.size() == 2)
+               defineConfigGroup(cmd.tokens[1].c_str());
+            else
+               throw CMMError(getCoreErrorText(MMERR_InvalidCFGEntry) + " (" +
+                     ToQuotedString(cmd.line) + ")",
+                     MMERR_InvalidCFGEntry);
+         }
+         else if(cmd.tokens[0].compare(MM::g_CFGCommand_ConfigPixelSize) == 0)
+         {
+            // define pixel size configuration command
+            // ---------------------------------------
+            if (cmd.tokens.size() == 5)
+               definePixelSizeConfig(cmd.tokens[1].c_str(), cmd.tokens[2].c_str(), cmd.tokens[3].c_str(), cmd.tokens[4].c_str());
+            else
+               throw CMMError(getCoreErrorText(MMERR_InvalidCFGEntry) + " (" +
+                     ToQuotedString(cmd.line) + ")",
+                     MMERR_InvalidCFGEntry);
+         }
+         else if(cmd.tokens[0].compare(MM::g_CFGCommand_PixelSize_um) == 0)
+         {
+            // set pixel size
+            // --------------
+            if (cmd.tokens.size() == 3)
+               setPixelSizeUm(cmd.tokens[1].c_str(), atof(cmd.tokens[2].c_str()));
+            else
+               throw CMMError(getCoreErrorText(MMERR_InvalidCFGEntry) + " (" +
+                     ToQuotedString(cmd.line) + ")",
+                     MMERR_InvalidCFGEntry);
+         }
+         else if(cmd.tokens[0].compare(MM::g_CFGCommand_PixelSizeAffine) == 0)
+         {
+            // set affine transform
+            // --------------
+            //
+            if (cmd.tokens.size() == 8)
             {
-               // set affine transform
-               // --------------
-               //
-               if (tokens.size() == 8)
+               std::vector<double> *affineT = new std::vector<double>(6);
+               for (int i = 0; i < 6; i++)
                {
-                  std::vector<double> *affineT = new std::vector<double>(6);
-                  for (int i = 0; i < 6; i++)
-                  {
-                     affineT->at(i) = atof(tokens[i + 2].c_str());
-                  }
-                  setPixelSizeAffine(tokens[1].c_str(), *affineT);
-                  delete affineT;
+                  affineT->at(i) = atof(cmd.tokens[i + 2].c_str());
                }
-               else
-                  throw CMMError(getCoreErrorText(MMERR_InvalidCFGEntry) + " (" +
-                        ToQuotedString(line) + ")",
-                        MMERR_InvalidCFGEntry);
-            }
-            else if(tokens[0].compare(MM::g_CFGCommand_Equipment) == 0)
-            {
-               // define configuration command
-               // ----------------------------
-               if (tokens.size() != 4)
-                  throw CMMError(getCoreErrorText(MMERR_InvalidCFGEntry) + " (" +
-                        ToQuotedString(line) + ")",
-                        MMERR_InvalidCFGEntry);
-               definePropertyBlock(tokens[1].c_str(), tokens[2].c_str(), tokens[3].c_str());
-            }
-            else if(tokens[0].compare(MM::g_CFGCommand_ImageSynchro) == 0)
-            {
-               // define image synchro
-               // --------------------
-               if (tokens.size() != 2)
-                  throw CMMError(getCoreErrorText(MMERR_InvalidCFGEntry) + " (" +
-                        ToQuotedString(line) + ")",
-                        MMERR_InvalidCFGEntry);
-               assignImageSynchro(tokens[1].c_str());
-            }
-            else if(tokens[0].compare(MM::g_CFGCommand_ParentID) == 0)
-            {
-               // set parent ID
-               // -------------
-               if (tokens.size() != 3)
-                  throw CMMError(getCoreErrorText(MMERR_InvalidCFGEntry) + " (" +
-                        ToQuotedString(line) + ")",
-                        MMERR_InvalidCFGEntry);
-
-               setParentLabel(tokens[1].c_str(), tokens[2].c_str());
+               setPixelSizeAffine(cmd.tokens[1].c_str(), *affineT);
+               delete affineT;
             }
-
+            else
+               throw CMMError(getCoreErrorText(MMERR_InvalidCFGEntry) + " (" +
+                     ToQuotedString(cmd.line) + ")",
+                     MMERR_InvalidCFGEntry);
+         }
+         else if(cmd.tokens[0].compare(MM::g_CFGCommand_Equipment) == 0)
+         {
+            // define configuration command
+            // ----------------------------
+            if (cmd.tokens.size() != 4)
+               throw CMMError(getCoreErrorText(MMERR_InvalidCFGEntry) + " (" +
+                     ToQuotedString(cmd.line) + ")",
+                     MMERR_InvalidCFGEntry);
+            definePropertyBlock(cmd.tokens[1].c_str(), cmd.tokens[2].c_str(), cmd.tokens[3].c_str());
+         }
+         else if(cmd.tokens[0].compare(MM::g_CFGCommand_ImageSynchro) == 0)
+         {
+            // define image synchro
+            // --------------------
+            if (cmd.tokens.size() != 2)
+               throw CMMError(getCoreErrorText(MMERR_InvalidCFGEntry) + " (" +
+                     ToQuotedString(cmd.line) + ")",
+                     MMERR_InvalidCFGEntry);
+            assignImageSynchro(cmd.tokens[1].c_str());
          }
-         catch (CMMError& err)
+         else if(cmd.tokens[0].compare(MM::g_CFGCommand_ParentID) == 0)
          {
-            if (externalCallback_)
-               externalCallback_->onSystemConfigurationLoaded();
-            std::ostringstream errorText;
-            errorText << "Line " << lineCount << ": " << line << endl;
-            errorText << err.getFullMsg() << endl << endl;
-            throw CMMError(errorText.str().c_str(), MMERR_InvalidConfigurationFile);
+            // set parent ID
+            // -------------
+            if (cmd.tokens.size() != 3)
+               throw CMMError(getCoreErrorText(MMERR_InvalidCFGEntry) + " (" +
+                     ToQuotedString(cmd.line) + ")",
+                     MMERR_InvalidCFGEntry);
+
+            setParentLabel(cmd.tokens[1].c_str(), cmd.tokens[2].c_str());
          }
+
+         if (cmd.tokens[0].compare(MM::g_CFGCommand_Property) == 0)
+            timer.EndPhase("Core properties");
+         else
+            timer.EndPhase(cmd.tokens[0]);
+      }
+      catch (CMMError& err)
+      {
+         if (externalCallback_)
+            eventDispatcher_->PostSystemConfigurationLoaded();
+         std::ostringstream errorText;
+         errorText << "Line " << failed->lineNumber << ": " << failed->line << endl;
+         errorText << err.getFullMsg() << endl << endl;
+         throw CMMError(errorText.str().c_str(), MMERR_InvalidConfigurationFile);
       }
    }
 
    updateAllowedChannelGroups();
+   timer.EndPhase("Definitions");
 
    // file parsing finished, try to set startup configuration
    if (isConfigDefined(MM::g_CFGGroup_System, MM::g_CFGGroup_System_Startup))
@@ -6916,25 +9368,41 @@ void CMMCore::loadSystemConfigurationImpl(const char* fileName) throw (CMMError)
       updateSystemStateCache();
 
       this->setConfig(MM::g_CFGGroup_System, MM::g_CFGGroup_System_Startup);
+      timer.EndPhase("Startup configuration");
    }
 
    waitForSystem();
    updateSystemStateCache();
+   deferral.End();
+   timer.EndPhase("State cache refresh");
+
+   LOG_INFO(coreLogger_) << "Loaded " << commands.size() <<
+      " configuration commands from " << fileName << ": " << timer.Report();
 
    if (externalCallback_)
    {
-      externalCallback_->onSystemConfigurationLoaded();
+      eventDispatcher_->PostSystemConfigurationLoaded();
    }
 }
 
-
 /**
  * Register a callback (listener class).
- * MMCore will send notifications on internal events using this interface
+ * MMCore will send notifications on internal events using this interface.
+ *
+ * Notifications are delivered on a thread owned by the core, one at a time
+ * and in the order they were posted, so that a slow listener does not hold
+ * up the devices reporting the changes. A notification that is superseded
+ * before it is delivered (for example, by a newer position of the same
+ * stage) is dropped, and the newer one takes its place at the end of the
+ * queue. Notifications still pending when the callback is replaced are
+ * delivered to the new callback. Unless called from within a notification,
+ * this function returns only once the previous callback is no longer being
+ * called, so that it can then be destroyed.
  */
 void CMMCore::registerCallback(MMEventCallback* cb)
 {
    externalCallback_ = cb;
+   eventDispatcher_->SetCallback(cb);
 }
 
 
@@ -7228,6 +9696,11 @@ void CMMCore::InitializeErrorMessages()
    errorText_[MMERR_NullPointerException] = "Null Pointer Exception.";
    errorText_[MMERR_CreatePeripheralFailed] = "Hub failed to create specified peripheral device.";
    errorText_[MMERR_BadAffineTransform] = "Bad affine transform.  Affine transforms need to have 6 numbers; 2 rows of 3 column.";
+   errorText_[MMERR_StreamToDiskFailed] = "Streaming to disk failed.";
+   errorText_[MMERR_ImageNotInBuffer] = "No image with the requested coordinates is in the circular buffer.";
+   errorText_[MMERR_InvalidDeviceHandle] = "The device referred to by the handle has been unloaded.";
+   errorText_[MMERR_CircularBufferImagesPinned] =
+      "The circular buffer cannot be reallocated while images are pinned; release them first.";
 }
 
 void CMMCore::CreateCoreProperties()
@@ -7391,7 +9864,7 @@ void CMMCore::applyConfiguration(const Configuration& config) throw (CMMError)
          properties_->Execute(setting.getPropertyName().c_str(), setting.getPropertyValue().c_str());
          {
             MMThreadGuard scg(stateCacheLock_);
-            stateCache_.addSetting(PropertySetting(MM::g_Keyword_CoreDevice, setting.getPropertyName().c_str(), setting.getPropertyValue().c_str()));
+            addStateCacheSetting(PropertySetting(MM::g_Keyword_CoreDevice, setting.getPropertyName().c_str(), setting.getPropertyValue().c_str()));
          }
       }
       else
@@ -7407,7 +9880,7 @@ void CMMCore::applyConfiguration(const Configuration& config) throw (CMMError)
 
             {
                MMThreadGuard scg(stateCacheLock_);
-               stateCache_.addSetting(setting);
+               addStateCacheSetting(setting);
             }
          }
          catch (const CMMError&)
@@ -7454,7 +9927,7 @@ int CMMCore::applyProperties(vector<PropertySetting>& props, string& lastError)
 
          {
             MMThreadGuard scg(stateCacheLock_);
-            stateCache_.addSetting(props[i]);
+            addStateCacheSetting(props[i]);
          }
       }
       catch (const CMMError& e)
@@ -56,13 +56,18 @@
 #include "../MMDevice/DeviceThreads.h"
 #include "../MMDevice/MMDevice.h"
 #include "../MMDevice/MMDeviceConstants.h"
+#include "AcquisitionPlan.h"
+#include "AsyncCommand.h"
 #include "Configuration.h"
 #include "CoreUtils.h"
+#include "DeviceHandle.h"
 #include "Error.h"
 #include "ErrorCodes.h"
 #include "Logging/Logger.h"
 
 #include <boost/shared_ptr.hpp>
+#include <boost/thread/condition_variable.hpp>
+#include <boost/thread/mutex.hpp>
 #include <boost/weak_ptr.hpp>
 
 #include <cstring>
@@ -94,6 +99,7 @@ class MMEventCallback;
 class Metadata;
 class PixelSizeConfigGroup;
 class PropertyBlock;
+class ThreadPool;
 
 class AutoFocusInstance;
 class CameraInstance;
@@ -108,7 +114,13 @@ class XYStageInstance;
 class CMMCore;
 
 namespace mm {
+   class AcquisitionStatistics;
+   class DeviceCommandExecutor;
    class DeviceManager;
+   class DiskStreamSink;
+   class EventDispatcher;
+   class FrameAccumulator;
+   class SequenceStreamer;
    class LogManager;
 } // namespace mm
 
@@ -167,6 +179,8 @@ public:
    void loadSystemState(const char* fileName) throw (CMMError);
    void saveSystemConfiguration(const char* fileName) throw (CMMError);
    void loadSystemConfiguration(const char* fileName) throw (CMMError);
+   void enableParallelConfigLoading(bool enable);
+   bool parallelConfigLoadingEnabled();
    void registerCallback(MMEventCallback* cb);
    ///@}
 
@@ -195,6 +209,8 @@ public:
    MMCORE_DEPRECATED(static void addSearchPath(const char *path));
 
    std::vector<std::string> getDeviceAdapterNames() throw (CMMError);
+   void setDeviceAdapterIndexFile(const char* filename) throw (CMMError);
+   std::string getDeviceAdapterIndexFile() const;
    MMCORE_DEPRECATED(static std::vector<std::string> getDeviceLibraries() throw (CMMError));
 
    std::vector<std::string> getAvailableDevices(const char* library) throw (CMMError);
@@ -213,6 +229,7 @@ public:
    std::string getDeviceLibrary(const char* label) throw (CMMError);
    std::string getDeviceName(const char* label) throw (CMMError);
    std::string getDeviceDescription(const char* label) throw (CMMError);
+   DeviceHandle getDeviceHandle(const char* label) throw (CMMError);
 
    std::vector<std::string> getDevicePropertyNames(const char* label) throw (CMMError);
    bool hasProperty(const char* label, const char* propName) throw (CMMError);
@@ -222,6 +239,8 @@ public:
    void setProperty(const char* label, const char* propName, const long propValue) throw (CMMError);
    void setProperty(const char* label, const char* propName, const float propValue) throw (CMMError);
    void setProperty(const char* label, const char* propName, const double propValue) throw (CMMError);
+   std::string getProperty(const DeviceHandle& device, const char* propName) throw (CMMError);
+   void setProperty(const DeviceHandle& device, const char* propName, const char* propValue) throw (CMMError);
 
    std::vector<std::string> getAllowedPropertyValues(const char* label, const char* propName) throw (CMMError);
    bool isPropertyReadOnly(const char* label, const char* propName) throw (CMMError);
@@ -235,10 +254,15 @@ public:
    void startPropertySequence(const char* label, const char* propName) throw (CMMError);
    void stopPropertySequence(const char* label, const char* propName) throw (CMMError);
    long getPropertySequenceMaxLength(const char* label, const char* propName) throw (CMMError);
-   void loadPropertySequence(const char* label, const char* propName, std::vector<std::string> eventSequence) throw (CMMError);
+   void loadPropertySequence(const char* label, const char* propName, const std::vector<std::string>& eventSequence) throw (CMMError);
+   void loadPropertySequence(const char* label, const char* propName, const std::vector<double>& valueSequence) throw (CMMError);
+   void loadPropertySequence(const char* label, const char* propName, const std::vector<long>& valueSequence) throw (CMMError);
+   bool isPropertySequenceStreamable(const char* label, const char* propName) throw (CMMError);
 
    bool deviceBusy(const char* label) throw (CMMError);
    void waitForDevice(const char* label) throw (CMMError);
+   bool deviceBusy(const DeviceHandle& device) throw (CMMError);
+   void waitForDevice(const DeviceHandle& device) throw (CMMError);
    void waitForConfig(const char* group, const char* configName) throw (CMMError);
    bool systemBusy() throw (CMMError);
    void waitForSystem() throw (CMMError);
@@ -286,6 +310,8 @@ public:
    ///@{
    Configuration getSystemStateCache() const;
    void updateSystemStateCache();
+   long getSystemStateCacheGeneration() const;
+   std::string getSystemStateCacheSnapshot() const;
    std::string getPropertyFromCache(const char* deviceLabel,
          const char* propName) const throw (CMMError);
    std::string getCurrentConfigFromCache(const char* groupName) throw (CMMError);
@@ -418,6 +444,29 @@ public:
    void* getNBeforeLastImageMD(unsigned long n, Metadata& md)
       const throw (CMMError);
    void* popNextImageMD(Metadata& md) throw (CMMError);
+   void* popNextImagePinned(unsigned channel, Metadata& md) throw (CMMError);
+   void* getLastImagePinned(unsigned channel, Metadata& md) throw (CMMError);
+   long getPinnedImageByteCount(const void* pixels) const throw (CMMError);
+   void releasePinnedImage(const void* pixels) throw (CMMError);
+   void enableCircularBufferCoordinateIndex(bool enable);
+   bool isCircularBufferCoordinateIndexEnabled() const;
+   bool hasImageAtCoordinates(long position, long channel, long slice,
+         long frame) const;
+   bool hasImageAtCoordinates(const char* cameraLabel, long position,
+         long channel, long slice, long frame) const;
+   void* getImageAtCoordinatesMD(long position, long channel, long slice,
+         long frame, Metadata& md) const throw (CMMError);
+   void* getImageAtCoordinatesMD(const char* cameraLabel, long position,
+         long channel, long slice, long frame, Metadata& md) const
+      throw (CMMError);
+   void* getImageAtCoordinatesPinned(long position, long channel, long slice,
+         long frame, Metadata& md) throw (CMMError);
+   void* getImageAtCoordinatesPinned(const char* cameraLabel, long position,
+         long channel, long slice, long frame, Metadata& md)
+      throw (CMMError);
+   long getPinnedImageCount() const;
+   void popNextImageIntoBuffer(void* pixelBuffer, long pixelBufferSize,
+         unsigned channel, Metadata& md) throw (CMMError);
 
    long getRemainingImageCount();
    long getBufferTotalCapacity();
@@ -427,13 +476,47 @@ public:
    unsigned getCircularBufferMemoryFootprint();
    void initializeCircularBuffer() throw (CMMError);
    void clearCircularBuffer() throw (CMMError);
+   void setCircularBufferOverflowPolicy(const char* policy) throw (CMMError);
+   std::string getCircularBufferOverflowPolicy() const;
+   void setCircularBufferOverflowBlockTimeoutMs(long timeoutMs) throw (CMMError);
+   long getCircularBufferOverflowBlockTimeoutMs() const;
+   void setCircularBufferSpillDirectory(const char* directory);
+   std::string getCircularBufferSpillDirectory() const;
+   long getCircularBufferDroppedImageCount() const;
+   long getCircularBufferSpilledImageCount() const;
+
+   void startStreamToDisk(const char* directory, const char* prefix)
+      throw (CMMError);
+   void startStreamToDisk(const char* directory, const char* prefix,
+         long maxFileSizeMB, unsigned queueSizeMB) throw (CMMError);
+   void stopStreamToDisk() throw (CMMError);
+   bool isStreamingToDisk() const;
+   long getStreamToDiskImageCount() const;
+   long getStreamToDiskDroppedImageCount() const;
+   double getStreamToDiskThroughputMBPerSecond() const;
+   double getStreamToDiskMeanLatencyMs() const;
+   double getStreamToDiskMaxLatencyMs() const;
+
+   void setFrameAccumulation(const char* mode, long frameCount)
+      throw (CMMError);
+   std::string getFrameAccumulationMode() const;
+   long getFrameAccumulationCount() const;
+
+   std::string getAcquisitionStatistics() const;
+   void resetAcquisitionStatistics();
+   void startAcquisitionTrace(long maxEvents) throw (CMMError);
+   void saveAcquisitionTrace(const char* filename) throw (CMMError);
+
+   void compileAcquisitionPlan(AcquisitionPlan& plan) throw (CMMError);
+   void runAcquisitionPlan(AcquisitionPlan& plan) throw (CMMError);
+   void stopAcquisitionPlan();
 
    bool isExposureSequenceable(const char* cameraLabel) throw (CMMError);
    void startExposureSequence(const char* cameraLabel) throw (CMMError);
    void stopExposureSequence(const char* cameraLabel) throw (CMMError);
    long getExposureSequenceMaxLength(const char* cameraLabel) throw (CMMError);
    void loadExposureSequence(const char* cameraLabel,
-         std::vector<double> exposureSequence_ms) throw (CMMError);
+         const std::vector<double>& exposureSequence_ms) throw (CMMError);
    ///@}
 
    /** \name Autofocus control. */
@@ -475,6 +558,8 @@ public:
    void setPosition(double position) throw (CMMError);
    double getPosition(const char* stageLabel) throw (CMMError);
    double getPosition() throw (CMMError);
+   void setPosition(const DeviceHandle& stage, double position) throw (CMMError);
+   double getPosition(const DeviceHandle& stage) throw (CMMError);
    void setRelativePosition(const char* stageLabel, double d) throw (CMMError);
    void setRelativePosition(double d) throw (CMMError);
    void setOrigin(const char* stageLabel) throw (CMMError);
@@ -491,7 +576,8 @@ public:
    void stopStageSequence(const char* stageLabel) throw (CMMError);
    long getStageSequenceMaxLength(const char* stageLabel) throw (CMMError);
    void loadStageSequence(const char* stageLabel,
-         std::vector<double> positionSequence) throw (CMMError);
+         const std::vector<double>& positionSequence) throw (CMMError);
+   bool isStageSequenceStreamable(const char* stageLabel) throw (CMMError);
    void setStageLinearSequence(const char* stageLabel, double dZ_um, int nSlices) throw (CMMError);
    ///@}
 
@@ -506,6 +592,10 @@ public:
    void getXYPosition(const char* xyStageLabel,
          double &x_stage, double &y_stage) throw (CMMError);
    void getXYPosition(double &x_stage, double &y_stage) throw (CMMError);
+   void setXYPosition(const DeviceHandle& xyStage,
+         double x, double y) throw (CMMError);
+   void getXYPosition(const DeviceHandle& xyStage,
+         double &x_stage, double &y_stage) throw (CMMError);
    double getXPosition(const char* xyStageLabel) throw (CMMError);
    double getYPosition(const char* xyStageLabel) throw (CMMError);
    double getXPosition() throw (CMMError);
@@ -527,8 +617,8 @@ public:
    void stopXYStageSequence(const char* xyStageLabel) throw (CMMError);
    long getXYStageSequenceMaxLength(const char* xyStageLabel) throw (CMMError);
    void loadXYStageSequence(const char* xyStageLabel,
-         std::vector<double> xSequence,
-         std::vector<double> ySequence) throw (CMMError);
+         const std::vector<double>& xSequence,
+         const std::vector<double>& ySequence) throw (CMMError);
    ///@}
 
    /** \name Serial port control. */
@@ -579,6 +669,17 @@ public:
    void stopSLMSequence(const char* slmLabel) throw (CMMError);
    void loadSLMSequence(const char* slmLabel,
          std::vector<unsigned char*> imageSequence) throw (CMMError);
+
+   void loadSLMPatternBank(const char* slmLabel,
+         std::vector<unsigned char*> patterns) throw (CMMError);
+   long getSLMPatternBankSize(const char* slmLabel) throw (CMMError);
+   void clearSLMPatternBank(const char* slmLabel) throw (CMMError);
+   void displaySLMPattern(const char* slmLabel, long patternIndex)
+      throw (CMMError);
+   AsyncCommand displaySLMPatternAsync(const char* slmLabel,
+         long patternIndex) throw (CMMError);
+   void loadSLMPatternSequence(const char* slmLabel,
+         const std::vector<long>& patternIndices) throw (CMMError);
    ///@}
 
    /** \name Galvo control.
@@ -604,6 +705,11 @@ public:
          double x, double y) throw (CMMError);
    void deleteGalvoPolygons(const char* galvoLabel) throw (CMMError);
    void loadGalvoPolygons(const char* galvoLabel) throw (CMMError);
+   void loadGalvoPolygons(const char* galvoLabel,
+         const std::vector<double>& xs, const std::vector<double>& ys,
+         const std::vector<long>& vertexCounts,
+         const std::vector<double>& dwellTimes_us,
+         const std::vector<long>& repetitions) throw (CMMError);
    void setGalvoPolygonRepetitions(const char* galvoLabel, int repetitions)
       throw (CMMError);
    void runGalvoPolygons(const char* galvoLabel) throw (CMMError);
@@ -611,6 +717,35 @@ public:
    std::string getGalvoChannel(const char* galvoLabel) throw (CMMError);
    ///@}
 
+   /** \name Asynchronous device commands.
+    *
+    * These return once the command is queued. Commands to the same device
+    * are executed in order; commands to different devices overlap.
+    */
+   ///@{
+   AsyncCommand setPositionAsync(const char* stageLabel, double position)
+      throw (CMMError);
+   AsyncCommand setXYPositionAsync(const char* xyStageLabel,
+         double x, double y) throw (CMMError);
+   AsyncCommand setStateAsync(const char* stateDeviceLabel, long state)
+      throw (CMMError);
+   AsyncCommand setShutterOpenAsync(const char* shutterLabel, bool state)
+      throw (CMMError);
+   AsyncCommand setPropertyAsync(const char* label, const char* propName,
+         const char* propValue) throw (CMMError);
+   AsyncCommand setConfigAsync(const char* groupName, const char* configName)
+      throw (CMMError);
+   void setStagePositions(const std::vector<std::string>& stageLabels,
+         const std::vector<double>& positions) throw (CMMError);
+   void setStagePositions(const char* xyStageLabel, double x, double y,
+         const std::vector<std::string>& stageLabels,
+         const std::vector<double>& positions) throw (CMMError);
+   void waitForAsyncCommands(const std::vector<AsyncCommand>& commands)
+      throw (CMMError);
+   bool waitForAsyncCommands(const std::vector<AsyncCommand>& commands,
+         long timeoutMs) throw (CMMError);
+   ///@}
+
    /** \name Device discovery. */
    ///@{
    bool supportsDeviceDetection(char* deviceLabel);
@@ -664,7 +799,21 @@ private:
    std::string channelGroup_;
    long pollingIntervalMs_;
    long timeoutMs_;
+
+   // Signaled when a device reports a busy state change
+   boost::mutex busyChangeMutex_;
+   boost::condition_variable busyChangeCond_;
+   unsigned long busyChangeCount_;
+
+   // Set while loading a configuration file, during which device property
+   // change notifications are only counted
+   class PropertyCallbackDeferral;
+   boost::mutex deferredCallbacksMutex_;
+   bool deferPropertyCallbacks_;
+   unsigned long deferredPropertyCallbacks_;
+
    bool autoShutter_;
+   bool parallelConfigLoading_;
    std::vector<double> *nullAffine_;
    MM::Core* callback_;                 // core services for devices
    ConfigGroupCollection* configGroups_;
@@ -672,6 +821,15 @@ private:
    MMEventCallback* externalCallback_;  // notification hook to the higher layer (e.g. GUI)
    PixelSizeConfigGroup* pixelSizeGroup_;
    CircularBuffer* cbuf_;
+   // Also attached to cbuf_ while streaming to disk
+   boost::shared_ptr<mm::DiskStreamSink> streamSink_;
+   mutable boost::mutex streamSinkMutex_;
+   // Timing of the image insertion path, attached to cbuf_
+   boost::shared_ptr<mm::AcquisitionStatistics> acqStats_;
+   // Combines inserted frames, if set; read by the insertion path
+   boost::shared_ptr<mm::FrameAccumulator> frameAccumulator_;
+   mutable boost::mutex frameAccumulatorMutex_;
+   boost::shared_ptr<ThreadPool> frameAccumulatorPool_;
 
    std::vector< boost::weak_ptr<DeviceInstance> > imageSynchroDevices_;
    boost::shared_ptr<CPluginManager> pluginManager_;
@@ -683,15 +841,54 @@ private:
    // or acquiring a module lock
    mutable MMThreadLock stateCacheLock_;
    mutable Configuration stateCache_; // Synchronized by stateCacheLock_
+   // Incremented whenever a value in stateCache_ changes
+   mutable long stateCacheGeneration_; // Synchronized by stateCacheLock_
+   mutable std::string stateCacheSnapshot_; // Synchronized by stateCacheLock_
+   mutable long stateCacheSnapshotGeneration_; // Synchronized by stateCacheLock_
 
    MMThreadLock* pPostedErrorsLock_;
    mutable std::deque<std::pair< int, std::string> > postedErrors_;
 
+   // Set by stopAcquisitionPlan(), polled by runAcquisitionPlan()
+   volatile bool acquisitionPlanStopRequested_;
+
+   // Runs the commands of the *Async() methods
+   boost::shared_ptr<mm::DeviceCommandExecutor> commandExecutor_;
+
+   // Delivers notifications to externalCallback_
+   boost::shared_ptr<mm::EventDispatcher> eventDispatcher_;
+
+   // Feed the parts of stage and property sequences that exceed the device
+   // sequence memory, keyed by device label and property name (empty for
+   // stages); created when loading and discarded when stopping a sequence
+   typedef std::pair<std::string, std::string> SequenceStreamerKey;
+   std::map< SequenceStreamerKey, boost::shared_ptr<mm::SequenceStreamer> >
+      sequenceStreamers_;
+   boost::mutex sequenceStreamersMutex_;
+
+   // Patterns loaded by loadSLMPatternBank(), keyed by SLM label. The pixels
+   // are kept here only for SLMs without (enough) pattern memory. Banks are
+   // replaced rather than modified, so that queued displays can hold on to
+   // the bank they were submitted for, and are numbered so that a display
+   // of a replaced bank can be told apart.
+   struct SLMPatternBank
+   {
+      unsigned long generation;
+      bool inDevice;
+      long size;
+      std::vector< std::vector<unsigned char> > patterns;
+   };
+   std::map< std::string, boost::shared_ptr<const SLMPatternBank> >
+      slmPatternBanks_;
+   unsigned long slmPatternBankGeneration_;
+   boost::mutex slmPatternBanksMutex_;
+
 private:
    void InitializeErrorMessages();
    void CreateCoreProperties();
 
    // Parameter/value validation
+   bool deferPropertyCallback();
    static void CheckDeviceLabel(const char* label) throw (CMMError);
    static void CheckPropertyName(const char* propName) throw (CMMError);
    static void CheckPropertyValue(const char* propValue) throw (CMMError);
@@ -704,9 +901,58 @@ private:
    void applyConfiguration(const Configuration& config) throw (CMMError);
    int applyProperties(std::vector<PropertySetting>& props, std::string& lastError);
    void waitForDevice(boost::shared_ptr<DeviceInstance> pDev) throw (CMMError);
+   boost::shared_ptr<DeviceInstance> resolveDeviceHandle(const DeviceHandle& device) const throw (CMMError);
+   bool deviceBusy(boost::shared_ptr<DeviceInstance> pDevice) throw (CMMError);
+   std::string getProperty(boost::shared_ptr<DeviceInstance> pDevice, const char* propName) throw (CMMError);
+   void setProperty(boost::shared_ptr<DeviceInstance> pDevice, const char* propName, const char* propValue) throw (CMMError);
+   void setConfigFileProperty(boost::shared_ptr<DeviceInstance> pDevice, const std::string& propName, const std::string& propValue) throw (CMMError);
+   void setPosition(boost::shared_ptr<StageInstance> pStage, double position) throw (CMMError);
+   double getPosition(boost::shared_ptr<StageInstance> pStage) throw (CMMError);
+   void setXYPosition(boost::shared_ptr<XYStageInstance> pXYStage, double x, double y) throw (CMMError);
+   void getXYPosition(boost::shared_ptr<XYStageInstance> pXYStage, double& x, double& y) throw (CMMError);
+   void waitForDevices(std::vector< boost::shared_ptr<DeviceInstance> > devices) throw (CMMError);
+   // Executed by commandExecutor_
+   void setPositionAndWait(std::string label, double position) throw (CMMError);
+   void setXYPositionAndWait(std::string label, double x, double y) throw (CMMError);
+   void setStateAndWait(std::string label, long state) throw (CMMError);
+   void setShutterOpenAndWait(std::string label, bool state) throw (CMMError);
+   void setPropertyAndWait(std::string label, std::string propName,
+         std::string propValue) throw (CMMError);
+   void setConfigAndWait(std::string groupName, std::string configName) throw (CMMError);
+   void displaySLMPatternInBank(std::string label,
+         boost::shared_ptr<const SLMPatternBank> bank, long patternIndex)
+      throw (CMMError);
+   void loadSLMPatternBankNow(std::string label,
+         const std::vector<unsigned char*>& patterns) throw (CMMError);
+   void clearSLMPatternBankNow(std::string label) throw (CMMError);
+   // SLM pattern banks
+   boost::shared_ptr<const SLMPatternBank> getSLMPatternBank(
+         const std::string& label, long patternIndex) throw (CMMError);
+   void discardSLMPatternBanks(const std::string& label);
+   boost::shared_ptr<mm::FrameAccumulator> getFrameAccumulator() const;
+   void resetFrameAccumulator();
+   int getCircularBufferInitializeError() const;
+   boost::shared_ptr<mm::DiskStreamSink> getStreamSink() const;
+   // Sequence streaming
+   void setSequenceStreamer(const SequenceStreamerKey& key,
+         boost::shared_ptr<mm::SequenceStreamer> streamer);
+   boost::shared_ptr<mm::SequenceStreamer> getSequenceStreamer(const SequenceStreamerKey& key);
+   void stopSequenceStreamer(const SequenceStreamerKey& key,
+         boost::shared_ptr<CMMError>& error);
+   void discardSequenceStreamers(const std::string& label);
+   long getStageSequenceFreeSpace(boost::shared_ptr<StageInstance> pStage) throw (CMMError);
+   void addArrayToStageSequence(boost::shared_ptr<StageInstance> pStage,
+         const double* positions, long count) throw (CMMError);
+   long getPropertySequenceFreeSpace(boost::shared_ptr<DeviceInstance> pDevice,
+         std::string propName) throw (CMMError);
+   void addArrayToPropertySequence(boost::shared_ptr<DeviceInstance> pDevice,
+         std::string propName, const double* values, long count) throw (CMMError);
+   void addStateCacheSetting(const PropertySetting& setting) const;
+   void notifyBusyChanged();
    Configuration getConfigGroupState(const char* group, bool fromCache) throw (CMMError);
    std::string getDeviceErrorText(int deviceCode, boost::shared_ptr<DeviceInstance> pDevice);
    std::string getDeviceName(boost::shared_ptr<DeviceInstance> pDev);
+   std::string getCurrentCameraLabel() const;
    void logError(const char* device, const char* msg);
    void updateAllowedChannelGroups();
    void assignDefaultRole(boost::shared_ptr<DeviceInstance> pDev);
@@ -59,13 +59,20 @@ const char* const LIB_NAME_SUFFIX = ".so.0";
 const char* const LIB_NAME_SUFFIX = "";
 #endif
 
+#ifdef WIN32
+const char* const PROBE_EXECUTABLE_NAME = "mmdeviceprobe.exe";
+#else
+const char* const PROBE_EXECUTABLE_NAME = "mmdeviceprobe";
+#endif
+
 ///////////////////////////////////////////////////////////////////////////////
 // CPluginManager class
 // --------------------
 
 std::vector<std::string> CPluginManager::fallbackSearchPaths_;
 
-CPluginManager::CPluginManager()
+CPluginManager::CPluginManager(mm::logging::Logger logger) :
+   logger_(logger)
 {
    const std::vector<std::string> paths = GetDefaultSearchPaths();
    SetSearchPaths(paths.begin(), paths.end());
@@ -145,10 +152,7 @@ CPluginManager::GetDeviceAdapter(const std::string& moduleName)
       return it->second;
    }
 
-   std::string filename(LIB_NAME_PREFIX);
-   filename += moduleName;
-   filename += LIB_NAME_SUFFIX;
-   filename = FindInSearchPath(filename);
+   std::string filename = FindInSearchPath(GetModuleFilename(moduleName));
 
    boost::shared_ptr<LoadedDeviceAdapter> module =
       boost::make_shared<LoadedDeviceAdapter>(moduleName, filename);
@@ -166,6 +170,140 @@ CPluginManager::GetDeviceAdapter(const char* moduleName)
    return GetDeviceAdapter(std::string(moduleName));
 }
 
+std::string
+CPluginManager::GetModuleFilename(const std::string& moduleName)
+{
+   return LIB_NAME_PREFIX + moduleName + LIB_NAME_SUFFIX;
+}
+
+
+/**
+ * Set the file used to cache the devices available in each module.
+ *
+ * The index is read immediately, and rewritten whenever a module that was not
+ * indexed (or has changed on disk) is listed.
+ */
+void
+CPluginManager::SetDeviceAdapterIndexFile(const std::string& filename)
+{
+   indexFile_ = filename;
+   index_ = mm::DeviceAdapterIndex();
+   if (!indexFile_.empty())
+      index_.Load(indexFile_);
+}
+
+
+/**
+ * List the devices in a module.
+ *
+ * With the index enabled, a module that is not already loaded is looked up in
+ * the index by its file path, modification time, and size. If it is not
+ * found, it is listed by the probe executable in a separate process and the
+ * result is added to the index. When the probe is unavailable or the module
+ * reports an error, the module is loaded into this process, as it would be
+ * without the index (so that errors are reported as usual). A module that
+ * crashes or hangs the probe is recorded as such and not loaded until its file
+ * changes; listing it throws.
+ */
+std::vector<mm::AdapterDeviceInfo>
+CPluginManager::GetAvailableDevices(const std::string& moduleName)
+{
+   mm::AdapterModuleInfo info;
+   info.name = moduleName;
+
+   if (!indexFile_.empty() && moduleMap_.find(moduleName) == moduleMap_.end())
+   {
+      info.path = FindInSearchPath(GetModuleFilename(moduleName));
+      if (mm::DeviceAdapterIndex::GetFileStamp(info.path, info.mtime, info.size))
+      {
+         bool indexed = index_.Lookup(info.path, info.mtime, info.size, info);
+         if (!indexed)
+         {
+            const std::string probe = FindProbeExecutable();
+            if (!probe.empty())
+            {
+               indexed = true;
+               if (!mm::DeviceAdapterIndex::Probe(probe, moduleName, info.path, info))
+               {
+                  LOG_WARNING(logger_) << "Device adapter " << moduleName <<
+                     " (" << info.path << ") could not be listed by " <<
+                     probe << "; it will not be loaded until it changes";
+                  info.probeFailed = true;
+                  info.error = "Listing the devices failed in " +
+                     std::string(PROBE_EXECUTABLE_NAME);
+               }
+               index_.Store(info);
+               SaveIndex();
+            }
+         }
+         if (indexed && info.probeFailed)
+            throw CMMError("Device adapter " + ToQuotedString(moduleName) +
+                  " was not loaded: " + info.error);
+         if (indexed && info.error.empty())
+            return info.devices;
+
+         info.error.clear();
+         mm::DeviceAdapterIndex::DescribeModule(*GetDeviceAdapter(moduleName), info);
+         index_.Store(info);
+         SaveIndex();
+         return info.devices;
+      }
+   }
+
+   mm::DeviceAdapterIndex::DescribeModule(*GetDeviceAdapter(moduleName), info);
+   return info.devices;
+}
+
+std::vector<mm::AdapterDeviceInfo>
+CPluginManager::GetAvailableDevices(const char* moduleName)
+{
+   if (!moduleName)
+   {
+      throw CMMError("Null device adapter module name");
+   }
+   return GetAvailableDevices(std::string(moduleName));
+}
+
+
+std::string
+CPluginManager::FindProbeExecutable() const
+{
+   // The probe is installed alongside the device adapters
+   std::vector<std::string> dirs(GetDefaultSearchPaths());
+   std::vector<std::string> searchPaths(GetActualSearchPaths());
+   dirs.insert(dirs.end(), searchPaths.begin(), searchPaths.end());
+
+   for (std::vector<std::string>::const_iterator it = dirs.begin(), end = dirs.end();
+         it != end; ++it)
+   {
+#ifdef WIN32
+      std::string path = *it + "\\" + PROBE_EXECUTABLE_NAME;
+#else
+      std::string path = *it + "/" + PROBE_EXECUTABLE_NAME;
+#endif
+      long long mtime, size;
+      if (mm::DeviceAdapterIndex::GetFileStamp(path, mtime, size))
+         return path;
+   }
+   return std::string();
+}
+
+
+void
+CPluginManager::SaveIndex()
+{
+   try
+   {
+      index_.Save(indexFile_);
+   }
+   catch (const CMMError& e)
+   {
+      // The index is only a cache; it will be rebuilt next time.
+      LOG_WARNING(logger_) << e.getMsg();
+   }
+}
+
+
 /** 
  * Unload a module.
  */
@@ -25,6 +25,8 @@
 
 
 #include "../MMDevice/DeviceThreads.h"
+#include "LoadableModules/DeviceAdapterIndex.h"
+#include "Logging/Logger.h"
 
 #include <boost/shared_ptr.hpp>
 #include <boost/weak_ptr.hpp>
@@ -39,7 +41,7 @@ class LoadedDeviceAdapter;
 class CPluginManager /* final */
 {
 public:
-   CPluginManager();
+   explicit CPluginManager(mm::logging::Logger logger);
    ~CPluginManager();
 
    void UnloadPluginLibrary(const char* moduleName);
@@ -64,16 +66,36 @@ public:
    boost::shared_ptr<LoadedDeviceAdapter>
    GetDeviceAdapter(const char* moduleName);
 
+   // On-disk index of available devices (an empty filename disables it)
+   void SetDeviceAdapterIndexFile(const std::string& filename);
+   std::string GetDeviceAdapterIndexFile() const { return indexFile_; }
+
+   /**
+    * Return the devices provided by a device adapter module, from the index
+    * if possible, without loading the module
+    */
+   std::vector<mm::AdapterDeviceInfo>
+   GetAvailableDevices(const std::string& moduleName);
+   std::vector<mm::AdapterDeviceInfo>
+   GetAvailableDevices(const char* moduleName);
+
 private:
    static std::vector<std::string> GetDefaultSearchPaths();
    std::vector<std::string> GetActualSearchPaths() const;
    static void GetModules(std::vector<std::string> &modules, const char *path);
    std::string FindInSearchPath(std::string filename);
+   static std::string GetModuleFilename(const std::string& moduleName);
+   std::string FindProbeExecutable() const;
+   void SaveIndex();
 
    std::vector<std::string> preferredSearchPaths_;
    static std::vector<std::string> fallbackSearchPaths_;
 
    std::map< std::string, boost::shared_ptr<LoadedDeviceAdapter> > moduleMap_;
+
+   mm::logging::Logger logger_;
+   std::string indexFile_;
+   mm::DeviceAdapterIndex index_;
 };
 
 #endif //_PLUGIN_MANAGER_H_
@@ -0,0 +1,156 @@
+///////////////////////////////////////////////////////////////////////////////
+// FILE:          SequenceStreamer.cpp
+// PROJECT:       Micro-Manager
+// SUBSYSTEM:     MMCore
+//-----------------------------------------------------------------------------
+// DESCRIPTION:   Refills the sequence memory of a device while its sequence
+//                is running
+//
+// LICENSE:       This file is distributed under the "Lesser GPL" (LGPL) license.
+//                License text is included with the source distribution.
+//
+//                This file is distributed in the hope that it will be useful,
+//                but WITHOUT ANY WARRANTY; without even the implied warranty
+//                of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+//
+//                IN NO EVENT SHALL THE COPYRIGHT OWNER OR
+//                CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+//                INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES.
+
+#include "SequenceStreamer.h"
+
+#include <boost/bind.hpp>
+#include <boost/date_time/posix_time/posix_time.hpp>
+#include <boost/make_shared.hpp>
+
+#include <algorithm>
+#include <exception>
+
+namespace mm {
+
+namespace {
+
+// How long to wait before asking a full device again
+const long g_PollIntervalMs = 1;
+
+} // anonymous namespace
+
+
+SequenceStreamer::SequenceStreamer(logging::Logger logger,
+      const std::string& description, const std::vector<double>& values,
+      long minChunk, FreeSpaceFunction getFreeSpace, AppendFunction append) :
+   logger_(logger),
+   description_(description),
+   values_(values),
+   minChunk_(std::max(1L, minChunk)),
+   getFreeSpace_(getFreeSpace),
+   append_(append),
+   nextIndex_(0),
+   stopRequested_(false)
+{
+}
+
+SequenceStreamer::~SequenceStreamer()
+{
+   StopThread();
+}
+
+void SequenceStreamer::Start()
+{
+   boost::mutex::scoped_lock lock(mutex_);
+   if (thread_)
+      return;
+   stopRequested_ = false;
+   thread_ = boost::make_shared<boost::thread>(
+         boost::bind(&SequenceStreamer::ThreadFunc, this));
+}
+
+void SequenceStreamer::Stop() throw (CMMError)
+{
+   StopThread();
+
+   boost::mutex::scoped_lock lock(mutex_);
+   if (error_)
+      throw CMMError("Streaming of " + description_ + " failed",
+            error_->getCode(), *error_);
+}
+
+size_t SequenceStreamer::GetRemainingCount()
+{
+   boost::mutex::scoped_lock lock(mutex_);
+   return values_.size() - nextIndex_;
+}
+
+void SequenceStreamer::StopThread()
+{
+   boost::shared_ptr<boost::thread> thread;
+   {
+      boost::mutex::scoped_lock lock(mutex_);
+      stopRequested_ = true;
+      thread.swap(thread_);
+   }
+   stopCond_.notify_all();
+   if (thread)
+      thread->join();
+}
+
+void SequenceStreamer::ThreadFunc()
+{
+   LOG_DEBUG(logger_) << "Streaming " << GetRemainingCount() <<
+      " remaining values of " << description_;
+
+   boost::mutex::scoped_lock lock(mutex_);
+   while (!stopRequested_ && nextIndex_ < values_.size())
+   {
+      const long remaining = static_cast<long>(values_.size() - nextIndex_);
+      const size_t index = nextIndex_;
+      lock.unlock();
+
+      // values_ is not modified, and nextIndex_ only by this thread, so the
+      // device is accessed without holding mutex_
+      long count = 0;
+      try
+      {
+         long freeSpace = getFreeSpace_();
+         if (freeSpace >= std::min(minChunk_, remaining))
+         {
+            count = std::min(freeSpace, remaining);
+            append_(&values_[index], count);
+         }
+      }
+      catch (const CMMError& e)
+      {
+         lock.lock();
+         error_ = boost::make_shared<CMMError>(e);
+         break;
+      }
+      catch (const std::exception& e)
+      {
+         lock.lock();
+         error_ = boost::make_shared<CMMError>(e.what());
+         break;
+      }
+
+      lock.lock();
+      nextIndex_ += count;
+      if (count == 0 && !stopRequested_)
+      {
+         stopCond_.timed_wait(lock, boost::get_system_time() +
+               boost::posix_time::milliseconds(g_PollIntervalMs));
+      }
+   }
+
+   if (error_)
+   {
+      LOG_ERROR(logger_) << "Streaming of " << description_ <<
+         " stopped after " << nextIndex_ << " of " << values_.size() <<
+         " values: " << error_->getFullMsg();
+   }
+   else
+   {
+      LOG_DEBUG(logger_) << "Streaming of " << description_ << " ended; " <<
+         (values_.size() - nextIndex_) << " values not sent";
+   }
+}
+
+} // namespace mm
@@ -0,0 +1,86 @@
+///////////////////////////////////////////////////////////////////////////////
+// FILE:          SequenceStreamer.h
+// PROJECT:       Micro-Manager
+// SUBSYSTEM:     MMCore
+//-----------------------------------------------------------------------------
+// DESCRIPTION:   Refills the sequence memory of a device while its sequence
+//                is running
+//
+// LICENSE:       This file is distributed under the "Lesser GPL" (LGPL) license.
+//                License text is included with the source distribution.
+//
+//                This file is distributed in the hope that it will be useful,
+//                but WITHOUT ANY WARRANTY; without even the implied warranty
+//                of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+//
+//                IN NO EVENT SHALL THE COPYRIGHT OWNER OR
+//                CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+//                INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES.
+
+#pragma once
+
+#include "Error.h"
+#include "Logging/Logger.h"
+
+#include <boost/function.hpp>
+#include <boost/shared_ptr.hpp>
+#include <boost/thread/condition_variable.hpp>
+#include <boost/thread/mutex.hpp>
+#include <boost/thread/thread.hpp>
+#include <boost/utility.hpp>
+
+#include <string>
+#include <vector>
+
+namespace mm {
+
+/**
+ * \brief Feeds the part of a sequence that did not fit into the device
+ *
+ * The first part of the sequence is loaded by the caller as usual. Once the
+ * device's sequence is started, the streamer polls the device for free space
+ * and appends the remaining values, waiting until at least minChunk values
+ * (or all remaining values) fit, so that the device is refilled in chunks
+ * rather than one value at a time.
+ */
+class SequenceStreamer /* final */ : boost::noncopyable
+{
+public:
+   // Both functions are called on the streaming thread and may throw
+   // CMMError
+   typedef boost::function<long ()> FreeSpaceFunction;
+   typedef boost::function<void (const double*, long)> AppendFunction;
+
+   SequenceStreamer(logging::Logger logger, const std::string& description,
+         const std::vector<double>& values, long minChunk,
+         FreeSpaceFunction getFreeSpace, AppendFunction append);
+   ~SequenceStreamer();
+
+   void Start();
+   // Stops feeding the device and throws the error that ended streaming
+   // early, if any
+   void Stop() throw (CMMError);
+
+   // Number of values not yet passed to the device
+   size_t GetRemainingCount();
+
+private:
+   void ThreadFunc();
+   void StopThread();
+
+   logging::Logger logger_;
+   const std::string description_;
+   const std::vector<double> values_;
+   const long minChunk_;
+   FreeSpaceFunction getFreeSpace_;
+   AppendFunction append_;
+
+   boost::mutex mutex_;
+   boost::condition_variable stopCond_;
+   size_t nextIndex_;
+   bool stopRequested_;
+   boost::shared_ptr<CMMError> error_;
+   boost::shared_ptr<boost::thread> thread_;
+};
+
+} // namespace mm
@@ -0,0 +1,254 @@
+#include <gtest/gtest.h>
+
+#include "MMCore.h"
+
+#include <boost/thread/thread.hpp>
+
+#include <cstdio>
+#include <cstdlib>
+#include <iostream>
+#include <map>
+#include <string>
+#include <vector>
+
+#ifndef _WIN32
+#include <signal.h>
+#include <sys/wait.h>
+#include <unistd.h>
+#endif
+
+// Runs the ASITiger adapter against the simulated controller (tigersim),
+// which must have been built along with the SerialManager and ASITiger
+// adapters (see Makefile.am for where they are looked up). POSIX only.
+#ifndef MM_TEST_DEVICEADAPTERS_DIR
+#define MM_TEST_DEVICEADAPTERS_DIR "../../DeviceAdapters"
+#endif
+
+#ifndef _WIN32
+
+namespace {
+
+const std::string g_AdaptersDir = MM_TEST_DEVICEADAPTERS_DIR;
+
+// A tigersim process serving XY, Z and scanner axes on a pseudo-terminal
+class TigerSimulator
+{
+public:
+   TigerSimulator() : pid_(-1) {}
+   ~TigerSimulator() { Stop(); }
+
+   // Returns the name of the pseudo-terminal, or an empty string
+   std::string Start(const std::string& options)
+   {
+      const std::string program = g_AdaptersDir + "/ASITiger/tigersim";
+      if (access(program.c_str(), X_OK) != 0)
+         return std::string();
+      char countsFile[] = "/tmp/tigersim-XXXXXX";
+      int countsFd = mkstemp(countsFile);
+      if (countsFd < 0)
+         return std::string();
+      countsFile_ = countsFile;
+
+      int out[2];
+      if (pipe(out) != 0)
+         return std::string();
+      pid_ = fork();
+      if (pid_ == 0)
+      {
+         dup2(out[1], 1);
+         dup2(countsFd, 2);
+         close(out[0]);
+         const std::string command = "exec '" + program + "' " + options +
+            " XY:x:1 Z:z:2 AB:u:3";
+         execl("/bin/sh", "sh", "-c", command.c_str(), (char*) 0);
+         _exit(127);
+      }
+      close(out[1]);
+      close(countsFd);
+
+      std::string port;
+      char c;
+      while (read(out[0], &c, 1) == 1 && c != '\n')
+         port += c;
+      close(out[0]);
+      return port;
+   }
+
+   // Starts counting commands from zero
+   void ResetCounts()
+   {
+      kill(pid_, SIGUSR1);
+      boost::this_thread::sleep(boost::posix_time::milliseconds(50));
+   }
+
+   // Stops the simulator and returns how many times each command was
+   // received
+   std::map<std::string, long> Stop()
+   {
+      std::map<std::string, long> counts;
+      if (pid_ <= 0)
+         return counts;
+      kill(pid_, SIGTERM);
+      waitpid(pid_, 0, 0);
+      pid_ = -1;
+
+      FILE* f = fopen(countsFile_.c_str(), "r");
+      if (f)
+      {
+         char command[64];
+         long count;
+         while (fscanf(f, "%63s %ld", command, &count) == 2)
+            counts[command] = count;
+         fclose(f);
+      }
+      remove(countsFile_.c_str());
+      return counts;
+   }
+
+private:
+   pid_t pid_;
+   std::string countsFile_;
+};
+
+class ASITigerSimulatorTests : public ::testing::Test
+{
+protected:
+   ASITigerSimulatorTests() : available_(false) {}
+
+   // Loads the hub and stages on a simulator started with the given options
+   void Connect(const std::string& options = std::string())
+   {
+      std::string port = sim_.Start(options);
+      if (port.empty())
+      {
+         std::cerr << "tigersim not available; skipping" << std::endl;
+         return;
+      }
+      std::vector<std::string> paths;
+      paths.push_back(g_AdaptersDir + "/SerialManager/.libs");
+      paths.push_back(g_AdaptersDir + "/ASITiger/.libs");
+      core_.setDeviceAdapterSearchPaths(paths);
+      try
+      {
+         core_.loadDevice(port.c_str(), "SerialManager", port.c_str());
+         core_.loadDevice("Hub", "ASITiger", "TigerCommHub");
+      }
+      catch (const CMMError& e)
+      {
+         std::cerr << "Adapters not available; skipping (" << e.getMsg() <<
+            ")" << std::endl;
+         return;
+      }
+      core_.setProperty("Hub", MM::g_Keyword_Port, port.c_str());
+      // The tests enable batched queries once the devices are initialized
+      core_.setProperty("Hub", "AxisStatusCacheTime(ms)", 0L);
+      core_.loadDevice("XY", "ASITiger", "XYStage:XY:31");
+      core_.loadDevice("Z", "ASITiger", "ZStage:Z:32");
+      core_.loadDevice("Scanner", "ASITiger", "Scanner:AB:33");
+      core_.setParentLabel("XY", "Hub");
+      core_.setParentLabel("Z", "Hub");
+      core_.setParentLabel("Scanner", "Hub");
+      core_.initializeAllDevices();
+      available_ = true;
+   }
+
+   // Number of position queries since the counts were reset
+   long StopAndCountWhere()
+   {
+      return sim_.Stop()["W"];
+   }
+
+   void GetAllPositions()
+   {
+      double x, y;
+      core_.getXYPosition("XY", x, y);
+      EXPECT_NEAR(100.0, x, 0.1);
+      EXPECT_NEAR(-50.0, y, 0.1);
+      EXPECT_NEAR(20.0, core_.getPosition("Z"), 0.1);
+      core_.getGalvoPosition("Scanner", x, y);
+   }
+
+   void Move()
+   {
+      core_.setXYPosition("XY", 100.0, -50.0);
+      core_.setPosition("Z", 20.0);
+      core_.waitForDevice("XY");
+      core_.waitForDevice("Z");
+   }
+
+   static void Sleep(long ms)
+   {
+      boost::this_thread::sleep(boost::posix_time::milliseconds(ms));
+   }
+
+   CMMCore core_;
+   TigerSimulator sim_;
+   bool available_;
+};
+
+} // anonymous namespace
+
+TEST_F(ASITigerSimulatorTests, AxesAreQueriedTogether)
+{
+   Connect();
+   if (!available_)
+      return;
+   Move();
+   core_.setProperty("Hub", "AxisStatusCacheTime(ms)", 1000L);
+   sim_.ResetCounts();
+   GetAllPositions();
+   EXPECT_EQ(1, StopAndCountWhere());
+}
+
+TEST_F(ASITigerSimulatorTests, AxesAreQueriedSeparatelyWithoutCache)
+{
+   Connect();
+   if (!available_)
+      return;
+   Move();
+   core_.setProperty("Hub", "AxisStatusCacheTime(ms)", 0L);
+   sim_.ResetCounts();
+   GetAllPositions();
+   EXPECT_EQ(5, StopAndCountWhere());
+}
+
+TEST_F(ASITigerSimulatorTests, BatchingResumesAfterUnmatchedReply)
+{
+   // The first two batched replies lack a value
+   Connect("-g 2");
+   if (!available_)
+      return;
+   Move();
+   core_.setProperty("Hub", "AxisStatusCacheTime(ms)", 50L);
+   sim_.ResetCounts();
+
+   GetAllPositions(); // batched query fails, then five separate ones
+   Sleep(100);
+   GetAllPositions(); // five separate queries
+   Sleep(1100);
+   GetAllPositions(); // batching is retried, fails again
+   Sleep(100);
+   GetAllPositions(); // five separate queries
+   // Changing the cache time retries batching at once
+   core_.setProperty("Hub", "AxisStatusCacheTime(ms)", 50L);
+   GetAllPositions();
+   Sleep(100);
+   GetAllPositions();
+
+   EXPECT_EQ(6 + 5 + 6 + 5 + 1 + 1, StopAndCountWhere());
+}
+
+int main(int argc, char **argv)
+{
+   ::testing::InitGoogleTest(&argc, argv);
+   return RUN_ALL_TESTS();
+}
+
+#else // _WIN32
+
+int main(int, char**)
+{
+   return 0;
+}
+
+#endif // _WIN32
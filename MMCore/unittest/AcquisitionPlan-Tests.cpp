@@ -0,0 +1,205 @@
+#include <gtest/gtest.h>
+
+#include "MMCore.h"
+
+#include <boost/lexical_cast.hpp>
+
+#include <iostream>
+#include <string>
+#include <vector>
+
+// The tests of execution use the DemoCamera adapter, which must have been
+// built (see Makefile.am for where it is looked up); they are skipped if it
+// is not available.
+#ifndef MM_TEST_ADAPTER_DIR
+#define MM_TEST_ADAPTER_DIR "../../DeviceAdapters/DemoCamera/.libs"
+#endif
+
+
+TEST(AcquisitionPlanTests, UnchangingEventsFormOneRun)
+{
+   CMMCore c;
+   AcquisitionPlan plan;
+   for (int i = 0; i < 5; ++i)
+      plan.addEvent(AcquisitionEvent());
+   EXPECT_FALSE(plan.isCompiled());
+   EXPECT_THROW(plan.getNumberOfRuns(), CMMError);
+
+   c.compileAcquisitionPlan(plan);
+   ASSERT_TRUE(plan.isCompiled());
+   ASSERT_EQ(1u, plan.getNumberOfRuns());
+   EXPECT_EQ(0, plan.getRunStart(0));
+   EXPECT_EQ(5, plan.getRunLength(0));
+   EXPECT_TRUE(plan.getRunSequencedAxes(0).empty());
+
+   plan.addEvent(AcquisitionEvent());
+   EXPECT_FALSE(plan.isCompiled());
+}
+
+TEST(AcquisitionPlanTests, UnsequenceableChangeSplitsRuns)
+{
+   CMMCore c;
+   AcquisitionPlan plan;
+   const char* values[] = { "1", "1", "0", "0", "0", "1" };
+   for (int i = 0; i < 6; ++i)
+   {
+      AcquisitionEvent event;
+      // Core properties are never sequenceable
+      if (i != 1)
+         event.setProperty("Core", "AutoShutter", values[i]);
+      plan.addEvent(event);
+   }
+
+   c.compileAcquisitionPlan(plan);
+   ASSERT_EQ(3u, plan.getNumberOfRuns());
+   EXPECT_EQ(0, plan.getRunStart(0));
+   EXPECT_EQ(2, plan.getRunLength(0));
+   EXPECT_EQ(2, plan.getRunStart(1));
+   EXPECT_EQ(3, plan.getRunLength(1));
+   EXPECT_EQ(5, plan.getRunStart(2));
+   EXPECT_EQ(1, plan.getRunLength(2));
+}
+
+TEST(AcquisitionPlanTests, PositionsRequireDevices)
+{
+   CMMCore c;
+   AcquisitionPlan plan;
+   AcquisitionEvent event;
+   event.setZPosition(1.0);
+   plan.addEvent(event);
+   EXPECT_THROW(c.compileAcquisitionPlan(plan), CMMError);
+   EXPECT_THROW(c.runAcquisitionPlan(plan), CMMError);
+}
+
+namespace {
+
+// A demo camera with exposure sequences (of at most 100 exposures) and a demo
+// focus stage that streams its sequences
+class AcquisitionPlanDemoTests : public ::testing::Test
+{
+protected:
+   AcquisitionPlanDemoTests() : available_(false) {}
+
+   virtual void SetUp()
+   {
+      core_.setDeviceAdapterSearchPaths(
+            std::vector<std::string>(1, MM_TEST_ADAPTER_DIR));
+      try
+      {
+         core_.loadDevice("Camera", "DemoCamera", "DCam");
+      }
+      catch (const CMMError& e)
+      {
+         std::cerr << "DemoCamera adapter not available; skipping (" <<
+            e.getMsg() << ")" << std::endl;
+         return;
+      }
+      available_ = true;
+      core_.loadDevice("Z", "DemoCamera", "DStage");
+      core_.initializeAllDevices();
+      core_.setCameraDevice("Camera");
+      core_.setFocusDevice("Z");
+      core_.setProperty("Camera", "UseExposureSequences", "Yes");
+      core_.setProperty("Z", "UseSequences", "Yes");
+      core_.setProperty("Z", "SequenceMaxLength", 10L);
+      core_.setProperty("Z", "SequenceStepIntervalMs", 0.001);
+      core_.setExposure(1.0);
+   }
+
+   // Events at successive Z positions, alternating between two exposures
+   static AcquisitionPlan MakePlan(int count, bool varyExposure)
+   {
+      AcquisitionPlan plan;
+      for (int i = 0; i < count; ++i)
+      {
+         AcquisitionEvent event;
+         event.setZPosition(i);
+         event.setExposure(varyExposure ? 1.0 + i % 2 : 1.0);
+         plan.addEvent(event);
+      }
+      return plan;
+   }
+
+   long GetStageCount(const char* propName)
+   {
+      return boost::lexical_cast<long>(core_.getProperty("Z", propName));
+   }
+
+   CMMCore core_;
+   bool available_;
+};
+
+} // anonymous namespace
+
+TEST_F(AcquisitionPlanDemoTests, SequenceableChangesAreMerged)
+{
+   if (!available_)
+      return;
+   // The stage streams, so its sequence length does not limit the run
+   AcquisitionPlan plan = MakePlan(50, false);
+   core_.compileAcquisitionPlan(plan);
+   ASSERT_EQ(1u, plan.getNumberOfRuns());
+   EXPECT_EQ(50, plan.getRunLength(0));
+   std::vector<std::string> axes = plan.getRunSequencedAxes(0);
+   ASSERT_EQ(1u, axes.size());
+   EXPECT_EQ("Z", axes[0]);
+
+   // Without sequencing every event is set in software
+   core_.setProperty("Z", "UseSequences", "No");
+   core_.compileAcquisitionPlan(plan);
+   EXPECT_EQ(50u, plan.getNumberOfRuns());
+}
+
+TEST_F(AcquisitionPlanDemoTests, RunsAreSplitAtMaxSequenceLength)
+{
+   if (!available_)
+      return;
+   AcquisitionPlan plan = MakePlan(250, true);
+   core_.compileAcquisitionPlan(plan);
+   ASSERT_EQ(3u, plan.getNumberOfRuns());
+   const long maxLength = core_.getExposureSequenceMaxLength("Camera");
+   ASSERT_EQ(100, maxLength);
+   for (size_t run = 0; run < 3; ++run)
+   {
+      EXPECT_EQ((long) run * maxLength, plan.getRunStart(run));
+      EXPECT_EQ(2u, plan.getRunSequencedAxes(run).size());
+   }
+   EXPECT_EQ(maxLength, plan.getRunLength(0));
+   EXPECT_EQ(maxLength, plan.getRunLength(1));
+   EXPECT_EQ(50, plan.getRunLength(2));
+}
+
+TEST_F(AcquisitionPlanDemoTests, RunStepsThroughLoadedSequence)
+{
+   if (!available_)
+      return;
+   AcquisitionPlan plan = MakePlan(6, true);
+   core_.runAcquisitionPlan(plan);
+   ASSERT_EQ(1u, plan.getNumberOfRuns());
+
+   EXPECT_EQ(6, core_.getRemainingImageCount());
+   // Only the first position was set in software; the stage reached the
+   // last one by stepping through the sequence loaded and started for the
+   // run
+   EXPECT_EQ(6, GetStageCount("SequencePositionsExecuted"));
+   EXPECT_DOUBLE_EQ(5.0, core_.getPosition("Z"));
+   EXPECT_FALSE(core_.isSequenceRunning("Camera"));
+}
+
+TEST_F(AcquisitionPlanDemoTests, RunAcquiresEveryRun)
+{
+   if (!available_)
+      return;
+   core_.setProperty("Z", "UseSequences", "No");
+   AcquisitionPlan plan = MakePlan(4, false);
+   core_.runAcquisitionPlan(plan);
+   EXPECT_EQ(4u, plan.getNumberOfRuns());
+   EXPECT_EQ(4, core_.getRemainingImageCount());
+   EXPECT_DOUBLE_EQ(3.0, core_.getPosition("Z"));
+}
+
+int main(int argc, char **argv)
+{
+   ::testing::InitGoogleTest(&argc, argv);
+   return RUN_ALL_TESTS();
+}
@@ -0,0 +1,105 @@
+#include <gtest/gtest.h>
+
+#include "AcquisitionStatistics.h"
+#include "CircularBuffer.h"
+
+#include <boost/make_shared.hpp>
+
+#include <cstdio>
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <vector>
+
+
+TEST(LatencyHistogramTests, BucketsArePowersOfTwo)
+{
+   mm::LatencyHistogram h;
+   h.Record(0);
+   h.Record(1);
+   h.Record(3);
+   h.Record(4);
+   h.Record(1000);
+   h.Record(-5); // counted as 0
+
+   mm::LatencyHistogram::Snapshot s = h.GetSnapshot();
+   EXPECT_EQ(6, s.count);
+   EXPECT_EQ(1008, s.sumUs);
+   EXPECT_EQ(1000, s.maxUs);
+   EXPECT_EQ(2, s.buckets[0]);
+   EXPECT_EQ(1, s.buckets[1]);
+   EXPECT_EQ(1, s.buckets[2]); // [2, 4)
+   EXPECT_EQ(1, s.buckets[3]); // [4, 8)
+   EXPECT_EQ(1, s.buckets[10]); // [512, 1024)
+   EXPECT_EQ(1, s.PercentileUs(50.0)); // third of six samples
+   EXPECT_EQ(1000, s.PercentileUs(99.0));
+
+   h.Reset();
+   EXPECT_EQ(0, h.GetSnapshot().count);
+   EXPECT_EQ(0, h.GetSnapshot().PercentileUs(50.0));
+}
+
+TEST(AcquisitionStatisticsTests, BufferRecordsInsertAndPop)
+{
+   boost::shared_ptr<mm::AcquisitionStatistics> stats =
+      boost::make_shared<mm::AcquisitionStatistics>();
+   CircularBuffer cbuf(4);
+   ASSERT_TRUE(cbuf.Initialize(1, 16, 16, 1));
+   cbuf.SetStatistics(stats);
+
+   std::vector<unsigned char> pixels(16 * 16);
+   Metadata md;
+   md.PutImageTag("Camera", "Camera");
+   for (int i = 0; i < 3; ++i)
+      ASSERT_TRUE(cbuf.InsertImage(&pixels[0], 16, 16, 1, &md));
+   ASSERT_TRUE(cbuf.GetNextImageBuffer(0) != 0);
+   ASSERT_TRUE(cbuf.GetNextImageBuffer(0) != 0);
+
+   EXPECT_EQ(3, stats->GetInsertedCount());
+   EXPECT_EQ(2, stats->GetPoppedCount());
+   EXPECT_EQ(3, stats->GetSnapshot(
+            mm::AcquisitionStatistics::StageCopy).count);
+   EXPECT_EQ(3, stats->GetSnapshot(
+            mm::AcquisitionStatistics::StageBufferWait).count);
+   EXPECT_EQ(2, stats->GetSnapshot(
+            mm::AcquisitionStatistics::StageQueue).count);
+
+   std::string report = stats->Format(0);
+   EXPECT_EQ(0u, report.find("frames\tinserted=3\trefused=0\tdropped=0\tpopped=2\n"));
+   EXPECT_NE(std::string::npos, report.find("\nQueue\t2\t"));
+}
+
+TEST(AcquisitionStatisticsTests, TraceIsChromeTraceJson)
+{
+   mm::AcquisitionStatistics stats;
+   stats.Record(mm::AcquisitionStatistics::StageCopy, 100, 5, 7);
+   EXPECT_FALSE(stats.IsTracing());
+
+   stats.StartTrace(2);
+   EXPECT_TRUE(stats.IsTracing());
+   stats.Record(mm::AcquisitionStatistics::StageCopy, 100, 5, 7);
+   stats.Record(mm::AcquisitionStatistics::StageQueue, 105, 50, 7);
+   stats.Record(mm::AcquisitionStatistics::StageInsert, 200, 5); // over limit
+   EXPECT_FALSE(stats.IsTracing());
+
+   const char* filename = "AcquisitionStatistics-Tests.json";
+   ASSERT_TRUE(stats.SaveTrace(filename));
+   std::ifstream f(filename);
+   std::ostringstream json;
+   json << f.rdbuf();
+   std::remove(filename);
+
+   std::string s = json.str();
+   EXPECT_EQ(0u, s.find("{\"displayTimeUnit\":\"ms\",\"traceEvents\":["));
+   EXPECT_NE(std::string::npos, s.find("\"name\":\"Copy\",\"cat\":\"insert\",\"ph\":\"X\""));
+   EXPECT_NE(std::string::npos, s.find("\"ph\":\"b\",\"id\":7"));
+   EXPECT_NE(std::string::npos, s.find("\"ph\":\"e\",\"id\":7"));
+   EXPECT_EQ(std::string::npos, s.find("\"name\":\"Insert\""));
+   EXPECT_EQ(s.size() - 4, s.rfind("\n]}\n"));
+}
+
+int main(int argc, char **argv)
+{
+   ::testing::InitGoogleTest(&argc, argv);
+   return RUN_ALL_TESTS();
+}
@@ -0,0 +1,253 @@
+#include <gtest/gtest.h>
+
+#include "MMCore.h"
+
+#include <cstdio>
+#include <cstdlib>
+#include <iostream>
+#include <map>
+#include <string>
+#include <vector>
+
+#ifndef _WIN32
+#include <signal.h>
+#include <sys/wait.h>
+#include <unistd.h>
+#endif
+
+// Runs the Arduino switch against the simulated controller (arduinosim),
+// which must have been built along with the SerialManager and Arduino
+// adapters (see Makefile.am for where they are looked up). POSIX only.
+#ifndef MM_TEST_DEVICEADAPTERS_DIR
+#define MM_TEST_DEVICEADAPTERS_DIR "../../DeviceAdapters"
+#endif
+
+#ifndef _WIN32
+
+namespace {
+
+const std::string g_AdaptersDir = MM_TEST_DEVICEADAPTERS_DIR;
+
+// What an arduinosim process received, as printed on exit
+struct SimulatorReport
+{
+   std::map<int, long> commandCounts;
+   std::vector<int> triggerPatterns;
+};
+
+// An arduinosim process on a pseudo-terminal
+class ArduinoSimulator
+{
+public:
+   ArduinoSimulator() : pid_(-1) {}
+   ~ArduinoSimulator() { Stop(); }
+
+   // Returns the name of the pseudo-terminal, or an empty string
+   std::string Start(const std::string& options)
+   {
+      const std::string program = g_AdaptersDir + "/Arduino/arduinosim";
+      if (access(program.c_str(), X_OK) != 0)
+         return std::string();
+      char reportFile[] = "/tmp/arduinosim-XXXXXX";
+      int reportFd = mkstemp(reportFile);
+      if (reportFd < 0)
+         return std::string();
+      reportFile_ = reportFile;
+
+      int out[2];
+      if (pipe(out) != 0)
+         return std::string();
+      pid_ = fork();
+      if (pid_ == 0)
+      {
+         dup2(out[1], 1);
+         dup2(reportFd, 2);
+         close(out[0]);
+         const std::string command = "exec '" + program + "' " + options;
+         execl("/bin/sh", "sh", "-c", command.c_str(), (char*) 0);
+         _exit(127);
+      }
+      close(out[1]);
+      close(reportFd);
+
+      std::string port;
+      char c;
+      while (read(out[0], &c, 1) == 1 && c != '\n')
+         port += c;
+      close(out[0]);
+      return port;
+   }
+
+   // Stops the simulator and returns what it received
+   SimulatorReport Stop()
+   {
+      SimulatorReport report;
+      if (pid_ <= 0)
+         return report;
+      kill(pid_, SIGTERM);
+      waitpid(pid_, 0, 0);
+      pid_ = -1;
+
+      FILE* f = fopen(reportFile_.c_str(), "r");
+      if (f)
+      {
+         char line[256];
+         while (fgets(line, sizeof(line), f))
+         {
+            int command, count, offset;
+            long commandCount;
+            if (sscanf(line, " %d: %ld", &command, &commandCount) == 2)
+               report.commandCounts[command] = commandCount;
+            else if (sscanf(line, "Trigger patterns (%d):%n", &count,
+                     &offset) == 1)
+            {
+               const char* p = line + offset;
+               int pattern, n;
+               while (sscanf(p, " %d%n", &pattern, &n) == 1)
+               {
+                  report.triggerPatterns.push_back(pattern);
+                  p += n;
+               }
+            }
+         }
+         fclose(f);
+      }
+      remove(reportFile_.c_str());
+      return report;
+   }
+
+private:
+   pid_t pid_;
+   std::string reportFile_;
+};
+
+class ArduinoSimulatorTests : public ::testing::Test
+{
+protected:
+   ArduinoSimulatorTests() : available_(false) {}
+
+   // Loads the hub and switch on a simulator started with the given options
+   void Connect(const std::string& options = std::string())
+   {
+      std::string port = sim_.Start(options);
+      if (port.empty())
+      {
+         std::cerr << "arduinosim not available; skipping" << std::endl;
+         return;
+      }
+      std::vector<std::string> paths;
+      paths.push_back(g_AdaptersDir + "/SerialManager/.libs");
+      paths.push_back(g_AdaptersDir + "/Arduino/.libs");
+      core_.setDeviceAdapterSearchPaths(paths);
+      try
+      {
+         core_.loadDevice(port.c_str(), "SerialManager", port.c_str());
+         core_.loadDevice("Hub", "Arduino", "Arduino-Hub");
+      }
+      catch (const CMMError& e)
+      {
+         std::cerr << "Adapters not available; skipping (" << e.getMsg() <<
+            ")" << std::endl;
+         return;
+      }
+      core_.setProperty("Hub", MM::g_Keyword_Port, port.c_str());
+      core_.loadDevice("Switch", "Arduino", "Arduino-Switch");
+      core_.setParentLabel("Switch", "Hub");
+      core_.initializeAllDevices();
+      core_.setProperty("Switch", "Sequence", "On");
+      available_ = true;
+   }
+
+   void LoadSequence()
+   {
+      core_.loadPropertySequence("Switch", MM::g_Keyword_State, Sequence());
+   }
+
+   static std::vector<std::string> Sequence()
+   {
+      std::vector<std::string> sequence;
+      sequence.push_back("1");
+      sequence.push_back("2");
+      sequence.push_back("4");
+      sequence.push_back("63");
+      return sequence;
+   }
+
+   static std::vector<int> Patterns()
+   {
+      std::vector<int> patterns;
+      patterns.push_back(1);
+      patterns.push_back(2);
+      patterns.push_back(4);
+      patterns.push_back(63);
+      return patterns;
+   }
+
+   CMMCore core_;
+   ArduinoSimulator sim_;
+   bool available_;
+};
+
+} // anonymous namespace
+
+TEST_F(ArduinoSimulatorTests, SequenceIsUploadedInOneFrame)
+{
+   Connect();
+   if (!available_)
+      return;
+   EXPECT_EQ("3", core_.getProperty("Hub", "Version"));
+   LoadSequence();
+
+   SimulatorReport report = sim_.Stop();
+   EXPECT_EQ(1, report.commandCounts[13]);
+   EXPECT_EQ(0, report.commandCounts[5]);
+   EXPECT_EQ(0, report.commandCounts[6]);
+   EXPECT_EQ(Patterns(), report.triggerPatterns);
+}
+
+TEST_F(ArduinoSimulatorTests, RejectedFrameIsReported)
+{
+   // The first bulk upload is answered with 13, 255
+   Connect("-r 1");
+   if (!available_)
+      return;
+   EXPECT_THROW(LoadSequence(), CMMError);
+   // The next upload is accepted
+   LoadSequence();
+
+   SimulatorReport report = sim_.Stop();
+   EXPECT_EQ(2, report.commandCounts[13]);
+   EXPECT_EQ(0, report.commandCounts[5]);
+   EXPECT_EQ(0, report.commandCounts[6]);
+   EXPECT_EQ(Patterns(), report.triggerPatterns);
+}
+
+TEST_F(ArduinoSimulatorTests, OlderFirmwareGetsOnePatternAtATime)
+{
+   Connect("-2");
+   if (!available_)
+      return;
+   EXPECT_EQ("2", core_.getProperty("Hub", "Version"));
+   LoadSequence();
+
+   SimulatorReport report = sim_.Stop();
+   EXPECT_EQ(0, report.commandCounts[13]);
+   EXPECT_EQ(4, report.commandCounts[5]);
+   EXPECT_EQ(1, report.commandCounts[6]);
+   EXPECT_EQ(Patterns(), report.triggerPatterns);
+}
+
+int main(int argc, char **argv)
+{
+   ::testing::InitGoogleTest(&argc, argv);
+   return RUN_ALL_TESTS();
+}
+
+#else // _WIN32
+
+int main(int, char**)
+{
+   return 0;
+}
+
+#endif // _WIN32
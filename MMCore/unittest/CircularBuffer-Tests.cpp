@@ -0,0 +1,294 @@
+#include <gtest/gtest.h>
+
+#include "CircularBuffer.h"
+
+#include <boost/thread/thread.hpp>
+
+#include <algorithm>
+#include <vector>
+
+namespace {
+
+const unsigned g_Width = 512;
+const unsigned g_Height = 512;
+const unsigned g_Capacity = 4; // 1 MB of 512x512x1 frames
+
+class CircularBufferOverflowTests : public ::testing::Test
+{
+protected:
+   CircularBufferOverflowTests() : cbuf_(1) {}
+
+   virtual void SetUp()
+   {
+      ASSERT_TRUE(cbuf_.Initialize(1, g_Width, g_Height, 1));
+      cbuf_.Clear();
+      ASSERT_EQ(g_Capacity, (unsigned)cbuf_.GetSize());
+   }
+
+   bool Insert(unsigned char value, long position = -1)
+   {
+      std::vector<unsigned char> pixels(g_Width * g_Height, value);
+      Metadata md;
+      md.PutImageTag("Camera", "Camera");
+      if (position >= 0)
+      {
+         md.PutImageTag(MM::g_Keyword_Metadata_PositionIndex, position);
+         md.PutImageTag(MM::g_Keyword_Metadata_FrameIndex, (long)value);
+      }
+      return cbuf_.InsertImage(&pixels[0], g_Width, g_Height, 1, &md);
+   }
+
+   int Pop()
+   {
+      const unsigned char* pixels = cbuf_.GetNextImage();
+      return pixels ? pixels[0] : -1;
+   }
+
+   void Fill()
+   {
+      for (unsigned i = 0; i < g_Capacity; ++i)
+         ASSERT_TRUE(Insert((unsigned char)i));
+   }
+
+   CircularBuffer cbuf_;
+};
+
+void PopAfterDelay(CircularBuffer* cbuf)
+{
+   boost::this_thread::sleep(boost::posix_time::milliseconds(50));
+   cbuf->GetNextImage();
+}
+
+// Pops only once the insert lock can be taken, as by another camera
+void InsertLockThenPop(CircularBuffer* cbuf)
+{
+   boost::this_thread::sleep(boost::posix_time::milliseconds(50));
+   {
+      MMThreadGuard guard(cbuf->g_insertLock);
+   }
+   cbuf->GetNextImage();
+}
+
+} // anonymous namespace
+
+TEST_F(CircularBufferOverflowTests, ErrorRefusesFrame)
+{
+   Fill();
+   EXPECT_FALSE(Insert(100));
+   EXPECT_TRUE(cbuf_.Overflow());
+   EXPECT_EQ(1u, cbuf_.GetDroppedImageCount());
+}
+
+TEST_F(CircularBufferOverflowTests, DropNewestKeepsQueuedFrames)
+{
+   cbuf_.SetOverflowPolicy(CircularBuffer::OverflowDropNewest);
+   Fill();
+   EXPECT_TRUE(Insert(100));
+   EXPECT_FALSE(cbuf_.Overflow());
+   EXPECT_EQ(1u, cbuf_.GetDroppedImageCount());
+   for (unsigned i = 0; i < g_Capacity; ++i)
+      EXPECT_EQ((int)i, Pop());
+   EXPECT_EQ(-1, Pop());
+}
+
+TEST_F(CircularBufferOverflowTests, DropOldestOverwritesOldestFrame)
+{
+   cbuf_.SetOverflowPolicy(CircularBuffer::OverflowDropOldest);
+   Fill();
+   EXPECT_TRUE(Insert(100));
+   EXPECT_EQ(1u, cbuf_.GetDroppedImageCount());
+   for (unsigned i = 1; i < g_Capacity; ++i)
+      EXPECT_EQ((int)i, Pop());
+   EXPECT_EQ(100, Pop());
+   EXPECT_EQ(-1, Pop());
+}
+
+TEST_F(CircularBufferOverflowTests, BlockTimesOut)
+{
+   cbuf_.SetOverflowPolicy(CircularBuffer::OverflowBlock);
+   cbuf_.SetOverflowBlockTimeoutMs(10);
+   Fill();
+   EXPECT_TRUE(Insert(100));
+   EXPECT_EQ(1u, cbuf_.GetDroppedImageCount());
+   EXPECT_EQ(g_Capacity, (unsigned)cbuf_.GetRemainingImageCount());
+}
+
+TEST_F(CircularBufferOverflowTests, BlockWaitsForConsumer)
+{
+   cbuf_.SetOverflowPolicy(CircularBuffer::OverflowBlock);
+   cbuf_.SetOverflowBlockTimeoutMs(5000);
+   Fill();
+   boost::thread consumer(PopAfterDelay, &cbuf_);
+   EXPECT_TRUE(Insert(100));
+   consumer.join();
+   EXPECT_EQ(0u, cbuf_.GetDroppedImageCount());
+   for (unsigned i = 1; i < g_Capacity; ++i)
+      EXPECT_EQ((int)i, Pop());
+   EXPECT_EQ(100, Pop());
+}
+
+TEST_F(CircularBufferOverflowTests, BlockedInsertDoesNotHoldInsertLock)
+{
+   cbuf_.SetOverflowPolicy(CircularBuffer::OverflowBlock);
+   cbuf_.SetOverflowBlockTimeoutMs(2000);
+   Fill();
+   boost::thread consumer(InsertLockThenPop, &cbuf_);
+   EXPECT_TRUE(Insert(100));
+   consumer.join();
+   EXPECT_EQ(0u, cbuf_.GetDroppedImageCount());
+}
+
+TEST_F(CircularBufferOverflowTests, SpillToDiskPreservesOrder)
+{
+   cbuf_.SetOverflowPolicy(CircularBuffer::OverflowSpillToDisk);
+   for (unsigned i = 0; i < 3 * g_Capacity; ++i)
+      ASSERT_TRUE(Insert((unsigned char)i));
+   EXPECT_EQ(0u, cbuf_.GetDroppedImageCount());
+   EXPECT_EQ(2 * g_Capacity, cbuf_.GetSpilledImageCount());
+   EXPECT_EQ(3 * g_Capacity, (unsigned)cbuf_.GetRemainingImageCount());
+
+   // Interleave reads and writes while frames are still on disk
+   EXPECT_EQ(0, Pop());
+   ASSERT_TRUE(Insert(200));
+   for (unsigned i = 1; i < 3 * g_Capacity; ++i)
+      EXPECT_EQ((int)i, Pop());
+   EXPECT_EQ(200, Pop());
+   EXPECT_EQ(-1, Pop());
+}
+
+TEST_F(CircularBufferOverflowTests, ClearDiscardsSpilledFrames)
+{
+   cbuf_.SetOverflowPolicy(CircularBuffer::OverflowSpillToDisk);
+   for (unsigned i = 0; i < 2 * g_Capacity; ++i)
+      ASSERT_TRUE(Insert((unsigned char)i));
+   cbuf_.Clear();
+   EXPECT_EQ(0, cbuf_.GetRemainingImageCount());
+   EXPECT_EQ(0u, cbuf_.GetSpilledImageCount());
+   ASSERT_TRUE(Insert(7));
+   EXPECT_EQ(7, Pop());
+   EXPECT_EQ(-1, Pop());
+}
+
+TEST_F(CircularBufferOverflowTests, PinnedFrameIsNotOverwritten)
+{
+   cbuf_.SetOverflowPolicy(CircularBuffer::OverflowDropOldest);
+   Fill();
+   const mm::ImgBuffer* pinned = cbuf_.GetNextImageBufferPinned(0);
+   ASSERT_TRUE(pinned != 0);
+   EXPECT_EQ(0, pinned->GetPixels()[0]);
+   EXPECT_EQ(1u, cbuf_.GetPinnedImageCount());
+
+   // The popped slot stays unavailable while pinned
+   EXPECT_TRUE(Insert(100));
+   EXPECT_EQ(0, pinned->GetPixels()[0]);
+   EXPECT_EQ(1u, cbuf_.GetDroppedImageCount());
+
+   EXPECT_TRUE(cbuf_.ReleasePinnedImage(pinned->GetPixels()));
+   EXPECT_FALSE(cbuf_.ReleasePinnedImage(pinned->GetPixels()));
+   EXPECT_EQ(0u, cbuf_.GetPinnedImageCount());
+   EXPECT_TRUE(Insert(101));
+   for (unsigned i = 1; i < g_Capacity; ++i)
+      EXPECT_EQ((int)i, Pop());
+   EXPECT_EQ(101, Pop());
+}
+
+TEST_F(CircularBufferOverflowTests, PinnedFrameSurvivesClearAndReallocation)
+{
+   Fill();
+   const mm::ImgBuffer* pinned = cbuf_.GetNextImageBufferPinned(0);
+   ASSERT_TRUE(pinned != 0);
+   const unsigned char* pixels = pinned->GetPixels();
+   EXPECT_EQ(g_Width * g_Height, cbuf_.GetPinnedImageByteCount(pixels));
+
+   cbuf_.Clear();
+   EXPECT_EQ(1u, cbuf_.GetPinnedImageCount());
+   for (unsigned i = 0; i < 2 * g_Capacity; ++i)
+      Insert(100);
+   EXPECT_EQ(0, pixels[0]);
+
+   EXPECT_FALSE(cbuf_.Initialize(1, g_Width / 2, g_Height, 1));
+   EXPECT_EQ(0, pixels[0]);
+
+   EXPECT_TRUE(cbuf_.ReleasePinnedImage(pixels));
+   EXPECT_EQ(0u, cbuf_.GetPinnedImageByteCount(pixels));
+   EXPECT_TRUE(cbuf_.Initialize(1, g_Width / 2, g_Height, 1));
+}
+
+TEST_F(CircularBufferOverflowTests, CoordinateIndexFindsLatestFrames)
+{
+   cbuf_.SetOverflowPolicy(CircularBuffer::OverflowDropOldest);
+   cbuf_.SetCoordinateIndexEnabled(true);
+   for (unsigned char frame = 0; frame < 6; ++frame)
+      ASSERT_TRUE(Insert(frame, 2));
+
+   CircularBuffer::Coordinates coords = { "Camera", 2, 0, 0, 5 };
+   const mm::ImgBuffer* found = cbuf_.GetImageBufferAt(coords);
+   ASSERT_TRUE(found != 0);
+   EXPECT_EQ(5, found->GetPixels()[0]);
+
+   // Frames 0 and 1 have been overwritten
+   coords.frame = 1;
+   EXPECT_TRUE(cbuf_.GetImageBufferAt(coords) == 0);
+   coords.frame = 2;
+   ASSERT_TRUE(cbuf_.GetImageBufferAt(coords) != 0);
+   EXPECT_EQ(2, cbuf_.GetImageBufferAt(coords)->GetPixels()[0]);
+
+   // Popping does not remove a frame from the index
+   EXPECT_EQ(2, Pop());
+   EXPECT_TRUE(cbuf_.GetImageBufferAt(coords) != 0);
+
+   cbuf_.Clear();
+   EXPECT_TRUE(cbuf_.GetImageBufferAt(coords) == 0);
+}
+
+TEST_F(CircularBufferOverflowTests, CoordinateIndexSeparatesCamerasAndChannels)
+{
+   ASSERT_TRUE(cbuf_.Initialize(2, g_Width, g_Height, 1));
+   cbuf_.SetOverflowPolicy(CircularBuffer::OverflowDropOldest);
+   cbuf_.SetCoordinateIndexEnabled(true);
+   std::vector<unsigned char> pixels(2 * g_Width * g_Height);
+   for (unsigned char n = 0; n < 2; ++n)
+   {
+      // Same (partial) tags; channel 1 of each frame differs from channel 0
+      std::fill(pixels.begin(), pixels.begin() + g_Width * g_Height, 10 * n);
+      std::fill(pixels.begin() + g_Width * g_Height, pixels.end(), 10 * n + 1);
+      Metadata md;
+      md.PutImageTag("Camera", n == 0 ? "Left" : "Right");
+      md.PutImageTag(MM::g_Keyword_Metadata_FrameIndex, 3L);
+      ASSERT_TRUE(cbuf_.InsertMultiChannel(&pixels[0], 2, g_Width, g_Height,
+               1, &md));
+   }
+
+   CircularBuffer::Coordinates coords = { "Left", 0, 0, 0, 3 };
+   ASSERT_TRUE(cbuf_.GetImageBufferAt(coords) != 0);
+   EXPECT_EQ(0, cbuf_.GetImageBufferAt(coords)->GetPixels()[0]);
+   coords.channel = 1;
+   ASSERT_TRUE(cbuf_.GetImageBufferAt(coords) != 0);
+   EXPECT_EQ(1, cbuf_.GetImageBufferAt(coords)->GetPixels()[0]);
+   coords.camera = "Right";
+   ASSERT_TRUE(cbuf_.GetImageBufferAt(coords) != 0);
+   EXPECT_EQ(11, cbuf_.GetImageBufferAt(coords)->GetPixels()[0]);
+   coords.channel = 2;
+   EXPECT_TRUE(cbuf_.GetImageBufferAt(coords) == 0);
+
+   // The channels are numbered from the frame's ChannelIndex
+   Metadata md;
+   md.PutImageTag("Camera", "Left");
+   md.PutImageTag(MM::g_Keyword_Metadata_ChannelIndex, 4L);
+   std::fill(pixels.begin(), pixels.begin() + g_Width * g_Height, 40);
+   std::fill(pixels.begin() + g_Width * g_Height, pixels.end(), 50);
+   ASSERT_TRUE(cbuf_.InsertMultiChannel(&pixels[0], 2, g_Width, g_Height, 1,
+            &md));
+   CircularBuffer::Coordinates channel4 = { "Left", 0, 4, 0, 0 };
+   CircularBuffer::Coordinates channel5 = { "Left", 0, 5, 0, 0 };
+   ASSERT_TRUE(cbuf_.GetImageBufferAt(channel4) != 0);
+   EXPECT_EQ(40, cbuf_.GetImageBufferAt(channel4)->GetPixels()[0]);
+   ASSERT_TRUE(cbuf_.GetImageBufferAt(channel5) != 0);
+   EXPECT_EQ(50, cbuf_.GetImageBufferAt(channel5)->GetPixels()[0]);
+}
+
+int main(int argc, char **argv)
+{
+   ::testing::InitGoogleTest(&argc, argv);
+   return RUN_ALL_TESTS();
+}
@@ -0,0 +1,180 @@
+#include <gtest/gtest.h>
+
+#include "MMCore.h"
+
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <iostream>
+#include <iterator>
+#include <string>
+#include <vector>
+
+#ifndef _WIN32
+#include <unistd.h>
+#endif
+
+// Loads configuration files with devices of the DemoCamera and Utilities
+// adapters, which must have been built (see Makefile.am for where they are
+// looked up). POSIX only.
+#ifndef MM_TEST_ADAPTER_DIR
+#define MM_TEST_ADAPTER_DIR "../../DeviceAdapters/DemoCamera/.libs"
+#endif
+#ifndef MM_TEST_DEVICEADAPTERS_DIR
+#define MM_TEST_DEVICEADAPTERS_DIR "../../DeviceAdapters"
+#endif
+
+#ifndef _WIN32
+
+namespace {
+
+// The device properties of lines 5-10 are applied together, the DemoCamera
+// lines and the Utilities lines in parallel. Lines 7 and 8 fail.
+const char* const g_Config[] = {
+   "Device,Shutter,DemoCamera,DShutter",
+   "Device,Camera,DemoCamera,DCam",
+   "Device,Multi,Utilities,Multi Shutter",
+   "Property,Core,Initialize,1",
+   "Property,Camera,Exposure,20",
+   "Property,Multi,Physical Shutter 1,Shutter",
+   "Property,Camera,Binning,3",
+   "Property,Multi,Physical Shutter 2,NoSuchShutter",
+   "Property,Camera,Exposure,30",
+   "Property,Multi,Physical Shutter 3,Shutter",
+};
+
+class ConfigFilePropertiesTests : public ::testing::Test
+{
+protected:
+   ConfigFilePropertiesTests() : available_(false) {}
+
+   virtual void SetUp()
+   {
+      std::vector<std::string> paths;
+      paths.push_back(MM_TEST_ADAPTER_DIR);
+      paths.push_back(std::string(MM_TEST_DEVICEADAPTERS_DIR) + "/Utilities/.libs");
+      core_.setDeviceAdapterSearchPaths(paths);
+      try
+      {
+         core_.getAvailableDevices("DemoCamera");
+         core_.getAvailableDevices("Utilities");
+      }
+      catch (const CMMError& e)
+      {
+         std::cerr << "Adapters not available; skipping (" << e.getMsg() <<
+            ")" << std::endl;
+         return;
+      }
+      available_ = true;
+
+      char configFile[] = "/tmp/mmconfig-XXXXXX";
+      close(mkstemp(configFile));
+      configFile_ = configFile;
+      std::ofstream config(configFile);
+      for (size_t i = 0; i < sizeof(g_Config) / sizeof(g_Config[0]); ++i)
+         config << g_Config[i] << '\n';
+
+      char logFile[] = "/tmp/mmconfiglog-XXXXXX";
+      close(mkstemp(logFile));
+      logFile_ = logFile;
+   }
+
+   virtual void TearDown()
+   {
+      if (!configFile_.empty())
+         remove(configFile_.c_str());
+      if (!logFile_.empty())
+         remove(logFile_.c_str());
+   }
+
+   // Loads the configuration, which fails, and returns the error message.
+   // The properties set are recorded in the debug log.
+   std::string LoadConfig()
+   {
+      int log = core_.startSecondaryLogFile(logFile_.c_str(), true, true, true);
+      std::string msg;
+      try
+      {
+         core_.loadSystemConfiguration(configFile_.c_str());
+      }
+      catch (const CMMError& e)
+      {
+         msg = e.getMsg();
+      }
+      core_.stopSecondaryLogFile(log);
+      return msg;
+   }
+
+   bool LogContains(const std::string& s)
+   {
+      std::ifstream log(logFile_.c_str());
+      std::string text((std::istreambuf_iterator<char>(log)),
+            std::istreambuf_iterator<char>());
+      return text.find(s) != std::string::npos;
+   }
+
+   bool WasSet(const std::string& name, const std::string& value)
+   {
+      return LogContains("Did set property \"" + name + "\" to \"" +
+            value + "\"");
+   }
+
+   bool WasAttempted(const std::string& name, const std::string& value)
+   {
+      return LogContains("Will set property \"" + name + "\" to \"" +
+            value + "\"");
+   }
+
+   void ExpectEarliestFailureWins()
+   {
+      std::string msg = LoadConfig();
+      EXPECT_EQ(0u, msg.find("Line 7: Property,Camera,Binning,3")) << msg;
+
+      // Earlier lines have been applied
+      EXPECT_TRUE(WasSet("Exposure", "20"));
+      EXPECT_TRUE(WasSet("Physical Shutter 1", "Shutter"));
+      // Later lines have not
+      EXPECT_FALSE(WasAttempted("Exposure", "30"));
+      EXPECT_FALSE(WasAttempted("Physical Shutter 3", "Shutter"));
+   }
+
+   CMMCore core_;
+   bool available_;
+   std::string configFile_;
+   std::string logFile_;
+};
+
+} // anonymous namespace
+
+TEST_F(ConfigFilePropertiesTests, EarliestFailureWinsInParallel)
+{
+   if (!available_)
+      return;
+   core_.enableParallelConfigLoading(true);
+   ExpectEarliestFailureWins();
+}
+
+TEST_F(ConfigFilePropertiesTests, EarliestFailureWinsOneByOne)
+{
+   if (!available_)
+      return;
+   core_.enableParallelConfigLoading(false);
+   ExpectEarliestFailureWins();
+   // Applied one by one, the later failing line is never reached
+   EXPECT_FALSE(WasAttempted("Physical Shutter 2", "NoSuchShutter"));
+}
+
+int main(int argc, char **argv)
+{
+   ::testing::InitGoogleTest(&argc, argv);
+   return RUN_ALL_TESTS();
+}
+
+#else // _WIN32
+
+int main(int, char**)
+{
+   return 0;
+}
+
+#endif // _WIN32
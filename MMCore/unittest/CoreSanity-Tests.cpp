@@ -24,6 +24,24 @@ TEST(CoreSanityTests, CreateAndReset)
    c.reset();
 }
 
+TEST(CoreSanityTests, DeviceHandleOfNoDeviceIsInvalid)
+{
+   CMMCore c;
+   EXPECT_THROW(c.getDeviceHandle("NoSuchDevice"), CMMError);
+
+   DeviceHandle handle;
+   EXPECT_FALSE(handle.isValid());
+   try
+   {
+      c.getPosition(handle);
+      FAIL();
+   }
+   catch (const CMMError& e)
+   {
+      EXPECT_EQ(MMERR_InvalidDeviceHandle, e.getCode());
+   }
+}
+
 int main(int argc, char **argv)
 {
    ::testing::InitGoogleTest(&argc, argv);
@@ -0,0 +1,120 @@
+#include <gtest/gtest.h>
+
+#include "LoadableModules/DeviceAdapterIndex.h"
+
+#include <cstdio>
+#include <sstream>
+
+using mm::AdapterDeviceInfo;
+using mm::AdapterModuleInfo;
+using mm::DeviceAdapterIndex;
+
+
+static AdapterModuleInfo MakeModule()
+{
+   AdapterModuleInfo info;
+   info.name = "Demo";
+   info.path = "/path/with\ttab/libmmgr_dal_Demo";
+   info.mtime = 1400000000;
+   info.size = 123456;
+
+   AdapterDeviceInfo camera;
+   camera.name = "DCam";
+   camera.description = "Demo camera\nwith a \\ backslash";
+   camera.type = MM::CameraDevice;
+   info.devices.push_back(camera);
+
+   AdapterDeviceInfo stage;
+   stage.name = "DStage";
+   stage.description = "";
+   stage.type = MM::StageDevice;
+   info.devices.push_back(stage);
+   return info;
+}
+
+
+TEST(DeviceAdapterIndexTests, RecordRoundTrip)
+{
+   AdapterModuleInfo info = MakeModule();
+   std::stringstream ss;
+   DeviceAdapterIndex::WriteRecord(ss, info);
+   DeviceAdapterIndex::WriteRecord(ss, info);
+
+   for (int i = 0; i < 2; ++i)
+   {
+      AdapterModuleInfo read;
+      ASSERT_TRUE(DeviceAdapterIndex::ReadRecord(ss, read));
+      EXPECT_EQ(info.name, read.name);
+      EXPECT_EQ(info.path, read.path);
+      EXPECT_EQ(info.mtime, read.mtime);
+      EXPECT_EQ(info.size, read.size);
+      EXPECT_TRUE(read.error.empty());
+      EXPECT_FALSE(read.probeFailed);
+      ASSERT_EQ(2u, read.devices.size());
+      EXPECT_EQ("DCam", read.devices[0].name);
+      EXPECT_EQ(info.devices[0].description, read.devices[0].description);
+      EXPECT_EQ(MM::CameraDevice, read.devices[0].type);
+      EXPECT_EQ("", read.devices[1].description);
+      EXPECT_EQ(MM::StageDevice, read.devices[1].type);
+   }
+   AdapterModuleInfo read;
+   EXPECT_FALSE(DeviceAdapterIndex::ReadRecord(ss, read));
+}
+
+
+TEST(DeviceAdapterIndexTests, ProbeFailureRoundTrip)
+{
+   AdapterModuleInfo info = MakeModule();
+   info.devices.clear();
+   info.error = "Listing the devices failed";
+   info.probeFailed = true;
+   std::stringstream ss;
+   DeviceAdapterIndex::WriteRecord(ss, info);
+
+   AdapterModuleInfo read;
+   ASSERT_TRUE(DeviceAdapterIndex::ReadRecord(ss, read));
+   EXPECT_EQ(info.error, read.error);
+   EXPECT_TRUE(read.probeFailed);
+   EXPECT_TRUE(read.devices.empty());
+}
+
+
+TEST(DeviceAdapterIndexTests, TruncatedRecordIsRejected)
+{
+   std::stringstream ss;
+   DeviceAdapterIndex::WriteRecord(ss, MakeModule());
+   std::string text = ss.str();
+   std::istringstream truncated(text.substr(0, text.rfind("device\t")));
+   AdapterModuleInfo read;
+   EXPECT_FALSE(DeviceAdapterIndex::ReadRecord(truncated, read));
+}
+
+
+TEST(DeviceAdapterIndexTests, LookupRequiresMatchingStamp)
+{
+   const std::string filename = "DeviceAdapterIndex-Tests.tmp";
+   AdapterModuleInfo info = MakeModule();
+   {
+      DeviceAdapterIndex index;
+      index.Store(info);
+      index.Save(filename);
+   }
+
+   DeviceAdapterIndex index;
+   index.Load(filename);
+   std::remove(filename.c_str());
+
+   AdapterModuleInfo found;
+   EXPECT_TRUE(index.Lookup(info.path, info.mtime, info.size, found));
+   EXPECT_EQ(2u, found.devices.size());
+   EXPECT_FALSE(index.Lookup(info.path, info.mtime + 1, info.size, found));
+   EXPECT_FALSE(index.Lookup(info.path, info.mtime, info.size + 1, found));
+   EXPECT_FALSE(index.Lookup("/other/path", info.mtime, info.size, found));
+}
+
+
+int main(int argc, char **argv)
+{
+   ::testing::InitGoogleTest(&argc, argv);
+   return RUN_ALL_TESTS();
+}
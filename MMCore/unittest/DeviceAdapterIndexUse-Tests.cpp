@@ -0,0 +1,182 @@
+#include <gtest/gtest.h>
+
+#include "MMCore.h"
+#include "LoadableModules/DeviceAdapterIndex.h"
+
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <string>
+#include <vector>
+
+#ifndef _WIN32
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+using mm::AdapterDeviceInfo;
+using mm::AdapterModuleInfo;
+using mm::DeviceAdapterIndex;
+
+// Lists the devices of a module file that cannot be loaded, so that any
+// attempt to load it fails. POSIX only.
+#ifndef _WIN32
+
+namespace {
+
+class DeviceAdapterIndexUseTests : public ::testing::Test
+{
+protected:
+   virtual void SetUp()
+   {
+      char dir[] = "/tmp/mmindex-XXXXXX";
+      ASSERT_TRUE(mkdtemp(dir) != 0);
+      dir_ = dir;
+      modulePath_ = dir_ + "/libmmgr_dal_Fake.so.0";
+      indexPath_ = dir_ + "/index.txt";
+      probeRunsPath_ = dir_ + "/probe-runs";
+      WriteFile(modulePath_, "not a shared library");
+      core_.setDeviceAdapterSearchPaths(std::vector<std::string>(1, dir_));
+   }
+
+   virtual void TearDown()
+   {
+      const char* files[] = { "libmmgr_dal_Fake.so.0", "index.txt",
+         "probe-runs", "mmdeviceprobe" };
+      for (size_t i = 0; i < sizeof(files) / sizeof(files[0]); ++i)
+         remove((dir_ + "/" + files[i]).c_str());
+      rmdir(dir_.c_str());
+   }
+
+   static void WriteFile(const std::string& path, const std::string& contents)
+   {
+      std::ofstream f(path.c_str(), std::ios::binary | std::ios::trunc);
+      f << contents;
+   }
+
+   // Writes an index listing one camera for the module as it is now
+   void WriteIndex(bool probeFailed)
+   {
+      AdapterModuleInfo info;
+      info.name = "Fake";
+      info.path = modulePath_;
+      ASSERT_TRUE(DeviceAdapterIndex::GetFileStamp(info.path, info.mtime,
+               info.size));
+      info.probeFailed = probeFailed;
+      if (probeFailed)
+         info.error = "Listing the devices failed in mmdeviceprobe";
+      else
+      {
+         AdapterDeviceInfo camera;
+         camera.name = "FakeCam";
+         camera.description = "Indexed camera";
+         camera.type = MM::CameraDevice;
+         info.devices.push_back(camera);
+      }
+      DeviceAdapterIndex index;
+      index.Store(info);
+      index.Save(indexPath_);
+   }
+
+   // Installs a probe that records each run and then fails
+   void InstallFailingProbe()
+   {
+      const std::string probe = dir_ + "/mmdeviceprobe";
+      WriteFile(probe, "#!/bin/sh\necho run >> '" + probeRunsPath_ +
+            "'\nexit 1\n");
+      chmod(probe.c_str(), 0755);
+   }
+
+   long CountProbeRuns()
+   {
+      std::ifstream f(probeRunsPath_.c_str());
+      long runs = 0;
+      std::string line;
+      while (std::getline(f, line))
+         ++runs;
+      return runs;
+   }
+
+   CMMCore core_;
+   std::string dir_;
+   std::string modulePath_;
+   std::string indexPath_;
+   std::string probeRunsPath_;
+};
+
+} // anonymous namespace
+
+TEST_F(DeviceAdapterIndexUseTests, IndexedModuleIsNotLoaded)
+{
+   WriteIndex(false);
+   core_.setDeviceAdapterIndexFile(indexPath_.c_str());
+
+   std::vector<std::string> names = core_.getAvailableDevices("Fake");
+   ASSERT_EQ(1u, names.size());
+   EXPECT_EQ("FakeCam", names[0]);
+   EXPECT_EQ("Indexed camera", core_.getAvailableDeviceDescriptions("Fake")[0]);
+   EXPECT_EQ((long) MM::CameraDevice, core_.getAvailableDeviceTypes("Fake")[0]);
+
+   // Without the index the module would have to be loaded
+   core_.setDeviceAdapterIndexFile("");
+   EXPECT_THROW(core_.getAvailableDevices("Fake"), CMMError);
+}
+
+TEST_F(DeviceAdapterIndexUseTests, ChangedModuleIsNotTakenFromIndex)
+{
+   WriteIndex(false);
+   WriteFile(modulePath_, "a different module");
+   core_.setDeviceAdapterIndexFile(indexPath_.c_str());
+   EXPECT_THROW(core_.getAvailableDevices("Fake"), CMMError);
+}
+
+TEST_F(DeviceAdapterIndexUseTests, ProbeFailureIsRecorded)
+{
+   InstallFailingProbe();
+   core_.setDeviceAdapterIndexFile(indexPath_.c_str());
+   EXPECT_THROW(core_.getAvailableDevices("Fake"), CMMError);
+   EXPECT_EQ(1, CountProbeRuns());
+
+   // Neither probed again nor loaded, also by the next session
+   EXPECT_THROW(core_.getAvailableDevices("Fake"), CMMError);
+   CMMCore other;
+   other.setDeviceAdapterSearchPaths(std::vector<std::string>(1, dir_));
+   other.setDeviceAdapterIndexFile(indexPath_.c_str());
+   EXPECT_THROW(other.getAvailableDevices("Fake"), CMMError);
+   EXPECT_EQ(1, CountProbeRuns());
+
+   // Until the module changes
+   WriteFile(modulePath_, "a different module");
+   EXPECT_THROW(other.getAvailableDevices("Fake"), CMMError);
+   EXPECT_EQ(2, CountProbeRuns());
+}
+
+TEST_F(DeviceAdapterIndexUseTests, RecordedProbeFailureIsReported)
+{
+   WriteIndex(true);
+   core_.setDeviceAdapterIndexFile(indexPath_.c_str());
+   try
+   {
+      core_.getAvailableDevices("Fake");
+      FAIL() << "No error for a module that failed to be listed";
+   }
+   catch (const CMMError& e)
+   {
+      EXPECT_NE(std::string::npos, e.getMsg().find("mmdeviceprobe"));
+   }
+}
+
+int main(int argc, char **argv)
+{
+   ::testing::InitGoogleTest(&argc, argv);
+   return RUN_ALL_TESTS();
+}
+
+#else // _WIN32
+
+int main(int, char**)
+{
+   return 0;
+}
+
+#endif // _WIN32
@@ -0,0 +1,127 @@
+#include <gtest/gtest.h>
+
+#include "DeviceCommandExecutor.h"
+#include "LogManager.h"
+
+#include <boost/bind.hpp>
+#include <boost/thread/thread.hpp>
+
+#include <string>
+#include <vector>
+
+namespace {
+
+class DeviceCommandExecutorTests : public ::testing::Test
+{
+protected:
+   DeviceCommandExecutorTests() :
+      executor_(logManager_.NewLogger("Test"))
+   {}
+
+   // Records the start and end of a command, after waiting for delayMs
+   void Step(std::string name, long delayMs)
+   {
+      Record(name + "+");
+      boost::this_thread::sleep(boost::posix_time::milliseconds(delayMs));
+      Record(name + "-");
+   }
+
+   void Record(const std::string& event)
+   {
+      boost::mutex::scoped_lock lock(mutex_);
+      events_.push_back(event);
+   }
+
+   AsyncCommand Submit(const std::string& name, const char* device,
+         long delayMs)
+   {
+      return Submit(name, std::vector<std::string>(1, device), delayMs);
+   }
+
+   AsyncCommand Submit(const std::string& name,
+         const std::vector<std::string>& devices, long delayMs)
+   {
+      return executor_.Submit(name, devices,
+            boost::bind(&DeviceCommandExecutorTests::Step, this, name,
+               delayMs));
+   }
+
+   size_t IndexOf(const std::string& event)
+   {
+      boost::mutex::scoped_lock lock(mutex_);
+      for (size_t i = 0; i < events_.size(); ++i)
+         if (events_[i] == event)
+            return i;
+      return events_.size();
+   }
+
+   mm::LogManager logManager_;
+   boost::mutex mutex_;
+   std::vector<std::string> events_;
+   mm::DeviceCommandExecutor executor_;
+};
+
+void Fail()
+{
+   throw CMMError("device error", MMERR_DEVICE_GENERIC);
+}
+
+} // anonymous namespace
+
+TEST_F(DeviceCommandExecutorTests, SameDeviceRunsInOrder)
+{
+   AsyncCommand a = Submit("a", "Stage", 30);
+   AsyncCommand b = Submit("b", "Stage", 0);
+   b.waitForCompletion();
+   EXPECT_TRUE(a.isDone());
+   EXPECT_LT(IndexOf("a-"), IndexOf("b+"));
+}
+
+TEST_F(DeviceCommandExecutorTests, DifferentDevicesOverlap)
+{
+   AsyncCommand a = Submit("a", "XY", 100);
+   AsyncCommand b = Submit("b", "Z", 100);
+   EXPECT_FALSE(a.waitForCompletion(0));
+   a.waitForCompletion();
+   b.waitForCompletion();
+   EXPECT_LT(IndexOf("b+"), IndexOf("a-"));
+   EXPECT_LT(IndexOf("a+"), IndexOf("b-"));
+}
+
+TEST_F(DeviceCommandExecutorTests, MultiDeviceCommandWaitsForEachDevice)
+{
+   AsyncCommand a = Submit("a", "XY", 50);
+   std::vector<std::string> devices;
+   devices.push_back("Z");
+   devices.push_back("XY");
+   AsyncCommand b = Submit("b", devices, 0);
+   // Queued after b, which uses Z
+   AsyncCommand c = Submit("c", "Z", 0);
+   executor_.WaitForIdle();
+   EXPECT_TRUE(a.isDone() && b.isDone() && c.isDone());
+   EXPECT_LT(IndexOf("a-"), IndexOf("b+"));
+   EXPECT_LT(IndexOf("b-"), IndexOf("c+"));
+}
+
+TEST_F(DeviceCommandExecutorTests, ErrorIsThrownByWait)
+{
+   AsyncCommand failed = executor_.Submit("fail",
+         std::vector<std::string>(1, "Shutter"), &Fail);
+   try
+   {
+      failed.waitForCompletion();
+      FAIL();
+   }
+   catch (const CMMError& e)
+   {
+      EXPECT_EQ(MMERR_DEVICE_GENERIC, e.getCode());
+   }
+   EXPECT_TRUE(failed.isDone());
+   EXPECT_TRUE(AsyncCommand().isDone());
+}
+
+int main(int argc, char **argv)
+{
+   ::testing::InitGoogleTest(&argc, argv);
+   return RUN_ALL_TESTS();
+}
@@ -0,0 +1,146 @@
+#include <gtest/gtest.h>
+
+#include "MMCore.h"
+
+#include <boost/bind.hpp>
+#include <boost/thread/thread.hpp>
+#include <boost/thread/thread_time.hpp>
+
+#include <iostream>
+#include <string>
+#include <vector>
+
+// Uses the DemoCamera adapter, which declares per-hub concurrency, and must
+// have been built (see Makefile.am for where it is looked up).
+#ifndef MM_TEST_ADAPTER_DIR
+#define MM_TEST_ADAPTER_DIR "../../DeviceAdapters/DemoCamera/.libs"
+#endif
+
+namespace {
+
+const long g_DisplayMs = 400;
+
+// Two demo hubs, each with an SLM whose displays take g_DisplayMs. A display
+// holds the lock of the SLM's device for its duration.
+class DeviceModuleLockTests : public ::testing::Test
+{
+protected:
+   DeviceModuleLockTests() : available_(false) {}
+
+   virtual void SetUp()
+   {
+      core_.setDeviceAdapterSearchPaths(
+            std::vector<std::string>(1, MM_TEST_ADAPTER_DIR));
+      try
+      {
+         core_.loadDevice("Hub1", "DemoCamera", "DHub");
+      }
+      catch (const CMMError& e)
+      {
+         std::cerr << "DemoCamera adapter not available; skipping (" <<
+            e.getMsg() << ")" << std::endl;
+         return;
+      }
+      available_ = true;
+      core_.loadDevice("Hub2", "DemoCamera", "DHub");
+      LoadSLM("SLM1", "Hub1");
+      LoadSLM("SLM2", "Hub2");
+      core_.initializeAllDevices();
+      core_.setProperty("SLM1", "DisplayDelayMs", (double) g_DisplayMs);
+      core_.setProperty("SLM2", "DisplayDelayMs", (double) g_DisplayMs);
+   }
+
+   void LoadSLM(const char* label, const char* hub)
+   {
+      core_.loadDevice(label, "DemoCamera", "DSLM");
+      core_.setParentLabel(label, hub);
+   }
+
+   // Displays on an SLM in the background
+   void StartDisplay(const char* label)
+   {
+      threads_.create_thread(boost::bind(&CMMCore::displaySLMImage, &core_,
+               label));
+   }
+
+   // Time taken by a quick call on a device, which includes waiting for its
+   // lock
+   long TimeGetPropertyMs(const char* label)
+   {
+      boost::system_time start = boost::get_system_time();
+      core_.getProperty(label, "Displays");
+      return (long) (boost::get_system_time() - start).total_milliseconds();
+   }
+
+   static void Sleep(long ms)
+   {
+      boost::this_thread::sleep(boost::posix_time::milliseconds(ms));
+   }
+
+   CMMCore core_;
+   bool available_;
+   boost::thread_group threads_;
+};
+
+} // anonymous namespace
+
+TEST_F(DeviceModuleLockTests, HubsDoNotBlockEachOther)
+{
+   if (!available_)
+      return;
+   StartDisplay("SLM1");
+   Sleep(g_DisplayMs / 4);
+   EXPECT_LT(TimeGetPropertyMs("SLM2"), g_DisplayMs / 4);
+   // The same hub is blocked
+   EXPECT_GT(TimeGetPropertyMs("SLM1"), g_DisplayMs / 4);
+   threads_.join_all();
+}
+
+TEST_F(DeviceModuleLockTests, UnresolvedPeripheralTakesModuleLock)
+{
+   if (!available_)
+      return;
+   // A peripheral of no known hub may share state with either hub
+   core_.loadDevice("SLM3", "DemoCamera", "DSLM");
+   StartDisplay("SLM1");
+   Sleep(g_DisplayMs / 4);
+   EXPECT_GT(TimeGetPropertyMs("SLM2"), g_DisplayMs / 4);
+   threads_.join_all();
+
+   core_.setParentLabel("SLM3", "Hub1");
+   StartDisplay("SLM1");
+   Sleep(g_DisplayMs / 4);
+   EXPECT_LT(TimeGetPropertyMs("SLM2"), g_DisplayMs / 4);
+   threads_.join_all();
+}
+
+TEST_F(DeviceModuleLockTests, CallWaitingDuringRemappingTakesNewLock)
+{
+   if (!available_)
+      return;
+   LoadSLM("SLM3", "Hub1");
+
+   // Holds Hub2's lock
+   StartDisplay("SLM2");
+   Sleep(g_DisplayMs / 8);
+
+   // Unresolving SLM3 moves every device to the module lock. The change
+   // holds the module lock and Hub1's lock while it waits for Hub2's.
+   threads_.create_thread(boost::bind(&CMMCore::setParentLabel, &core_,
+            "SLM3", ""));
+   Sleep(g_DisplayMs / 8);
+
+   // Waits for Hub1's lock, which is no longer SLM1's lock when obtained
+   StartDisplay("SLM1");
+   Sleep(g_DisplayMs);
+
+   // SLM1 is now displaying, holding the module lock, which SLM2 also needs
+   EXPECT_GT(TimeGetPropertyMs("SLM2"), g_DisplayMs / 4);
+   threads_.join_all();
+}
+
+int main(int argc, char **argv)
+{
+   ::testing::InitGoogleTest(&argc, argv);
+   return RUN_ALL_TESTS();
+}
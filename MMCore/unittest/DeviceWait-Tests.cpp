@@ -0,0 +1,134 @@
+#include <gtest/gtest.h>
+
+#include "MMCore.h"
+
+#include <boost/bind.hpp>
+#include <boost/thread/thread.hpp>
+#include <boost/thread/thread_time.hpp>
+
+#include <iostream>
+#include <string>
+#include <vector>
+
+// Uses the stages and SLM of the DemoCamera adapter, which must have been
+// built (see Makefile.am for where it is looked up).
+#ifndef MM_TEST_ADAPTER_DIR
+#define MM_TEST_ADAPTER_DIR "../../DeviceAdapters/DemoCamera/.libs"
+#endif
+
+namespace {
+
+// Three stages that are busy for 100, 200 and 300 ms after each move
+class DeviceWaitTests : public ::testing::Test
+{
+protected:
+   DeviceWaitTests() : available_(false) {}
+
+   virtual void SetUp()
+   {
+      core_.setDeviceAdapterSearchPaths(
+            std::vector<std::string>(1, MM_TEST_ADAPTER_DIR));
+      try
+      {
+         core_.loadDevice("Z1", "DemoCamera", "DStage");
+      }
+      catch (const CMMError& e)
+      {
+         std::cerr << "DemoCamera adapter not available; skipping (" <<
+            e.getMsg() << ")" << std::endl;
+         return;
+      }
+      available_ = true;
+      core_.loadDevice("Z2", "DemoCamera", "DStage");
+      core_.loadDevice("Z3", "DemoCamera", "DStage");
+      core_.initializeAllDevices();
+      core_.setProperty("Z1", "MoveTimeMs", 100.0);
+      core_.setProperty("Z2", "MoveTimeMs", 200.0);
+      core_.setProperty("Z3", "MoveTimeMs", 300.0);
+   }
+
+   void MoveAll()
+   {
+      core_.setPosition("Z1", 1.0);
+      core_.setPosition("Z2", 2.0);
+      core_.setPosition("Z3", 3.0);
+   }
+
+   static long ElapsedMs(const boost::system_time& start)
+   {
+      return (long) (boost::get_system_time() - start).total_milliseconds();
+   }
+
+   CMMCore core_;
+   bool available_;
+};
+
+} // anonymous namespace
+
+TEST_F(DeviceWaitTests, WaitLastsAsLongAsTheSlowestDevice)
+{
+   if (!available_)
+      return;
+   boost::system_time start = boost::get_system_time();
+   MoveAll();
+   core_.waitForSystem();
+   long elapsedMs = ElapsedMs(start);
+   EXPECT_FALSE(core_.systemBusy());
+   // Waiting for one device after another would take 600 ms
+   EXPECT_GE(elapsedMs, 290);
+   EXPECT_LT(elapsedMs, 450);
+
+   start = boost::get_system_time();
+   MoveAll();
+   core_.waitForDeviceType(MM::StageDevice);
+   elapsedMs = ElapsedMs(start);
+   EXPECT_GE(elapsedMs, 290);
+   EXPECT_LT(elapsedMs, 450);
+}
+
+TEST_F(DeviceWaitTests, QuickDeviceIsNotChargedAFullPollingInterval)
+{
+   if (!available_)
+      return;
+   core_.setProperty("Z1", "MoveTimeMs", 2.0);
+   long totalMs = 0;
+   const int moves = 10;
+   for (int i = 0; i < moves; ++i)
+   {
+      boost::system_time start = boost::get_system_time();
+      core_.setPosition("Z1", (double) i);
+      core_.waitForDevice("Z1");
+      totalMs += ElapsedMs(start);
+   }
+   // Polling at 1, 2 and 4 ms notices the end of the move by 7 ms
+   EXPECT_LT(totalMs, moves * 8);
+}
+
+TEST_F(DeviceWaitTests, TimeoutHoldsWhileAnotherThreadHoldsTheDevice)
+{
+   if (!available_)
+      return;
+   core_.loadDevice("SLM", "DemoCamera", "DSLM");
+   core_.initializeDevice("SLM");
+   core_.setProperty("SLM", "DisplayDelayMs", 400.0);
+   core_.setTimeoutMs(100);
+
+   // The display holds the lock of the adapter module, which the stages
+   // share, for 400 ms
+   boost::thread display(boost::bind(&CMMCore::displaySLMImage, &core_,
+            "SLM"));
+   boost::this_thread::sleep(boost::posix_time::milliseconds(50));
+   boost::system_time start = boost::get_system_time();
+   EXPECT_THROW(core_.waitForSystem(), CMMError);
+   long elapsedMs = ElapsedMs(start);
+   display.join();
+   EXPECT_LT(elapsedMs, 200);
+
+   core_.waitForSystem();
+}
+
+int main(int argc, char **argv)
+{
+   ::testing::InitGoogleTest(&argc, argv);
+   return RUN_ALL_TESTS();
+}
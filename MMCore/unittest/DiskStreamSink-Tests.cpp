@@ -0,0 +1,160 @@
+#include <gtest/gtest.h>
+
+#include "CircularBuffer.h"
+#include "DiskStreamSink.h"
+#include "LogManager.h"
+
+#include <boost/make_shared.hpp>
+
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include <unistd.h>
+
+namespace {
+
+const unsigned g_Width = 100;
+const unsigned g_Height = 100;
+const long long g_SlotBytes = 12288; // 100x100x1 rounded up to 4096
+const long long g_HeaderBytes = 4096;
+
+class DiskStreamSinkTests : public ::testing::Test
+{
+protected:
+   DiskStreamSinkTests() : cbuf_(4) {}
+
+   virtual void SetUp()
+   {
+      char tmpl[] = "/tmp/mmstreamtestXXXXXX";
+      ASSERT_TRUE(mkdtemp(tmpl) != 0);
+      directory_ = tmpl;
+      ASSERT_TRUE(cbuf_.Initialize(1, g_Width, g_Height, 1));
+      cbuf_.SetOverflowPolicy(CircularBuffer::OverflowDropOldest);
+   }
+
+   virtual void TearDown()
+   {
+      std::string command = "rm -rf " + directory_;
+      ASSERT_EQ(0, std::system(command.c_str()));
+   }
+
+   boost::shared_ptr<mm::DiskStreamSink> MakeSink(long long maxFileBytes)
+   {
+      return boost::make_shared<mm::DiskStreamSink>(
+            logManager_.NewLogger("Test"), directory_, "test", maxFileBytes,
+            1u);
+   }
+
+   void Insert(unsigned char value)
+   {
+      std::vector<unsigned char> pixels(g_Width * g_Height, value);
+      Metadata md;
+      md.PutImageTag("Camera", "Camera");
+      ASSERT_TRUE(cbuf_.InsertImage(&pixels[0], g_Width, g_Height, 1, &md));
+   }
+
+   std::string Path(const char* name)
+   {
+      return directory_ + "/" + name;
+   }
+
+   long long FileSize(const char* name)
+   {
+      std::ifstream f(Path(name).c_str(), std::ios::binary | std::ios::ate);
+      return f ? (long long)f.tellg() : -1;
+   }
+
+   std::vector<std::string> Lines(const char* name)
+   {
+      std::ifstream f(Path(name).c_str());
+      std::vector<std::string> lines;
+      std::string line;
+      while (std::getline(f, line))
+         lines.push_back(line);
+      return lines;
+   }
+
+   mm::LogManager logManager_;
+   CircularBuffer cbuf_;
+   std::string directory_;
+};
+
+} // anonymous namespace
+
+TEST_F(DiskStreamSinkTests, WritesEveryInsertedFrame)
+{
+   boost::shared_ptr<mm::DiskStreamSink> sink = MakeSink(1LL << 30);
+   sink->Start();
+   cbuf_.SetStreamSink(sink);
+   // More frames than the circular buffer holds
+   for (unsigned i = 0; i < 10; ++i)
+      Insert((unsigned char)i);
+   sink->Stop();
+
+   mm::DiskStreamSink::Statistics stats = sink->GetStatistics();
+   EXPECT_EQ(10u, stats.framesWritten);
+   EXPECT_EQ(0u, stats.framesDropped);
+   EXPECT_EQ(1u, stats.filesWritten);
+   EXPECT_EQ(g_HeaderBytes + 10 * g_SlotBytes, FileSize("test_00000.mmraw"));
+
+   std::ifstream data(Path("test_00000.mmraw").c_str(), std::ios::binary);
+   std::string header(g_HeaderBytes, '\0');
+   data.read(&header[0], g_HeaderBytes);
+   EXPECT_EQ(0u, header.find("MMRawStream\t1\nwidth=100\nheight=100\n"));
+   data.seekg(g_HeaderBytes + 7 * g_SlotBytes);
+   EXPECT_EQ(7, data.get());
+
+   std::vector<std::string> index = Lines("test_00000.mmidx");
+   ASSERT_EQ(11u, index.size());
+   EXPECT_EQ(0u, index[1].find("4096\t0\t"));
+   EXPECT_NE(std::string::npos, index[1].find("\tCamera=Camera"));
+   // Unchanged tags are not repeated
+   EXPECT_EQ(std::string::npos, index[2].find("Camera="));
+   EXPECT_NE(std::string::npos, index[2].find("\tImageNumber=1"));
+}
+
+TEST_F(DiskStreamSinkTests, RollsOverAtSizeLimit)
+{
+   boost::shared_ptr<mm::DiskStreamSink> sink =
+      MakeSink(g_HeaderBytes + 4 * g_SlotBytes);
+   sink->Start();
+   cbuf_.SetStreamSink(sink);
+   for (unsigned i = 0; i < 10; ++i)
+      Insert((unsigned char)i);
+   sink->Stop();
+
+   EXPECT_EQ(3u, sink->GetStatistics().filesWritten);
+   EXPECT_EQ(g_HeaderBytes + 4 * g_SlotBytes, FileSize("test_00000.mmraw"));
+   EXPECT_EQ(g_HeaderBytes + 4 * g_SlotBytes, FileSize("test_00001.mmraw"));
+   EXPECT_EQ(g_HeaderBytes + 2 * g_SlotBytes, FileSize("test_00002.mmraw"));
+   // Each file's index starts with the full set of tags
+   std::vector<std::string> index = Lines("test_00001.mmidx");
+   ASSERT_EQ(5u, index.size());
+   EXPECT_EQ(0u, index[1].find("4096\t4\t"));
+   EXPECT_NE(std::string::npos, index[1].find("\tCamera=Camera"));
+}
+
+TEST_F(DiskStreamSinkTests, RefusesExistingFilesAndMissingDirectory)
+{
+   std::ofstream(Path("test_00000.mmraw").c_str()) << "x";
+   boost::shared_ptr<mm::DiskStreamSink> sink = MakeSink(1LL << 30);
+   sink->Start();
+   cbuf_.SetStreamSink(sink);
+   Insert(1);
+   EXPECT_THROW(sink->Stop(), CMMError);
+   EXPECT_EQ(1, FileSize("test_00000.mmraw"));
+
+   mm::DiskStreamSink missing(logManager_.NewLogger("Test"),
+         Path("nonexistent"), "test", 1LL << 30, 1u);
+   EXPECT_THROW(missing.Start(), CMMError);
+}
+
+int main(int argc, char **argv)
+{
+   ::testing::InitGoogleTest(&argc, argv);
+   return RUN_ALL_TESTS();
+}
@@ -0,0 +1,174 @@
+#include <gtest/gtest.h>
+
+#include "EventDispatcher.h"
+#include "LogManager.h"
+#include "MMEventCallback.h"
+
+#include <boost/thread/condition_variable.hpp>
+#include <boost/thread/mutex.hpp>
+#include <boost/thread/thread.hpp>
+
+#include <sstream>
+#include <string>
+#include <vector>
+
+namespace {
+
+// Records notifications; blocks in the first one until Release() is called
+class RecordingCallback : public MMEventCallback
+{
+public:
+   RecordingCallback() : blocked_(false), released_(false) {}
+
+   void WaitUntilBlocked()
+   {
+      boost::mutex::scoped_lock lock(mutex_);
+      while (!blocked_)
+         cond_.wait(lock);
+   }
+
+   void Release()
+   {
+      boost::mutex::scoped_lock lock(mutex_);
+      released_ = true;
+      cond_.notify_all();
+   }
+
+   bool IsReleased()
+   {
+      boost::mutex::scoped_lock lock(mutex_);
+      return released_;
+   }
+
+   std::vector<std::string> Events()
+   {
+      boost::mutex::scoped_lock lock(mutex_);
+      return events_;
+   }
+
+   void onPropertiesChanged() { Record("*"); }
+
+   void onPropertyChanged(const char* name, const char* propName,
+         const char* propValue)
+   { Record(std::string(name) + "-" + propName + "=" + propValue); }
+
+   void onStagePositionChanged(char* name, double pos)
+   {
+      std::ostringstream oss;
+      oss << name << "=" << pos;
+      Record(oss.str());
+   }
+
+private:
+   void Record(const std::string& event)
+   {
+      boost::mutex::scoped_lock lock(mutex_);
+      events_.push_back(event);
+      blocked_ = true;
+      cond_.notify_all();
+      while (!released_)
+         cond_.wait(lock);
+   }
+
+   boost::mutex mutex_;
+   boost::condition_variable cond_;
+   bool blocked_;
+   bool released_;
+   std::vector<std::string> events_;
+};
+
+void ReleaseAfterDelay(RecordingCallback* callback)
+{
+   boost::this_thread::sleep(boost::posix_time::milliseconds(50));
+   callback->Release();
+}
+
+class EventDispatcherTests : public ::testing::Test
+{
+protected:
+   mm::LogManager logManager_;
+   RecordingCallback callback_;
+};
+
+} // anonymous namespace
+
+TEST_F(EventDispatcherTests, DeliversLatestPositionPerStage)
+{
+   mm::EventDispatcher dispatcher(logManager_.NewLogger("Test"));
+   dispatcher.SetCallback(&callback_);
+   dispatcher.PostStagePositionChanged("Z", 0.0);
+   callback_.WaitUntilBlocked();
+   for (int i = 1; i <= 100; ++i)
+   {
+      dispatcher.PostStagePositionChanged("Z", i);
+      dispatcher.PostStagePositionChanged("F", -i);
+   }
+   callback_.Release();
+   dispatcher.WaitForIdle();
+
+   std::vector<std::string> events = callback_.Events();
+   ASSERT_EQ(3u, events.size());
+   EXPECT_EQ("Z=0", events[0]);
+   EXPECT_EQ("Z=100", events[1]);
+   EXPECT_EQ("F=-100", events[2]);
+}
+
+TEST_F(EventDispatcherTests, LatestPropertyValueMovesToBack)
+{
+   mm::EventDispatcher dispatcher(logManager_.NewLogger("Test"));
+   dispatcher.SetCallback(&callback_);
+   dispatcher.PostPropertiesChanged();
+   callback_.WaitUntilBlocked();
+   dispatcher.PostPropertyChanged("Cam", "Binning", "1");
+   dispatcher.PostPropertyChanged("Cam", "Gain", "5");
+   dispatcher.PostPropertyChanged("Cam", "Binning", "2");
+   callback_.Release();
+   dispatcher.WaitForIdle();
+
+   std::vector<std::string> events = callback_.Events();
+   ASSERT_EQ(3u, events.size());
+   EXPECT_EQ("Cam-Gain=5", events[1]);
+   EXPECT_EQ("Cam-Binning=2", events[2]);
+}
+
+TEST_F(EventDispatcherTests, SetCallbackWaitsForDelivery)
+{
+   mm::EventDispatcher dispatcher(logManager_.NewLogger("Test"));
+   dispatcher.SetCallback(&callback_);
+   dispatcher.PostStagePositionChanged("Z", 1.0);
+   callback_.WaitUntilBlocked();
+
+   boost::thread releaser(ReleaseAfterDelay, &callback_);
+   dispatcher.SetCallback(0);
+   // The previous listener has returned and will not be called again
+   EXPECT_TRUE(callback_.IsReleased());
+   dispatcher.PostStagePositionChanged("Z", 2.0);
+   dispatcher.WaitForIdle();
+   releaser.join();
+   EXPECT_EQ(1u, callback_.Events().size());
+}
+
+TEST_F(EventDispatcherTests, OverflowIsReportedAsPropertiesChanged)
+{
+   mm::EventDispatcher dispatcher(logManager_.NewLogger("Test"), 2);
+   dispatcher.SetCallback(&callback_);
+   dispatcher.PostStagePositionChanged("Z", 0.0);
+   callback_.WaitUntilBlocked();
+   dispatcher.PostPropertyChanged("Cam", "A", "1");
+   dispatcher.PostPropertyChanged("Cam", "B", "1");
+   dispatcher.PostPropertyChanged("Cam", "C", "1");
+   callback_.Release();
+   dispatcher.WaitForIdle();
+
+   std::vector<std::string> events = callback_.Events();
+   ASSERT_EQ(4u, events.size());
+   EXPECT_EQ("Cam-A=1", events[1]);
+   EXPECT_EQ("Cam-B=1", events[2]);
+   EXPECT_EQ("*", events[3]);
+}
+
+int main(int argc, char **argv)
+{
+   ::testing::InitGoogleTest(&argc, argv);
+   return RUN_ALL_TESTS();
+}
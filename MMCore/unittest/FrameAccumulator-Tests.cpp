@@ -0,0 +1,135 @@
+#include <gtest/gtest.h>
+
+#include "FrameAccumulator.h"
+#include "LogManager.h"
+#include "ThreadPool.h"
+
+#include <boost/cstdint.hpp>
+#include <boost/make_shared.hpp>
+
+#include <vector>
+
+namespace {
+
+class FrameAccumulatorTests : public ::testing::Test
+{
+protected:
+   FrameAccumulatorTests() : pool_(boost::make_shared<ThreadPool>()) {}
+
+   boost::shared_ptr<mm::FrameAccumulator> Make(
+         mm::FrameAccumulator::Mode mode, unsigned frameCount)
+   {
+      return boost::make_shared<mm::FrameAccumulator>(
+            logManager_.NewLogger("Test"), mode, frameCount, pool_);
+   }
+
+   // Adds a 16-bit frame of the given size filled with value
+   static bool Add16(mm::FrameAccumulator& acc, unsigned width,
+         unsigned height, boost::uint16_t value,
+         std::vector<boost::uint16_t>& result)
+   {
+      std::vector<boost::uint16_t> frame(width * height, value);
+      mm::FrameAccumulator::Result pixels;
+      if (!acc.Add(&source_, reinterpret_cast<unsigned char*>(&frame[0]),
+               width, height, 2, 1, 1, pixels))
+         return false;
+      const boost::uint16_t* p =
+         reinterpret_cast<const boost::uint16_t*>(&(*pixels)[0]);
+      result.assign(p, p + frame.size());
+      return true;
+   }
+
+   static int source_;
+   mm::LogManager logManager_;
+   boost::shared_ptr<ThreadPool> pool_;
+};
+
+int FrameAccumulatorTests::source_ = 0;
+
+} // anonymous namespace
+
+TEST_F(FrameAccumulatorTests, MeanIsEmittedEveryNthFrame)
+{
+   boost::shared_ptr<mm::FrameAccumulator> acc =
+      Make(mm::FrameAccumulator::ModeMean, 4);
+   std::vector<boost::uint16_t> result;
+   EXPECT_FALSE(Add16(*acc, 8, 8, 100, result));
+   EXPECT_FALSE(Add16(*acc, 8, 8, 200, result));
+   EXPECT_FALSE(Add16(*acc, 8, 8, 300, result));
+   ASSERT_TRUE(Add16(*acc, 8, 8, 401, result));
+   EXPECT_EQ(250, result[0]);
+   EXPECT_EQ(250, result[63]);
+
+   // Starts over after each result
+   for (int i = 0; i < 3; ++i)
+      EXPECT_FALSE(Add16(*acc, 8, 8, 7, result));
+   ASSERT_TRUE(Add16(*acc, 8, 8, 7, result));
+   EXPECT_EQ(7, result[0]);
+}
+
+TEST_F(FrameAccumulatorTests, SumIsClampedAndVarianceIsComputed)
+{
+   boost::shared_ptr<mm::FrameAccumulator> sum =
+      Make(mm::FrameAccumulator::ModeSum, 2);
+   std::vector<boost::uint16_t> result;
+   EXPECT_FALSE(Add16(*sum, 4, 4, 60000, result));
+   ASSERT_TRUE(Add16(*sum, 4, 4, 60000, result));
+   EXPECT_EQ(65535, result[0]);
+
+   boost::shared_ptr<mm::FrameAccumulator> variance =
+      Make(mm::FrameAccumulator::ModeVariance, 4);
+   EXPECT_FALSE(Add16(*variance, 4, 4, 1000, result));
+   EXPECT_FALSE(Add16(*variance, 4, 4, 1002, result));
+   EXPECT_FALSE(Add16(*variance, 4, 4, 1004, result));
+   ASSERT_TRUE(Add16(*variance, 4, 4, 1006, result));
+   EXPECT_EQ(5, result[0]);
+}
+
+TEST_F(FrameAccumulatorTests, LargeFramesMatchAcrossRowPartitions)
+{
+   // Large enough to be split among threads; rows differ so that a wrong
+   // partition would show
+   const unsigned width = 1024, height = 1024;
+   boost::shared_ptr<mm::FrameAccumulator> acc =
+      Make(mm::FrameAccumulator::ModeMaximum, 3);
+   std::vector<boost::uint16_t> frame(width * height);
+   mm::FrameAccumulator::Result pixels;
+   for (int n = 0; n < 3; ++n)
+   {
+      for (unsigned i = 0; i < frame.size(); ++i)
+         frame[i] = static_cast<boost::uint16_t>((i / width) * (n + 1));
+      bool due = acc->Add(&source_, reinterpret_cast<unsigned char*>(&frame[0]),
+            width, height, 2, 1, 1, pixels);
+      EXPECT_EQ(n == 2, due);
+   }
+   const boost::uint16_t* result =
+      reinterpret_cast<const boost::uint16_t*>(&(*pixels)[0]);
+   for (unsigned row = 0; row < height; ++row)
+      ASSERT_EQ(row * 3, result[row * width + width - 1]);
+}
+
+TEST_F(FrameAccumulatorTests, HeldResultSurvivesResetAndLaterFrames)
+{
+   boost::shared_ptr<mm::FrameAccumulator> acc =
+      Make(mm::FrameAccumulator::ModeMaximum, 1);
+   boost::uint16_t frame[4] = { 10, 20, 30, 40 };
+   mm::FrameAccumulator::Result held;
+   ASSERT_TRUE(acc->Add(&source_, reinterpret_cast<unsigned char*>(frame),
+            2, 2, 2, 1, 1, held));
+
+   frame[0] = 99;
+   mm::FrameAccumulator::Result next;
+   ASSERT_TRUE(acc->Add(&source_, reinterpret_cast<unsigned char*>(frame),
+            2, 2, 2, 1, 1, next));
+   EXPECT_NE(held.get(), next.get());
+   acc->Reset();
+
+   EXPECT_EQ(10, reinterpret_cast<const boost::uint16_t*>(&(*held)[0])[0]);
+   EXPECT_EQ(99, reinterpret_cast<const boost::uint16_t*>(&(*next)[0])[0]);
+}
+
+int main(int argc, char **argv)
+{
+   ::testing::InitGoogleTest(&argc, argv);
+   return RUN_ALL_TESTS();
+}
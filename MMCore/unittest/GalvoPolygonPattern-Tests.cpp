@@ -0,0 +1,161 @@
+#include <gtest/gtest.h>
+
+#include "MMCore.h"
+
+#include <boost/lexical_cast.hpp>
+
+#include <iostream>
+#include <string>
+#include <vector>
+
+// Uses the DemoGalvo of the DemoCamera adapter, which must have been built
+// (see Makefile.am for where it is looked up).
+#ifndef MM_TEST_ADAPTER_DIR
+#define MM_TEST_ADAPTER_DIR "../../DeviceAdapters/DemoCamera/.libs"
+#endif
+
+namespace {
+
+// A polygon set as passed to loadGalvoPolygons()
+struct Polygons
+{
+   std::vector<double> xs;
+   std::vector<double> ys;
+   std::vector<long> vertexCounts;
+   std::vector<double> dwellTimes_us;
+   std::vector<long> repetitions;
+
+   void Add(double x0, double y0, double size, double dwellTime_us,
+         long repetitionCount)
+   {
+      const double dx[] = { 0.0, size, size, 0.0 };
+      const double dy[] = { 0.0, 0.0, size, size };
+      for (int i = 0; i < 4; ++i)
+      {
+         xs.push_back(x0 + dx[i]);
+         ys.push_back(y0 + dy[i]);
+      }
+      vertexCounts.push_back(4);
+      dwellTimes_us.push_back(dwellTime_us);
+      repetitions.push_back(repetitionCount);
+   }
+};
+
+class GalvoPolygonPatternTests : public ::testing::Test
+{
+protected:
+   GalvoPolygonPatternTests() : available_(false) {}
+
+   virtual void SetUp()
+   {
+      core_.setDeviceAdapterSearchPaths(
+            std::vector<std::string>(1, MM_TEST_ADAPTER_DIR));
+      try
+      {
+         core_.loadDevice("Galvo", "DemoCamera", "DGalvo");
+      }
+      catch (const CMMError& e)
+      {
+         std::cerr << "DemoCamera adapter not available; skipping (" <<
+            e.getMsg() << ")" << std::endl;
+         return;
+      }
+      available_ = true;
+      core_.initializeDevice("Galvo");
+   }
+
+   void Load(const Polygons& p)
+   {
+      core_.loadGalvoPolygons("Galvo", p.xs, p.ys, p.vertexCounts,
+            p.dwellTimes_us, p.repetitions);
+   }
+
+   long CountUploads()
+   {
+      return boost::lexical_cast<long>(
+            core_.getProperty("Galvo", "PatternUploads"));
+   }
+
+   // Two squares, the first using the spot interval
+   static Polygons MakePolygons()
+   {
+      Polygons p;
+      p.Add(1.0, 1.0, 2.0, 0.0, 1);
+      p.Add(5.0, 5.0, 1.0, 100.0, 3);
+      return p;
+   }
+
+   CMMCore core_;
+   bool available_;
+};
+
+} // anonymous namespace
+
+TEST_F(GalvoPolygonPatternTests, IdenticalPatternIsNotUploadedAgain)
+{
+   if (!available_)
+      return;
+   Load(MakePolygons());
+   EXPECT_EQ(1, CountUploads());
+   Load(MakePolygons());
+   EXPECT_EQ(1, CountUploads());
+}
+
+TEST_F(GalvoPolygonPatternTests, ChangedPolygonsAreUploaded)
+{
+   if (!available_)
+      return;
+   Load(MakePolygons());
+   Polygons moved = MakePolygons();
+   moved.xs[5] += 0.5;
+   Load(moved);
+   EXPECT_EQ(2, CountUploads());
+
+   Polygons added = MakePolygons();
+   added.Add(8.0, 1.0, 1.0, 100.0, 1);
+   Load(added);
+   EXPECT_EQ(3, CountUploads());
+
+   // Each of them is still held by the device
+   Load(MakePolygons());
+   Load(moved);
+   EXPECT_EQ(3, CountUploads());
+}
+
+TEST_F(GalvoPolygonPatternTests, ChangedRepetitionsAreUploaded)
+{
+   if (!available_)
+      return;
+   Load(MakePolygons());
+   Polygons repeated = MakePolygons();
+   repeated.repetitions[1] = 4;
+   Load(repeated);
+   EXPECT_EQ(2, CountUploads());
+
+   Polygons dwelling = MakePolygons();
+   dwelling.dwellTimes_us[1] = 200.0;
+   Load(dwelling);
+   EXPECT_EQ(3, CountUploads());
+}
+
+TEST_F(GalvoPolygonPatternTests, ChangedSpotIntervalIsUploaded)
+{
+   if (!available_)
+      return;
+   core_.setGalvoSpotInterval("Galvo", 10.0);
+   Load(MakePolygons());
+   // The first polygon's zero dwell time stands for the spot interval
+   core_.setGalvoSpotInterval("Galvo", 20.0);
+   Load(MakePolygons());
+   EXPECT_EQ(2, CountUploads());
+
+   core_.setGalvoSpotInterval("Galvo", 20.0);
+   Load(MakePolygons());
+   EXPECT_EQ(2, CountUploads());
+}
+
+int main(int argc, char **argv)
+{
+   ::testing::InitGoogleTest(&argc, argv);
+   return RUN_ALL_TESTS();
+}
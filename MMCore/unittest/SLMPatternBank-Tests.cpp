@@ -0,0 +1,189 @@
+#include <gtest/gtest.h>
+
+#include "MMCore.h"
+
+#include <boost/bind.hpp>
+#include <boost/lexical_cast.hpp>
+#include <boost/thread/thread.hpp>
+
+#include <iostream>
+#include <string>
+#include <vector>
+
+// Uses the DemoSLM of the DemoCamera adapter, which must have been built (see
+// Makefile.am for where it is looked up).
+#ifndef MM_TEST_ADAPTER_DIR
+#define MM_TEST_ADAPTER_DIR "../../DeviceAdapters/DemoCamera/.libs"
+#endif
+
+namespace {
+
+class SLMPatternBankTests : public ::testing::Test
+{
+protected:
+   SLMPatternBankTests() : available_(false), pixelCount_(0) {}
+
+   virtual void SetUp()
+   {
+      core_.setDeviceAdapterSearchPaths(
+            std::vector<std::string>(1, MM_TEST_ADAPTER_DIR));
+      try
+      {
+         core_.loadDevice("SLM", "DemoCamera", "DSLM");
+      }
+      catch (const CMMError& e)
+      {
+         std::cerr << "DemoCamera adapter not available; skipping (" <<
+            e.getMsg() << ")" << std::endl;
+         return;
+      }
+      available_ = true;
+      core_.initializeDevice("SLM");
+      pixelCount_ = core_.getSLMWidth("SLM") * core_.getSLMHeight("SLM");
+   }
+
+public:
+   // Loads patterns filled with the given values
+   void LoadBank(const std::vector<unsigned char>& values)
+   {
+      std::vector< std::vector<unsigned char> > patterns;
+      std::vector<unsigned char*> pointers;
+      for (size_t i = 0; i < values.size(); ++i)
+         patterns.push_back(std::vector<unsigned char>(pixelCount_, values[i]));
+      for (size_t i = 0; i < patterns.size(); ++i)
+         pointers.push_back(&patterns[i][0]);
+      core_.loadSLMPatternBank("SLM", pointers);
+   }
+
+protected:
+   long GetCount(const char* propName)
+   {
+      return boost::lexical_cast<long>(core_.getProperty("SLM", propName));
+   }
+
+   // The checksum of a displayed pattern filled with value
+   long Checksum(unsigned char value) const
+   {
+      return (long) pixelCount_ * value;
+   }
+
+   static std::vector<unsigned char> Values(unsigned char a, unsigned char b,
+         unsigned char c)
+   {
+      std::vector<unsigned char> values;
+      values.push_back(a);
+      values.push_back(b);
+      values.push_back(c);
+      return values;
+   }
+
+   CMMCore core_;
+   bool available_;
+   unsigned pixelCount_;
+};
+
+} // anonymous namespace
+
+TEST_F(SLMPatternBankTests, PatternsInDeviceMemoryAreNotTransferredAgain)
+{
+   if (!available_)
+      return;
+   LoadBank(Values(1, 2, 3));
+   EXPECT_EQ(3, core_.getSLMPatternBankSize("SLM"));
+   EXPECT_EQ(3, GetCount("PatternTransfers"));
+
+   core_.displaySLMPattern("SLM", 2);
+   EXPECT_EQ(Checksum(3), GetCount("DisplayedChecksum"));
+   core_.displaySLMPattern("SLM", 0);
+   EXPECT_EQ(Checksum(1), GetCount("DisplayedChecksum"));
+
+   std::vector<long> indices;
+   indices.push_back(1);
+   indices.push_back(0);
+   core_.loadSLMPatternSequence("SLM", indices);
+
+   EXPECT_EQ(0, GetCount("ImageTransfers"));
+   EXPECT_EQ(3, GetCount("PatternTransfers"));
+   EXPECT_EQ(2, GetCount("Displays"));
+}
+
+TEST_F(SLMPatternBankTests, CoreKeepsPatternsThatDoNotFitTheDevice)
+{
+   if (!available_)
+      return;
+   // Two patterns do not fit in one slot; then no pattern memory at all
+   for (long memory = 1; memory >= 0; --memory)
+   {
+      core_.setProperty("SLM", "PatternMemory", memory);
+      LoadBank(Values(4, 5, 6));
+      EXPECT_EQ(0, GetCount("PatternTransfers"));
+
+      long transfers = GetCount("ImageTransfers");
+      core_.displaySLMPattern("SLM", 1);
+      EXPECT_EQ(Checksum(5), GetCount("DisplayedChecksum"));
+      EXPECT_EQ(transfers + 1, GetCount("ImageTransfers"));
+   }
+   EXPECT_THROW(core_.displaySLMPattern("SLM", 3), CMMError);
+}
+
+TEST_F(SLMPatternBankTests, StagingDoesNotDisturbTheDisplayedPattern)
+{
+   if (!available_)
+      return;
+   core_.setProperty("SLM", "PatternMemory", 0L);
+   LoadBank(Values(7, 8, 9));
+   core_.displaySLMPattern("SLM", 0);
+
+   std::vector<unsigned char> image(pixelCount_, 10);
+   core_.setSLMImage("SLM", &image[0]);
+   EXPECT_EQ(Checksum(7), GetCount("DisplayedChecksum"));
+   core_.displaySLMImage("SLM");
+   EXPECT_EQ(Checksum(10), GetCount("DisplayedChecksum"));
+}
+
+TEST_F(SLMPatternBankTests, QueuedDisplaysRunInOrder)
+{
+   if (!available_)
+      return;
+   LoadBank(Values(1, 2, 3));
+   std::vector<AsyncCommand> displays;
+   for (int i = 0; i < 10; ++i)
+      displays.push_back(core_.displaySLMPatternAsync("SLM", i % 3));
+   for (size_t i = 0; i < displays.size(); ++i)
+      displays[i].waitForCompletion();
+   EXPECT_EQ(10, GetCount("Displays"));
+   EXPECT_EQ(Checksum(1), GetCount("DisplayedChecksum"));
+}
+
+TEST_F(SLMPatternBankTests, DisplayOfReplacedBankIsDropped)
+{
+   if (!available_)
+      return;
+   core_.setProperty("SLM", "DisplayDelayMs", 500.0);
+   LoadBank(Values(1, 2, 3));
+
+   // Keeps the SLM busy while the bank is replaced behind it
+   AsyncCommand first = core_.displaySLMPatternAsync("SLM", 0);
+   boost::thread reload(boost::bind(&SLMPatternBankTests::LoadBank, this,
+            Values(4, 5, 6)));
+   boost::this_thread::sleep(boost::posix_time::milliseconds(100));
+
+   // Refers to the old bank, but is queued after the reload
+   AsyncCommand stale = core_.displaySLMPatternAsync("SLM", 1);
+   reload.join();
+
+   EXPECT_NO_THROW(first.waitForCompletion());
+   EXPECT_THROW(stale.waitForCompletion(), CMMError);
+   EXPECT_EQ(1, GetCount("Displays"));
+   EXPECT_EQ(Checksum(1), GetCount("DisplayedChecksum"));
+
+   core_.setProperty("SLM", "DisplayDelayMs", 0.0);
+   core_.displaySLMPattern("SLM", 1);
+   EXPECT_EQ(Checksum(5), GetCount("DisplayedChecksum"));
+}
+
+int main(int argc, char **argv)
+{
+   ::testing::InitGoogleTest(&argc, argv);
+   return RUN_ALL_TESTS();
+}
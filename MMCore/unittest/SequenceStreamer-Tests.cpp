@@ -0,0 +1,156 @@
+#include <gtest/gtest.h>
+
+#include "LogManager.h"
+#include "SequenceStreamer.h"
+
+#include <boost/bind.hpp>
+#include <boost/thread/mutex.hpp>
+#include <boost/thread/thread.hpp>
+
+#include <deque>
+#include <vector>
+
+namespace {
+
+// Sequence memory of a device that executes one value per Consume()
+class FakeSequenceMemory
+{
+public:
+   explicit FakeSequenceMemory(long capacity) :
+      capacity_(capacity), failAppend_(false)
+   {}
+
+   long GetFreeSpace()
+   {
+      boost::mutex::scoped_lock lock(mutex_);
+      return capacity_ - static_cast<long>(buffered_.size());
+   }
+
+   void Append(const double* values, long count)
+   {
+      boost::mutex::scoped_lock lock(mutex_);
+      if (failAppend_)
+         throw CMMError("device error", MMERR_DEVICE_GENERIC);
+      ASSERT_LE(count, capacity_ - static_cast<long>(buffered_.size()));
+      buffered_.insert(buffered_.end(), values, values + count);
+      chunkSizes_.push_back(count);
+   }
+
+   bool Consume()
+   {
+      boost::mutex::scoped_lock lock(mutex_);
+      if (buffered_.empty())
+         return false;
+      executed_.push_back(buffered_.front());
+      buffered_.pop_front();
+      return true;
+   }
+
+   void SetFailAppend() { boost::mutex::scoped_lock lock(mutex_); failAppend_ = true; }
+   std::vector<double> Executed() { boost::mutex::scoped_lock lock(mutex_); return executed_; }
+   std::vector<long> ChunkSizes() { boost::mutex::scoped_lock lock(mutex_); return chunkSizes_; }
+
+private:
+   boost::mutex mutex_;
+   const long capacity_;
+   bool failAppend_;
+   std::deque<double> buffered_;
+   std::vector<double> executed_;
+   std::vector<long> chunkSizes_;
+};
+
+class SequenceStreamerTests : public ::testing::Test
+{
+protected:
+   SequenceStreamerTests() : memory_(8) {}
+
+   boost::shared_ptr<mm::SequenceStreamer> MakeStreamer(
+         const std::vector<double>& values)
+   {
+      return boost::shared_ptr<mm::SequenceStreamer>(
+            new mm::SequenceStreamer(logManager_.NewLogger("Test"), "test",
+               values, 4,
+               boost::bind(&FakeSequenceMemory::GetFreeSpace, &memory_),
+               boost::bind(&FakeSequenceMemory::Append, &memory_, _1, _2)));
+   }
+
+   // Executes values until count have been executed or timeoutMs passes
+   void Run(size_t count, long timeoutMs)
+   {
+      for (long elapsed = 0; elapsed < timeoutMs &&
+            memory_.Executed().size() < count; )
+      {
+         if (!memory_.Consume())
+         {
+            boost::this_thread::sleep(boost::posix_time::milliseconds(1));
+            ++elapsed;
+         }
+      }
+   }
+
+   mm::LogManager logManager_;
+   FakeSequenceMemory memory_;
+};
+
+std::vector<double> Ramp(size_t count)
+{
+   std::vector<double> values;
+   for (size_t i = 0; i < count; ++i)
+      values.push_back(static_cast<double>(i));
+   return values;
+}
+
+} // anonymous namespace
+
+TEST_F(SequenceStreamerTests, StreamsAllValuesInOrderInChunks)
+{
+   std::vector<double> values = Ramp(1000);
+   boost::shared_ptr<mm::SequenceStreamer> streamer = MakeStreamer(values);
+   streamer->Start();
+   Run(values.size(), 10000);
+   streamer->Stop();
+
+   EXPECT_EQ(0u, streamer->GetRemainingCount());
+   EXPECT_EQ(values, memory_.Executed());
+   std::vector<long> chunks = memory_.ChunkSizes();
+   for (size_t i = 0; i + 1 < chunks.size(); ++i)
+      EXPECT_GE(chunks[i], 4);
+}
+
+TEST_F(SequenceStreamerTests, StopLeavesRemainingValues)
+{
+   boost::shared_ptr<mm::SequenceStreamer> streamer = MakeStreamer(Ramp(100));
+   streamer->Start();
+   Run(20, 10000);
+   streamer->Stop();
+
+   size_t remaining = streamer->GetRemainingCount();
+   EXPECT_LT(0u, remaining);
+   while (memory_.Consume())
+      ;
+   EXPECT_EQ(100u, memory_.Executed().size() + remaining);
+}
+
+TEST_F(SequenceStreamerTests, AppendErrorIsThrownByStop)
+{
+   memory_.SetFailAppend();
+   boost::shared_ptr<mm::SequenceStreamer> streamer = MakeStreamer(Ramp(10));
+   streamer->Start();
+   boost::this_thread::sleep(boost::posix_time::milliseconds(50));
+   try
+   {
+      streamer->Stop();
+      FAIL();
+   }
+   catch (const CMMError& e)
+   {
+      EXPECT_EQ(MMERR_DEVICE_GENERIC, e.getCode());
+   }
+   EXPECT_EQ(10u, streamer->GetRemainingCount());
+}
+
+int main(int argc, char **argv)
+{
+   ::testing::InitGoogleTest(&argc, argv);
+   return RUN_ALL_TESTS();
+}
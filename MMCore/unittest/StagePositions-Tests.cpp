@@ -0,0 +1,136 @@
+#include <gtest/gtest.h>
+
+#include "MMCore.h"
+
+#include <boost/thread/thread_time.hpp>
+
+#include <iostream>
+#include <string>
+#include <vector>
+
+// Uses the stages of the DemoCamera adapter, which must have been built (see
+// Makefile.am for where it is looked up).
+#ifndef MM_TEST_ADAPTER_DIR
+#define MM_TEST_ADAPTER_DIR "../../DeviceAdapters/DemoCamera/.libs"
+#endif
+
+namespace {
+
+const long g_MoveMs = 300;
+
+// Two focus stages and an XY stage, each busy for g_MoveMs after a move
+class StagePositionsTests : public ::testing::Test
+{
+protected:
+   StagePositionsTests() : available_(false) {}
+
+   virtual void SetUp()
+   {
+      core_.setDeviceAdapterSearchPaths(
+            std::vector<std::string>(1, MM_TEST_ADAPTER_DIR));
+      try
+      {
+         core_.loadDevice("Z1", "DemoCamera", "DStage");
+      }
+      catch (const CMMError& e)
+      {
+         std::cerr << "DemoCamera adapter not available; skipping (" <<
+            e.getMsg() << ")" << std::endl;
+         return;
+      }
+      available_ = true;
+      core_.loadDevice("Z2", "DemoCamera", "DStage");
+      core_.loadDevice("XY", "DemoCamera", "DXYStage");
+      core_.initializeAllDevices();
+      core_.setProperty("Z1", "MoveTimeMs", (double) g_MoveMs);
+      core_.setProperty("Z2", "MoveTimeMs", (double) g_MoveMs);
+   }
+
+   static std::vector<std::string> Labels(const char* a, const char* b)
+   {
+      std::vector<std::string> labels;
+      labels.push_back(a);
+      labels.push_back(b);
+      return labels;
+   }
+
+   static std::vector<double> Positions(double a, double b)
+   {
+      std::vector<double> positions;
+      positions.push_back(a);
+      positions.push_back(b);
+      return positions;
+   }
+
+   // The demo XY stage is busy for a tenth of the distance moved (in um) in
+   // milliseconds
+   static double XYDistanceForMoveMs()
+   {
+      return 10.0 * g_MoveMs;
+   }
+
+   CMMCore core_;
+   bool available_;
+};
+
+} // anonymous namespace
+
+TEST_F(StagePositionsTests, MismatchedSizesThrowWithoutMoving)
+{
+   if (!available_)
+      return;
+   std::vector<double> positions(1, 10.0);
+   EXPECT_THROW(core_.setStagePositions(Labels("Z1", "Z2"), positions),
+         CMMError);
+   EXPECT_THROW(core_.setStagePositions("XY", 100.0, 100.0,
+            Labels("Z1", "Z2"), positions), CMMError);
+   EXPECT_DOUBLE_EQ(0.0, core_.getPosition("Z1"));
+   EXPECT_DOUBLE_EQ(0.0, core_.getPosition("Z2"));
+   EXPECT_DOUBLE_EQ(0.0, core_.getXPosition("XY"));
+}
+
+TEST_F(StagePositionsTests, LabelsAreCheckedBeforeAnyMove)
+{
+   if (!available_)
+      return;
+   // An unknown device, and a device that is not a focus stage, after a
+   // valid one
+   EXPECT_THROW(core_.setStagePositions(Labels("Z1", "NoSuchStage"),
+            Positions(10.0, 20.0)), CMMError);
+   EXPECT_THROW(core_.setStagePositions(Labels("Z1", "XY"),
+            Positions(10.0, 20.0)), CMMError);
+   EXPECT_DOUBLE_EQ(0.0, core_.getPosition("Z1"));
+
+   // A focus stage given as the XY stage
+   EXPECT_THROW(core_.setStagePositions("Z1", 100.0, 100.0,
+            Labels("Z2", "Z2"), Positions(10.0, 20.0)), CMMError);
+   EXPECT_DOUBLE_EQ(0.0, core_.getPosition("Z2"));
+}
+
+TEST_F(StagePositionsTests, AllMovesStartBeforeWaiting)
+{
+   if (!available_)
+      return;
+   const double xy = XYDistanceForMoveMs();
+   boost::system_time start = boost::get_system_time();
+   core_.setStagePositions("XY", xy, 0.0, Labels("Z1", "Z2"),
+         Positions(10.0, 20.0));
+   long elapsedMs =
+      (long) (boost::get_system_time() - start).total_milliseconds();
+
+   EXPECT_FALSE(core_.deviceBusy("XY"));
+   EXPECT_FALSE(core_.deviceBusy("Z1"));
+   EXPECT_FALSE(core_.deviceBusy("Z2"));
+   EXPECT_NEAR(xy, core_.getXPosition("XY"), 0.1);
+   EXPECT_DOUBLE_EQ(10.0, core_.getPosition("Z1"));
+   EXPECT_DOUBLE_EQ(20.0, core_.getPosition("Z2"));
+   // Waiting for each move in turn would take 3 * g_MoveMs
+   EXPECT_GE(elapsedMs, g_MoveMs - 10);
+   EXPECT_LT(elapsedMs, 2 * g_MoveMs);
+}
+
+int main(int argc, char **argv)
+{
+   ::testing::InitGoogleTest(&argc, argv);
+   return RUN_ALL_TESTS();
+}
@@ -0,0 +1,134 @@
+#include <gtest/gtest.h>
+
+#include "MMCore.h"
+
+#include <boost/date_time/posix_time/posix_time.hpp>
+#include <boost/lexical_cast.hpp>
+#include <boost/thread/thread.hpp>
+
+#include <iostream>
+#include <string>
+#include <vector>
+
+// Streams a sequence through the DemoStage of the DemoCamera adapter, which
+// must have been built (see Makefile.am for where it is looked up).
+#ifndef MM_TEST_ADAPTER_DIR
+#define MM_TEST_ADAPTER_DIR "../../DeviceAdapters/DemoCamera/.libs"
+#endif
+
+namespace {
+
+const long g_MaxLength = 40;
+
+class StageSequenceStreamingTests : public ::testing::Test
+{
+protected:
+   StageSequenceStreamingTests() : available_(false) {}
+
+   virtual void SetUp()
+   {
+      core_.setDeviceAdapterSearchPaths(
+            std::vector<std::string>(1, MM_TEST_ADAPTER_DIR));
+      try
+      {
+         core_.loadDevice("Z", "DemoCamera", "DStage");
+      }
+      catch (const CMMError& e)
+      {
+         std::cerr << "DemoCamera adapter not available; skipping (" <<
+            e.getMsg() << ")" << std::endl;
+         return;
+      }
+      available_ = true;
+      core_.initializeDevice("Z");
+      core_.setProperty("Z", "UseSequences", "Yes");
+      core_.setProperty("Z", "SequenceMaxLength", g_MaxLength);
+      core_.setProperty("Z", "SequenceStepIntervalMs", 0.2);
+   }
+
+   long GetCount(const char* propName)
+   {
+      return boost::lexical_cast<long>(core_.getProperty("Z", propName));
+   }
+
+   // Waits until count positions have been executed or timeoutMs passes
+   void WaitForPositions(long count, long timeoutMs)
+   {
+      for (long elapsed = 0; elapsed < timeoutMs &&
+            GetCount("SequencePositionsExecuted") < count; elapsed += 5)
+         boost::this_thread::sleep(boost::posix_time::milliseconds(5));
+   }
+
+   static std::vector<double> MakeSequence(size_t length)
+   {
+      std::vector<double> positions;
+      for (size_t i = 0; i < length; ++i)
+         positions.push_back(0.1 * i);
+      return positions;
+   }
+
+   CMMCore core_;
+   bool available_;
+};
+
+} // anonymous namespace
+
+TEST_F(StageSequenceStreamingTests, StreamsSequenceLongerThanMaxLength)
+{
+   if (!available_)
+      return;
+   ASSERT_EQ(g_MaxLength, core_.getStageSequenceMaxLength("Z"));
+   ASSERT_TRUE(core_.isStageSequenceStreamable("Z"));
+
+   const long length = 10 * g_MaxLength;
+   std::vector<double> positions = MakeSequence(length);
+   core_.loadStageSequence("Z", positions);
+
+   boost::posix_time::ptime start = boost::posix_time::microsec_clock::universal_time();
+   core_.startStageSequence("Z");
+   WaitForPositions(length, 10000);
+   long elapsedMs = (boost::posix_time::microsec_clock::universal_time() -
+         start).total_milliseconds();
+   long appends = GetCount("SequenceRunningAppends");
+   long queries = GetCount("SequenceFreeSpaceQueries");
+   EXPECT_NO_THROW(core_.stopStageSequence("Z"));
+
+   EXPECT_EQ(length, GetCount("SequencePositionsExecuted"));
+   EXPECT_DOUBLE_EQ(positions.back(), core_.getPosition("Z"));
+
+   // Refilled in chunks of at least a quarter of the sequence memory
+   EXPECT_GE(appends, 1);
+   EXPECT_LE(appends, (length - g_MaxLength) / (g_MaxLength / 4));
+
+   // A full stage is asked again after about 1 ms, not continuously
+   EXPECT_GE(queries, appends);
+   EXPECT_LE(queries, appends + 2 * elapsedMs + 10);
+}
+
+TEST_F(StageSequenceStreamingTests, StreamingErrorIsThrownByStop)
+{
+   if (!available_)
+      return;
+   core_.loadStageSequence("Z", MakeSequence(4 * g_MaxLength));
+   core_.setProperty("Z", "SimulateSequenceError", "Yes");
+   core_.startStageSequence("Z");
+   WaitForPositions(g_MaxLength, 5000);
+
+   try
+   {
+      core_.stopStageSequence("Z");
+      FAIL();
+   }
+   catch (const CMMError& e)
+   {
+      EXPECT_NE(std::string::npos,
+            e.getFullMsg().find("Simulated sequence error"));
+   }
+   EXPECT_LE(GetCount("SequencePositionsExecuted"), g_MaxLength);
+}
+
+int main(int argc, char **argv)
+{
+   ::testing::InitGoogleTest(&argc, argv);
+   return RUN_ALL_TESTS();
+}
@@ -592,6 +592,111 @@
 }
 
 
+// Zero-copy image access
+//
+// DirectImagePixels is returned to Java as a direct java.nio.ByteBuffer
+// wrapping the pixels in place (no copy, no Java heap allocation). Buffers
+// from popNextImageDirect() and getLastImageDirect() pin a circular buffer
+// slot and must be handed back with releaseImageDirect(). The buffer from
+// getImageDirect() wraps the camera's snap buffer and is valid until the
+// next snap.
+//
+// The size travels with the pointer: a pinned image keeps the size it was
+// inserted with, which need not match the current camera settings.
+
+%{
+struct DirectImagePixels
+{
+   void* pixels;
+   long size;
+};
+%}
+%feature("novaluewrapper") DirectImagePixels;
+struct DirectImagePixels;
+
+%typemap(jni) DirectImagePixels        "jobject"
+%typemap(jtype) DirectImagePixels      "java.nio.ByteBuffer"
+%typemap(jstype) DirectImagePixels     "java.nio.ByteBuffer"
+%typemap(javaout) DirectImagePixels {
+   java.nio.ByteBuffer buffer = $jnicall;
+   return buffer == null ? null : buffer.order(java.nio.ByteOrder.nativeOrder());
+}
+%typemap(out) DirectImagePixels
+{
+   $result = $1.pixels ?
+      JCALL2(NewDirectByteBuffer, jenv, $1.pixels, (jlong) $1.size) : 0;
+}
+%typemap(javain) DirectImagePixels "$javainput"
+%typemap(in) DirectImagePixels
+{
+   $1.pixels = JCALL1(GetDirectBufferAddress, jenv, $input);
+   $1.size = (long) JCALL1(GetDirectBufferCapacity, jenv, $input);
+   if (!$1.pixels)
+   {
+      jclass excep = jenv->FindClass("java/lang/IllegalArgumentException");
+      if (excep)
+         jenv->ThrowNew(excep, "A direct ByteBuffer is required.");
+      return $null;
+   }
+}
+
+// Map input arguments: direct java.nio.ByteBuffer -> C++ pointer and capacity
+%typemap(jni) (void* pixelBuffer, long pixelBufferSize)        "jobject"
+%typemap(jtype) (void* pixelBuffer, long pixelBufferSize)      "java.nio.ByteBuffer"
+%typemap(jstype) (void* pixelBuffer, long pixelBufferSize)     "java.nio.ByteBuffer"
+%typemap(javain) (void* pixelBuffer, long pixelBufferSize)     "$javainput"
+%typemap(in) (void* pixelBuffer, long pixelBufferSize)
+{
+   $1 = JCALL1(GetDirectBufferAddress, jenv, $input);
+   $2 = (long) JCALL1(GetDirectBufferCapacity, jenv, $input);
+   if (!$1)
+   {
+      jclass excep = jenv->FindClass("java/lang/IllegalArgumentException");
+      if (excep)
+         jenv->ThrowNew(excep, "A direct ByteBuffer is required.");
+      return $null;
+   }
+}
+
+// The raw pinned-image functions are exposed through the Direct variants below
+%ignore CMMCore::popNextImagePinned;
+%ignore CMMCore::getLastImagePinned;
+%ignore CMMCore::releasePinnedImage;
+%ignore CMMCore::getPinnedImageByteCount;
+
+%extend CMMCore {
+   DirectImagePixels popNextImageDirect(unsigned channel, Metadata& md) throw (CMMError)
+   {
+      DirectImagePixels image;
+      image.pixels = $self->popNextImagePinned(channel, md);
+      image.size = image.pixels ? $self->getPinnedImageByteCount(image.pixels) : 0;
+      return image;
+   }
+
+   DirectImagePixels getLastImageDirect(unsigned channel, Metadata& md) throw (CMMError)
+   {
+      DirectImagePixels image;
+      image.pixels = $self->getLastImagePinned(channel, md);
+      image.size = image.pixels ? $self->getPinnedImageByteCount(image.pixels) : 0;
+      return image;
+   }
+
+   DirectImagePixels getImageDirect() throw (CMMError)
+   {
+      DirectImagePixels image;
+      image.pixels = $self->getImage();
+      image.size = (long) $self->getImageWidth() * $self->getImageHeight() *
+         $self->getBytesPerPixel();
+      return image;
+   }
+
+   void releaseImageDirect(DirectImagePixels pixels) throw (CMMError)
+   {
+      $self->releasePinnedImage(pixels.pixels);
+   }
+}
+
+
 //
 // Map all exception objects coming from C++ level
 // generic Java Exception
@@ -634,10 +739,25 @@
    import java.awt.geom.Point2D;
    import java.awt.Rectangle;
    import java.util.ArrayList;
+   import java.util.Iterator;
    import java.util.List;
 %}
 
 %typemap(javacode) CMMCore %{
+   private long stateSnapshotGeneration_ = -1;
+   private JSONObject stateSnapshot_;
+
+   // Returns the parsed system state cache, re-fetched only when it changed.
+   // Callers must not modify the returned object.
+   private synchronized JSONObject getStateSnapshot() throws java.lang.Exception {
+      long generation = getSystemStateCacheGeneration();
+      if (stateSnapshot_ == null || generation != stateSnapshotGeneration_) {
+         stateSnapshot_ = new JSONObject(getSystemStateCacheSnapshot());
+         stateSnapshotGeneration_ = generation;
+      }
+      return stateSnapshot_;
+   }
+
    private JSONObject metadataToMap(Metadata md) {
       JSONObject tags = new JSONObject();
       for (String key:md.GetKeys()) {
@@ -718,13 +838,10 @@
 
    private TaggedImage createTaggedImage(Object pixels, Metadata md) throws java.lang.Exception {
       JSONObject tags = metadataToMap(md);
-      PropertySetting setting;
-      Configuration config = getSystemStateCache();
-      for (int i = 0; i < config.size(); ++i) {
-         setting = config.getSetting(i);
-         String key = setting.getDeviceLabel() + "-" + setting.getPropertyName();
-         String value = setting.getPropertyValue();
-          tags.put(key, value);
+      JSONObject state = getStateSnapshot();
+      for (Iterator<String> keys = state.keys(); keys.hasNext(); ) {
+         String key = keys.next();
+         tags.put(key, state.get(key));
       }
       tags.put("BitDepth", getImageBitDepth());
       tags.put("PixelSizeUm", getPixelSizeUm(true));
@@ -747,9 +864,16 @@
       tags.put("ChannelIndex", 0);
 
 
-      try {
-         tags.put("Binning", getProperty(getCameraDevice(), "Binning"));
-      } catch (Exception ex) {}
+      // Use the cached value; querying the camera here costs a device call
+      // per image
+      String binningKey = state.optString("Core-Camera") + "-Binning";
+      if (state.has(binningKey)) {
+         tags.put("Binning", state.get(binningKey));
+      } else {
+         try {
+            tags.put("Binning", getProperty(getCameraDevice(), "Binning"));
+         } catch (Exception ex) {}
+      }
       
       return new TaggedImage(pixels, tags);	
    }
@@ -901,7 +1025,10 @@
 
 %{
 #include "../MMDevice/MMDeviceConstants.h"
+#include "../MMCore/AcquisitionPlan.h"
+#include "../MMCore/AsyncCommand.h"
 #include "../MMCore/Configuration.h"
+#include "../MMCore/DeviceHandle.h"
 #include "../MMDevice/ImageMetadata.h"
 #include "../MMCore/MMEventCallback.h"
 #include "../MMCore/MMCore.h"
@@ -1220,6 +1347,12 @@ namespace std {
 
 %include "../MMDevice/MMDeviceConstants.h"
 %include "../MMCore/Configuration.h"
+%include "../MMCore/DeviceHandle.h"
+%include "../MMCore/AcquisitionPlan.h"
+%include "../MMCore/AsyncCommand.h"
+namespace std {
+    %template(AsyncCommandVector) vector<AsyncCommand>;
+}
 %include "../MMCore/MMCore.h"
 %include "../MMDevice/ImageMetadata.h"
 %include "../MMCore/MMEventCallback.h"
@@ -480,6 +480,43 @@ public:
       return pProp->SendSequence();
    }
 
+   /**
+    * This function is used by the Core to communicate a sequence to the device
+    * Adds each value by calling AddToPropertySequence(); override to
+    * transfer the values in bulk
+    * @param name - name of the sequenceable property
+    */
+   virtual int AddArrayToPropertySequence(const char* name,
+         const double* values, long count)
+   {
+      MM::PropertyType type;
+      int ret = GetPropertyType(name, type);
+      if (ret != DEVICE_OK)
+         return ret;
+
+      for (long i = 0; i < count; ++i)
+      {
+         std::ostringstream os;
+         if (type == MM::Integer)
+            os << static_cast<long>(floor(values[i] + 0.5));
+         else
+            os << std::setprecision(15) << values[i];
+         ret = AddToPropertySequence(name, os.str().c_str());
+         if (ret != DEVICE_OK)
+            return ret;
+      }
+      return DEVICE_OK;
+   }
+
+   /**
+    * Streaming of property sequences is not supported by default
+    */
+   virtual int GetPropertySequenceFreeSpace(const char* /*name*/,
+         long& /*nrEvents*/) const
+   {
+      return DEVICE_UNSUPPORTED_COMMAND;
+   }
+
    /**
    * Obtains the property name given the index.
    * Can be used for enumerating properties.
@@ -1085,6 +1122,17 @@ protected:
       return DEVICE_NO_CALLBACK_REGISTERED;
    }
 
+   /**
+    * Signals to the core that the value returned by Busy() has changed.
+    * Optional; wakes up threads waiting for this device.
+    */
+   int OnBusyChanged(bool busy)
+   {
+      if (callback_)
+         return callback_->OnBusyChanged(this, busy);
+      return DEVICE_NO_CALLBACK_REGISTERED;
+   }
+
    /*
     * Signals that the stage has arrived at a new position
    */
@@ -1304,7 +1352,7 @@ public:
    virtual unsigned GetImageBytesPerPixel() const = 0;
    virtual int SnapImage() = 0;
 
-   CCameraBase() : busy_(false), stopWhenCBOverflows_(false), thd_(0)
+   CCameraBase() : busy_(false), stopWhenCBOverflows_(false), tagsVersion_(0), thd_(0)
    {
       // create and initialize common transpose properties
       std::vector<std::string> allowedValues;
@@ -1414,7 +1462,11 @@ public:
     */
    virtual void GetTags(char* serializedMetadata)
    {
-      std::string data = metadata_.Serialize();
+      std::string data;
+      {
+         MMThreadGuard g(tagsLock_);
+         data = metadata_.Serialize();
+      }
       data.copy(serializedMetadata, data.size(), 0);
    }
 
@@ -1467,17 +1519,39 @@ public:
       return DEVICE_UNSUPPORTED_COMMAND;
    }
 
+   virtual int AddArrayToExposureSequence(const double* exposureTimes_ms,
+         long count)
+   {
+      for (long i = 0; i < count; ++i)
+      {
+         int ret = AddToExposureSequence(exposureTimes_ms[i]);
+         if (ret != DEVICE_OK)
+            return ret;
+      }
+      return DEVICE_OK;
+   }
+
    virtual bool IsCapturing(){return !thd_->IsStopped();}
 
    virtual void AddTag(const char* key, const char* deviceLabel, const char* value)
    {
+      MMThreadGuard g(tagsLock_);
       metadata_.PutTag(key, deviceLabel, value);
+      ++tagsVersion_;
    }
 
 
    virtual void RemoveTag(const char* key)
    {
+      MMThreadGuard g(tagsLock_);
       metadata_.RemoveTag(key);
+      ++tagsVersion_;
+   }
+
+   virtual long GetTagsVersion()
+   {
+      MMThreadGuard g(tagsLock_);
+      return tagsVersion_;
    }
 
    virtual bool SupportsMultiROI()
@@ -1515,11 +1589,13 @@ protected:
 
    virtual std::vector<std::string> GetTagKeys()
    {
+      MMThreadGuard g(tagsLock_);
       return metadata_.GetKeys();
    }
 
    virtual std::string GetTagValue(const char* key)
    {
+      MMThreadGuard g(tagsLock_);
       return metadata_.GetSingleTag(key).GetValue();
    }
 
@@ -1543,27 +1619,51 @@ protected:
 
    virtual int InsertImage()
    {
-      char label[MM::MaxStrLength];
-      this->GetLabel(label);
-      Metadata md;
-      md.put("Camera", label);
+      // The record only carries the camera label, which does not change once
+      // the camera is loaded, so it is filled in once and reused
+      if (!frameMetadata_.HasTag("Camera"))
+      {
+         char label[MM::MaxStrLength];
+         this->GetLabel(label);
+         frameMetadata_.put("Camera", label);
+      }
+      const std::string serializedMetadata = frameMetadata_.Serialize();
       int ret = GetCoreCallback()->InsertImage(this, GetImageBuffer(), GetImageWidth(),
          GetImageHeight(), GetImageBytesPerPixel(),
-         md.Serialize().c_str());
+         serializedMetadata.c_str());
       if (!stopWhenCBOverflows_ && ret == DEVICE_BUFFER_OVERFLOW)
       {
-         // do not stop on overflow - just reset the buffer
+         // do not stop on overflow - just reset the buffer (only reported
+         // when the core's overflow policy is to refuse the frame)
          GetCoreCallback()->ClearImageBuffer(this);
          return GetCoreCallback()->InsertImage(this, GetImageBuffer(), GetImageWidth(),
             GetImageHeight(), GetImageBytesPerPixel(),
-            md.Serialize().c_str());
-      } else
-         return ret;
+            serializedMetadata.c_str());
+      }
+      return ret;
    }
 
    virtual double GetIntervalMs() {return thd_->GetIntervalMs();}
    virtual long GetImageCounter() {return thd_->GetImageCounter();}
    virtual long GetNumberOfImages() {return thd_->GetNumberOfImages();}
+   // When the default sequence thread started its most recent frame
+   virtual MM::MMTime GetLastFrameTime() {return thd_->GetLastFrameTime();}
+
+   /**
+   * Pause and resume the default sequence acquisition thread. While
+   * suspended, no frames are acquired; on resume, the frame interval is
+   * counted from the moment of resumption.
+   */
+   virtual void SuspendSequenceThread() {thd_->Suspend();}
+   virtual void ResumeSequenceThread() {thd_->Resume();}
+   virtual bool IsSequenceThreadSuspended() {return thd_->IsSuspended();}
+
+   /**
+   * Frame start timing error of the default sequence thread, relative to the
+   * requested interval, for the current or last acquisition.
+   */
+   virtual double GetMeanFrameJitterUs() {return thd_->GetMeanJitterUs();}
+   virtual double GetMaxFrameJitterUs() {return thd_->GetMaxJitterUs();}
 
    // called from the thread function before exit
    virtual void OnThreadExiting() throw()
@@ -1619,13 +1719,19 @@ protected:
          ,startTime_(0)
          ,actualDuration_(0)
          ,lastFrameTime_(0)
+         ,jitterCount_(0)
+         ,jitterSumUs_(0)
+         ,jitterMaxUs_(0)
       {};
 
       ~BaseSequenceThread() {}
 
       void Stop() {
-         MMThreadGuard g(this->stopLock_);
-         stop_=true;
+         {
+            MMThreadGuard g(this->stopLock_);
+            stop_=true;
+         }
+         wakeUp_.Signal();
       }
 
       void Start(long numImages, double intervalMs)
@@ -1637,10 +1743,11 @@ protected:
          imageCounter_=0;
          stop_ = false;
          suspend_=false;
+         ResetJitter();
          activate();
          actualDuration_ = 0;
          startTime_= camera_->GetCurrentMMTime();
-         lastFrameTime_ = 0;
+         SetLastFrameTime(0);
       }
       bool IsStopped(){
          MMThreadGuard g(this->stopLock_);
@@ -1655,8 +1762,11 @@ protected:
          return suspend_;
       }
       void Resume() {
-         MMThreadGuard g(this->suspendLock_);
-         suspend_ = false;
+         {
+            MMThreadGuard g(this->suspendLock_);
+            suspend_ = false;
+         }
+         wakeUp_.Signal();
       }
       double GetIntervalMs(){return intervalMs_;}
       void SetLength(long images) {numImages_ = images;}
@@ -1665,6 +1775,19 @@ protected:
       long GetImageCounter(){return imageCounter_;}
       MM::MMTime GetStartTime(){return startTime_;}
       MM::MMTime GetActualDuration(){return actualDuration_;}
+      MM::MMTime GetLastFrameTime() {
+         MMThreadGuard g(this->frameTimeLock_);
+         return lastFrameTime_;
+      }
+
+      double GetMeanJitterUs() {
+         MMThreadGuard g(this->jitterLock_);
+         return jitterCount_ > 0 ? (double)jitterSumUs_ / jitterCount_ : 0.0;
+      }
+      double GetMaxJitterUs() {
+         MMThreadGuard g(this->jitterLock_);
+         return (double)jitterMaxUs_;
+      }
 
       CCameraBase* GetCamera() {return camera_;}
       long GetNumberOfImages() {return numImages_;}
@@ -1672,13 +1795,85 @@ protected:
       void UpdateActualDuration() {actualDuration_ = camera_->GetCurrentMMTime() - startTime_;}
 
    private:
+      // Written by the acquisition thread, read by any
+      void SetLastFrameTime(const MM::MMTime& time) {
+         MMThreadGuard g(this->frameTimeLock_);
+         lastFrameTime_ = time;
+      }
+
+      void ResetJitter() {
+         MMThreadGuard g(this->jitterLock_);
+         jitterCount_ = 0;
+         jitterSumUs_ = 0;
+         jitterMaxUs_ = 0;
+      }
+
+      void RecordJitter(long long lateUs) {
+         MMThreadGuard g(this->jitterLock_);
+         ++jitterCount_;
+         jitterSumUs_ += lateUs;
+         if (lateUs > jitterMaxUs_)
+            jitterMaxUs_ = lateUs;
+      }
+
+      // Returns when resumed or stopped
+      void WaitWhileSuspended() {
+         while (IsSuspended() && !IsStopped())
+            wakeUp_.WaitUs(1000000);
+      }
+
+      // Returns at the deadline, or earlier when stopped
+      void WaitUntil(long long deadlineUs) {
+         for (;;)
+         {
+            if (IsStopped())
+               return;
+            long long remainingUs = deadlineUs - CDeviceUtils::GetMonotonicTimeUs();
+            if (remainingUs <= 2000)
+            {
+               // the timed wait may have millisecond granularity; sleep the
+               // last stretch for precise frame timing
+               CDeviceUtils::SleepUntilMonotonicUs(deadlineUs);
+               return;
+            }
+            wakeUp_.WaitUs(remainingUs - 1000);
+         }
+      }
+
+      // Frames are started on an absolute schedule (start + n * interval) so
+      // that the time spent in ThreadRun() does not add to the interval and
+      // errors do not accumulate. When a frame overruns by more than a whole
+      // interval, the missed slots are skipped rather than made up in a burst.
       virtual int svc(void) throw()
       {
          int ret=DEVICE_ERR;
          try
          {
+            const long long intervalUs = (long long)(intervalMs_ * 1000.0);
+            long long deadlineUs = CDeviceUtils::GetMonotonicTimeUs();
             do
             {
+               if (IsSuspended())
+               {
+                  WaitWhileSuspended();
+                  if (IsStopped())
+                     break;
+                  deadlineUs = CDeviceUtils::GetMonotonicTimeUs();
+               }
+
+               if (intervalUs > 0)
+               {
+                  long long nowUs = CDeviceUtils::GetMonotonicTimeUs();
+                  if (nowUs - deadlineUs >= intervalUs)
+                     deadlineUs += ((nowUs - deadlineUs) / intervalUs) * intervalUs;
+                  WaitUntil(deadlineUs);
+                  if (IsStopped())
+                     break;
+                  RecordJitter(CDeviceUtils::GetMonotonicTimeUs() - deadlineUs);
+                  deadlineUs += intervalUs;
+               }
+               SetLastFrameTime(camera_->GetCurrentMMTime());
+
                ret=camera_->ThreadRun();
             } while (DEVICE_OK == ret && !IsStopped() && imageCounter_++ < numImages_-1);
             if (IsStopped())
@@ -1702,8 +1897,15 @@ protected:
       MM::MMTime startTime_;
       MM::MMTime actualDuration_;
       MM::MMTime lastFrameTime_;
+      long jitterCount_;
+      long long jitterSumUs_;
+      long long jitterMaxUs_;
       MMThreadLock stopLock_;
       MMThreadLock suspendLock_;
+      MMThreadLock jitterLock_;
+      MMThreadLock frameTimeLock_;
+      // Signalled by Stop() and Resume()
+      MMThreadEvent wakeUp_;
    };
    //////////////////////////////////////////////////////////////////////////
 
@@ -1712,7 +1914,11 @@ private:
 
    bool busy_;
    bool stopWhenCBOverflows_;
+   // Tags may be changed by the camera's own threads while the core reads them
+   MMThreadLock tagsLock_;
    Metadata metadata_;
+   long tagsVersion_;
+   Metadata frameMetadata_;
 
    BaseSequenceThread * thd_;
    friend class BaseSequenceThread;
@@ -1808,6 +2014,22 @@ class CStageBase : public CDeviceBase<MM::Stage, U>
       return DEVICE_UNSUPPORTED_COMMAND;
    }
 
+   virtual int AddArrayToStageSequence(const double* positions, long count)
+   {
+      for (long i = 0; i < count; ++i)
+      {
+         int ret = AddToStageSequence(positions[i]);
+         if (ret != DEVICE_OK)
+            return ret;
+      }
+      return DEVICE_OK;
+   }
+
+   virtual int GetStageSequenceFreeSpace(long& /*nrEvents*/) const
+   {
+      return DEVICE_UNSUPPORTED_COMMAND;
+   }
+
    virtual int SetStageLinearSequence(double, long)
    {
       return DEVICE_UNSUPPORTED_COMMAND;
@@ -2003,6 +2225,18 @@ public:
       return DEVICE_UNSUPPORTED_COMMAND;
    }
 
+   virtual int AddArrayToXYStageSequence(const double* positionsX,
+         const double* positionsY, long count)
+   {
+      for (long i = 0; i < count; ++i)
+      {
+         int ret = AddToXYStageSequence(positionsX[i], positionsY[i]);
+         if (ret != DEVICE_OK)
+            return ret;
+      }
+      return DEVICE_OK;
+   }
+
 protected:
 
    /**
@@ -2149,6 +2383,27 @@ class CSLMBase : public CDeviceBase<MM::SLM, U>
    virtual int SendSLMSequence() {
       return DEVICE_UNSUPPORTED_COMMAND;
    }
+
+   // No pattern memory; the core keeps the patterns and uses SetImage()
+   virtual int GetSLMPatternBankCapacity(long& /*capacity*/) const
+   {
+      return DEVICE_UNSUPPORTED_COMMAND;
+   }
+
+   virtual int SetSLMPattern(long /*index*/, const unsigned char* /*pixels*/)
+   {
+      return DEVICE_UNSUPPORTED_COMMAND;
+   }
+
+   virtual int DisplaySLMPattern(long /*index*/)
+   {
+      return DEVICE_UNSUPPORTED_COMMAND;
+   }
+
+   virtual int AddSLMPatternToSequence(long /*index*/)
+   {
+      return DEVICE_UNSUPPORTED_COMMAND;
+   }
 };
 
 /**
@@ -2159,6 +2414,64 @@ class CGalvoBase : public CDeviceBase<MM::Galvo, U>
 {
    double GetXMinimum() { return 0.0;};
    double GetYMinimum() { return 0.0;};
+
+public:
+   /**
+   * Default implementation in terms of the per-vertex functions, which
+   * only supports patterns whose polygons share the same dwell time and
+   * repetitions. Override to upload patterns in bulk, and to keep them for
+   * SelectPolygonPattern().
+   */
+   virtual int LoadPolygonPattern(const char* /*patternKey*/,
+         const double* xs, const double* ys, const long* vertexCounts,
+         const double* dwellTimes_us, const long* repetitions,
+         long polygonCount)
+   {
+      for (long i = 1; i < polygonCount; ++i)
+      {
+         if (dwellTimes_us[i] != dwellTimes_us[0] ||
+               repetitions[i] != repetitions[0])
+            return DEVICE_UNSUPPORTED_COMMAND;
+      }
+
+      int ret = this->DeletePolygons();
+      if (ret != DEVICE_OK)
+         return ret;
+
+      long vertex = 0;
+      for (long i = 0; i < polygonCount; ++i)
+      {
+         for (long j = 0; j < vertexCounts[i]; ++j, ++vertex)
+         {
+            ret = this->AddPolygonVertex((int) i, xs[vertex], ys[vertex]);
+            if (ret != DEVICE_OK)
+               return ret;
+         }
+      }
+
+      if (polygonCount > 0)
+      {
+         if (dwellTimes_us[0] > 0.0)
+         {
+            ret = this->SetSpotInterval(dwellTimes_us[0]);
+            if (ret != DEVICE_OK)
+               return ret;
+         }
+         ret = this->SetPolygonRepetitions((int) repetitions[0]);
+         if (ret != DEVICE_OK)
+            return ret;
+      }
+      return this->LoadPolygons();
+   }
+
+   /**
+   * Patterns are not kept by default.
+   */
+   virtual int SelectPolygonPattern(const char* /*patternKey*/, bool& found)
+   {
+      found = false;
+      return DEVICE_OK;
+   }
 };
 
 /**
@@ -24,7 +24,9 @@
    #define WIN32_LEAN_AND_MEAN
    #include <windows.h>
 #else
+   #include <errno.h>
    #include <pthread.h>
+   #include <time.h>
 #endif
 
 /**
@@ -132,6 +134,16 @@ public:
 #endif
    }
 
+   // Returns false, without waiting, if another thread holds the lock
+   bool TryLock()
+   {
+#ifdef _WIN32
+      return TryEnterCriticalSection(&lock_) != 0;
+#else
+      return pthread_mutex_trylock(&lock_) == 0;
+#endif
+   }
+
    void Unlock()
    {
 #ifdef _WIN32
@@ -183,3 +195,103 @@ private:
 
    MMThreadLock* lock_;
 };
+
+
+/**
+ * Event that a thread can wait on with a timeout, backed by a condition
+ * variable (an event object on Windows). A signal is kept until a wait
+ * consumes it, so a signal given just before the wait is not lost.
+ */
+class MMThreadEvent
+{
+public:
+   MMThreadEvent()
+   {
+#ifdef _WIN32
+      event_ = CreateEvent(NULL, FALSE, FALSE, NULL);
+#else
+      signaled_ = false;
+      pthread_mutex_init(&mutex_, NULL);
+      pthread_condattr_t a;
+      pthread_condattr_init(&a);
+#ifndef __APPLE__
+      pthread_condattr_setclock(&a, CLOCK_MONOTONIC);
+#endif
+      pthread_cond_init(&cond_, &a);
+      pthread_condattr_destroy(&a);
+#endif
+   }
+
+   ~MMThreadEvent()
+   {
+#ifdef _WIN32
+      CloseHandle(event_);
+#else
+      pthread_cond_destroy(&cond_);
+      pthread_mutex_destroy(&mutex_);
+#endif
+   }
+
+   void Signal()
+   {
+#ifdef _WIN32
+      SetEvent(event_);
+#else
+      pthread_mutex_lock(&mutex_);
+      signaled_ = true;
+      pthread_cond_broadcast(&cond_);
+      pthread_mutex_unlock(&mutex_);
+#endif
+   }
+
+   /**
+    * Waits for a signal for at most timeoutUs microseconds. Returns true if
+    * signaled, false on timeout.
+    */
+   bool WaitUs(long long timeoutUs)
+   {
+      if (timeoutUs < 0)
+         timeoutUs = 0;
+#ifdef _WIN32
+      return WaitForSingleObject(event_,
+            (DWORD)((timeoutUs + 999) / 1000)) == WAIT_OBJECT_0;
+#else
+      pthread_mutex_lock(&mutex_);
+#ifdef __APPLE__
+      struct timespec ts;
+      ts.tv_sec = (time_t)(timeoutUs / 1000000LL);
+      ts.tv_nsec = (long)(timeoutUs % 1000000LL) * 1000L;
+      if (!signaled_)
+         pthread_cond_timedwait_relative_np(&cond_, &mutex_, &ts);
+#else
+      struct timespec ts;
+      clock_gettime(CLOCK_MONOTONIC, &ts);
+      long long ns = (long long)ts.tv_nsec + (timeoutUs % 1000000LL) * 1000LL;
+      ts.tv_sec += (time_t)(timeoutUs / 1000000LL + ns / 1000000000LL);
+      ts.tv_nsec = (long)(ns % 1000000000LL);
+      while (!signaled_)
+      {
+         if (pthread_cond_timedwait(&cond_, &mutex_, &ts) == ETIMEDOUT)
+            break;
+      }
+#endif
+      bool signaled = signaled_;
+      signaled_ = false;
+      pthread_mutex_unlock(&mutex_);
+      return signaled;
+#endif
+   }
+
+private:
+   // Forbid copying
+   MMThreadEvent(const MMThreadEvent&);
+   MMThreadEvent& operator=(const MMThreadEvent&);
+
+#ifdef _WIN32
+   HANDLE event_;
+#else
+   bool signaled_;
+   pthread_mutex_t mutex_;
+   pthread_cond_t cond_;
+#endif
+};
@@ -28,6 +28,8 @@
    #define WIN32_LEAN_AND_MEAN
    #include <windows.h>
 #else
+   #include <errno.h>
+   #include <time.h>
    #include <unistd.h>
 #endif
 
@@ -172,6 +174,66 @@ void CDeviceUtils::NapMicros(unsigned long period)
 #endif
 }
 
+/**
+ * Returns the time of a monotonic clock in microseconds. The epoch is
+ * arbitrary, so the value is only useful for computing intervals and
+ * deadlines.
+ */
+long long CDeviceUtils::GetMonotonicTimeUs()
+{
+#ifdef WIN32
+   LARGE_INTEGER freq, count;
+   QueryPerformanceFrequency(&freq);
+   QueryPerformanceCounter(&count);
+   return (long long)(count.QuadPart / freq.QuadPart) * 1000000LL +
+      (long long)((count.QuadPart % freq.QuadPart) * 1000000LL / freq.QuadPart);
+#else
+   struct timespec ts;
+   clock_gettime(CLOCK_MONOTONIC, &ts);
+   return (long long)ts.tv_sec * 1000000LL + ts.tv_nsec / 1000;
+#endif
+}
+
+/**
+ * Sleeps until the monotonic clock (see GetMonotonicTimeUs()) reaches the
+ * given deadline. Sleeping to an absolute deadline, rather than for an
+ * interval, keeps periodic loops from accumulating drift.
+ */
+void CDeviceUtils::SleepUntilMonotonicUs(long long deadlineUs)
+{
+#ifdef WIN32
+   // Sleep() has millisecond granularity at best; sleep for the bulk of the
+   // interval and yield for the remainder.
+   for (;;)
+   {
+      long long remainingUs = deadlineUs - GetMonotonicTimeUs();
+      if (remainingUs <= 0)
+         return;
+      if (remainingUs > 2000)
+         Sleep((DWORD)(remainingUs / 1000 - 1));
+      else
+         Sleep(0);
+   }
+#elif defined(__linux__)
+   struct timespec ts;
+   ts.tv_sec = (time_t)(deadlineUs / 1000000LL);
+   ts.tv_nsec = (long)(deadlineUs % 1000000LL) * 1000L;
+   while (clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &ts, 0) == EINTR)
+      ;
+#else
+   for (;;)
+   {
+      long long remainingUs = deadlineUs - GetMonotonicTimeUs();
+      if (remainingUs <= 0)
+         return;
+      struct timespec ts;
+      ts.tv_sec = (time_t)(remainingUs / 1000000LL);
+      ts.tv_nsec = (long)(remainingUs % 1000000LL) * 1000L;
+      nanosleep(&ts, 0);
+   }
+#endif
+}
+
 
 bool CDeviceUtils::CheckEnvironment(std::string env)
 {
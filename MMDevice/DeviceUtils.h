@@ -64,6 +64,8 @@ public:
    static void Tokenize(const std::string& str, std::vector<std::string>& tokens, const std::string& delimiters = ",");
    static void SleepMs(long ms);
    static void NapMicros(unsigned long microsecs);
+   static long long GetMonotonicTimeUs();
+   static void SleepUntilMonotonicUs(long long deadlineUs);
    static std::string HexRep(std::vector<unsigned char>  );
    static bool CheckEnvironment(std::string environment);
 private:
@@ -27,7 +27,7 @@
 // Header version
 // If any of the class definitions changes, the interface version
 // must be incremented
-#define DEVICE_INTERFACE_VERSION 70
+#define DEVICE_INTERFACE_VERSION 75
 ///////////////////////////////////////////////////////////////////////////////
 
 
@@ -289,6 +289,27 @@ namespace MM {
        * Signal that we are done sending sequence values so that the adapter can send the whole sequence to the device
        */
       virtual int SendPropertySequence(const char* propertyName) = 0;
+      /**
+       * Add count values of a numeric (Integer or Float) property to the
+       * sequence in one call. Equivalent to calling AddToPropertySequence()
+       * for each value, but lets the adapter transfer the values in bulk.
+       *
+       * If the device supports streaming (see
+       * GetPropertySequenceFreeSpace()), values added while the sequence is
+       * running are appended to the running sequence, without calling
+       * SendPropertySequence().
+       */
+      virtual int AddArrayToPropertySequence(const char* propertyName,
+            const double* values, long count) = 0;
+      /**
+       * Number of values that can currently be added to the sequence: before
+       * the sequence is started, the room left in the device's sequence
+       * memory; while it is running, the room freed by the values already
+       * executed. Devices that cannot extend a running sequence return
+       * DEVICE_UNSUPPORTED_COMMAND.
+       */
+      virtual int GetPropertySequenceFreeSpace(const char* propertyName,
+            long& nrEvents) const = 0;
 
       virtual bool GetErrorText(int errorCode, char* errMessage) const = 0;
       virtual bool Busy() = 0;
@@ -554,6 +575,13 @@ namespace MM {
        */
       virtual void RemoveTag(const char* key) = 0;
 
+      /**
+       * Returns a number that changes whenever the tags returned by GetTags()
+       * change. The core uses it to avoid re-parsing the tags for every
+       * inserted image.
+       */
+      virtual long GetTagsVersion() = 0;
+
       /**
        * Returns whether a camera's exposure time can be sequenced.
        * If returning true, then a Camera adapter class should also inherit
@@ -578,6 +606,9 @@ namespace MM {
       virtual int AddToExposureSequence(double exposureTime_ms) = 0;
       // Signal that we are done sending sequence values so that the adapter can send the whole sequence to the device
       virtual int SendExposureSequence() const = 0;
+      // Add count values to the sequence in one call
+      virtual int AddArrayToExposureSequence(const double* exposureTimes_ms,
+            long count) = 0;
    };
 
    /**
@@ -691,6 +722,21 @@ namespace MM {
        * can send the whole sequence to the device
        */
       virtual int SendStageSequence() = 0;
+      /**
+       * Add count values to the sequence in one call. Values added while the
+       * sequence is running are appended to it if the stage supports
+       * streaming (see GetStageSequenceFreeSpace()).
+       */
+      virtual int AddArrayToStageSequence(const double* positions,
+            long count) = 0;
+      /**
+       * Number of positions that can currently be added to the sequence:
+       * before the sequence is started, the room left in the stage's
+       * sequence memory; while it is running, the room freed by the
+       * positions already executed. Stages that cannot extend a running
+       * sequence return DEVICE_UNSUPPORTED_COMMAND.
+       */
+      virtual int GetStageSequenceFreeSpace(long& nrEvents) const = 0;
 
       /**
        * Set up to perform an equally-spaced triggered Z stack.
@@ -786,6 +832,11 @@ namespace MM {
        * can send the whole sequence to the device
        */
       virtual int SendXYStageSequence() = 0;
+      /**
+       * Add count positions to the sequence in one call
+       */
+      virtual int AddArrayToXYStageSequence(const double* positionsX,
+            const double* positionsY, long count) = 0;
 
    };
 
@@ -1129,6 +1180,37 @@ namespace MM {
        */
       virtual int SendSLMSequence() = 0;
 
+      // SLM pattern bank
+      //
+      // Devices with on-board pattern memory can keep a set of patterns that
+      // is uploaded once and then displayed, or sequenced, by index, without
+      // transferring the pixels again.
+
+      /**
+       * Returns the number of patterns the device can store.
+       * Returns DEVICE_UNSUPPORTED_COMMAND if the device has no pattern
+       * memory.
+       */
+      virtual int GetSLMPatternBankCapacity(long& capacity) const = 0;
+      /**
+       * Stores a pattern at the given index (0 to capacity - 1), replacing
+       * any pattern previously stored there.
+       * @param pixels An array of pixels as passed to SetImage(); the device
+       * must copy it.
+       */
+      virtual int SetSLMPattern(long index, const unsigned char* pixels) = 0;
+      /**
+       * Displays a stored pattern.
+       * The device should return once the pattern is displayed, and must not
+       * disturb the pattern currently displayed while SetSLMPattern() or
+       * SetImage() stage other patterns.
+       */
+      virtual int DisplaySLMPattern(long index) = 0;
+      /**
+       * Appends a stored pattern to the sequence, like AddToSLMSequence()
+       * does with an image.
+       */
+      virtual int AddSLMPatternToSequence(long index) = 0;
    };
 
    /**
@@ -1181,6 +1263,29 @@ namespace MM {
       virtual int RunPolygons() = 0;
       virtual int StopSequence() = 0;
       virtual int GetChannel(char* channelName) = 0;
+      /**
+       * Replaces all polygons and loads them, as DeletePolygons(),
+       * AddPolygonVertex() for each vertex and LoadPolygons() would, in
+       * one call. Polygon i consists of the next vertexCounts[i] points of
+       * xs and ys; the beam dwells dwellTimes_us[i] at each of its points
+       * (0: the current spot interval) and the polygon is repeated
+       * repetitions[i] times.
+       *
+       * patternKey identifies the content of the arguments. A device may
+       * keep the pattern, compiled into its own representation, under this
+       * key, so that SelectPolygonPattern() can load it again later.
+       */
+      virtual int LoadPolygonPattern(const char* patternKey,
+            const double* xs, const double* ys, const long* vertexCounts,
+            const double* dwellTimes_us, const long* repetitions,
+            long polygonCount) = 0;
+      /**
+       * Loads a pattern kept from an earlier LoadPolygonPattern() call, if
+       * the device still has it; sets found to false (and changes nothing)
+       * otherwise.
+       */
+      virtual int SelectPolygonPattern(const char* patternKey,
+            bool& found) = 0;
    };
 
    /**
@@ -1307,6 +1412,13 @@ namespace MM {
        * Magnifiers can use this to signal changes in magnification
        */
       virtual int OnMagnifierChanged(const Device* caller) = 0;
+      /**
+       * Devices that learn by themselves when an operation completes (e.g.
+       * from a completion message) can call this whenever Busy() changes, so
+       * that the Core does not have to wait for its next poll. Busy() is
+       * still queried to confirm the state.
+       */
+      virtual int OnBusyChanged(const Device* caller, bool busy) = 0;
 
       virtual unsigned long GetClockTicksUs(const Device* caller) = 0;
       virtual MM::MMTime GetCurrentMMTime() = 0;
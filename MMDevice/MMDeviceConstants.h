@@ -150,6 +150,11 @@ namespace MM {
    const char* const g_Keyword_Metadata_ROI_X       = "ROI-X-start";
    const char* const g_Keyword_Metadata_ROI_Y       = "ROI-Y-start";
    const char* const g_Keyword_Metadata_TimeInCore  = "TimeReceivedByCore";
+   // acquisition coordinates of a frame, indexed by the core's circular buffer
+   const char* const g_Keyword_Metadata_PositionIndex = "PositionIndex";
+   const char* const g_Keyword_Metadata_ChannelIndex  = "ChannelIndex";
+   const char* const g_Keyword_Metadata_SliceIndex    = "SliceIndex";
+   const char* const g_Keyword_Metadata_FrameIndex    = "FrameIndex";
 
    // configuration file format constants
    const char* const g_FieldDelimiters = ",";
@@ -266,6 +271,14 @@ namespace MM {
       CanCommunicate = 1     // -- communication verified, parameters have been set to valid values.
    };
 
+   // Granularity at which the Core serializes calls into the devices of a
+   // device adapter module (see SetModuleConcurrency())
+   enum DeviceConcurrency {
+      ConcurrencyPerModule = 0, // -- one lock shared by all devices of the module (default)
+      ConcurrencyPerHub = 1,    // -- one lock for each hub, shared with its peripherals
+      ConcurrencyPerDevice = 2  // -- one lock for each device
+   };
+
 } // namespace MM
 
 #endif //_MMDEVICE_CONSTANTS_H_
@@ -58,6 +58,9 @@ public:
 // Registered devices in this module (device adapter library)
 static std::vector<DeviceInfo> g_registeredDevices;
 
+// Locking granularity declared by the module
+static MM::DeviceConcurrency g_moduleConcurrency = MM::ConcurrencyPerModule;
+
 
 MODULE_API long GetModuleVersion()
 {
@@ -119,6 +122,11 @@ MODULE_API bool GetDeviceDescription(const char* deviceName, char* description,
    return true;
 }
 
+MODULE_API int GetModuleConcurrency()
+{
+   return static_cast<int>(g_moduleConcurrency);
+}
+
 void RegisterDevice(const char* deviceName, MM::DeviceType deviceType, const char* deviceDescription)
 {
    if (!deviceName)
@@ -135,3 +143,8 @@ void RegisterDevice(const char* deviceName, MM::DeviceType deviceType, const cha
 
    g_registeredDevices.push_back(DeviceInfo(deviceName, deviceType, deviceDescription));
 }
+
+void SetModuleConcurrency(MM::DeviceConcurrency concurrency)
+{
+   g_moduleConcurrency = concurrency;
+}
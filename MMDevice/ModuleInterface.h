@@ -104,6 +104,9 @@ extern "C" {
    MODULE_API bool GetDeviceName(unsigned deviceIndex, char* name, unsigned bufferLength);
    MODULE_API bool GetDeviceType(const char* deviceName, int* type);
    MODULE_API bool GetDeviceDescription(const char* deviceName, char* name, unsigned bufferLength);
+   // Optional for the Core: modules built before it was added are treated as
+   // MM::ConcurrencyPerModule, so it does not change the interface version.
+   MODULE_API int GetModuleConcurrency();
 
    // Function pointer types for module interface functions
    // (Not for use by device adapters)
@@ -117,6 +120,7 @@ extern "C" {
    typedef bool (*fnGetDeviceName)(unsigned, char*, unsigned);
    typedef bool (*fnGetDeviceType)(const char*, int*);
    typedef bool (*fnGetDeviceDescription)(const char*, char*, unsigned);
+   typedef int (*fnGetModuleConcurrency)();
 #endif
 }
 
@@ -137,5 +141,29 @@ extern "C" {
  */
 void RegisterDevice(const char* deviceName, MM::DeviceType deviceType, const char* description);
 
+/// Declare how finely the Core may serialize calls into the module's devices.
+/**
+ * To be called in the device adapter module's implementation of
+ * InitializeModuleData(), by modules whose devices can safely be called from
+ * different threads at the same time.
+ *
+ * By default (MM::ConcurrencyPerModule), the Core holds a single lock for the
+ * whole module while calling any of its devices. With
+ * MM::ConcurrencyPerHub, a hub and the peripherals whose parent ID is the
+ * hub's label share a lock, so that devices of different hubs can be called
+ * concurrently. While any peripheral of the module has no parent ID (as
+ * set through the Core), all of its devices, hubs included, use the module
+ * lock.
+ * With MM::ConcurrencyPerDevice, only calls into the same device are
+ * serialized.
+ *
+ * The module remains responsible for state shared between devices that are
+ * not serialized with each other (for example a serial port that several
+ * devices use: such modules should stay with the default).
+ *
+ * \see InitializeModuleData()
+ */
+void SetModuleConcurrency(MM::DeviceConcurrency concurrency);
+
 
 #endif //_MODULE_INTERFACE_H_
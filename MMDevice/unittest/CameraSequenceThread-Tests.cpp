@@ -0,0 +1,284 @@
+#include <gtest/gtest.h>
+
+#include "DeviceBase.h"
+#include "DeviceThreads.h"
+#include "ImageMetadata.h"
+
+#include <boost/date_time/posix_time/posix_time.hpp>
+
+#include <string>
+#include <vector>
+
+
+namespace {
+
+// Accepts the frames inserted by a camera; everything else is a no-op
+class FrameCollectingCore : public MM::Core
+{
+public:
+   std::vector<std::string> GetFrameMetadata()
+   {
+      MMThreadGuard g(lock_);
+      return frameMetadata_;
+   }
+
+   virtual int InsertImage(const MM::Device*, const unsigned char*, unsigned,
+         unsigned, unsigned, const char* serializedMetadata, const bool)
+   {
+      MMThreadGuard g(lock_);
+      frameMetadata_.push_back(serializedMetadata);
+      return DEVICE_OK;
+   }
+   virtual int InsertImage(const MM::Device* caller, const unsigned char* buf,
+         unsigned width, unsigned height, unsigned byteDepth, unsigned,
+         const char* serializedMetadata, const bool doProcess)
+   {
+      return InsertImage(caller, buf, width, height, byteDepth,
+            serializedMetadata, doProcess);
+   }
+   virtual int InsertImage(const MM::Device*, const ImgBuffer&)
+   { return DEVICE_OK; }
+   virtual int InsertImage(const MM::Device*, const unsigned char*, unsigned,
+         unsigned, unsigned, const Metadata*, const bool)
+   { return DEVICE_OK; }
+   virtual MM::MMTime GetCurrentMMTime()
+   {
+      boost::posix_time::time_duration t =
+         boost::posix_time::microsec_clock::universal_time() -
+         boost::posix_time::ptime(boost::gregorian::date(1970, 1, 1));
+      return MM::MMTime((double) t.total_microseconds());
+   }
+
+   virtual int LogMessage(const MM::Device*, const char*, bool) const
+   { return DEVICE_OK; }
+   virtual MM::Device* GetDevice(const MM::Device*, const char*) { return 0; }
+   virtual int GetDeviceProperty(const char*, const char*, char*)
+   { return DEVICE_ERR; }
+   virtual int SetDeviceProperty(const char*, const char*, const char*)
+   { return DEVICE_ERR; }
+   virtual void GetLoadedDeviceOfType(const MM::Device*, MM::DeviceType,
+         char* name, const unsigned int)
+   { name[0] = '\0'; }
+   virtual int SetSerialProperties(const char*, const char*, const char*,
+         const char*, const char*, const char*, const char*)
+   { return DEVICE_ERR; }
+   virtual int SetSerialCommand(const MM::Device*, const char*, const char*,
+         const char*) { return DEVICE_ERR; }
+   virtual int GetSerialAnswer(const MM::Device*, const char*, unsigned long,
+         char*, const char*) { return DEVICE_ERR; }
+   virtual int WriteToSerial(const MM::Device*, const char*,
+         const unsigned char*, unsigned long) { return DEVICE_ERR; }
+   virtual int ReadFromSerial(const MM::Device*, const char*, unsigned char*,
+         unsigned long, unsigned long&) { return DEVICE_ERR; }
+   virtual int PurgeSerial(const MM::Device*, const char*) { return DEVICE_ERR; }
+   virtual MM::PortType GetSerialPortType(const char*) const
+   { return MM::InvalidPort; }
+   virtual int OnPropertiesChanged(const MM::Device*) { return DEVICE_OK; }
+   virtual int OnPropertyChanged(const MM::Device*, const char*, const char*)
+   { return DEVICE_OK; }
+   virtual int OnStagePositionChanged(const MM::Device*, double)
+   { return DEVICE_OK; }
+   virtual int OnXYStagePositionChanged(const MM::Device*, double, double)
+   { return DEVICE_OK; }
+   virtual int OnExposureChanged(const MM::Device*, double) { return DEVICE_OK; }
+   virtual int OnSLMExposureChanged(const MM::Device*, double)
+   { return DEVICE_OK; }
+   virtual int OnMagnifierChanged(const MM::Device*) { return DEVICE_OK; }
+   virtual int OnBusyChanged(const MM::Device*, bool) { return DEVICE_OK; }
+   virtual unsigned long GetClockTicksUs(const MM::Device*) { return 0; }
+   virtual int AcqFinished(const MM::Device*, int) { return DEVICE_OK; }
+   virtual int PrepareForAcq(const MM::Device*) { return DEVICE_OK; }
+   virtual void ClearImageBuffer(const MM::Device*) {}
+   virtual bool InitializeImageBuffer(unsigned, unsigned, unsigned int,
+         unsigned int, unsigned int) { return true; }
+   virtual int InsertMultiChannel(const MM::Device*, const unsigned char*,
+         unsigned, unsigned, unsigned, unsigned, Metadata*)
+   { return DEVICE_OK; }
+   virtual const char* GetImage() { return 0; }
+   virtual int GetImageDimensions(int&, int&, int&) { return DEVICE_ERR; }
+   virtual int GetFocusPosition(double&) { return DEVICE_ERR; }
+   virtual int SetFocusPosition(double) { return DEVICE_ERR; }
+   virtual int MoveFocus(double) { return DEVICE_ERR; }
+   virtual int SetXYPosition(double, double) { return DEVICE_ERR; }
+   virtual int GetXYPosition(double&, double&) { return DEVICE_ERR; }
+   virtual int MoveXYStage(double, double) { return DEVICE_ERR; }
+   virtual int SetExposure(double) { return DEVICE_ERR; }
+   virtual int GetExposure(double&) { return DEVICE_ERR; }
+   virtual int SetConfig(const char*, const char*) { return DEVICE_ERR; }
+   virtual int GetCurrentConfig(const char*, int, char*) { return DEVICE_ERR; }
+   virtual int GetChannelConfig(char*, const unsigned int) { return DEVICE_ERR; }
+   virtual MM::ImageProcessor* GetImageProcessor(const MM::Device*) { return 0; }
+   virtual MM::AutoFocus* GetAutoFocus(const MM::Device*) { return 0; }
+   virtual MM::Hub* GetParentHub(const MM::Device*) const { return 0; }
+   virtual MM::State* GetStateDevice(const MM::Device*, const char*) { return 0; }
+   virtual MM::SignalIO* GetSignalIODevice(const MM::Device*, const char*)
+   { return 0; }
+   virtual void NextPostedError(int&, char*, int, int&) {}
+   virtual void PostError(const int, const char*) {}
+   virtual void ClearPostedErrors() {}
+
+private:
+   MMThreadLock lock_;
+   std::vector<std::string> frameMetadata_;
+};
+
+class TestCamera : public CCameraBase<TestCamera>
+{
+public:
+   TestCamera() : buffer_(16 * 16, 0) {}
+
+   int Initialize() { return DEVICE_OK; }
+   int Shutdown() { return DEVICE_OK; }
+   void GetName(char* name) const
+   { CDeviceUtils::CopyLimitedString(name, "TestCamera"); }
+   int SnapImage() { CDeviceUtils::SleepMs(1); return DEVICE_OK; }
+   const unsigned char* GetImageBuffer() { return &buffer_[0]; }
+   unsigned GetImageWidth() const { return 16; }
+   unsigned GetImageHeight() const { return 16; }
+   unsigned GetImageBytesPerPixel() const { return 1; }
+   unsigned GetBitDepth() const { return 8; }
+   long GetImageBufferSize() const { return (long) buffer_.size(); }
+   double GetExposure() const { return 1.0; }
+   void SetExposure(double) {}
+   int SetROI(unsigned, unsigned, unsigned, unsigned) { return DEVICE_OK; }
+   int GetROI(unsigned& x, unsigned& y, unsigned& width, unsigned& height)
+   {
+      x = y = 0;
+      width = height = 16;
+      return DEVICE_OK;
+   }
+   int ClearROI() { return DEVICE_OK; }
+   int GetBinning() const { return 1; }
+   int SetBinning(int) { return DEVICE_OK; }
+   int IsExposureSequenceable(bool& sequenceable) const
+   {
+      sequenceable = false;
+      return DEVICE_OK;
+   }
+
+   MM::MMTime LastFrameTime() { return GetLastFrameTime(); }
+   size_t TagCount() { return GetTagKeys().size(); }
+
+private:
+   std::vector<unsigned char> buffer_;
+};
+
+// Adds and removes tags of a camera, as a camera's own threads might
+class TagChangingThread : public MMDeviceThreadBase
+{
+public:
+   TagChangingThread(TestCamera& camera, const std::string& prefix, int count) :
+      camera_(camera), prefix_(prefix), count_(count)
+   {}
+
+   int svc()
+   {
+      for (int i = 0; i < count_; ++i)
+      {
+         std::string key = prefix_ + CDeviceUtils::ConvertToString(i % 10);
+         camera_.AddTag(key.c_str(), "_", "1");
+         camera_.RemoveTag(key.c_str());
+      }
+      return 0;
+   }
+
+private:
+   TestCamera& camera_;
+   std::string prefix_;
+   int count_;
+};
+
+class CameraSequenceThreadTests : public ::testing::Test
+{
+protected:
+   virtual void SetUp()
+   {
+      camera_.SetLabel("Cam");
+      camera_.SetCallback(&core_);
+   }
+
+   void WaitForSequence()
+   {
+      for (int i = 0; i < 5000 && camera_.IsCapturing(); ++i)
+         CDeviceUtils::SleepMs(1);
+      ASSERT_FALSE(camera_.IsCapturing());
+   }
+
+   FrameCollectingCore core_;
+   TestCamera camera_;
+};
+
+} // anonymous namespace
+
+TEST_F(CameraSequenceThreadTests, EveryFrameCarriesTheCameraLabel)
+{
+   for (int acquisition = 0; acquisition < 2; ++acquisition)
+   {
+      ASSERT_EQ(DEVICE_OK, camera_.StartSequenceAcquisition(5, 0.0, true));
+      WaitForSequence();
+   }
+
+   std::vector<std::string> frames = core_.GetFrameMetadata();
+   ASSERT_EQ(10u, frames.size());
+   for (size_t i = 0; i < frames.size(); ++i)
+   {
+      Metadata md;
+      ASSERT_TRUE(md.Restore(frames[i].c_str()));
+      EXPECT_EQ(1u, md.GetKeys().size());
+      EXPECT_EQ("Cam", md.GetSingleTag("Camera").GetValue());
+   }
+}
+
+TEST_F(CameraSequenceThreadTests, LastFrameTimeCanBeReadDuringAcquisition)
+{
+   const MM::MMTime start = core_.GetCurrentMMTime();
+   ASSERT_EQ(DEVICE_OK, camera_.StartSequenceAcquisition(20, 5.0, true));
+
+   // Read concurrently with the acquisition thread's updates
+   MM::MMTime previous(0.0);
+   while (camera_.IsCapturing())
+   {
+      MM::MMTime frameTime = camera_.LastFrameTime();
+      EXPECT_FALSE(frameTime < previous);
+      previous = frameTime;
+      CDeviceUtils::SleepMs(1);
+   }
+   WaitForSequence();
+
+   const MM::MMTime last = camera_.LastFrameTime();
+   EXPECT_TRUE(start < last);
+   // The 20th frame starts 19 intervals after the first
+   EXPECT_GE((last - start).getMsec(), 19 * 5.0 - 1.0);
+}
+
+TEST_F(CameraSequenceThreadTests, TagsCanBeChangedFromSeveralThreads)
+{
+   const int count = 500000;
+   const long startVersion = camera_.GetTagsVersion();
+   TagChangingThread first(camera_, "First", count);
+   TagChangingThread second(camera_, "Second", count);
+   first.activate();
+   second.activate();
+
+   // Read concurrently with the changes
+   std::vector<char> tags(1 << 16);
+   long previous = startVersion;
+   for (int i = 0; i < 10000; ++i)
+   {
+      long version = camera_.GetTagsVersion();
+      EXPECT_GE(version, previous);
+      previous = version;
+      camera_.GetTags(&tags[0]);
+   }
+   first.wait();
+   second.wait();
+
+   EXPECT_EQ(startVersion + 4 * count, camera_.GetTagsVersion());
+   EXPECT_EQ(0u, camera_.TagCount());
+}
+
+int main(int argc, char **argv)
+{
+   ::testing::InitGoogleTest(&argc, argv);
+   return RUN_ALL_TESTS();
+}